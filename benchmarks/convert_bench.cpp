@@ -0,0 +1,101 @@
+// Compares the speed of PlanarToBgrScaler with the cv::merge() + cv::resize()
+// sequence it replaces in data_process. planar_convert_test checks that both
+// produce the same pixels.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "planar_convert.hpp"
+
+namespace {
+
+struct FrameSize {
+  const char *name;
+  uint32_t width;
+  uint32_t height;
+};
+
+// The display adds 50 columns to the received width
+constexpr uint32_t kExtraWidth = 50;
+
+template <typename F>
+double measure_ms(int iterations, F func) {
+  func();  // warm up
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    func();
+  }
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / iterations;
+}
+
+void reference(std::vector<uint8_t> &planar, uint32_t width, uint32_t height,
+               cv::Mat &merged, cv::Mat &scaled) {
+  size_t plane_size = static_cast<size_t>(width) * height;
+  cv::Mat colors[3];
+  colors[2] = cv::Mat(height, width, CV_8UC1, planar.data());
+  colors[1] = cv::Mat(height, width, CV_8UC1, planar.data() + plane_size);
+  colors[0] = cv::Mat(height, width, CV_8UC1, planar.data() + plane_size * 2);
+  cv::merge(colors, 3, merged);
+  cv::resize(merged, scaled, cv::Size(width + kExtraWidth, height));
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int iterations = argc > 1 ? std::atoi(argv[1]) : 50;
+  if (iterations <= 0) {
+    std::printf("Usage: %s [Iterations]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const FrameSize sizes[] = {
+      {"640x480", 640, 480}, {"1080p", 1920, 1080}, {"4K", 3840, 2160}};
+  const PlanarToBgrScaler::Isa isas[] = {PlanarToBgrScaler::Isa::SCALAR,
+                                         PlanarToBgrScaler::Isa::SSE2,
+                                         PlanarToBgrScaler::Isa::AVX2};
+
+  std::mt19937 rng(42);
+
+  std::printf("%-8s %-8s %12s %12s %9s\n", "size", "isa", "merge+resize",
+              "kernel", "speedup");
+  for (const auto &size : sizes) {
+    std::vector<uint8_t> planar(static_cast<size_t>(size.width) * size.height * 3);
+    for (auto &value : planar) {
+      value = static_cast<uint8_t>(rng());
+    }
+
+    cv::Mat merged;
+    cv::Mat expected;
+    double reference_ms = measure_ms(iterations, [&] {
+      reference(planar, size.width, size.height, merged, expected);
+    });
+
+    for (auto isa : isas) {
+      if (!PlanarToBgrScaler::isa_supported(isa)) {
+        continue;
+      }
+
+      PlanarToBgrScaler scaler(isa);
+      uint32_t dst_width = size.width + kExtraWidth;
+      cv::Mat actual(size.height, dst_width, CV_8UC3);
+      double kernel_ms = measure_ms(iterations, [&] {
+        scaler.convert(planar.data(), size.width, size.height, actual.data,
+                       actual.step, dst_width);
+      });
+
+      std::printf("%-8s %-8s %10.3fms %10.3fms %8.2fx\n", size.name,
+                  PlanarToBgrScaler::isa_name(isa), reference_ms, kernel_ms,
+                  reference_ms / kernel_ms);
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
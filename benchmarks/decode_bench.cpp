@@ -0,0 +1,133 @@
+// Throughput of the FrameDecoder of every encoding and layout, at the display
+// width (received width + 50) and at the received width.
+//
+// Every frame is built from the same RGB pixels, so all decoders must give
+// the same image as rgb8 planar. The program fails if one doesn't.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "frame_decoder.hpp"
+
+namespace {
+
+struct FrameSize {
+  const char *name;
+  uint32_t width;
+  uint32_t height;
+};
+
+// The display adds 50 columns to the received width
+constexpr uint32_t kExtraWidth = 50;
+
+template <typename F>
+double measure_ms(int iterations, F func) {
+  func();  // warm up
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    func();
+  }
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / iterations;
+}
+
+// Lays out the R, G and B planes rgb as the given encoding
+std::vector<uint8_t> encode(const std::vector<uint8_t> &rgb, uint32_t width,
+                            uint32_t height, const std::string &encoding,
+                            PixelLayout layout, std::mt19937 &rng) {
+  bool bgr = encoding[0] == 'b';
+  int channels = encoding.find('a') != std::string::npos ? 4 : 3;
+  int bytes = encoding.find("16") != std::string::npos ? 2 : 1;
+
+  size_t pixels = static_cast<size_t>(width) * height;
+  std::vector<uint8_t> data(pixels * channels * bytes);
+  for (size_t i = 0; i < pixels; ++i) {
+    for (int c = 0; c < channels; ++c) {
+      // Source plane of channel c, alpha gets noise
+      int plane = c == 3 ? -1 : (bgr ? 2 - c : c);
+      uint8_t value = plane < 0 ? static_cast<uint8_t>(rng()) : rgb[plane * pixels + i];
+
+      size_t index = layout == PixelLayout::PLANAR ? c * pixels + i : i * channels + c;
+      if (bytes == 1) {
+        data[index] = value;
+      } else {
+        // The low byte is dropped by the decoder
+        uint16_t sample = static_cast<uint16_t>(value << 8 | (rng() & 0xff));
+        std::memcpy(&data[index * 2], &sample, sizeof(sample));
+      }
+    }
+  }
+  return data;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int iterations = argc > 1 ? std::atoi(argv[1]) : 50;
+  if (iterations <= 0) {
+    std::printf("Usage: %s [Iterations]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const FrameSize sizes[] = {{"640x480", 640, 480}, {"1080p", 1920, 1080}};
+  const PixelLayout layouts[] = {PixelLayout::PLANAR, PixelLayout::INTERLEAVED};
+
+  std::mt19937 rng(42);
+  bool all_same = true;
+
+  std::printf("isa: %s\n", PlanarToBgrScaler::isa_name(PlanarToBgrScaler::detect_isa()));
+  std::printf("%-8s %-8s %-12s %10s %10s %10s %10s %s\n", "size", "encoding",
+              "layout", "scaled", "unscaled", "MPixel/s", "MB/s", "same as rgb8");
+  for (const auto &size : sizes) {
+    size_t pixels = static_cast<size_t>(size.width) * size.height;
+    std::vector<uint8_t> rgb(pixels * 3);
+    for (auto &value : rgb) {
+      value = static_cast<uint8_t>(rng());
+    }
+
+    uint32_t dst_width = size.width + kExtraWidth;
+    size_t dst_step = static_cast<size_t>(dst_width) * 3;
+    std::vector<uint8_t> expected(dst_step * size.height);
+    FrameDecoder reference(PixelLayout::PLANAR);
+    reference.select("rgb8", 4);
+    reference.decode(rgb.data(), size.width, size.height, expected.data(),
+                     dst_step, dst_width);
+
+    for (const auto &encoding : FrameDecoder::encodings()) {
+      for (auto layout : layouts) {
+        std::vector<uint8_t> data =
+            encode(rgb, size.width, size.height, encoding, layout, rng);
+
+        FrameDecoder decoder(layout);
+        decoder.select(encoding.data(), encoding.size());
+
+        std::vector<uint8_t> scaled(dst_step * size.height);
+        std::vector<uint8_t> unscaled(pixels * 3);
+        double scaled_ms = measure_ms(iterations, [&] {
+          decoder.decode(data.data(), size.width, size.height, scaled.data(),
+                         dst_step, dst_width);
+        });
+        double unscaled_ms = measure_ms(iterations, [&] {
+          decoder.decode(data.data(), size.width, size.height, unscaled.data(),
+                         static_cast<size_t>(size.width) * 3, size.width);
+        });
+
+        bool same = scaled == expected;
+        all_same = all_same && same;
+
+        std::printf("%-8s %-8s %-12s %8.3fms %8.3fms %10.1f %10.1f %s\n",
+                    size.name, encoding.c_str(), pixel_layout_name(layout),
+                    scaled_ms, unscaled_ms, pixels / scaled_ms / 1e3,
+                    data.size() / scaled_ms / 1e3, same ? "yes" : "NO");
+      }
+    }
+  }
+
+  return all_same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,135 @@
+// Cost of each MsgDeserializer mode at several frame sizes, next to the
+// header check which runs in all of them.
+//
+// It also checks that every mode rejects a payload whose pixel data points
+// past its end, and that the integrity mode rejects a flipped pixel.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "cista.h"
+
+#include "img_msg.hpp"
+#include "msg_deserializer.hpp"
+
+namespace {
+
+using imx500_img_transport::img_msg;
+
+struct FrameSize {
+  const char *name;
+  uint32_t width;
+  uint32_t height;
+};
+
+template <typename F>
+double measure_us(int iterations, F func) {
+  func();  // warm up
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    func();
+  }
+  std::chrono::duration<double, std::micro> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / iterations;
+}
+
+std::vector<uint8_t> make_payload(uint32_t width, uint32_t height,
+                                  DeserializeMode mode, std::mt19937 &rng) {
+  img_msg msg;
+  msg.timestamp = 1;
+  msg.height = static_cast<int32_t>(height);
+  msg.width = width;
+  msg.encoding = "rgb8";
+  msg.data.resize(static_cast<size_t>(width) * height * 3);
+  for (auto &value : msg.data) {
+    value = static_cast<uint8_t>(rng());
+  }
+
+  if (mode == DeserializeMode::INTEGRITY) {
+    return cista::serialize<cista::mode::WITH_INTEGRITY>(msg);
+  }
+  return cista::serialize(msg);
+}
+
+// Deserialization only rewrites the message header, so restoring it makes
+// the payload deserializable again
+void restore_header(std::vector<uint8_t> &payload, const std::vector<uint8_t> &original,
+                    DeserializeMode mode) {
+  std::memcpy(payload.data(), original.data(),
+              MsgDeserializer::header_offset(mode) + sizeof(img_msg));
+}
+
+bool rejects_bad_payloads(const std::vector<uint8_t> &original, DeserializeMode mode) {
+  MsgDeserializer deserializer(mode);
+
+  // Pixel data reaching past the end of a truncated payload
+  std::vector<uint8_t> truncated(original.begin(), original.end() - 1);
+  if (deserializer.deserialize(truncated.data(), truncated.size()) != nullptr) {
+    return false;
+  }
+
+  if (mode == DeserializeMode::INTEGRITY) {
+    std::vector<uint8_t> flipped = original;
+    flipped.back() ^= 1;
+    if (deserializer.deserialize(flipped.data(), flipped.size()) != nullptr) {
+      return false;
+    }
+  }
+
+  std::vector<uint8_t> payload = original;
+  auto msg = deserializer.deserialize(payload.data(), payload.size());
+  return msg != nullptr && msg->data.size() == original.size() - sizeof(img_msg) -
+                                                   MsgDeserializer::header_offset(mode);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int iterations = argc > 1 ? std::atoi(argv[1]) : 50;
+  if (iterations <= 0) {
+    std::printf("Usage: %s [Iterations]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const FrameSize sizes[] = {
+      {"640x480", 640, 480}, {"1080p", 1920, 1080}, {"4K", 3840, 2160}};
+  const DeserializeMode modes[] = {DeserializeMode::FULL, DeserializeMode::INTEGRITY,
+                                   DeserializeMode::UNCHECKED};
+
+  std::mt19937 rng(42);
+  bool all_rejected = true;
+
+  std::printf("%-8s %-10s %12s %12s %10s %s\n", "size", "mode", "header check",
+              "deserialize", "GB/s", "rejects bad payloads");
+  for (const auto &size : sizes) {
+    for (auto mode : modes) {
+      const std::vector<uint8_t> original = make_payload(size.width, size.height, mode, rng);
+      std::vector<uint8_t> payload = original;
+
+      volatile bool valid = false;
+      double check_us = measure_us(iterations, [&] {
+        valid = MsgDeserializer::check_header(payload.data(), payload.size(), mode) == nullptr;
+      });
+
+      MsgDeserializer deserializer(mode);
+      double deserialize_us = measure_us(iterations, [&] {
+        restore_header(payload, original, mode);
+        valid = deserializer.deserialize(payload.data(), payload.size()) != nullptr;
+      });
+
+      bool rejected = valid && rejects_bad_payloads(original, mode);
+      all_rejected = all_rejected && rejected;
+
+      std::printf("%-8s %-10s %10.3fus %10.1fus %10.2f %s\n", size.name,
+                  deserialize_mode_name(mode), check_us, deserialize_us,
+                  payload.size() / deserialize_us / 1e3, rejected ? "yes" : "NO");
+    }
+  }
+
+  return all_rejected ? EXIT_SUCCESS : EXIT_FAILURE;
+}
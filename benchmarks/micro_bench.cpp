@@ -0,0 +1,414 @@
+// Times each hot path of the receiver on its own: the message queues, the
+// deserialization, the planar to BGR merge, the display resize and writing
+// images. The results are printed as a table and can be written as JSON, so
+// runs on different commits or machines can be compared.
+//
+// Usage: micro_bench [--json FILE] [--filter TEXT] [--min-time SECONDS] [--label TEXT]
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "bounded_msg_queue.hpp"
+#include "buffer_pool.hpp"
+#include "frame_generator.hpp"
+#include "msg_deserializer.hpp"
+#include "msg_queue.hpp"
+#include "planar_convert.hpp"
+
+namespace {
+
+struct FrameSize {
+  const char *name;
+  uint32_t width;
+  uint32_t height;
+};
+
+// The display adds 50 columns to the received width
+constexpr uint32_t kExtraWidth = 50;
+
+// Cheaper operations are timed in batches, so the clock doesn't dominate
+constexpr double kMinSampleNs = 10000;
+
+struct Result {
+  std::string name;
+  std::string size;
+  size_t samples;
+  double ops_per_sample;
+  double min_ns;  // per operation
+  double median_ns;
+  double mean_ns;
+  double p90_ns;
+  double bytes_per_op;
+};
+
+class BenchRunner final {
+public:
+  BenchRunner(double min_time, const std::string &filter)
+      : min_time_ns_(min_time * 1e9), filter_(filter) {}
+
+  // fn performs ops operations of bytes_per_op bytes each
+  template <typename F>
+  void run(const std::string &name, const std::string &size, double bytes_per_op,
+           size_t ops, F fn) {
+    if (!filter_.empty() && (name + "/" + size).find(filter_) == std::string::npos) {
+      return;
+    }
+
+    // Warm up, and find out how many calls make a sample
+    double first_ns = time_ns([&] { fn(); });
+    size_t batch = first_ns < kMinSampleNs
+                       ? static_cast<size_t>(kMinSampleNs / std::max(first_ns, 1.0)) + 1
+                       : 1;
+
+    std::vector<double> samples;
+    double total_ns = 0;
+    while ((total_ns < min_time_ns_ || samples.size() < 5) && samples.size() < 100000) {
+      double sample_ns = time_ns([&] {
+        for (size_t i = 0; i < batch; ++i) {
+          fn();
+        }
+      });
+      samples.push_back(sample_ns / (batch * ops));
+      total_ns += sample_ns;
+    }
+    std::sort(samples.begin(), samples.end());
+
+    Result result;
+    result.name = name;
+    result.size = size;
+    result.samples = samples.size();
+    result.ops_per_sample = static_cast<double>(batch * ops);
+    result.min_ns = samples.front();
+    result.median_ns = samples[samples.size() / 2];
+    result.p90_ns = samples[samples.size() * 9 / 10];
+    result.mean_ns = 0;
+    for (double sample : samples) {
+      result.mean_ns += sample;
+    }
+    result.mean_ns /= samples.size();
+    result.bytes_per_op = bytes_per_op;
+
+    std::printf("%-32s %-12s %12.1f %12.1f %12.1f %10.1f\n", name.c_str(),
+                size.c_str(), result.median_ns, result.min_ns, result.p90_ns,
+                mb_per_s(result));
+    std::fflush(stdout);
+    results_.push_back(result);
+  }
+
+  static void show_header() {
+    std::printf("%-32s %-12s %12s %12s %12s %10s\n", "benchmark", "size",
+                "median ns", "min ns", "p90 ns", "MB/s");
+  }
+
+  bool write_json(const std::string &path, const std::string &label) const;
+
+private:
+  double min_time_ns_;
+  std::string filter_;
+  std::vector<Result> results_;
+
+  template <typename F>
+  static double time_ns(F fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+  }
+
+  static double mb_per_s(const Result &result) {
+    return result.bytes_per_op > 0 ? result.bytes_per_op / result.median_ns * 1e3 : 0;
+  }
+
+  static std::string json_string(const std::string &text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+      if (c == '"' || c == '\\') {
+        quoted += '\\';
+      }
+      quoted += c;
+    }
+    return quoted + "\"";
+  }
+};
+
+bool BenchRunner::write_json(const std::string &path, const std::string &label) const {
+  std::FILE *file = std::fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    std::printf("Failed to open %s\n", path.c_str());
+    return false;
+  }
+
+  char host[256] = {0};
+  gethostname(host, sizeof(host) - 1);
+  char time_text[32];
+  std::time_t now = std::time(nullptr);
+  std::strftime(time_text, sizeof(time_text), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+  std::fprintf(file, "{\n");
+  std::fprintf(file, "  \"label\": %s,\n", json_string(label).c_str());
+  std::fprintf(file, "  \"host\": %s,\n", json_string(host).c_str());
+  std::fprintf(file, "  \"time\": \"%s\",\n", time_text);
+  std::fprintf(file, "  \"cpus\": %u,\n", std::thread::hardware_concurrency());
+  std::fprintf(file, "  \"isa\": \"%s\",\n",
+               PlanarToBgrScaler::isa_name(PlanarToBgrScaler::detect_isa()));
+  std::fprintf(file, "  \"opencv\": \"%s\",\n", CV_VERSION);
+  std::fprintf(file, "  \"benchmarks\": [\n");
+  for (size_t i = 0; i < results_.size(); ++i) {
+    const auto &result = results_[i];
+    std::fprintf(file,
+                 "    {\"name\": %s, \"size\": %s, \"samples\": %lu, "
+                 "\"ops_per_sample\": %.0f, \"median_ns\": %.1f, \"min_ns\": %.1f, "
+                 "\"mean_ns\": %.1f, \"p90_ns\": %.1f, \"bytes_per_op\": %.0f, "
+                 "\"mb_per_s\": %.1f}%s\n",
+                 json_string(result.name).c_str(), json_string(result.size).c_str(),
+                 static_cast<unsigned long>(result.samples), result.ops_per_sample,
+                 result.median_ns, result.min_ns, result.mean_ns, result.p90_ns,
+                 result.bytes_per_op, mb_per_s(result),
+                 i + 1 < results_.size() ? "," : "");
+  }
+  std::fprintf(file, "  ]\n}\n");
+  return std::fclose(file) == 0;
+}
+
+// Messages moved through the queue by one round. The producers keep at most
+// kWindow messages queued, below the unbounded queue's size warning.
+constexpr size_t kQueueMessages = 20000;
+constexpr size_t kWindow = 256;
+
+void queue_round(MsgQueueBase<FrameBuffer> &queue, size_t producers,
+                 const std::vector<std::shared_ptr<FrameBuffer>> &messages) {
+  std::atomic_size_t queued{0};
+  std::vector<std::thread> threads;
+  for (size_t p = 0; p < producers; ++p) {
+    threads.emplace_back([&, p] {
+      for (size_t i = p; i < kQueueMessages; i += producers) {
+        while (queued.load(std::memory_order_relaxed) >= kWindow) {
+          std::this_thread::yield();
+        }
+        queued++;
+        queue.add_msg_to_queue(messages[i % messages.size()]);
+      }
+    });
+  }
+  // Polls like the stream pipelines do
+  for (size_t i = 0; i < kQueueMessages; ++i) {
+    while (queue.try_get_msg_from_queue().get() == nullptr) {
+      std::this_thread::yield();
+    }
+    queued--;
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+void bench_queues(BenchRunner &runner) {
+  std::vector<std::shared_ptr<FrameBuffer>> messages;
+  for (size_t i = 0; i < kWindow * 2; ++i) {
+    messages.push_back(std::make_shared<FrameBuffer>(64));
+  }
+
+  for (size_t producers : {1, 2, 4}) {
+    MsgQueue<FrameBuffer> queue;
+    runner.run("msg_queue/unbounded",
+               std::to_string(producers) + (producers == 1 ? " producer" : " producers"), 0,
+               kQueueMessages, [&] { queue_round(queue, producers, messages); });
+  }
+
+  // Single producer, single consumer by design
+  for (size_t capacity : {8, 64}) {
+    BoundedMsgQueue<FrameBuffer> queue(capacity, OverflowPolicy::BLOCK);
+    runner.run("msg_queue/bounded_block", "capacity " + std::to_string(capacity), 0,
+               kQueueMessages, [&] { queue_round(queue, 1, messages); });
+  }
+}
+
+void bench_deserialize(BenchRunner &runner, const std::vector<FrameSize> &sizes) {
+  const DeserializeMode modes[] = {DeserializeMode::FULL, DeserializeMode::INTEGRITY,
+                                   DeserializeMode::UNCHECKED};
+  for (const auto &size : sizes) {
+    for (auto mode : modes) {
+      GeneratorConfig config;
+      config.width = size.width;
+      config.height = size.height;
+      config.integrity = mode == DeserializeMode::INTEGRITY;
+      config.variants = 1;
+      FrameGenerator generator(config);
+      const std::vector<uint8_t> original = generator.next(0);
+      std::vector<uint8_t> payload = original;
+
+      // Deserialization only rewrites the message header, restoring it
+      // makes the payload deserializable again
+      size_t header_size = MsgDeserializer::header_offset(mode) +
+                           sizeof(imx500_img_transport::img_msg);
+      MsgDeserializer deserializer(mode);
+      runner.run(std::string("deserialize/") + deserialize_mode_name(mode), size.name,
+                 static_cast<double>(payload.size()), 1, [&] {
+                   std::memcpy(payload.data(), original.data(), header_size);
+                   if (deserializer.deserialize(payload.data(), payload.size()) == nullptr) {
+                     std::abort();
+                   }
+                 });
+    }
+  }
+}
+
+// Planes with a gradient and some noise, like a camera picture
+std::vector<uint8_t> make_planes(const FrameSize &size) {
+  std::vector<uint8_t> planes(static_cast<size_t>(size.width) * size.height * 3);
+  uint32_t noise = 1;
+  for (size_t i = 0; i < planes.size(); ++i) {
+    noise = noise * 1664525 + 1013904223;
+    size_t pixel = i % (static_cast<size_t>(size.width) * size.height);
+    planes[i] = static_cast<uint8_t>(pixel % size.width / 8 + pixel / size.width / 8 +
+                                     (noise >> 29));
+  }
+  return planes;
+}
+
+void bench_convert(BenchRunner &runner, const std::vector<FrameSize> &sizes) {
+  PlanarToBgrScaler scaler;
+  std::string kernel = std::string("planar_convert_") +
+                       PlanarToBgrScaler::isa_name(scaler.isa());
+
+  for (const auto &size : sizes) {
+    std::vector<uint8_t> planes = make_planes(size);
+    size_t plane_size = static_cast<size_t>(size.width) * size.height;
+    double frame_bytes = static_cast<double>(planes.size());
+
+    cv::Mat colors[3];
+    colors[2] = cv::Mat(size.height, size.width, CV_8UC1, planes.data());
+    colors[1] = cv::Mat(size.height, size.width, CV_8UC1, planes.data() + plane_size);
+    colors[0] = cv::Mat(size.height, size.width, CV_8UC1, planes.data() + plane_size * 2);
+    cv::Mat merged;
+    runner.run("merge/cv_merge", size.name, frame_bytes, 1,
+               [&] { cv::merge(colors, 3, merged); });
+
+    cv::Mat interleaved(size.height, size.width, CV_8UC3);
+    runner.run("merge/" + kernel, size.name, frame_bytes, 1, [&] {
+      scaler.convert(planes.data(), size.width, size.height, interleaved.data,
+                     interleaved.step, size.width);
+    });
+
+    uint32_t dst_width = size.width + kExtraWidth;
+    cv::Mat resized;
+    runner.run("resize/cv_resize", size.name, frame_bytes, 1, [&] {
+      cv::resize(merged, resized, cv::Size(dst_width, size.height));
+    });
+
+    // What the pipeline does: merge and resize in one pass
+    cv::Mat scaled(size.height, dst_width, CV_8UC3);
+    runner.run("resize/" + kernel + "_fused", size.name, frame_bytes, 1, [&] {
+      scaler.convert(planes.data(), size.width, size.height, scaled.data, scaled.step,
+                     dst_width);
+    });
+  }
+}
+
+void bench_imwrite(BenchRunner &runner, const std::vector<FrameSize> &sizes) {
+  char dir_template[] = "/tmp/micro_bench_XXXXXX";
+  if (mkdtemp(dir_template) == nullptr) {
+    std::printf("Failed to create a directory for imwrite\n");
+    return;
+  }
+  std::string dir = dir_template;
+
+  struct Format {
+    const char *name;
+    const char *extension;
+    std::vector<int> params;
+  };
+  const Format formats[] = {
+      {"bmp", ".bmp", {}},
+      {"png_1", ".png", {cv::IMWRITE_PNG_COMPRESSION, 1}},
+      {"png_9", ".png", {cv::IMWRITE_PNG_COMPRESSION, 9}},
+  };
+
+  for (const auto &size : sizes) {
+    std::vector<uint8_t> planes = make_planes(size);
+    cv::Mat image(size.height, size.width, CV_8UC3);
+    PlanarToBgrScaler().convert(planes.data(), size.width, size.height, image.data,
+                                image.step, size.width);
+    double frame_bytes = static_cast<double>(image.total() * image.elemSize());
+
+    for (const auto &format : formats) {
+      std::string file = dir + "/frame" + format.extension;
+      runner.run(std::string("imwrite/") + format.name, size.name, frame_bytes, 1, [&] {
+        cv::imwrite(file, image, format.params);
+      });
+      unlink(file.c_str());
+    }
+
+    // Like ImageWriter's raw format
+    std::string file = dir + "/frame.raw";
+    runner.run("imwrite/raw", size.name, frame_bytes, 1, [&] {
+      std::FILE *out = std::fopen(file.c_str(), "wb");
+      if (out != nullptr) {
+        std::fwrite(image.data, 1, static_cast<size_t>(frame_bytes), out);
+        std::fclose(out);
+      }
+    });
+    unlink(file.c_str());
+  }
+  rmdir(dir.c_str());
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string json_path;
+  std::string filter;
+  std::string label;
+  double min_time = 0.5;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 < argc && arg == "--json") {
+      json_path = argv[++i];
+    } else if (i + 1 < argc && arg == "--filter") {
+      filter = argv[++i];
+    } else if (i + 1 < argc && arg == "--label") {
+      label = argv[++i];
+    } else if (i + 1 < argc && arg == "--min-time") {
+      min_time = std::atof(argv[++i]);
+    } else {
+      min_time = 0;
+      break;
+    }
+  }
+  if (min_time <= 0) {
+    std::printf("Usage: %s [--json FILE] [--filter TEXT] [--min-time SECONDS] "
+                "[--label TEXT]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const std::vector<FrameSize> sizes = {
+      {"640x480", 640, 480}, {"1080p", 1920, 1080}, {"4K", 3840, 2160}};
+  // Writing 4K PNGs takes seconds per sample
+  const std::vector<FrameSize> write_sizes = {{"640x480", 640, 480}, {"1080p", 1920, 1080}};
+
+  BenchRunner runner(min_time, filter);
+  BenchRunner::show_header();
+  bench_queues(runner);
+  bench_deserialize(runner, sizes);
+  bench_convert(runner, sizes);
+  bench_imwrite(runner, write_sizes);
+
+  if (!json_path.empty() && !runner.write_json(json_path, label)) {
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,230 @@
+// Throughput and latency of the MQTT ingest profiles of img_viewer against a
+// broker, usually one on the same host so the network doesn't dominate.
+//
+// For every profile a subscriber with those settings and a publisher of
+// the same QoS connect, and the publisher sends Count payloads of Size KB
+// as fast as the broker takes them. Every payload carries its send time, so
+// the subscriber measures the latency through the broker. QoS 1 and 2 need
+// acknowledgements per message, which limits large payloads.
+//
+// Usage: mqtt_bench -a Broker_IP -p Port [--size KB] [--count N] [--profile NAME]
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "latency_histogram.hpp"
+#include "mqtt_publisher.hpp"
+#include "mqtt_subscription.hpp"
+#include "pipeline_stats.hpp"
+
+namespace {
+
+struct Profile {
+  const char *name;
+  MqttSubscriptionConfig config;
+};
+
+std::vector<Profile> make_profiles() {
+  std::vector<Profile> profiles;
+  MqttSubscriptionConfig config;
+
+  config.qos = 0;
+  profiles.push_back({"qos0", config});
+  config.qos = 1;
+  profiles.push_back({"qos1", config});
+  config.qos = 2;
+  profiles.push_back({"qos2", config});
+
+  config.qos = 1;
+  config.tcp_nodelay = true;
+  config.receive_buffer = 8 * 1024 * 1024;
+  profiles.push_back({"qos1-nodelay-rcvbuf", config});
+
+  config = MqttSubscriptionConfig();
+  config.mqtt5 = true;
+  profiles.push_back({"qos1-v5", config});
+  config.receive_maximum = 200;
+  profiles.push_back({"qos1-v5-recvmax200", config});
+
+  config = MqttSubscriptionConfig();
+  config.loop_thread = true;
+  config.loop_priority = 10;
+  profiles.push_back({"qos1-thread-fifo", config});
+
+  config.qos = 0;
+  config.tcp_nodelay = true;
+  config.receive_buffer = 8 * 1024 * 1024;
+  profiles.push_back({"qos0-tuned", config});
+  return profiles;
+}
+
+// What the subscriber saw
+struct Received {
+  LatencyHistogram latency;
+  std::atomic_uint64_t count{0};
+  std::atomic_uint64_t bytes{0};
+  std::atomic_int64_t last_ns{0};
+  std::mutex mutex;
+  std::condition_variable cond;
+};
+
+struct Result {
+  uint64_t sent;
+  uint64_t received;
+  double seconds;
+  double mb_per_s;
+  double p50_ms;
+  double p99_ms;
+  double max_ms;
+};
+
+bool wait_for(const std::function<bool()> &done, std::chrono::milliseconds timeout) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (!done()) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return true;
+}
+
+bool run_profile(const std::string &broker, int port, const Profile &profile,
+                 size_t size, uint64_t count, Result &result) {
+  std::string topic = "mqtt_bench/" + std::to_string(getpid()) + "/" + profile.name;
+  Received received;
+  MqttSubscription subscription(
+      broker, port, {topic},
+      [&received, count](const char *, const void *payload, size_t len) {
+        int64_t now = steady_clock_ns();
+        int64_t sent_ns = 0;
+        if (len >= sizeof(sent_ns)) {
+          std::memcpy(&sent_ns, payload, sizeof(sent_ns));
+          received.latency.record(now - sent_ns);
+        }
+        received.bytes += len;
+        received.last_ns = now;
+        if (++received.count == count) {
+          std::lock_guard<std::mutex> lock(received.mutex);
+          received.cond.notify_all();
+        }
+      },
+      profile.config);
+  if (!subscription.init() ||
+      !wait_for([&] { return subscription.is_subscribed(); }, std::chrono::seconds(5))) {
+    std::printf("%s: can't subscribe\n", profile.name);
+    return false;
+  }
+
+  MqttPublisher publisher(broker, port, profile.config.qos, 16);
+  if (!publisher.init() || !publisher.wait_connected(std::chrono::seconds(5))) {
+    std::printf("%s: can't connect the publisher\n", profile.name);
+    return false;
+  }
+
+  std::vector<uint8_t> payload(std::max(size, sizeof(int64_t)));
+  for (size_t i = 0; i < payload.size(); ++i) {
+    payload[i] = static_cast<uint8_t>(i * 7);
+  }
+
+  int64_t start_ns = steady_clock_ns();
+  uint64_t sent = 0;
+  for (uint64_t i = 0; i < count; ++i) {
+    int64_t now = steady_clock_ns();
+    std::memcpy(payload.data(), &now, sizeof(now));
+    if (publisher.publish(topic, payload.data(), payload.size())) {
+      sent++;
+    }
+  }
+
+  // QoS 0 may lose messages, so don't wait for them forever
+  {
+    std::unique_lock<std::mutex> lock(received.mutex);
+    received.cond.wait_for(lock, std::chrono::seconds(10),
+                           [&] { return received.count >= count; });
+  }
+  publisher.stop();
+  subscription.stop();
+
+  result.sent = sent;
+  result.received = received.count;
+  result.seconds = received.count > 0 ? (received.last_ns - start_ns) / 1e9 : 0;
+  result.mb_per_s =
+      result.seconds > 0 ? received.bytes / (1024.0 * 1024.0) / result.seconds : 0;
+  result.p50_ms = received.latency.percentile(50) / 1e6;
+  result.p99_ms = received.latency.percentile(99) / 1e6;
+  result.max_ms = received.latency.max() / 1e6;
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string broker;
+  int port = 1883;
+  size_t size_kb = 2048;
+  uint64_t count = 200;
+  std::string only;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 < argc && arg == "-a") {
+      broker = argv[++i];
+    } else if (i + 1 < argc && arg == "-p") {
+      port = std::atoi(argv[++i]);
+    } else if (i + 1 < argc && arg == "--size") {
+      size_kb = std::strtoul(argv[++i], nullptr, 10);
+    } else if (i + 1 < argc && arg == "--count") {
+      count = std::strtoull(argv[++i], nullptr, 10);
+    } else if (i + 1 < argc && arg == "--profile") {
+      only = argv[++i];
+    } else {
+      broker.clear();
+      break;
+    }
+  }
+  if (broker.empty() || port <= 0 || size_kb == 0 || count == 0) {
+    std::printf("Usage: %s -a Broker_IP -p Port [--size KB] [--count N] [--profile NAME]\n",
+                argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  auto profiles = make_profiles();
+  std::vector<std::pair<const Profile *, Result>> results;
+  for (auto &profile : profiles) {
+    if (!only.empty() && only != profile.name) {
+      continue;
+    }
+    Result result{};
+    if (!run_profile(broker, port, profile, size_kb * 1024, count, result)) {
+      return EXIT_FAILURE;
+    }
+    results.emplace_back(&profile, result);
+  }
+
+  std::printf("\n%lu messages of %lu KB\n", static_cast<unsigned long>(count),
+              static_cast<unsigned long>(size_kb));
+  std::printf("%-22s %9s %9s %10s %9s %9s %9s  %s\n", "profile", "received", "msg/s",
+              "MB/s", "p50 ms", "p99 ms", "max ms", "settings");
+  for (auto &entry : results) {
+    auto &result = entry.second;
+    std::printf("%-22s %4lu/%-4lu %9.1f %10.1f %9.2f %9.2f %9.2f  %s\n", entry.first->name,
+                static_cast<unsigned long>(result.received),
+                static_cast<unsigned long>(result.sent),
+                result.seconds > 0 ? result.received / result.seconds : 0, result.mb_per_s,
+                result.p50_ms, result.p99_ms, result.max_ms,
+                MqttSubscription::describe(entry.first->config).c_str());
+  }
+  return 0;
+}
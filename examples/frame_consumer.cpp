@@ -0,0 +1,174 @@
+// An application taking the frames from the receiver library in process,
+// instead of running img_viewer and reading its output.
+//
+// Usage: frame_consumer -a Broker_IP -p Broker_Port -t Topic[,Topic...]
+//        frame_consumer -i Recording
+//        [--callback] [--seconds N]
+//
+// It pulls the decoded frames (or takes them in a callback with --callback)
+// and computes the mean brightness of each in place as a stand-in for real
+// analytics. Every second it prints the frame rate, the latency since the
+// message arrived and how many frames it skipped by falling behind.
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "img_receiver.hpp"
+
+std::atomic_bool g_request_exit{false};
+
+static void signal_handler(int signal)
+{
+  g_request_exit = true;
+}
+
+// "a,b" -> {"a", "b"}
+static std::vector<std::string> split_topics(const std::string &param)
+{
+  std::vector<std::string> topics;
+  size_t start = 0;
+  while (start <= param.size()) {
+    size_t end = param.find(',', start);
+    if (end == std::string::npos) {
+      end = param.size();
+    }
+    if (end > start) {
+      topics.push_back(param.substr(start, end - start));
+    }
+    start = end + 1;
+  }
+  return topics;
+}
+
+// Frames taken since the last report, the callback runs on the decode threads
+struct Interval {
+  std::mutex mutex;
+  uint64_t frames{0};
+  int64_t latency_ns{0};
+  double mean{0};
+
+  void add(const ReceivedFrame &frame)
+  {
+    double value = cv::mean(*frame.image)[0];
+    std::lock_guard<std::mutex> lock(mutex);
+    frames++;
+    latency_ns += steady_clock_ns() - frame.receive_time_ns;
+    mean = value;
+  }
+};
+
+int main(int argc, char **argv)
+{
+  ImgReceiverConfig config;
+  bool callback = false;
+  double seconds = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+      config.broker_addr = argv[++i];
+    } else if (std::strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+      config.broker_port = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      config.topics = split_topics(argv[++i]);
+    } else if (std::strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+      config.replay_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--callback") == 0) {
+      callback = true;
+    } else if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = std::atof(argv[++i]);
+    } else {
+      config.replay_path.clear();
+      config.topics.clear();
+      break;
+    }
+  }
+  if (config.replay_path.empty() && (config.broker_addr.empty() || config.topics.empty())) {
+    std::printf("Usage: %s -a Broker_IP -p Broker_Port -t Topic[,Topic...] | -i Recording "
+                "[--callback] [--seconds N]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  std::signal(SIGINT, signal_handler);
+  std::signal(SIGTERM, signal_handler);
+
+  Interval interval;
+  config.decoders = 2;
+  if (callback) {
+    config.on_frame = [&interval](const ReceivedFrame &frame) { interval.add(frame); };
+  } else {
+    config.pull_capacity = 4;
+  }
+
+  // Set once a replay queued its last frame
+  std::atomic_bool done{false};
+  ImgReceiver receiver(config);
+  if (!receiver.open()) {
+    std::printf("No frames to replay in %s\n", config.replay_path.c_str());
+    return EXIT_FAILURE;
+  }
+  if (!receiver.start([&done] { done = true; })) {
+    std::printf("Can't connect to the broker\n");
+    receiver.stop();
+    return EXIT_FAILURE;
+  }
+
+  const int64_t start = steady_clock_ns();
+  int64_t last_report = start;
+  uint64_t frames = 0;
+  while (!g_request_exit) {
+    int64_t now = steady_clock_ns();
+    if (seconds > 0 && now - start > seconds * 1e9) {
+      break;
+    }
+
+    // The frames of a replay are still being decoded after the last one was
+    // queued, stop() waits for them
+    ReceivedFrame frame;
+    if (callback) {
+      if (done) {
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    } else if (receiver.pull(frame, std::chrono::milliseconds(100))) {
+      interval.add(frame);
+    } else if (done) {
+      break;
+    }
+
+    now = steady_clock_ns();
+    if (now - last_report >= 1000000000) {
+      std::lock_guard<std::mutex> lock(interval.mutex);
+      double elapsed = (now - last_report) / 1e9;
+      frames += interval.frames;
+      std::printf("%lu frames, %.1f fps, latency %.2f ms, mean %.1f\n",
+                  static_cast<unsigned long>(frames), interval.frames / elapsed,
+                  interval.frames > 0 ? interval.latency_ns / 1e6 / interval.frames : 0.0,
+                  interval.mean);
+      interval.frames = 0;
+      interval.latency_ns = 0;
+      last_report = now;
+    }
+  }
+
+  // The frames still queued once the streams stopped
+  receiver.stop();
+  ReceivedFrame frame;
+  while (receiver.pull(frame, std::chrono::milliseconds(0))) {
+    interval.add(frame);
+  }
+  frames += interval.frames;
+
+  receiver.show_statistics();
+  std::printf("Took %lu frames\n", static_cast<unsigned long>(frames));
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+// A local consumer of the frames img_viewer --shm publishes.
+//
+// Usage: ring_consumer [Shm_Name] [--seconds N]
+//
+// It reads every frame in place, without copying it, and computes the mean
+// brightness as a stand-in for real analytics. Every second it prints the
+// frame rate, the latency since img_viewer received the frame, and how many
+// frames it missed or saw overwritten while reading them.
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "frame_ring_reader.hpp"
+
+std::atomic_bool g_request_exit{false};
+
+static void signal_handler(int signal)
+{
+  g_request_exit = true;
+}
+
+static int64_t steady_clock_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Mean of all samples of the frame
+static double mean_value(const RingFrame &frame)
+{
+  uint64_t sum = 0;
+  size_t row_size = static_cast<size_t>(frame.width) * 3;
+  for (uint32_t y = 0; y < frame.height; ++y) {
+    const uint8_t *row = frame.data + static_cast<size_t>(y) * frame.step;
+    for (size_t x = 0; x < row_size; ++x) {
+      sum += row[x];
+    }
+  }
+  size_t samples = row_size * frame.height;
+  return samples > 0 ? static_cast<double>(sum) / samples : 0;
+}
+
+int main(int argc, char **argv)
+{
+  std::string name = "/img_viewer";
+  double seconds = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = std::atof(argv[++i]);
+    } else if (argv[i][0] != '-') {
+      name = argv[i];
+    } else {
+      std::printf("Usage: %s [Shm_Name] [--seconds N]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::signal(SIGINT, signal_handler);
+  std::signal(SIGTERM, signal_handler);
+
+  FrameRingReader reader(name);
+  std::printf("Waiting for frames in %s\n", name.c_str());
+
+  const int64_t start = steady_clock_ns();
+  int64_t last_report = start;
+  uint64_t frames = 0;
+  uint64_t torn = 0;
+  uint64_t interval_frames = 0;
+  int64_t interval_latency_ns = 0;
+  uint64_t last_open_count = 0;
+  double mean = 0;
+  while (!g_request_exit) {
+    int64_t now = steady_clock_ns();
+    if (seconds > 0 && now - start > seconds * 1e9) {
+      break;
+    }
+
+    RingFrame frame;
+    if (!reader.next(frame)) {
+      // The writer doesn't signal new frames, a short sleep keeps the
+      // latency low enough for analytics
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    } else {
+      double value = mean_value(frame);
+      if (!reader.valid(frame)) {
+        // Overwritten while it was read, the mean is garbage
+        torn++;
+      } else {
+        mean = value;
+        frames++;
+        interval_frames++;
+        interval_latency_ns += steady_clock_ns() - frame.receive_time_ns;
+      }
+      if (reader.open_count() != last_open_count) {
+        last_open_count = reader.open_count();
+        std::printf("Reading %s: stream %s, %ux%u\n", name.c_str(), reader.stream().c_str(),
+                    frame.width, frame.height);
+      }
+    }
+
+    now = steady_clock_ns();
+    if (now - last_report >= 1000000000) {
+      double elapsed = (now - last_report) / 1e9;
+      std::printf("%lu frames, %.1f fps, latency %.2f ms, mean %.1f, %lu missed, %lu torn\n",
+                  static_cast<unsigned long>(frames), interval_frames / elapsed,
+                  interval_frames > 0 ? interval_latency_ns / 1e6 / interval_frames : 0.0,
+                  mean, static_cast<unsigned long>(reader.missed_count()),
+                  static_cast<unsigned long>(torn));
+      interval_frames = 0;
+      interval_latency_ns = 0;
+      last_report = now;
+    }
+  }
+
+  std::printf("Read %lu frames, %lu missed, %lu torn\n", static_cast<unsigned long>(frames),
+              static_cast<unsigned long>(reader.missed_count()),
+              static_cast<unsigned long>(torn));
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,127 @@
+#include "include/buffer_pool.hpp"
+#include "include/pipeline_stats.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace {
+constexpr size_t kSlabAlignment = 4096;
+
+size_t round_up_to_page(size_t len) {
+  if (len == 0) {
+    len = 1;
+  }
+  return (len + kSlabAlignment - 1) / kSlabAlignment * kSlabAlignment;
+}
+} // namespace
+
+FrameBuffer::FrameBuffer(size_t capacity) : capacity_(round_up_to_page(capacity)) {
+  data_ = static_cast<uint8_t *>(std::aligned_alloc(kSlabAlignment, capacity_));
+  if (data_ == nullptr) {
+    throw std::bad_alloc();
+  }
+}
+
+FrameBuffer::~FrameBuffer() {
+  std::free(data_);
+}
+
+void FrameBuffer::prefault() {
+  // Writing is what faults the page in, reading would map the zero page
+  for (size_t offset = 0; offset < capacity_; offset += kSlabAlignment) {
+    data_[offset] = 0;
+  }
+}
+
+void FrameBuffer::assign(const void *src, size_t len) {
+  std::memcpy(data_, src, len);
+  size_ = len;
+}
+
+void FrameBuffer::write(size_t offset, const void *src, size_t len) {
+  std::memcpy(data_ + offset, src, len);
+}
+
+BufferPool::BufferPool(size_t max_slabs) : max_slabs_(max_slabs) {
+  slabs_.reserve(max_slabs_);
+}
+
+size_t BufferPool::slab_size() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return slab_size_;
+}
+
+void BufferPool::prefault(size_t len, size_t count) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (round_up_to_page(len) > slab_size_) {
+    slab_size_ = round_up_to_page(len);
+    slabs_.clear();
+  }
+  while (slabs_.size() < std::min(count, max_slabs_)) {
+    auto slab = std::make_shared<FrameBuffer>(slab_size_);
+    slab->prefault();
+    slabs_.push_back(slab);
+    allocation_count_++;
+  }
+}
+
+std::shared_ptr<FrameBuffer> BufferPool::acquire(const void *payload, size_t len) {
+  std::shared_ptr<FrameBuffer> buffer = get_free_slab(len);
+
+  buffer->assign(payload, len);
+  buffer->set_receive_time_ns(steady_clock_ns());
+  frame_count_++;
+  copy_bytes_ += len;
+
+  return buffer;
+}
+
+std::shared_ptr<FrameBuffer> BufferPool::allocate(size_t len) {
+  std::shared_ptr<FrameBuffer> buffer = get_free_slab(len);
+
+  buffer->resize(len);
+  frame_count_++;
+
+  return buffer;
+}
+
+std::shared_ptr<FrameBuffer> BufferPool::get_free_slab(size_t len) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (len > slab_size_) {
+    // First frame or the resolution grows. Slabs still held by consumers are
+    // released by them, the pool just forgets about them.
+    slab_size_ = round_up_to_page(len);
+    slabs_.clear();
+  }
+
+  // A slab whose only owner is the pool has been dropped by every consumer.
+  for (auto &slab : slabs_) {
+    if (slab.use_count() == 1) {
+      // Pairs with the release decrement of the last consumer, so all its
+      // reads of the slab happen before the slab is overwritten.
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return slab;
+    }
+  }
+
+  allocation_count_++;
+  auto slab = std::make_shared<FrameBuffer>(slab_size_);
+  if (slabs_.size() < max_slabs_) {
+    slabs_.push_back(slab);
+  }
+  return slab;
+}
+
+void BufferPool::show_statistics() {
+  std::printf("Buffer pool: %lu frames, %lu slab allocations, %lu bytes copied, "
+              "slab size %lu bytes\n",
+              static_cast<unsigned long>(frame_count_),
+              static_cast<unsigned long>(allocation_count_),
+              static_cast<unsigned long>(copy_bytes_),
+              static_cast<unsigned long>(slab_size()));
+}
@@ -0,0 +1,151 @@
+#include "include/chunk_assembler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "include/pipeline_stats.hpp"
+
+namespace {
+// Bigger than any frame, a corrupt header mustn't allocate gigabytes
+constexpr uint64_t kMaxFrameSize = 512ull * 1024 * 1024;
+} // namespace
+
+ChunkAssembler::ChunkAssembler(std::shared_ptr<BufferPool> buffer_pool,
+                               std::chrono::milliseconds timeout, size_t max_partial)
+    : buffer_pool_(buffer_pool),
+      timeout_ns_(std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count()),
+      max_partial_(max_partial > 0 ? max_partial : 1) {}
+
+std::shared_ptr<FrameBuffer> ChunkAssembler::add(const void *chunk, size_t len,
+                                                 int64_t *assembly_ns) {
+  chunk_count_++;
+
+  ChunkHeader header;
+  if (len < sizeof(header)) {
+    invalid_count_++;
+    return nullptr;
+  }
+  std::memcpy(&header, chunk, sizeof(header));
+  const uint8_t *data = static_cast<const uint8_t *>(chunk) + sizeof(header);
+  uint64_t data_len = len - sizeof(header);
+  if (std::memcmp(header.magic, kChunkMagic, sizeof(kChunkMagic)) != 0 ||
+      header.count == 0 || header.index >= header.count ||
+      header.frame_size == 0 || header.frame_size > kMaxFrameSize ||
+      header.count > kMaxChunkCount || header.count > header.frame_size) {
+    invalid_count_++;
+    return nullptr;
+  }
+  // Only the range the index stands for, chunks overlapping another one or
+  // leaving a gap would complete a frame with stale slab bytes in it
+  uint64_t stride = chunk_stride(header.frame_size, header.count);
+  uint64_t offset = header.index * stride;
+  if (header.offset != offset || offset >= header.frame_size ||
+      data_len != std::min(stride, header.frame_size - offset)) {
+    invalid_count_++;
+    return nullptr;
+  }
+
+  int64_t now = steady_clock_ns();
+  std::lock_guard<std::mutex> lock(mutex_);
+  expire(now);
+
+  auto iter = partial_.find(header.frame_id);
+  if (iter == partial_.end()) {
+    if (is_finished(header.frame_id)) {
+      late_count_++;
+      return nullptr;
+    }
+    if (partial_.size() >= max_partial_) {
+      // The oldest frame has the least chance to be completed
+      auto oldest = partial_.begin();
+      for (auto it = partial_.begin(); it != partial_.end(); ++it) {
+        if (it->second.first_chunk_ns < oldest->second.first_chunk_ns) {
+          oldest = it;
+        }
+      }
+      finish(oldest->first, now);
+      partial_.erase(oldest);
+      incomplete_count_++;
+    }
+
+    PartialFrame frame;
+    frame.buffer = buffer_pool_->allocate(header.frame_size);
+    frame.count = header.count;
+    frame.chunks.assign(header.count, false);
+    frame.first_chunk_ns = now;
+    iter = partial_.emplace(header.frame_id, std::move(frame)).first;
+  }
+
+  auto &frame = iter->second;
+  if (frame.count != header.count || frame.buffer->size() != header.frame_size) {
+    invalid_count_++;
+    return nullptr;
+  }
+  if (frame.chunks[header.index]) {
+    // QoS 1 may deliver a chunk twice
+    duplicate_count_++;
+    return nullptr;
+  }
+
+  frame.buffer->write(header.offset, data, data_len);
+  buffer_pool_->add_copy_bytes(data_len);
+  frame.chunks[header.index] = true;
+  frame.received++;
+  if (frame.received < frame.count) {
+    return nullptr;
+  }
+
+  auto buffer = std::move(frame.buffer);
+  int64_t first_chunk_ns = frame.first_chunk_ns;
+  finish(header.frame_id, now);
+  partial_.erase(iter);
+
+  assembled_count_++;
+  buffer->set_receive_time_ns(now);
+  *assembly_ns = now - first_chunk_ns;
+  return buffer;
+}
+
+void ChunkAssembler::expire(int64_t now) {
+  while (!finished_.empty() && now - finished_.front().second > timeout_ns_) {
+    finished_.pop_front();
+  }
+  for (auto iter = partial_.begin(); iter != partial_.end();) {
+    if (now - iter->second.first_chunk_ns > timeout_ns_) {
+      finish(iter->first, now);
+      iter = partial_.erase(iter);
+      incomplete_count_++;
+    } else {
+      ++iter;
+    }
+  }
+}
+
+void ChunkAssembler::finish(uint32_t frame_id, int64_t now) {
+  finished_.emplace_back(frame_id, now);
+}
+
+bool ChunkAssembler::is_finished(uint32_t frame_id) const {
+  return std::any_of(finished_.begin(), finished_.end(),
+                     [frame_id](const std::pair<uint32_t, int64_t> &finished) {
+                       return finished.first == frame_id;
+                     });
+}
+
+void ChunkAssembler::show_statistics() {
+  size_t pending;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending = partial_.size();
+  }
+  std::printf("Chunks: %lu received, %lu frames assembled, %lu incomplete frames "
+              "discarded, %lu still incomplete, %lu duplicate, %lu late and %lu invalid chunks\n",
+              static_cast<unsigned long>(chunk_count_),
+              static_cast<unsigned long>(assembled_count_),
+              static_cast<unsigned long>(incomplete_count_),
+              static_cast<unsigned long>(pending),
+              static_cast<unsigned long>(duplicate_count_),
+              static_cast<unsigned long>(late_count_),
+              static_cast<unsigned long>(invalid_count_));
+}
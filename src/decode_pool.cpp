@@ -0,0 +1,83 @@
+#include "include/decode_pool.hpp"
+
+#include "include/thread_tuning.hpp"
+
+DecodePool::DecodePool(size_t threads) {
+  if (threads == 0) {
+    threads = 1;
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    threads_.emplace_back(&DecodePool::worker, this);
+  }
+}
+
+DecodePool::~DecodePool() {
+  stop();
+}
+
+bool DecodePool::submit(std::function<void()> job) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stop_) {
+      return false;
+    }
+    jobs_.push_back(std::move(job));
+    active_count_++;
+    if (jobs_.size() > peak_backlog_) {
+      peak_backlog_ = jobs_.size();
+    }
+  }
+  job_cond_.notify_one();
+  return true;
+}
+
+void DecodePool::drain() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_cond_.wait(lock, [this] { return active_count_ == 0; });
+}
+
+void DecodePool::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stop_) {
+      return;
+    }
+    stop_ = true;
+  }
+  job_cond_.notify_all();
+
+  for (auto &thread : threads_) {
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+}
+
+size_t DecodePool::peak_backlog() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return peak_backlog_;
+}
+
+void DecodePool::worker() {
+  ThreadTuning::apply(ThreadRole::DECODE);
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      job_cond_.wait(lock, [this] { return !jobs_.empty() || stop_; });
+      // Queued jobs still run after stop(), the streams wait for their frames
+      if (jobs_.empty()) {
+        break;
+      }
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+
+    job();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--active_count_ == 0) {
+      idle_cond_.notify_all();
+    }
+  }
+}
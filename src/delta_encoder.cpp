@@ -0,0 +1,73 @@
+#include "include/delta_encoder.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+DeltaEncoder::DeltaEncoder(uint32_t width, uint32_t height, uint32_t channels,
+                           uint32_t sample_size, PixelLayout layout, uint32_t tile_size)
+    : width_(width), height_(height), channels_(channels), sample_size_(sample_size),
+      layout_(layout), tile_size_(tile_size),
+      columns_((width + tile_size - 1) / tile_size),
+      rows_((height + tile_size - 1) / tile_size) {}
+
+void DeltaEncoder::encode(const uint8_t *pixels, const uint8_t *previous,
+                          uint32_t sequence, std::vector<uint8_t> &data) const {
+  std::vector<DeltaTile> tiles;
+  for (uint32_t row = 0; row < rows_; ++row) {
+    for (uint32_t column = 0; column < columns_; ++column) {
+      DeltaTile tile{static_cast<uint16_t>(column), static_cast<uint16_t>(row)};
+      bool changed = previous == nullptr;
+      if (!changed) {
+        for_each_run(tile, [&](size_t frame_offset, size_t, size_t length) {
+          changed = changed ||
+                    std::memcmp(pixels + frame_offset, previous + frame_offset, length) != 0;
+        });
+      }
+      if (changed) {
+        tiles.push_back(tile);
+      }
+    }
+  }
+
+  DeltaHeader header;
+  std::memcpy(header.magic, kDeltaMagic, sizeof(header.magic));
+  header.sequence = sequence;
+  header.flags = previous == nullptr ? kDeltaKeyframe : 0;
+  header.tile_size = tile_size_;
+  header.tile_count = static_cast<uint32_t>(tiles.size());
+
+  size_t pixel_size = static_cast<size_t>(channels_) * sample_size_;
+  size_t size = sizeof(header) + tiles.size() * sizeof(DeltaTile);
+  for (auto &tile : tiles) {
+    uint32_t x = tile.column * tile_size_;
+    uint32_t y = tile.row * tile_size_;
+    size += static_cast<size_t>(std::min(tile_size_, width_ - x)) *
+            std::min(tile_size_, height_ - y) * pixel_size;
+  }
+  data.resize(size);
+
+  uint8_t *out = data.data();
+  std::memcpy(out, &header, sizeof(header));
+  out += sizeof(header);
+  if (!tiles.empty()) {
+    std::memcpy(out, tiles.data(), tiles.size() * sizeof(DeltaTile));
+    out += tiles.size() * sizeof(DeltaTile);
+  }
+  for (auto &tile : tiles) {
+    size_t tile_bytes = 0;
+    for_each_run(tile, [&](size_t frame_offset, size_t tile_offset, size_t length) {
+      std::memcpy(out + tile_offset, pixels + frame_offset, length);
+      tile_bytes += length;
+    });
+    out += tile_bytes;
+  }
+}
+
+template <typename Copy>
+void DeltaEncoder::for_each_run(DeltaTile tile, Copy copy) const {
+  uint32_t x = tile.column * tile_size_;
+  uint32_t y = tile.row * tile_size_;
+  for_each_tile_run(width_, height_, x, y, std::min(tile_size_, width_ - x),
+                    std::min(tile_size_, height_ - y), channels_, sample_size_, layout_,
+                    copy);
+}
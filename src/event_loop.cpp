@@ -0,0 +1,223 @@
+#include "include/event_loop.hpp"
+
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+constexpr int kMaxEvents = 32;
+
+struct itimerspec timer_spec(std::chrono::nanoseconds delay,
+                             std::chrono::nanoseconds interval) {
+  struct itimerspec spec {};
+  spec.it_value.tv_sec = delay.count() / 1000000000;
+  spec.it_value.tv_nsec = delay.count() % 1000000000;
+  spec.it_interval.tv_sec = interval.count() / 1000000000;
+  spec.it_interval.tv_nsec = interval.count() % 1000000000;
+  return spec;
+}
+
+// Timers, signals and notifiers are non-blocking, so a handler called
+// twice for one event doesn't hang the loop
+void drain_counter(int fd) {
+  uint64_t count;
+  while (::read(fd, &count, sizeof(count)) == static_cast<ssize_t>(sizeof(count))) {
+  }
+}
+} // namespace
+
+EventLoop::EventLoop() : start_time_(std::chrono::steady_clock::now()) {
+  epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+  stop_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epoll_fd_ < 0 || stop_fd_ < 0) {
+    std::printf("Failed to create the event loop: %s\n", std::strerror(errno));
+    return;
+  }
+  struct epoll_event event {};
+  event.events = EPOLLIN;
+  event.data.fd = stop_fd_;
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, stop_fd_, &event);
+}
+
+EventLoop::~EventLoop() {
+  for (auto &entry : entries_) {
+    if (entry.second->owned) {
+      ::close(entry.first);
+    }
+  }
+  if (stop_fd_ >= 0) {
+    ::close(stop_fd_);
+  }
+  if (epoll_fd_ >= 0) {
+    ::close(epoll_fd_);
+  }
+}
+
+bool EventLoop::add_entry(int fd, uint32_t events, Handler handler, bool owned) {
+  struct epoll_event event {};
+  event.events = events;
+  event.data.fd = fd;
+  if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+    std::printf("Failed to watch fd %d: %s\n", fd, std::strerror(errno));
+    return false;
+  }
+  entries_[fd] = std::make_shared<Entry>(Entry{std::move(handler), owned});
+  return true;
+}
+
+bool EventLoop::add(int fd, uint32_t events, Handler handler) {
+  return add_entry(fd, events, std::move(handler), false);
+}
+
+bool EventLoop::modify(int fd, uint32_t events) {
+  struct epoll_event event {};
+  event.events = events;
+  event.data.fd = fd;
+  return ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) == 0;
+}
+
+void EventLoop::remove(int fd) {
+  auto iter = entries_.find(fd);
+  if (iter == entries_.end()) {
+    return;
+  }
+  // Fails if fd is closed already, which removed it anyway
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  if (iter->second->owned) {
+    ::close(fd);
+  }
+  entries_.erase(iter);
+}
+
+int EventLoop::add_timer(std::chrono::nanoseconds delay, std::chrono::nanoseconds interval,
+                         std::function<void()> handler) {
+  int fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+  auto on_timer = [fd, handler](uint32_t) {
+    drain_counter(fd);
+    handler();
+  };
+  if (!add_entry(fd, EPOLLIN, on_timer, true)) {
+    ::close(fd);
+    return -1;
+  }
+  if (!set_timer(fd, delay, interval)) {
+    remove(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool EventLoop::set_timer(int timer, std::chrono::nanoseconds delay,
+                          std::chrono::nanoseconds interval) {
+  struct itimerspec spec = timer_spec(delay, interval);
+  return ::timerfd_settime(timer, 0, &spec, nullptr) == 0;
+}
+
+bool EventLoop::add_signals(const std::vector<int> &signals,
+                            std::function<void(int)> handler) {
+  sigset_t mask;
+  sigemptyset(&mask);
+  for (int signal : signals) {
+    sigaddset(&mask, signal);
+  }
+  int fd = ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  auto on_signal = [fd, handler](uint32_t) {
+    struct signalfd_siginfo info;
+    while (::read(fd, &info, sizeof(info)) == static_cast<ssize_t>(sizeof(info))) {
+      handler(static_cast<int>(info.ssi_signo));
+    }
+  };
+  if (!add_entry(fd, EPOLLIN, on_signal, true)) {
+    ::close(fd);
+    return false;
+  }
+  return true;
+}
+
+int EventLoop::add_notifier(std::function<void()> handler) {
+  int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+  auto on_notify = [fd, handler](uint32_t) {
+    drain_counter(fd);
+    handler();
+  };
+  if (!add_entry(fd, EPOLLIN, on_notify, true)) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void EventLoop::notify(int notifier) {
+  uint64_t one = 1;
+  // Only fails if the counter is about to overflow, the loop wakes up then
+  // anyway
+  ssize_t written = ::write(notifier, &one, sizeof(one));
+  (void)written;
+}
+
+void EventLoop::run() {
+  struct epoll_event events[kMaxEvents];
+  while (!stop_) {
+    int count = ::epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::printf("epoll_wait() failed: %s\n", std::strerror(errno));
+      break;
+    }
+    wakeup_count_++;
+
+    for (int i = 0; i < count && !stop_; ++i) {
+      // A handler before may have removed the fd
+      auto iter = entries_.find(events[i].data.fd);
+      if (iter == entries_.end()) {
+        continue;
+      }
+      // Keeps the handler alive if it removes itself
+      auto entry = iter->second;
+      event_count_++;
+      entry->handler(events[i].events);
+    }
+  }
+}
+
+void EventLoop::stop() {
+  stop_ = true;
+  notify(stop_fd_);
+}
+
+void EventLoop::show_statistics() {
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start_time_;
+  double seconds = elapsed.count() > 0 ? elapsed.count() : 1;
+
+  std::printf("Event loop: %lu wakeups (%.1f/s), %lu events handled\n",
+              static_cast<unsigned long>(wakeup_count_), wakeup_count_ / seconds,
+              static_cast<unsigned long>(event_count_));
+}
+
+bool EventLoop::block_signals(const std::vector<int> &signals) {
+  sigset_t mask;
+  sigemptyset(&mask);
+  for (int signal : signals) {
+    sigaddset(&mask, signal);
+  }
+  return ::pthread_sigmask(SIG_BLOCK, &mask, nullptr) == 0;
+}
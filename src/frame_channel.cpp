@@ -0,0 +1,86 @@
+#include "include/frame_channel.hpp"
+
+#include <cstdio>
+
+FrameChannel::FrameChannel(FrameCallback callback, size_t pull_capacity)
+    : callback_(std::move(callback)), pull_capacity_(pull_capacity) {}
+
+uint32_t FrameChannel::add_stream(const std::string &name, std::shared_ptr<PipelineStats>) {
+  auto stream = std::make_unique<Stream>();
+  stream->name = name;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  streams_.push_back(std::move(stream));
+  return static_cast<uint32_t>(streams_.size() - 1);
+}
+
+FrameChannel::Stream &FrameChannel::get(uint32_t stream) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return *streams_[stream];
+}
+
+void FrameChannel::publish(uint32_t stream, ReceivedFrame frame) {
+  Stream &target = get(stream);
+  if (callback_) {
+    callback_(frame);
+  }
+  if (pull_capacity_ == 0) {
+    target.delivered_count++;
+    return;
+  }
+
+  // The frame dropped is released outside of the lock
+  ReceivedFrame dropped;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (frames_.size() >= pull_capacity_) {
+      dropped = std::move(frames_.front());
+      frames_.pop_front();
+      streams_[dropped.stream]->skipped_count++;
+    }
+    frames_.push_back(std::move(frame));
+  }
+  cond_.notify_one();
+}
+
+bool FrameChannel::pull(ReceivedFrame &frame, std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!cond_.wait_for(lock, timeout, [this] { return closed_ || !frames_.empty(); }) ||
+      frames_.empty()) {
+    return false;
+  }
+  frame = std::move(frames_.front());
+  frames_.pop_front();
+  streams_[frame.stream]->delivered_count++;
+  return true;
+}
+
+void FrameChannel::close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+  }
+  cond_.notify_all();
+}
+
+std::string FrameChannel::stream_name(uint32_t stream) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stream < streams_.size() ? streams_[stream]->name : std::string();
+}
+
+uint64_t FrameChannel::delivered_count(uint32_t stream) {
+  return get(stream).delivered_count;
+}
+
+uint64_t FrameChannel::skipped_count(uint32_t stream) {
+  return get(stream).skipped_count;
+}
+
+void FrameChannel::show_statistics() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &stream : streams_) {
+    std::printf("Frames of %s: delivered %lu, skipped %lu\n", stream->name.c_str(),
+                static_cast<unsigned long>(stream->delivered_count),
+                static_cast<unsigned long>(stream->skipped_count));
+  }
+}
@@ -0,0 +1,157 @@
+#include "include/frame_decoder.hpp"
+
+#include <cstring>
+
+namespace {
+
+enum class Order { RGB, BGR };
+
+// 8 bit value of a sample. 16 bit samples are in host byte order.
+template <int Depth>
+inline uint8_t sample(const uint8_t *p) {
+  if constexpr (Depth == 8) {
+    return *p;
+  } else {
+    uint16_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return static_cast<uint8_t>(value >> 8);
+  }
+}
+
+template <int Depth>
+inline void narrow_row(const uint8_t *src, uint8_t *dst, uint32_t width) {
+  constexpr size_t kBytes = Depth / 8;
+  for (uint32_t x = 0; x < width; ++x) {
+    dst[x] = sample<Depth>(src + x * kBytes);
+  }
+}
+
+// One instance per encoding and layout. The channel count, depth and order
+// are constants, so the per pixel loops have no branches left.
+template <int Channels, int Depth, Order ChannelOrder, PixelLayout Layout>
+void decode_image(const uint8_t *src, uint32_t width, uint32_t height,
+                  uint32_t first_row, uint32_t end_row, uint8_t *dst, size_t dst_step,
+                  uint32_t dst_width, PlanarToBgrScaler &scaler, uint8_t *rows) {
+  constexpr size_t kBytes = Depth / 8;
+  // Index of the R and B channel (or plane), G is always 1
+  constexpr size_t kR = ChannelOrder == Order::RGB ? 0 : 2;
+  constexpr size_t kB = 2 - kR;
+
+  uint8_t *r_row = rows;
+  uint8_t *g_row = rows + width;
+  uint8_t *b_row = rows + width * 2;
+
+  if constexpr (Layout == PixelLayout::PLANAR) {
+    const size_t plane = static_cast<size_t>(width) * height * kBytes;
+    for (uint32_t y = first_row; y < end_row; ++y) {
+      const uint8_t *line = src + static_cast<size_t>(y) * width * kBytes;
+      uint8_t *out = dst + y * dst_step;
+      if constexpr (Depth == 8) {
+        // The planes already are the rows the scaler takes
+        scaler.convert_row(line + kR * plane, line + plane, line + kB * plane,
+                           width, out, dst_width);
+      } else {
+        narrow_row<Depth>(line + kR * plane, r_row, width);
+        narrow_row<Depth>(line + plane, g_row, width);
+        narrow_row<Depth>(line + kB * plane, b_row, width);
+        scaler.convert_row(r_row, g_row, b_row, width, out, dst_width);
+      }
+    }
+  } else {
+    constexpr size_t kPixel = Channels * kBytes;
+    for (uint32_t y = first_row; y < end_row; ++y) {
+      const uint8_t *line = src + static_cast<size_t>(y) * width * kPixel;
+      uint8_t *out = dst + y * dst_step;
+      if constexpr (Channels == 3 && Depth == 8 && ChannelOrder == Order::BGR) {
+        // Already the output format
+        if (width == dst_width) {
+          std::memcpy(out, line, static_cast<size_t>(width) * 3);
+          continue;
+        }
+      }
+      for (uint32_t x = 0; x < width; ++x) {
+        const uint8_t *pixel = line + x * kPixel;
+        r_row[x] = sample<Depth>(pixel + kR * kBytes);
+        g_row[x] = sample<Depth>(pixel + kBytes);
+        b_row[x] = sample<Depth>(pixel + kB * kBytes);
+      }
+      scaler.convert_row(r_row, g_row, b_row, width, out, dst_width);
+    }
+  }
+}
+
+#define DECODER(name, channels, depth, order)                                   \
+  {                                                                             \
+    name, channels, depth,                                                      \
+        &decode_image<channels, depth, Order::order, PixelLayout::PLANAR>,      \
+        &decode_image<channels, depth, Order::order, PixelLayout::INTERLEAVED>  \
+  }
+
+const FrameDecoder::Entry kDecoders[] = {
+    DECODER("rgb8", 3, 8, RGB),    DECODER("bgr8", 3, 8, BGR),
+    DECODER("rgb16", 3, 16, RGB),  DECODER("bgr16", 3, 16, BGR),
+    DECODER("rgba8", 4, 8, RGB),   DECODER("bgra8", 4, 8, BGR),
+    DECODER("rgba16", 4, 16, RGB), DECODER("bgra16", 4, 16, BGR),
+};
+
+#undef DECODER
+
+} // namespace
+
+FrameDecoder::FrameDecoder(PixelLayout layout) : layout_(layout) {}
+
+FrameDecoder::FrameDecoder(PixelLayout layout, PlanarToBgrScaler::Isa isa)
+    : layout_(layout), scaler_(isa) {}
+
+bool FrameDecoder::select(const char *encoding, size_t length, bool *changed) {
+  bool same = encoding_.size() == length &&
+              std::memcmp(encoding_.data(), encoding, length) == 0;
+  if (changed != nullptr) {
+    *changed = !same;
+  }
+  if (same) {
+    return entry_ != nullptr;
+  }
+
+  encoding_.assign(encoding, length);
+  entry_ = nullptr;
+  decode_ = nullptr;
+  for (const auto &entry : kDecoders) {
+    if (encoding_ == entry.encoding) {
+      entry_ = &entry;
+      decode_ = layout_ == PixelLayout::PLANAR ? entry.planar : entry.interleaved;
+      break;
+    }
+  }
+  return entry_ != nullptr;
+}
+
+size_t FrameDecoder::frame_size(uint32_t width, uint32_t height) const {
+  if (entry_ == nullptr) {
+    return 0;
+  }
+  return static_cast<size_t>(width) * height * entry_->channels * (entry_->depth / 8);
+}
+
+void FrameDecoder::decode(const uint8_t *src, uint32_t width, uint32_t height,
+                          uint8_t *dst, size_t dst_step, uint32_t dst_width) {
+  decode_rows(src, width, height, 0, height, dst, dst_step, dst_width);
+}
+
+void FrameDecoder::decode_rows(const uint8_t *src, uint32_t width, uint32_t height,
+                               uint32_t first_row, uint32_t end_row, uint8_t *dst,
+                               size_t dst_step, uint32_t dst_width) {
+  if (rows_.size() < static_cast<size_t>(width) * 3) {
+    rows_.resize(static_cast<size_t>(width) * 3);
+  }
+  decode_(src, width, height, first_row, end_row, dst, dst_step, dst_width, scaler_,
+          rows_.data());
+}
+
+std::vector<std::string> FrameDecoder::encodings() {
+  std::vector<std::string> names;
+  for (const auto &entry : kDecoders) {
+    names.push_back(entry.encoding);
+  }
+  return names;
+}
@@ -0,0 +1,295 @@
+#include "include/frame_display.hpp"
+
+#include <cmath>
+#include <cstdio>
+
+#include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "include/thread_tuning.hpp"
+
+namespace {
+const char *kWindowName = "Show received BMP file";
+const char *kIdleText = "Wait for BMP file";
+
+// How long the window goes without events, and the delay before the idle
+// screen is shown
+constexpr std::chrono::milliseconds kEventInterval(10);
+constexpr std::chrono::seconds kIdleTimeout(1);
+
+// Size of the idle screen, and of the tiles until the first frame arrives
+const cv::Size kIdleSize(350, 300);
+
+void draw_idle_text(cv::Mat &image) {
+  cv::putText(image, kIdleText, cv::Point(20, image.rows / 2),
+              cv::FONT_HERSHEY_COMPLEX, 1, cv::Scalar(0, 255, 0), 1);
+}
+} // namespace
+
+FrameDisplay::FrameDisplay(double max_fps, bool tiled, bool multi_stream)
+    : min_interval_(max_fps > 0 ? static_cast<int64_t>(1e9 / max_fps) : 0),
+      tiled_(tiled), multi_stream_(multi_stream) {}
+
+FrameDisplay::~FrameDisplay() {
+  stop();
+}
+
+const char *FrameDisplay::window_name() {
+  return kWindowName;
+}
+
+uint32_t FrameDisplay::add_stream(const std::string &name,
+                                  std::shared_ptr<PipelineStats> stats) {
+  auto slot = std::make_unique<Slot>();
+  slot->title = kWindowName;
+  if (multi_stream_) {
+    slot->title += " - " + name;
+  }
+  slot->stats = stats;
+  slot->last_frame = std::chrono::steady_clock::now();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  slots_.push_back(std::move(slot));
+  return static_cast<uint32_t>(slots_.size() - 1);
+}
+
+void FrameDisplay::start() {
+  thread_ = std::thread(&FrameDisplay::render_loop, this);
+}
+
+bool FrameDisplay::attach(EventLoop &loop) {
+  loop_ = &loop;
+  last_render_ = std::chrono::steady_clock::now() - min_interval_;
+  // Until the first stream shows up
+  show_idle_screen(kWindowName);
+
+  render_timer_ = loop.add_timer(std::chrono::nanoseconds(0), std::chrono::nanoseconds(0),
+                                 [this] { on_loop_event(); });
+  events_timer_ = loop.add_timer(kEventInterval, kEventInterval, [this] { on_loop_event(); });
+  notifier_ = loop.add_notifier([this] { on_loop_event(); });
+  return render_timer_ >= 0 && events_timer_ >= 0 && notifier_ >= 0;
+}
+
+void FrameDisplay::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_one();
+
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  if (loop_ != nullptr) {
+    loop_->remove(notifier_.exchange(-1));
+    loop_->remove(render_timer_);
+    loop_->remove(events_timer_);
+    render_timer_ = events_timer_ = -1;
+    loop_ = nullptr;
+  }
+}
+
+void FrameDisplay::publish(uint32_t stream, ReceivedFrame frame) {
+  bool first = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Slot &slot = *slots_[stream];
+    if (slot.latest) {
+      slot.skipped_count++;
+    } else {
+      first = pending_++ == 0;
+    }
+    slot.latest = std::move(frame.image);
+    slot.publish_ns = steady_clock_ns();
+    slot.published_count++;
+  }
+  cond_.notify_one();
+  // The loop only needs waking for the first frame waiting, the render
+  // timer takes care of the ones held back by the frame rate limit
+  int notifier = notifier_;
+  if (first && notifier >= 0) {
+    EventLoop::notify(notifier);
+  }
+}
+
+void FrameDisplay::render_loop() {
+  ThreadTuning::apply(ThreadRole::DISPLAY);
+  // Until the first stream shows up
+  show_idle_screen(kWindowName);
+  last_render_ = std::chrono::steady_clock::now() - min_interval_;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      auto next_render = last_render_ + min_interval_;
+      auto now = std::chrono::steady_clock::now();
+      auto deadline = now + kEventInterval;
+      if (next_render > now && next_render < deadline) {
+        deadline = next_render;
+      }
+      cond_.wait_until(lock, deadline, [&] {
+        return stop_ || (pending_ > 0 && std::chrono::steady_clock::now() >= next_render);
+      });
+      if (stop_) {
+        break;
+      }
+    }
+    render_step();
+  }
+}
+
+void FrameDisplay::on_loop_event() {
+  auto wait = render_step();
+  if (wait.count() > 0) {
+    loop_->set_timer(render_timer_, wait);
+  }
+}
+
+// Shows the frames waiting if the frame rate limit allows it, and the idle
+// screens. Returns how long the frames still waiting are held back.
+std::chrono::nanoseconds FrameDisplay::render_step() {
+  std::chrono::nanoseconds held_back(0);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Slots are never removed, so the pointers stay valid
+    render_slots_.clear();
+    for (auto &slot : slots_) {
+      render_slots_.push_back(slot.get());
+    }
+    auto next_render = last_render_ + min_interval_;
+    auto now = std::chrono::steady_clock::now();
+    if (pending_ > 0 && now >= next_render) {
+      for (auto *slot : render_slots_) {
+        if (slot->latest) {
+          rendered_.push_back({slot, std::move(slot->latest), slot->publish_ns});
+        }
+      }
+      pending_ = 0;
+    } else if (pending_ > 0) {
+      held_back = next_render - now;
+    }
+  }
+  auto &slots = render_slots_;
+
+  // Every stream has a window of its own from now on
+  if (waiting_window_ && !tiled_ && !slots.empty() && slots[0]->title != kWindowName) {
+    cv::destroyWindow(kWindowName);
+    waiting_window_ = false;
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  bool tiles_changed = false;
+  for (auto &item : rendered_) {
+    if (tiled_) {
+      item.slot->shown = item.frame;
+      tiles_changed = true;
+    } else {
+      cv::imshow(item.slot->title, *item.frame);
+    }
+    item.slot->last_frame = now;
+    item.slot->idle = false;
+  }
+  for (auto *slot : slots) {
+    if (!slot->idle && now - slot->last_frame > kIdleTimeout) {
+      slot->idle = true;
+      if (tiled_) {
+        slot->shown.reset();
+        tiles_changed = true;
+      } else {
+        show_idle_screen(slot->title);
+      }
+    }
+  }
+  if (tiles_changed) {
+    render_tiles(slots);
+  }
+
+  // Also keeps the windows responsive
+  cv::waitKey(1);
+
+  if (!rendered_.empty()) {
+    int64_t shown_ns = steady_clock_ns();
+    for (auto &item : rendered_) {
+      item.slot->rendered_count++;
+      item.slot->stats->record(PipelineStats::DISPLAY, shown_ns - item.publish_ns);
+    }
+    rendered_.clear();
+    last_render_ = now;
+  }
+  return held_back;
+}
+
+void FrameDisplay::render_tiles(const std::vector<Slot *> &slots) {
+  if (slots.empty()) {
+    return;
+  }
+
+  // All tiles get the size of the first frame
+  if (tile_size_.area() == 0) {
+    for (auto *slot : slots) {
+      if (slot->shown) {
+        tile_size_ = slot->shown->size();
+        break;
+      }
+    }
+  }
+  cv::Size tile = tile_size_.area() == 0 ? kIdleSize : tile_size_;
+
+  int cols = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(slots.size()))));
+  int rows = (static_cast<int>(slots.size()) + cols - 1) / cols;
+  composite_.create(rows * tile.height, cols * tile.width, CV_8UC3);
+  composite_.setTo(cv::Scalar(0, 0, 0));
+
+  for (size_t i = 0; i < slots.size(); ++i) {
+    int col = static_cast<int>(i) % cols;
+    int row = static_cast<int>(i) / cols;
+    cv::Mat roi = composite_(cv::Rect(col * tile.width, row * tile.height,
+                                      tile.width, tile.height));
+
+    const auto &shown = slots[i]->shown;
+    if (shown && shown->size() == tile) {
+      shown->copyTo(roi);
+    } else if (shown) {
+      cv::resize(*shown, roi, tile);
+    } else {
+      draw_idle_text(roi);
+    }
+    cv::putText(roi, slots[i]->title, cv::Point(10, 25), cv::FONT_HERSHEY_SIMPLEX,
+                0.7, cv::Scalar(0, 255, 0), 1);
+  }
+
+  cv::imshow(kWindowName, composite_);
+}
+
+void FrameDisplay::show_idle_screen(const std::string &title) {
+  cv::Mat empty_frame = cv::Mat::zeros(kIdleSize.height, kIdleSize.width, CV_8UC3);
+  draw_idle_text(empty_frame);
+  cv::imshow(title, empty_frame);
+  cv::waitKey(1);
+}
+
+uint64_t FrameDisplay::published_count(uint32_t stream) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return slots_[stream]->published_count;
+}
+
+uint64_t FrameDisplay::rendered_count(uint32_t stream) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return slots_[stream]->rendered_count;
+}
+
+uint64_t FrameDisplay::skipped_count(uint32_t stream) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return slots_[stream]->skipped_count;
+}
+
+void FrameDisplay::show_statistics() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &slot : slots_) {
+    std::printf("Display %s: published %lu frames, rendered %lu, skipped %lu\n",
+                slot->title.c_str(),
+                static_cast<unsigned long>(slot->published_count),
+                static_cast<unsigned long>(slot->rendered_count),
+                static_cast<unsigned long>(slot->skipped_count));
+  }
+}
@@ -0,0 +1,240 @@
+#include "include/frame_generator.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+#include <opencv2/imgcodecs.hpp>
+
+#include "cista.h"
+
+#include "include/delta_encoder.hpp"
+#include "include/img_msg.hpp"
+
+namespace {
+// All variants together stay below this
+constexpr size_t kMaxVariantBytes = 256 * 1024 * 1024;
+
+inline bool is_16bit(const std::string &encoding) {
+  return encoding.size() > 2 && encoding.compare(encoding.size() - 2, 2, "16") == 0;
+}
+
+inline bool is_compressed(const std::string &encoding) {
+  return is_compressed_encoding(encoding.data(), encoding.size());
+}
+
+inline uint8_t pattern(uint32_t x, uint32_t y, size_t variant, size_t channel) {
+  return static_cast<uint8_t>(x + y + variant * 16 + channel * 85);
+}
+} // namespace
+
+FrameGenerator::FrameGenerator(const GeneratorConfig &config) : config_(config) {
+  // A compressed frame is smaller than its rgb8 image
+  size_t frame_bytes = static_cast<size_t>(config_.width) * config_.height *
+                       (is_compressed(config_.encoding)
+                            ? 3
+                            : imx500_img_transport::numChannels(config_.encoding) *
+                                  (is_16bit(config_.encoding) ? 2 : 1));
+  config_.variants = std::max<size_t>(
+      1, std::min(config_.variants, kMaxVariantBytes / std::max<size_t>(frame_bytes, 1)));
+
+  if (config_.delta_tile_size > 0) {
+    serialize_deltas();
+  } else {
+    for (size_t i = 0; i < config_.variants; ++i) {
+      payloads_.push_back(serialize(i));
+    }
+    for (auto &payload : payloads_) {
+      payload_size_ += payload.size();
+    }
+    payload_size_ /= payloads_.size();
+  }
+
+  for (const auto *payloads : {&payloads_, &keyframes_}) {
+    for (auto &payload : *payloads) {
+      max_payload_size_ = std::max(max_payload_size_, payload.size());
+    }
+  }
+}
+
+const std::vector<uint8_t> &FrameGenerator::next(int64_t timestamp) {
+  bool keyframe = !keyframes_.empty() &&
+                  (frame_index_ == 0 || (config_.keyframe_interval > 0 &&
+                                         frame_index_ % config_.keyframe_interval == 0));
+  auto &payload = keyframe ? keyframes_[next_variant_] : payloads_[next_variant_];
+  next_variant_ = (next_variant_ + 1) % payloads_.size();
+
+  // The timestamp is the first field of img_msg, after the checksum
+  size_t offset = config_.integrity ? cista::data_start(cista::mode::WITH_INTEGRITY) : 0;
+  std::memcpy(payload.data() + offset, &timestamp, sizeof(timestamp));
+  if (!keyframes_.empty()) {
+    std::memcpy(payload.data() + sequence_offset_, &frame_index_, sizeof(frame_index_));
+  }
+  frame_index_++;
+
+  if (config_.integrity) {
+    // Same as cista::serialize(), the checksum covers everything after it
+    cista::hash_t checksum = cista::hash(std::string_view(
+        reinterpret_cast<const char *>(payload.data() + offset), payload.size() - offset));
+    std::memcpy(payload.data(), &checksum, sizeof(checksum));
+  }
+  return payload;
+}
+
+bool FrameGenerator::is_supported(const std::string &encoding) {
+  if (is_compressed(encoding)) {
+    return true;
+  }
+  try {
+    imx500_img_transport::numChannels(encoding);
+  } catch (std::runtime_error &) {
+    return false;
+  }
+  return true;
+}
+
+// Diagonal stripes which move by 16 pixels per variant, each channel shifted
+// by a third of the period. A moving box goes from the top left to the
+// bottom right over the variants, its stripes move along with it.
+uint8_t FrameGenerator::pixel(uint32_t x, uint32_t y, size_t variant, size_t channel) const {
+  uint32_t box = std::min({config_.moving_box, config_.width, config_.height});
+  if (box == 0) {
+    return pattern(x, y, variant, channel);
+  }
+  uint32_t left = static_cast<uint32_t>((config_.width - box) * variant / config_.variants);
+  uint32_t top = static_cast<uint32_t>((config_.height - box) * variant / config_.variants);
+  if (x >= left && x < left + box && y >= top && y < top + box) {
+    return static_cast<uint8_t>(255 - pattern(x - left, y - top, 0, channel));
+  }
+  return pattern(x, y, 0, channel);
+}
+
+// img_msg::data of a raw frame
+std::vector<uint8_t> FrameGenerator::raw_pixels(size_t variant) const {
+  const size_t channels = imx500_img_transport::numChannels(config_.encoding);
+  const size_t bytes = is_16bit(config_.encoding) ? 2 : 1;
+  const size_t pixels = static_cast<size_t>(config_.width) * config_.height;
+
+  std::vector<uint8_t> data(pixels * channels * bytes);
+  for (uint32_t y = 0; y < config_.height; ++y) {
+    for (uint32_t x = 0; x < config_.width; ++x) {
+      size_t pixel_index = static_cast<size_t>(y) * config_.width + x;
+      for (size_t c = 0; c < channels; ++c) {
+        uint8_t value = pixel(x, y, variant, c);
+        size_t index = config_.layout == PixelLayout::PLANAR ? c * pixels + pixel_index
+                                                             : pixel_index * channels + c;
+        if (bytes == 1) {
+          data[index] = value;
+        } else {
+          uint16_t sample = static_cast<uint16_t>(value << 8 | value);
+          std::memcpy(data.data() + index * 2, &sample, sizeof(sample));
+        }
+      }
+    }
+  }
+  return data;
+}
+
+std::vector<uint8_t> FrameGenerator::serialize(size_t variant) const {
+  if (is_compressed(config_.encoding)) {
+    return serialize_compressed(variant);
+  }
+  auto data = raw_pixels(variant);
+  return serialize_msg(config_.encoding, data.data(), data.size());
+}
+
+// The same stripes as rgb8, encoded as a whole image
+std::vector<uint8_t> FrameGenerator::serialize_compressed(size_t variant) const {
+  cv::Mat image(static_cast<int>(config_.height), static_cast<int>(config_.width), CV_8UC3);
+  for (uint32_t y = 0; y < config_.height; ++y) {
+    uint8_t *row = image.ptr(static_cast<int>(y));
+    for (uint32_t x = 0; x < config_.width; ++x) {
+      // BGR
+      for (size_t c = 0; c < 3; ++c) {
+        row[x * 3 + 2 - c] = pixel(x, y, variant, c);
+      }
+    }
+  }
+
+  bool png = config_.encoding == "png";
+  std::vector<int> params;
+  if (config_.quality >= 0) {
+    params = {png ? cv::IMWRITE_PNG_COMPRESSION : cv::IMWRITE_JPEG_QUALITY,
+              config_.quality};
+  }
+  std::vector<uint8_t> encoded;
+  if (!cv::imencode(png ? ".png" : ".jpg", image, encoded, params)) {
+    throw std::runtime_error("Failed to encode a " + config_.encoding + " frame");
+  }
+
+  return serialize_msg(config_.encoding, encoded.data(), encoded.size());
+}
+
+// A keyframe of every variant and the delta from the variant before it, so
+// any variant can follow either
+void FrameGenerator::serialize_deltas() {
+  std::vector<std::vector<uint8_t>> frames;
+  for (size_t i = 0; i < config_.variants; ++i) {
+    frames.push_back(raw_pixels(i));
+  }
+
+  DeltaEncoder encoder(config_.width, config_.height,
+                       imx500_img_transport::numChannels(config_.encoding),
+                       is_16bit(config_.encoding) ? 2 : 1, config_.layout,
+                       config_.delta_tile_size);
+  std::string encoding = kDeltaPrefix + config_.encoding;
+  std::vector<uint8_t> data;
+  size_t keyframe_total = 0;
+  size_t delta_total = 0;
+  for (size_t i = 0; i < frames.size(); ++i) {
+    encoder.encode(frames[i].data(), nullptr, 0, data);
+    keyframes_.push_back(serialize_msg(encoding, data.data(), data.size()));
+    keyframe_total += keyframes_.back().size();
+
+    const auto &previous = frames[(i + frames.size() - 1) % frames.size()];
+    encoder.encode(frames[i].data(), previous.data(), 0, data);
+    payloads_.push_back(serialize_msg(encoding, data.data(), data.size()));
+    delta_total += payloads_.back().size();
+  }
+
+  // The data goes right behind the img_msg, which is the same for every
+  // frame of the encoding
+  auto copy = keyframes_.front();
+  const imx500_img_transport::img_msg *msg =
+      config_.integrity
+          ? cista::deserialize<imx500_img_transport::img_msg,
+                               cista::mode::WITH_INTEGRITY | cista::mode::UNCHECKED>(
+                copy.data(), copy.data() + copy.size())
+          : cista::deserialize<imx500_img_transport::img_msg, cista::mode::UNCHECKED>(
+                copy.data(), copy.data() + copy.size());
+  sequence_offset_ =
+      (msg->data.data() - copy.data()) + offsetof(DeltaHeader, sequence);
+
+  // A keyframe every keyframe_interval frames
+  size_t count = frames.size();
+  size_t interval = config_.keyframe_interval;
+  payload_size_ = interval > 0
+                      ? (keyframe_total + delta_total * (interval - 1)) / count / interval
+                      : delta_total / count;
+}
+
+std::vector<uint8_t> FrameGenerator::serialize_msg(const std::string &encoding,
+                                                   const uint8_t *data,
+                                                   size_t size) const {
+  imx500_img_transport::img_msg msg;
+  msg.timestamp = 0;
+  msg.height = static_cast<int32_t>(config_.height);
+  msg.width = config_.width;
+  msg.encoding = std::string_view(encoding);
+  msg.data.resize(size);
+  if (size > 0) {
+    std::memcpy(msg.data.data(), data, size);
+  }
+
+  if (config_.integrity) {
+    return cista::serialize<cista::mode::WITH_INTEGRITY>(msg);
+  }
+  return cista::serialize(msg);
+}
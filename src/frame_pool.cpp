@@ -0,0 +1,97 @@
+#include "include/frame_pool.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+// Whether a cv::Mat other than the pool's one still refers to the pixels of
+// m, e.g. `cv::Mat copy = *frame.image;`. Read with an atomic add like the
+// decrement in cv::Mat::release().
+bool pixels_shared(cv::Mat &m) {
+  return m.u != nullptr && CV_XADD(&m.u->refcount, 0) != 1;
+}
+
+} // namespace
+
+FramePool::FramePool(const std::string &name, size_t max_frames)
+    : name_(name), max_frames_(max_frames) {
+  frames_.reserve(max_frames_);
+}
+
+void FramePool::set_max_frames(size_t max_frames) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_frames_ = max_frames;
+  if (frames_.size() > max_frames_) {
+    frames_.resize(max_frames_);
+  }
+}
+
+size_t FramePool::frame_bytes() const {
+  return static_cast<size_t>(size_.width) * size_.height * CV_ELEM_SIZE(type_);
+}
+
+std::shared_ptr<cv::Mat> FramePool::acquire(cv::Size size, int type) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (size != size_ || type != type_) {
+    // Frames still in use are freed by their last user, the pool just
+    // forgets about them
+    if (!frames_.empty()) {
+      rebuild_count_++;
+    }
+    frames_.clear();
+    size_ = size;
+    type_ = type;
+  }
+
+  // A frame whose only owner is the pool has been dropped by every user,
+  // unless one of them kept a cv::Mat copy of it
+  for (auto &frame : frames_) {
+    if (frame.use_count() == 1 && !pixels_shared(*frame)) {
+      // Pairs with the release decrement of the last user, so its reads of
+      // the pixels happen before they are overwritten
+      std::atomic_thread_fence(std::memory_order_acquire);
+      // cv::imdecode() may have given it the size of the image instead
+      if (frame->size() != size || frame->type() != type) {
+        miss_count_++;
+        frame->create(size, type);
+      } else {
+        hit_count_++;
+      }
+      return frame;
+    }
+  }
+
+  miss_count_++;
+  auto frame = std::make_shared<cv::Mat>(size, type);
+  if (frames_.size() < max_frames_) {
+    frames_.push_back(frame);
+    peak_resident_bytes_ = std::max(peak_resident_bytes_, frames_.size() * frame_bytes());
+  }
+  return frame;
+}
+
+size_t FramePool::resident_bytes() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return frames_.size() * frame_bytes();
+}
+
+size_t FramePool::peak_resident_bytes() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return peak_resident_bytes_;
+}
+
+void FramePool::show_statistics() {
+  uint64_t hits = hit_count_;
+  uint64_t misses = miss_count_;
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::printf("Frame pool (%s): %lu frames, %.1f%% from the pool (%lu allocated), "
+              "%lu of %dx%d resident (%.1f MB, peak %.1f MB), rebuilt %lu times\n",
+              name_.c_str(), static_cast<unsigned long>(hits + misses),
+              hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0,
+              static_cast<unsigned long>(misses), static_cast<unsigned long>(frames_.size()),
+              size_.width, size_.height, frames_.size() * frame_bytes() / (1024.0 * 1024.0),
+              peak_resident_bytes_ / (1024.0 * 1024.0),
+              static_cast<unsigned long>(rebuild_count_));
+}
@@ -0,0 +1,269 @@
+#include "include/frame_recorder.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "include/thread_tuning.hpp"
+
+namespace {
+constexpr size_t kDirectIoAlignment = 4096;
+
+uint64_t align_up(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+bool write_all(int fd, const uint8_t *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = ::write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+} // namespace
+
+FrameRecorder::FrameRecorder(const std::string &path, uint64_t segment_size,
+                             bool direct_io)
+    : path_(path), segment_size_(segment_size), direct_io_(direct_io) {
+  writer_ = std::thread(&FrameRecorder::writer_loop, this);
+}
+
+FrameRecorder::~FrameRecorder() {
+  stop();
+  for (auto &chunk : free_) {
+    std::free(chunk->data);
+  }
+}
+
+void FrameRecorder::record(const uint8_t *payload, size_t size, int64_t timestamp) {
+  static const uint8_t padding[kRecordAlignment] = {};
+  uint64_t padded_size = align_up(size, kRecordAlignment);
+
+  if (segment_offset_ > 0 && segment_offset_ + padded_size > segment_size_) {
+    submit_current(true);
+    segment_index_++;
+    segment_offset_ = 0;
+  }
+
+  append(payload, size);
+  append(padding, padded_size - size);
+
+  // The entry travels with the chunk holding the end of the payload, so the
+  // index never points at data which isn't written yet.
+  current_->entries.push_back(RecordingIndexEntry{segment_offset_, size, timestamp});
+  segment_offset_ += padded_size;
+  frame_count_++;
+}
+
+void FrameRecorder::append(const uint8_t *data, size_t size) {
+  do {
+    if (!current_ || current_->used == kChunkSize) {
+      if (current_) {
+        submit_current(false);
+      }
+      current_ = get_free_chunk();
+      current_->segment = segment_index_;
+    }
+
+    size_t len = std::min(size, kChunkSize - current_->used);
+    std::memcpy(current_->data + current_->used, data, len);
+    current_->used += len;
+    data += len;
+    size -= len;
+  } while (size > 0);
+}
+
+void FrameRecorder::submit_current(bool last_in_segment) {
+  if (!current_) {
+    if (!last_in_segment) {
+      return;
+    }
+    // Carries the close of a segment whose last chunk was already full
+    current_ = get_free_chunk();
+    current_->segment = segment_index_;
+  }
+
+  current_->last_in_segment = last_in_segment;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.push_back(std::move(current_));
+  }
+  pending_cond_.notify_one();
+}
+
+std::unique_ptr<FrameRecorder::Chunk> FrameRecorder::get_free_chunk() {
+  std::unique_ptr<Chunk> chunk;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (free_.empty() && allocated_chunks_ < kMaxPendingChunks + 1) {
+      allocated_chunks_++;
+      chunk = std::make_unique<Chunk>();
+      chunk->data = static_cast<uint8_t *>(
+          std::aligned_alloc(kDirectIoAlignment, kChunkSize));
+      if (chunk->data == nullptr) {
+        throw std::bad_alloc();
+      }
+    } else {
+      free_cond_.wait(lock, [this] { return !free_.empty(); });
+      chunk = std::move(free_.back());
+      free_.pop_back();
+    }
+  }
+
+  chunk->used = 0;
+  chunk->last_in_segment = false;
+  chunk->entries.clear();
+  return chunk;
+}
+
+void FrameRecorder::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stop_) {
+      return;
+    }
+  }
+
+  if (frame_count_ > 0) {
+    submit_current(true);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  pending_cond_.notify_one();
+
+  if (writer_.joinable()) {
+    writer_.join();
+  }
+}
+
+void FrameRecorder::writer_loop() {
+  ThreadTuning::apply(ThreadRole::WRITER);
+  while (true) {
+    std::unique_ptr<Chunk> chunk;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      pending_cond_.wait(lock, [this] { return !pending_.empty() || stop_; });
+      if (pending_.empty()) {
+        break;
+      }
+      chunk = std::move(pending_.front());
+      pending_.pop_front();
+    }
+
+    write_chunk(*chunk);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_.push_back(std::move(chunk));
+    }
+    free_cond_.notify_one();
+  }
+
+  close_segment();
+}
+
+void FrameRecorder::write_chunk(Chunk &chunk) {
+  if (data_fd_ < 0 || open_segment_ != chunk.segment) {
+    close_segment();
+    if (!open_segment(chunk.segment)) {
+      return;
+    }
+  }
+
+  // O_DIRECT needs whole blocks. Only the last chunk of a segment can be
+  // partly filled, the padding is cut off again when the segment is closed.
+  size_t len = chunk.used;
+  if (direct_io_) {
+    len = align_up(chunk.used, kDirectIoAlignment);
+    std::memset(chunk.data + chunk.used, 0, len - chunk.used);
+  }
+
+  const uint8_t *entries = reinterpret_cast<const uint8_t *>(chunk.entries.data());
+  if (!write_all(data_fd_, chunk.data, len) ||
+      !write_all(index_fd_, entries, chunk.entries.size() * sizeof(RecordingIndexEntry))) {
+    if (!error_.exchange(true)) {
+      std::printf("Failed to write recording segment %u: %s\n", chunk.segment,
+                  std::strerror(errno));
+    }
+    return;
+  }
+
+  segment_written_ += chunk.used;
+  written_bytes_ += chunk.used;
+
+  if (chunk.last_in_segment) {
+    close_segment();
+  }
+}
+
+bool FrameRecorder::open_segment(uint32_t segment) {
+  std::string data_file = recording_segment_name(path_, segment, ".dat");
+  std::string index_file = recording_segment_name(path_, segment, ".idx");
+
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+  if (direct_io_) {
+    data_fd_ = ::open(data_file.c_str(), flags | O_DIRECT, 0644);
+    if (data_fd_ < 0 && errno == EINVAL) {
+      std::printf("%s doesn't support O_DIRECT, use buffered I/O\n", path_.c_str());
+      direct_io_ = false;
+    }
+  }
+  if (data_fd_ < 0) {
+    data_fd_ = ::open(data_file.c_str(), flags, 0644);
+  }
+  index_fd_ = ::open(index_file.c_str(), flags, 0644);
+
+  RecordingIndexHeader header;
+  std::memcpy(header.magic, kRecordingIndexMagic, sizeof(header.magic));
+  header.version = kRecordingVersion;
+  header.entry_size = sizeof(RecordingIndexEntry);
+
+  if (data_fd_ < 0 || index_fd_ < 0 ||
+      !write_all(index_fd_, reinterpret_cast<const uint8_t *>(&header), sizeof(header))) {
+    if (!error_.exchange(true)) {
+      std::printf("Failed to create recording segment %s: %s\n",
+                  data_file.c_str(), std::strerror(errno));
+    }
+    close_segment();
+    return false;
+  }
+
+  open_segment_ = segment;
+  segment_written_ = 0;
+  return true;
+}
+
+void FrameRecorder::close_segment() {
+  if (data_fd_ >= 0) {
+    if (direct_io_ && ftruncate(data_fd_, segment_written_) != 0) {
+      std::printf("Failed to truncate recording segment %u\n", open_segment_);
+    }
+    ::close(data_fd_);
+    data_fd_ = -1;
+  }
+  if (index_fd_ >= 0) {
+    ::close(index_fd_);
+    index_fd_ = -1;
+  }
+}
+
+void FrameRecorder::show_statistics() {
+  std::printf("Recorder: %lu frames, %.1f MB in %u segments%s\n",
+              static_cast<unsigned long>(frame_count_),
+              written_bytes_ / (1024.0 * 1024.0), segment_count(),
+              error_ ? ", write errors occurred" : "");
+}
@@ -0,0 +1,120 @@
+#include "include/frame_ring_reader.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+
+FrameRingReader::FrameRingReader(const std::string &name) : name_(name) {}
+
+FrameRingReader::~FrameRingReader() {
+  close();
+}
+
+bool FrameRingReader::next(RingFrame &frame) {
+  if (ring_ == nullptr && !open()) {
+    return false;
+  }
+  auto ring = header();
+  if (ring->closed.load(std::memory_order_acquire) != 0) {
+    // Replaced or gone, the next call looks for a new one
+    close();
+    return false;
+  }
+
+  uint64_t written = ring->write_count.load(std::memory_order_acquire);
+  while (next_frame_ < written) {
+    if (written - next_frame_ > slot_count_) {
+      missed_count_ += written - next_frame_ - slot_count_;
+      next_frame_ = written - slot_count_;
+    }
+
+    auto slot = reinterpret_cast<const RingSlot *>(
+        ring_ + ring_slot_offset(static_cast<uint32_t>(next_frame_ % slot_count_),
+                                 slot_size_));
+    frame.slot = slot;
+    frame.generation = slot->generation.load(std::memory_order_acquire);
+    frame.frame = slot->frame;
+    frame.timestamp = slot->timestamp;
+    frame.receive_time_ns = slot->receive_time_ns;
+    frame.width = slot->width;
+    frame.height = slot->height;
+    frame.step = slot->step;
+    frame.format = slot->format;
+    frame.size = slot->size;
+    frame.data = reinterpret_cast<const uint8_t *>(slot) + kRingSlotDataOffset;
+
+    // A slot being written, or already holding a newer frame, was lapped
+    if ((frame.generation & 1) != 0 || frame.frame != next_frame_ || !valid(frame) ||
+        frame.size > data_capacity_ ||
+        static_cast<uint64_t>(frame.step) * frame.height > frame.size) {
+      missed_count_++;
+      next_frame_++;
+      written = ring->write_count.load(std::memory_order_acquire);
+      continue;
+    }
+    next_frame_++;
+    return true;
+  }
+  return false;
+}
+
+bool FrameRingReader::valid(const RingFrame &frame) const {
+  // The reads of the frame happen before the generation is read again
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return frame.slot != nullptr &&
+         frame.slot->generation.load(std::memory_order_relaxed) == frame.generation;
+}
+
+bool FrameRingReader::open() {
+  int fd = shm_open(name_.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat sb;
+  void *ring = MAP_FAILED;
+  if (fstat(fd, &sb) == 0 && static_cast<size_t>(sb.st_size) >= sizeof(RingHeader)) {
+    ring = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);
+  if (ring == MAP_FAILED) {
+    return false;
+  }
+  ring_ = static_cast<const uint8_t *>(ring);
+  ring_size_ = sb.st_size;
+
+  // The writer sets the magic once everything else is in place
+  auto ring_header = header();
+  if (std::memcmp(ring_header->magic, kRingMagic, sizeof(kRingMagic)) != 0) {
+    close();
+    return false;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (ring_header->version != kRingVersion || ring_header->slot_count == 0 ||
+      ring_header->slot_size < kRingSlotDataOffset + ring_header->data_capacity ||
+      ring_slot_offset(ring_header->slot_count, ring_header->slot_size) > ring_size_) {
+    close();
+    return false;
+  }
+  slot_count_ = ring_header->slot_count;
+  slot_size_ = ring_header->slot_size;
+  data_capacity_ = ring_header->data_capacity;
+  stream_.assign(ring_header->stream, strnlen(ring_header->stream, sizeof(ring_header->stream)));
+
+  uint64_t written = ring_header->write_count.load(std::memory_order_acquire);
+  next_frame_ = written > 0 ? written - 1 : 0;
+  open_count_++;
+  return true;
+}
+
+void FrameRingReader::close() {
+  if (ring_ == nullptr) {
+    return;
+  }
+  munmap(const_cast<uint8_t *>(ring_), ring_size_);
+  ring_ = nullptr;
+  ring_size_ = 0;
+}
@@ -0,0 +1,183 @@
+#include "include/frame_ring_writer.hpp"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+FrameRingWriter::FrameRingWriter(const std::string &name, const std::string &stream,
+                                 uint32_t slot_count)
+    : name_(name), stream_(stream), slot_count_(slot_count > 0 ? slot_count : 1) {}
+
+FrameRingWriter::~FrameRingWriter() {
+  close();
+}
+
+bool FrameRingWriter::write(const cv::Mat &image, int64_t timestamp,
+                            int64_t receive_time_ns) {
+  size_t row_size = static_cast<size_t>(image.cols) * 3;
+  size_t size = row_size * image.rows;
+  if (failed_ || (size > data_capacity_ && !create(size))) {
+    error_count_++;
+    return false;
+  }
+
+  auto ring = header();
+  uint64_t frame = ring->write_count.load(std::memory_order_relaxed);
+  auto slot = reinterpret_cast<RingSlot *>(
+      ring_ + ring_slot_offset(static_cast<uint32_t>(frame % slot_count_), slot_size_));
+
+  // Odd: readers of the slot's old frame see it is being overwritten. The
+  // fence keeps the pixel stores behind the odd generation.
+  uint64_t generation = slot->generation.load(std::memory_order_relaxed);
+  slot->generation.store(generation + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot->frame = frame;
+  slot->timestamp = timestamp;
+  slot->receive_time_ns = receive_time_ns;
+  slot->width = static_cast<uint32_t>(image.cols);
+  slot->height = static_cast<uint32_t>(image.rows);
+  slot->step = static_cast<uint32_t>(row_size);
+  slot->format = RingPixelFormat::BGR8;
+  slot->size = size;
+  uint8_t *data = reinterpret_cast<uint8_t *>(slot) + kRingSlotDataOffset;
+  for (int row = 0; row < image.rows; ++row) {
+    std::memcpy(data + row * row_size, image.ptr(row), row_size);
+  }
+
+  slot->generation.store(generation + 2, std::memory_order_release);
+  ring->write_count.store(frame + 1, std::memory_order_release);
+  frame_count_++;
+  return true;
+}
+
+// Slots for frames of frame_size bytes, readers of an older ring reopen
+bool FrameRingWriter::create(size_t frame_size) {
+  close();
+
+  data_capacity_ = frame_size;
+  slot_size_ = (kRingSlotDataOffset + frame_size + kRingAlignment - 1) / kRingAlignment *
+               kRingAlignment;
+  size_t size = ring_slot_offset(slot_count_, slot_size_);
+
+  int fd = open_object();
+  if (fd < 0) {
+    data_capacity_ = 0;
+    failed_ = true;
+    return false;
+  }
+  void *ring = MAP_FAILED;
+  if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+    ring = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (ring == MAP_FAILED) {
+    std::printf("Failed to map %lu bytes of shared memory %s: %s\n",
+                static_cast<unsigned long>(size), name_.c_str(), std::strerror(errno));
+    shm_unlink(name_.c_str());
+    ::close(fd);
+    data_capacity_ = 0;
+    failed_ = true;
+    return false;
+  }
+  // The descriptor holds the lock
+  fd_ = fd;
+  ring_ = static_cast<uint8_t *>(ring);
+  ring_size_ = size;
+
+  // ftruncate() zeroed the object, so every slot starts at generation 0.
+  // Readers check the magic last.
+  auto ring_header = new (ring_) RingHeader();
+  ring_header->version = kRingVersion;
+  ring_header->slot_count = slot_count_;
+  ring_header->slot_size = slot_size_;
+  ring_header->data_capacity = data_capacity_;
+  std::snprintf(ring_header->stream, sizeof(ring_header->stream), "%s", stream_.c_str());
+  ring_header->write_count.store(0, std::memory_order_relaxed);
+  ring_header->closed.store(0, std::memory_order_relaxed);
+  for (uint32_t i = 0; i < slot_count_; ++i) {
+    new (ring_ + ring_slot_offset(i, slot_size_)) RingSlot();
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(ring_header->magic, kRingMagic, sizeof(kRingMagic));
+
+  if (create_count_++ == 0) {
+    std::printf("%s: Frames go to shared memory %s, %u slots of %.1f MB\n", stream_.c_str(),
+                name_.c_str(), slot_count_, slot_size_ / (1024.0 * 1024.0));
+  }
+  return true;
+}
+
+// The writer holds an exclusive flock() on the object for as long as it
+// uses it, the lock goes away with the writer however it exits. An object
+// of the same name nobody holds the lock of was left behind by a viewer
+// which crashed and is replaced. One another viewer writes to is left alone.
+int FrameRingWriter::open_object() {
+  // Without the leading slash
+  if (name_.size() - 1 > NAME_MAX) {
+    std::printf("Failed to create the shared memory %s: the name is longer than %d "
+                "characters\n", name_.c_str(), NAME_MAX);
+    return -1;
+  }
+
+  int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0 && errno == EEXIST) {
+    int existing = shm_open(name_.c_str(), O_RDONLY, 0);
+    if (existing < 0 || flock(existing, LOCK_EX | LOCK_NB) != 0) {
+      std::printf("Shared memory %s is used by another viewer, pick another --shm name\n",
+                  name_.c_str());
+      if (existing >= 0) {
+        ::close(existing);
+      }
+      return -1;
+    }
+    std::printf("Replacing shared memory %s left behind by a viewer which exited\n",
+                name_.c_str());
+    shm_unlink(name_.c_str());
+    ::close(existing);
+    fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  }
+  if (fd < 0) {
+    std::printf("Failed to create the shared memory %s: %s\n", name_.c_str(),
+                std::strerror(errno));
+    return -1;
+  }
+  if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+    // Another viewer took the new object for a stale one
+    std::printf("Failed to lock the shared memory %s: %s\n", name_.c_str(),
+                std::strerror(errno));
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void FrameRingWriter::close() {
+  if (ring_ == nullptr) {
+    return;
+  }
+  header()->closed.store(1, std::memory_order_release);
+  munmap(ring_, ring_size_);
+  shm_unlink(name_.c_str());
+  ::close(fd_);
+  fd_ = -1;
+  ring_ = nullptr;
+  ring_size_ = 0;
+  data_capacity_ = 0;
+}
+
+void FrameRingWriter::show_statistics() {
+  std::printf("Shared memory %s: %lu frames, %u slots of %.1f MB, %u times created",
+              name_.c_str(), static_cast<unsigned long>(frame_count_), slot_count_,
+              slot_size_ / (1024.0 * 1024.0), create_count_);
+  if (error_count_ > 0) {
+    std::printf(", %lu frames failed", static_cast<unsigned long>(error_count_));
+  }
+  std::printf("\n");
+}
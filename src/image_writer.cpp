@@ -0,0 +1,206 @@
+#include "include/image_writer.hpp"
+
+#include <cstdio>
+
+#include <opencv2/imgcodecs.hpp>
+
+#include "include/thread_tuning.hpp"
+
+ImageWriter::ImageWriter(const ImageWriterConfig &config)
+    : config_(config), start_time_(std::chrono::steady_clock::now()) {
+  switch (config_.format) {
+  case ImageFormat::BMP:
+    extension_ = ".bmp";
+    break;
+  case ImageFormat::PNG:
+    extension_ = ".png";
+    imwrite_params_ = {cv::IMWRITE_PNG_COMPRESSION, config_.png_compression};
+    break;
+  case ImageFormat::RAW:
+    extension_ = ".raw";
+    break;
+  }
+
+  if (config_.threads == 0) {
+    config_.threads = 1;
+  }
+  if (config_.queue_capacity == 0) {
+    config_.queue_capacity = 1;
+  }
+
+  for (size_t i = 0; i < config_.threads; ++i) {
+    workers_.emplace_back(&ImageWriter::worker, this);
+  }
+}
+
+ImageWriter::~ImageWriter() {
+  stop();
+}
+
+bool ImageWriter::submit(uint32_t index, std::shared_ptr<cv::Mat> image) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (jobs_.size() >= config_.queue_capacity) {
+      if (config_.drop_when_full) {
+        dropped_count_++;
+        return false;
+      }
+      not_full_cond_.wait(lock, [this] {
+        return jobs_.size() < config_.queue_capacity || stop_;
+      });
+    }
+    if (stop_) {
+      dropped_count_++;
+      return false;
+    }
+
+    jobs_.push_back(Job{index, std::move(image)});
+    if (jobs_.size() > peak_backlog_) {
+      peak_backlog_ = jobs_.size();
+    }
+  }
+
+  not_empty_cond_.notify_one();
+  return true;
+}
+
+void ImageWriter::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stop_) {
+      return;
+    }
+    stop_ = true;
+  }
+  not_empty_cond_.notify_all();
+  not_full_cond_.notify_all();
+
+  for (auto &worker : workers_) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+}
+
+size_t ImageWriter::backlog() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return jobs_.size();
+}
+
+size_t ImageWriter::peak_backlog() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return peak_backlog_;
+}
+
+void ImageWriter::worker() {
+  ThreadTuning::apply(ThreadRole::WRITER);
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      not_empty_cond_.wait(lock, [this] {
+        return !jobs_.empty() || stop_;
+      });
+      // Queued jobs are still written after stop()
+      if (jobs_.empty()) {
+        break;
+      }
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+    not_full_cond_.notify_one();
+
+    if (write(job)) {
+      written_count_++;
+      written_bytes_ += job.image->total() * job.image->elemSize();
+    } else {
+      failed_count_++;
+      std::printf("Failed to write frame %u !!!\n", job.index);
+    }
+  }
+}
+
+bool ImageWriter::write(const Job &job) {
+  std::string output_file = config_.output_path + "/frame_" +
+                            std::to_string(job.index) + extension_;
+
+  if (config_.format != ImageFormat::RAW) {
+    return cv::imwrite(output_file, *job.image, imwrite_params_);
+  }
+
+  std::FILE *file = std::fopen(output_file.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  bool ok = true;
+  const cv::Mat &image = *job.image;
+  size_t row_size = image.cols * image.elemSize();
+  for (int y = 0; y < image.rows && ok; ++y) {
+    ok = std::fwrite(image.ptr(y), 1, row_size, file) == row_size;
+  }
+  return std::fclose(file) == 0 && ok;
+}
+
+void ImageWriter::show_statistics() {
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start_time_;
+  double seconds = elapsed.count() > 0 ? elapsed.count() : 1;
+
+  std::printf("Image writer (%s, %lu threads): written %lu frames "
+              "(%.1f frames/s, %.1f MB/s), dropped %lu, failed %lu, "
+              "backlog %lu, peak backlog %lu\n",
+              format_name(config_.format),
+              static_cast<unsigned long>(config_.threads),
+              static_cast<unsigned long>(written_count_),
+              written_count_ / seconds,
+              written_bytes_ / seconds / (1024 * 1024),
+              static_cast<unsigned long>(dropped_count_),
+              static_cast<unsigned long>(failed_count_),
+              static_cast<unsigned long>(backlog()),
+              static_cast<unsigned long>(peak_backlog()));
+}
+
+bool ImageWriter::parse_format(const std::string &param, ImageFormat &format,
+                               int &png_compression) {
+  auto pos = param.find(':');
+  std::string name = param.substr(0, pos);
+
+  if (name == "png") {
+    format = ImageFormat::PNG;
+    if (pos != std::string::npos) {
+      try {
+        png_compression = std::stoi(param.substr(pos + 1), nullptr);
+      } catch (std::exception &) {
+        return false;
+      }
+      if (png_compression < 0 || png_compression > 9) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  if (pos != std::string::npos) {
+    return false;
+  }
+  if (name == "bmp") {
+    format = ImageFormat::BMP;
+  } else if (name == "raw") {
+    format = ImageFormat::RAW;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char *ImageWriter::format_name(ImageFormat format) {
+  switch (format) {
+  case ImageFormat::BMP:
+    return "bmp";
+  case ImageFormat::PNG:
+    return "png";
+  case ImageFormat::RAW:
+    return "raw";
+  }
+  return "unknown";
+}
@@ -0,0 +1,505 @@
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "include/chunk_format.hpp"
+#include "include/frame_generator.hpp"
+#include "include/frame_recorder.hpp"
+#include "include/mqtt_publisher.hpp"
+#include "include/pipeline_stats.hpp"
+#include "include/publisher_param_parser.hpp"
+
+// Exit flag
+std::atomic_bool g_request_exit{false};
+
+static void signal_handler(int signal)
+{
+  g_request_exit = true;
+}
+
+// "a,b" -> {"a", "b"}
+static std::vector<std::string> split_topics(const std::string &param) {
+  std::vector<std::string> topics;
+  size_t start = 0;
+  while (start <= param.size()) {
+    size_t end = param.find(',', start);
+    if (end == std::string::npos) {
+      end = param.size();
+    }
+    if (end > start) {
+      topics.push_back(param.substr(start, end - start));
+    }
+    start = end + 1;
+  }
+  return topics;
+}
+
+// "1920x1080" -> 1920, 1080. Delta tiles number their columns and rows
+// with 16 bits, so neither may exceed 65535 even with 1 pixel tiles.
+static bool parse_frame_size(const std::string &param, uint32_t &width, uint32_t &height) {
+  constexpr unsigned long kMaxSize = 65535;
+  size_t pos = param.find('x');
+  if (pos == std::string::npos || param.find('-') != std::string::npos) {
+    return false;
+  }
+  unsigned long parsed_width;
+  unsigned long parsed_height;
+  try {
+    parsed_width = std::stoul(param.substr(0, pos), nullptr);
+    parsed_height = std::stoul(param.substr(pos + 1), nullptr);
+  } catch (std::exception &) {
+    return false;
+  }
+  if (parsed_width == 0 || parsed_height == 0 || parsed_width > kMaxSize ||
+      parsed_height > kMaxSize) {
+    return false;
+  }
+  width = static_cast<uint32_t>(parsed_width);
+  height = static_cast<uint32_t>(parsed_height);
+  return true;
+}
+
+// Publish a payload in chunks of at most chunk_size bytes, each behind a
+// ChunkHeader. The payload is split evenly, see chunk_stride(). message is
+// reused from chunk to chunk.
+static void publish_chunks(MqttPublisher &publisher, const std::vector<std::string> &topics,
+                           const std::vector<uint8_t> &payload, size_t chunk_size,
+                           uint32_t frame_id, std::vector<uint8_t> &message) {
+  uint32_t count = static_cast<uint32_t>((payload.size() + chunk_size - 1) / chunk_size);
+  size_t stride = chunk_stride(payload.size(), count);
+  for (uint32_t index = 0; index < count; ++index) {
+    size_t offset = static_cast<size_t>(index) * stride;
+    size_t len = std::min(stride, payload.size() - offset);
+
+    ChunkHeader header;
+    std::memcpy(header.magic, kChunkMagic, sizeof(header.magic));
+    header.frame_id = frame_id;
+    header.index = index;
+    header.count = count;
+    header.frame_size = payload.size();
+    header.offset = offset;
+
+    message.resize(sizeof(header) + len);
+    std::memcpy(message.data(), &header, sizeof(header));
+    std::memcpy(message.data() + sizeof(header), payload.data() + offset, len);
+    for (auto &topic : topics) {
+      if (!publisher.publish(topic, message.data(), message.size()) && g_request_exit) {
+        return;
+      }
+    }
+  }
+}
+
+static bool is_directory(const std::string &path) {
+  struct stat sb;
+  return stat(path.c_str(), &sb) == 0 && (sb.st_mode & S_IFDIR) != 0;
+}
+
+static bool write_file(const std::string &path, const std::vector<uint8_t> &payload) {
+  std::FILE *file = std::fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  bool ok = std::fwrite(payload.data(), 1, payload.size(), file) == payload.size();
+  return std::fclose(file) == 0 && ok;
+}
+
+int main(int argc, char ** argv)
+{
+  auto parser = std::make_shared<PublisherParamParser>(argc, argv);
+
+  // Without a broker the frames only go to files
+  std::string mqtt_broker_ip = parser->get_broker_addr();
+  int32_t broker_port = 0;
+  std::vector<std::string> topics;
+  int qos = 1;
+  if (!mqtt_broker_ip.empty()) {
+    try {
+      broker_port = std::stoi(parser->get_broker_port(), nullptr);
+    } catch (std::exception &) {
+      std::cout << "Input command arguments \"-p\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+
+    topics = split_topics(parser->get_topic());
+    if (topics.empty()) {
+      std::cout << "Input command arguments \"-t\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+
+    std::string qos_param = parser->get_qos();
+    if (!qos_param.empty()) {
+      qos = qos_param == "0" ? 0 : qos_param == "1" ? 1 : qos_param == "2" ? 2 : -1;
+      if (qos < 0) {
+        std::cout << "Input command arguments \"--qos\" error !" << std::endl;
+        parser->show_usage();
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  std::string output_path = parser->get_output_path();
+  std::string record_path = parser->get_record_path();
+  if (mqtt_broker_ip.empty() && output_path.empty() && record_path.empty()) {
+    std::cout << "Nothing to do, give a broker (-a) or an output (-o, -r) !" << std::endl;
+    parser->show_usage();
+    return EXIT_FAILURE;
+  }
+  for (auto &path : {output_path, record_path}) {
+    if (!path.empty() && !is_directory(path)) {
+      std::cout << "Output path \"" << path << "\" doesn't exist !!!" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  GeneratorConfig generator_config;
+  std::string size_param = parser->get_frame_size();
+  if (!size_param.empty() &&
+      !parse_frame_size(size_param, generator_config.width, generator_config.height)) {
+    std::cout << "Input command arguments \"--size\" error !" << std::endl;
+    parser->show_usage();
+    return EXIT_FAILURE;
+  }
+
+  std::string encoding_param = parser->get_encoding();
+  if (!encoding_param.empty()) {
+    generator_config.encoding = encoding_param;
+  }
+  if (!FrameGenerator::is_supported(generator_config.encoding)) {
+    std::cout << "Input command arguments \"-e\" error !" << std::endl;
+    parser->show_usage();
+    return EXIT_FAILURE;
+  }
+
+  std::string layout_param = parser->get_pixel_layout();
+  if (!layout_param.empty() && !parse_pixel_layout(layout_param, generator_config.layout)) {
+    std::cout << "Input command arguments \"--layout\" error !" << std::endl;
+    parser->show_usage();
+    return EXIT_FAILURE;
+  }
+  generator_config.integrity = parser->use_integrity();
+
+  std::string quality_param = parser->get_quality();
+  if (!quality_param.empty()) {
+    int max_quality = generator_config.encoding == "png" ? 9 : 100;
+    try {
+      generator_config.quality = std::stoi(quality_param, nullptr);
+    } catch (std::exception &) {
+      generator_config.quality = -1;
+    }
+    if (generator_config.quality < 0 || generator_config.quality > max_quality) {
+      std::cout << "Input command arguments \"--quality\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  try {
+    if (!parser->get_delta_tile_size().empty()) {
+      generator_config.delta_tile_size = std::stoul(parser->get_delta_tile_size(), nullptr);
+    }
+    if (!parser->get_keyframe_interval().empty()) {
+      generator_config.keyframe_interval =
+          std::stoul(parser->get_keyframe_interval(), nullptr);
+    }
+    if (!parser->get_moving_box().empty()) {
+      generator_config.moving_box = std::stoul(parser->get_moving_box(), nullptr);
+    }
+  } catch (std::exception &) {
+    std::cout << "Input command arguments \"--delta\", \"--keyframe-interval\" or "
+              << "\"--moving-box\" error !" << std::endl;
+    parser->show_usage();
+    return EXIT_FAILURE;
+  }
+  // Deltas are made of raw pixels, a tile column must fit DeltaTile
+  if (!parser->get_delta_tile_size().empty() &&
+      (generator_config.delta_tile_size == 0 ||
+       generator_config.delta_tile_size > (1u << 16) ||
+       is_compressed_encoding(generator_config.encoding.data(),
+                              generator_config.encoding.size()))) {
+    std::cout << "Input command arguments \"--delta\" error !" << std::endl;
+    parser->show_usage();
+    return EXIT_FAILURE;
+  }
+
+  // 0 publishes every frame as one message
+  size_t chunk_size = 0;
+  std::string chunk_param = parser->get_chunk_size();
+  if (!chunk_param.empty()) {
+    try {
+      chunk_size = std::stoul(chunk_param, nullptr) * 1024;
+    } catch (std::exception &) {
+      chunk_size = 0;
+    }
+    if (chunk_size == 0 || mqtt_broker_ip.empty()) {
+      std::cout << "Input command arguments \"--chunk-size\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  double fps = 30;
+  std::string fps_param = parser->get_fps();
+  if (!fps_param.empty()) {
+    try {
+      fps = std::stod(fps_param, nullptr);
+    } catch (std::exception &) {
+      fps = -1;
+    }
+    if (fps < 0) {
+      std::cout << "Input command arguments \"--fps\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  uint64_t burst = 1;
+  uint64_t frame_count = mqtt_broker_ip.empty() ? 100 : 0;
+  uint64_t skip_every = 0;
+  int64_t clock_offset_ms = 0;
+  try {
+    if (!parser->get_burst().empty()) {
+      burst = std::stoull(parser->get_burst(), nullptr);
+    }
+    if (!parser->get_frame_count().empty()) {
+      frame_count = std::stoull(parser->get_frame_count(), nullptr);
+    }
+    if (!parser->get_skip_every().empty()) {
+      skip_every = std::stoull(parser->get_skip_every(), nullptr);
+    }
+    if (!parser->get_clock_offset().empty()) {
+      clock_offset_ms = std::stoll(parser->get_clock_offset(), nullptr);
+    }
+  } catch (std::exception &) {
+    std::cout << "Input command arguments \"--burst\", \"-n\", \"--skip-every\" or "
+              << "\"--clock-offset\" error !" << std::endl;
+    parser->show_usage();
+    return EXIT_FAILURE;
+  }
+  if (burst == 0) {
+    std::cout << "Input command arguments \"--burst\" error !" << std::endl;
+    parser->show_usage();
+    return EXIT_FAILURE;
+  }
+
+  // now: the send time. synthetic: an ideal clock at the frame rate, which
+  // doesn't see the pacing jitter of this program.
+  bool synthetic_timestamps = false;
+  std::string timestamp_param = parser->get_timestamp_mode();
+  if (!timestamp_param.empty()) {
+    if (timestamp_param != "now" && timestamp_param != "synthetic") {
+      std::cout << "Input command arguments \"--timestamp\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+    synthetic_timestamps = timestamp_param == "synthetic";
+  }
+
+  if (!mqtt_broker_ip.empty()) {
+    std::cout << "MQTT Broker Address: " << mqtt_broker_ip << std::endl;
+    std::cout << "    Server TCP Port: " << broker_port << std::endl;
+    for (auto &topic : topics) {
+      std::cout << "              Topic: " << topic << std::endl;
+    }
+    std::cout << "                QoS: " << qos << std::endl;
+    if (chunk_size > 0) {
+      std::cout << "             Chunks: " << chunk_size / 1024 << " KB" << std::endl;
+    }
+  }
+  if (!output_path.empty()) {
+    std::cout << "              Files: " << output_path << std::endl;
+  }
+  if (!record_path.empty()) {
+    std::cout << "          Recording: " << record_path << std::endl;
+  }
+  std::cout << "              Frame: " << generator_config.width << "x"
+            << generator_config.height << " " << generator_config.encoding << " (";
+  if (is_compressed_encoding(generator_config.encoding.data(),
+                             generator_config.encoding.size())) {
+    std::cout << (generator_config.encoding == "png" ? "level " : "quality ");
+    if (generator_config.quality >= 0) {
+      std::cout << generator_config.quality;
+    } else {
+      std::cout << "default";
+    }
+  } else {
+    std::cout << pixel_layout_name(generator_config.layout);
+  }
+  std::cout << (generator_config.integrity ? ", with checksum" : "") << ")" << std::endl;
+  if (generator_config.delta_tile_size > 0) {
+    std::cout << "             Deltas: tiles of " << generator_config.delta_tile_size
+              << " pixels, keyframe ";
+    if (generator_config.keyframe_interval > 0) {
+      std::cout << "every " << generator_config.keyframe_interval << " frames";
+    } else {
+      std::cout << "only first";
+    }
+    std::cout << std::endl;
+  }
+  if (generator_config.moving_box > 0) {
+    std::cout << "              Scene: still, a box of " << generator_config.moving_box
+              << " pixels moves" << std::endl;
+  }
+  std::cout << "               Rate: ";
+  if (fps > 0) {
+    std::cout << fps << " fps";
+  } else {
+    std::cout << "as fast as possible";
+  }
+  if (burst > 1) {
+    std::cout << ", bursts of " << burst;
+  }
+  std::cout << std::endl;
+  std::cout << "         Timestamps: " << (synthetic_timestamps ? "synthetic" : "now");
+  if (clock_offset_ms != 0) {
+    std::cout << ", " << clock_offset_ms << " ms off";
+  }
+  if (skip_every > 0) {
+    std::cout << ", every " << skip_every << ". frame skipped";
+  }
+  std::cout << std::endl;
+
+  std::signal(SIGINT, signal_handler);
+  std::signal(SIGTERM, signal_handler);
+
+  FrameGenerator generator(generator_config);
+  std::printf("%lu bytes per message on average, %lu test images\n",
+              static_cast<unsigned long>(generator.payload_size()),
+              static_cast<unsigned long>(generator.config().variants));
+
+  if (chunk_size > 0 &&
+      (generator.max_payload_size() + chunk_size - 1) / chunk_size > kMaxChunkCount) {
+    std::cout << "Input command arguments \"--chunk-size\" error, more than "
+              << kMaxChunkCount << " chunks per frame !" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::unique_ptr<MqttPublisher> publisher;
+  if (!mqtt_broker_ip.empty()) {
+    publisher = std::make_unique<MqttPublisher>(mqtt_broker_ip, broker_port, qos);
+    // With the broker gone publish() would wait for it forever
+    publisher->set_abort([] { return g_request_exit.load(); });
+    if (!publisher->init() || !publisher->wait_connected(std::chrono::seconds(5))) {
+      std::cout << "Can't connect to the broker !!!" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::unique_ptr<FrameRecorder> recorder;
+  if (!record_path.empty()) {
+    recorder = std::make_unique<FrameRecorder>(record_path, 1024ull * 1024 * 1024, false);
+  }
+
+  // Synthetic timestamps without a frame rate advance like 30 fps
+  const double interval_ns = 1e9 / (fps > 0 ? fps : 30);
+  const int64_t clock_offset_ns = clock_offset_ms * 1000000;
+  const int64_t first_timestamp = realtime_clock_ns();
+  const auto start_time = std::chrono::steady_clock::now();
+
+  uint64_t sent = 0;
+  uint64_t skipped = 0;
+  uint64_t file_index = 0;
+  uint64_t last_sent = 0;
+  std::vector<uint8_t> chunk_message;
+  auto last_report = start_time;
+  for (uint64_t i = 0; (frame_count == 0 || i < frame_count) && !g_request_exit; ++i) {
+    // A burst goes out back to back, the bursts keep the average rate
+    if (fps > 0 && i % burst == 0) {
+      std::this_thread::sleep_until(
+          start_time + std::chrono::nanoseconds(static_cast<int64_t>(i * interval_ns)));
+    }
+
+    int64_t timestamp = synthetic_timestamps
+                            ? first_timestamp + static_cast<int64_t>(i * interval_ns)
+                            : realtime_clock_ns();
+    timestamp += clock_offset_ns;
+
+    // The timestamp is used up, so the receiver sees a gap
+    if (skip_every > 0 && (i + 1) % skip_every == 0) {
+      skipped++;
+      continue;
+    }
+
+    const auto &payload = generator.next(timestamp);
+    if (publisher && chunk_size > 0) {
+      publish_chunks(*publisher, topics, payload, chunk_size,
+                     static_cast<uint32_t>(sent), chunk_message);
+    } else if (publisher) {
+      for (auto &topic : topics) {
+        publisher->publish(topic, payload.data(), payload.size());
+      }
+    }
+    if (!output_path.empty()) {
+      char name[32];
+      std::snprintf(name, sizeof(name), "/frame_%08lu.msg",
+                    static_cast<unsigned long>(file_index++));
+      if (!write_file(output_path + name, payload)) {
+        std::printf("Failed to write %s%s\n", output_path.c_str(), name);
+        output_path.clear();
+      }
+    }
+    if (recorder) {
+      recorder->record(payload.data(), payload.size(), timestamp);
+    }
+    sent++;
+
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = now - last_report;
+    if (elapsed.count() >= 1.0) {
+      double rate = (sent - last_sent) / elapsed.count();
+      std::printf("%lu frames, %.1f fps, %.1f MB/s", static_cast<unsigned long>(sent),
+                  rate, rate * payload.size() * std::max<size_t>(topics.size(), 1) / 1e6);
+      if (publisher) {
+        std::printf(", %lu waiting for the broker",
+                    static_cast<unsigned long>(publisher->pending_count()));
+      }
+      std::printf("\n");
+      last_sent = sent;
+      last_report = now;
+    }
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+
+  if (publisher) {
+    // Give the queued messages a moment to reach the broker
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (publisher->pending_count() > 0 && !g_request_exit &&
+           std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    publisher->stop();
+  }
+  if (recorder) {
+    recorder->stop();
+    recorder->show_statistics();
+  }
+
+  std::printf("Sent %lu frames in %.2f s (%.1f fps, %.1f MB/s)\n",
+              static_cast<unsigned long>(sent), elapsed.count(),
+              elapsed.count() > 0 ? sent / elapsed.count() : 0.0,
+              elapsed.count() > 0 ? sent * generator.payload_size() *
+                                        std::max<size_t>(topics.size(), 1) /
+                                        elapsed.count() / 1e6
+                                  : 0.0);
+  if (skipped > 0) {
+    std::printf("Skipped %lu frames\n", static_cast<unsigned long>(skipped));
+  }
+  if (publisher) {
+    std::printf("Published %lu messages, %lu failed\n",
+                static_cast<unsigned long>(publisher->published_count()),
+                static_cast<unsigned long>(publisher->failed_count()));
+  }
+
+  return EXIT_SUCCESS;
+}
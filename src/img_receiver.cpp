@@ -0,0 +1,88 @@
+#include "include/img_receiver.hpp"
+
+ImgReceiver::ImgReceiver(const ImgReceiverConfig &config, std::shared_ptr<FrameSink> sink)
+    : config_(config) {
+  if (!sink && (config_.on_frame || config_.pull_capacity > 0)) {
+    channel_ = std::make_shared<FrameChannel>(config_.on_frame, config_.pull_capacity);
+    sink = channel_;
+  }
+  config_.stream.sender_latency = !is_replay();
+  // Recordings hold whole frames, only live messages are chunked
+  if (is_replay()) {
+    config_.stream.chunked = false;
+  }
+
+  router_ = std::make_shared<StreamRouter>(config_.stream, config_.workers, config_.decoders,
+                                           is_multi_stream(config_.topics), sink);
+  if (is_replay()) {
+    replay_source_ = std::make_shared<ReplaySource>(config_.replay_path, router_,
+                                                    config_.replay_rate, config_.replay_fps);
+  } else {
+    sub_ = std::make_shared<MqttSubscription>(config_.broker_addr, config_.broker_port,
+                                              config_.topics, router_, config_.mqtt);
+  }
+}
+
+ImgReceiver::~ImgReceiver() {
+  stop();
+}
+
+bool ImgReceiver::is_multi_stream(const std::vector<std::string> &topics) {
+  return topics.size() > 1 ||
+         (!topics.empty() && topics[0].find_first_of("+#") != std::string::npos);
+}
+
+bool ImgReceiver::open() {
+  return !replay_source_ || replay_source_->open();
+}
+
+void ImgReceiver::attach(EventLoop &loop) {
+  if (sub_) {
+    sub_->attach(loop);
+  }
+}
+
+bool ImgReceiver::start(std::function<void()> on_done) {
+  started_ = true;
+  router_->start();
+  if (replay_source_) {
+    replay_source_->start(std::move(on_done));
+    return true;
+  }
+  return sub_->init();
+}
+
+void ImgReceiver::stop() {
+  if (!started_ || stopped_) {
+    return;
+  }
+  stopped_ = true;
+
+  if (replay_source_) {
+    replay_source_->stop();
+    router_->drain();
+  }
+  // No more messages come in while the streams stop
+  if (sub_) {
+    sub_->stop();
+  }
+  router_->stop();
+  if (channel_) {
+    channel_->close();
+  }
+}
+
+bool ImgReceiver::pull(ReceivedFrame &frame, std::chrono::milliseconds timeout) {
+  return channel_ && channel_->pull(frame, timeout);
+}
+
+std::string ImgReceiver::stream_name(uint32_t stream) {
+  return channel_ ? channel_->stream_name(stream) : std::string();
+}
+
+void ImgReceiver::show_statistics() {
+  router_->show_statistics();
+  if (channel_) {
+    channel_->show_statistics();
+  }
+}
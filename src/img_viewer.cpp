@@ -1,171 +1,589 @@
+#include <signal.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 
 #include "cista.h"
 
 #include <atomic>
 #include <chrono>
-#include <condition_variable>
+#include <climits>
 #include <cstdint>
+#include <cstring>
 #include <memory.h>
 #include <memory>
-#include <mutex>
 #include <opencv2/core/hal/interface.h>
 #include <opencv2/core/types.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
 #include <thread>
+#include <vector>
 
 #include <opencv2/opencv.hpp>
 
+#include "include/bounded_msg_queue.hpp"
+#include "include/event_loop.hpp"
+#include "include/frame_decoder.hpp"
+#include "include/frame_display.hpp"
+#include "include/frame_recorder.hpp"
+#include "include/image_writer.hpp"
 #include "include/input_param_parser.hpp"
 #include "include/img_msg.hpp"
+#include "include/img_receiver.hpp"
+#include "include/metrics_exporter.hpp"
 #include "include/mqtt_subscription.hpp"
+#include "include/msg_deserializer.hpp"
 #include "include/msg_queue.hpp"
-
-// Exit flag
-std::atomic_bool g_request_exit{false};
-std::mutex g_main_thread_mutex;
-std::condition_variable g_main_thread_cond;
-
-std::atomic_uint32_t g_height = 0;
-std::atomic_uint32_t g_width = 0;
-
-std::mutex last_show_time_mutex;
-std::chrono::time_point<std::chrono::system_clock> last_show_time;
-
-static void signal_handler(int signal)
-{
-  g_request_exit = true;
-  g_main_thread_cond.notify_one();
+#include "include/pipeline_stats.hpp"
+#include "include/planar_convert.hpp"
+#include "include/replay_source.hpp"
+#include "include/thread_tuning.hpp"
+#include "include/video_file_writer.hpp"
+
+// "a,b" -> {"a", "b"}
+static std::vector<std::string> split_topics(const std::string &param) {
+  std::vector<std::string> topics;
+  size_t start = 0;
+  while (start <= param.size()) {
+    size_t end = param.find(',', start);
+    if (end == std::string::npos) {
+      end = param.size();
+    }
+    if (end > start) {
+      topics.push_back(param.substr(start, end - start));
+    }
+    start = end + 1;
+  }
+  return topics;
 }
 
-static void show_empty_window(uint32_t height = 300, uint32_t width = 350) {
-  cv::Mat empty_frame = cv::Mat::zeros(300, 350, CV_8UC3);
-  cv::putText(empty_frame, "Wait for BMP file", cv::Point(20, 150),
-              cv::FONT_HERSHEY_COMPLEX, 1, cv::Scalar(0, 255, 0), 1);
-  cv::imshow("Show received BMP file", empty_frame);
-  cv::waitKey(1);
+// An integer option within [min, max]
+static bool parse_int(const std::string &param, int64_t min, int64_t max, int64_t &value) {
+  try {
+    size_t end = 0;
+    value = std::stoll(param, &end);
+    return end == param.size() && value >= min && value <= max;
+  } catch (std::exception &) {
+    return false;
+  }
 }
 
-static void
-data_process(std::shared_ptr<MqttSubscription> sub,
-             std::shared_ptr<MsgQueue<std::vector<uint8_t>>> queue,
-             std::string output_path) {
-  std::printf("data_process thread start !!!\n");
-  sub->init();
-  show_empty_window();
-
-  bool save_bmp_files = !output_path.empty();
-  uint32_t recevied_frame_index = 0;
-
-  while(!g_request_exit) {
-    auto serialized_msg = queue->get_msg_from_queue();
-    if (serialized_msg.get() == nullptr) {
-      break;
-    }
-
-    auto deserialized_msg =
-        cista::deserialize<imx500_img_transport::img_msg>(*serialized_msg);
-
-    if (deserialized_msg->encoding == "rgb8") {
-      cv::Mat colors[4];
-      uint32_t pictureSize = deserialized_msg->height * deserialized_msg->width;
-
-      if (!g_height) {
-        g_height = deserialized_msg->height;
-        g_width = deserialized_msg->width;
-      }
-
-      colors[2] = cv::Mat(deserialized_msg->height,
-                          deserialized_msg->width, CV_8UC1,
-                          (reinterpret_cast<uint8_t *>(&deserialized_msg->data[0])));
-      colors[1] = cv::Mat(deserialized_msg->height,
-                          deserialized_msg->width, CV_8UC1,
-                          (reinterpret_cast<uint8_t *>(
-                               &deserialized_msg->data[0]) +
-                           pictureSize));
-      colors[0] = cv::Mat(deserialized_msg->height,
-                          deserialized_msg->width, CV_8UC1,
-                          (reinterpret_cast<uint8_t *>(
-                               &deserialized_msg->data[0]) +
-                           pictureSize * 2));
-      cv::Mat resizeWin;
-      uint8_t merge_num = imx500_img_transport::numChannels(deserialized_msg->encoding.str());
-      cv::merge(colors, merge_num, resizeWin);
-
-      //cv::Rect roi(cv::Point(0, 0), cv::Size(deserialized_msg->width, deserialized_msg->height));
-      //cv::imshow("Show received BMP file", resizeWin(roi));
-
-      if(save_bmp_files) {
-        std::string output_file = output_path + "/frame_" +
-                                  std::to_string(recevied_frame_index++) + ".bmp";
-        cv::imwrite(output_file, resizeWin);
-      }
-
-      {
-        std::lock_guard<std::mutex> lock(last_show_time_mutex);
-        last_show_time = std::chrono::system_clock::now();
-      }
-
-      cv::Mat resizeImg;
-      cv::resize(
-          resizeWin, resizeImg,
-          cv::Size(deserialized_msg->width + 50, deserialized_msg->height));
-
-      cv::imshow("Show received BMP file", resizeImg);
-
-      cv::waitKey(2);
-    } else {
-      std::cout << "Unsupported encoding " << deserialized_msg->encoding << " !!!" << std::endl;
-    }
-  }
-
-  std::printf("data_process thread exit !!!\n");
+// CPU time of the whole process per decoded frame, how often its threads
+// went to sleep and were woken up again, and how often they touched memory
+// not mapped in yet
+static void show_cpu_usage(StreamRouter &router,
+                           std::chrono::steady_clock::time_point start_time) {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return;
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+  double seconds = elapsed.count() > 0 ? elapsed.count() : 1;
+  double user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+  double system = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+
+  uint64_t frames = 0;
+  for (auto &stream : router.streams()) {
+    frames += stream->metrics().decoded;
+  }
+  std::printf("CPU: %.2f s user, %.2f s system (%.0f%% of a core), %.3f ms per frame "
+              "over %lu frames, %.0f context switches/s (%.0f voluntary), "
+              "%lu page faults (%lu major)\n",
+              user, system, (user + system) * 100 / seconds,
+              frames > 0 ? (user + system) * 1000 / frames : 0.0,
+              static_cast<unsigned long>(frames),
+              (usage.ru_nvcsw + usage.ru_nivcsw) / seconds, usage.ru_nvcsw / seconds,
+              static_cast<unsigned long>(usage.ru_minflt + usage.ru_majflt),
+              static_cast<unsigned long>(usage.ru_majflt));
 }
 
 int main(int argc, char ** argv)
 {
+  // Before any thread starts, so SIGINT and SIGTERM only reach the main
+  // loop below
+  EventLoop::block_signals({SIGINT, SIGTERM});
+
   auto parser = std::make_shared<InputParamParser>(argc, argv);
 
-  std::string mqtt_broker_ip = parser->get_broker_addr();
-  if (mqtt_broker_ip.empty()) {
-    std::cout << "Input command arguments \"-a\" error !" << std::endl;
+  // Replay mode reads recorded frames instead of connecting to a broker
+  std::string replay_path = parser->get_replay_path();
+  bool replay = !replay_path.empty();
+
+  std::string mqtt_broker_ip;
+  int32_t broker_port = 0;
+  std::vector<std::string> topics;
+  if (!replay) {
+    mqtt_broker_ip = parser->get_broker_addr();
+    if (mqtt_broker_ip.empty()) {
+      std::cout << "Input command arguments \"-a\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+
+    std::string mqtt_broker_port = parser->get_broker_port();
+    if (mqtt_broker_port.empty()) {
+      std::cout << "Input command arguments \"-p\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+
+    try {
+      broker_port = std::stoi(mqtt_broker_port, nullptr);
+    } catch (std::invalid_argument) {
+      std::cout << "Input command arguments \"-p\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+
+    topics = split_topics(parser->get_topic());
+    if (topics.empty()) {
+      std::cout << "Input command arguments \"-t\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  // How the subscription talks to the broker, the defaults keep the old
+  // behavior
+  MqttSubscriptionConfig mqtt_config;
+  int64_t value = 0;
+  std::string qos_param = parser->get_qos();
+  if (!qos_param.empty()) {
+    if (!parse_int(qos_param, 0, 2, value)) {
+      std::cout << "Input command arguments \"--qos\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+    mqtt_config.qos = static_cast<int>(value);
+  }
+  mqtt_config.mqtt5 = parser->use_mqtt5();
+  std::string receive_maximum_param = parser->get_receive_maximum();
+  if (!receive_maximum_param.empty()) {
+    if (!mqtt_config.mqtt5 || !parse_int(receive_maximum_param, 1, 65535, value)) {
+      std::cout << "Input command arguments \"--receive-max\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+    mqtt_config.receive_maximum = static_cast<uint16_t>(value);
+  }
+  std::string max_packet_param = parser->get_max_packet_size();
+  if (!max_packet_param.empty()) {
+    // The size field of an MQTT packet ends at 256 MB
+    if (!mqtt_config.mqtt5 || !parse_int(max_packet_param, 1, 256 * 1024, value)) {
+      std::cout << "Input command arguments \"--max-packet\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+    mqtt_config.max_packet_size = static_cast<uint32_t>(value * 1024);
+  }
+  mqtt_config.tcp_nodelay = parser->use_tcp_nodelay();
+  std::string receive_buffer_param = parser->get_receive_buffer();
+  if (!receive_buffer_param.empty()) {
+    if (!parse_int(receive_buffer_param, 1, 1024 * 1024, value)) {
+      std::cout << "Input command arguments \"--rcvbuf\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+    mqtt_config.receive_buffer = static_cast<int>(value * 1024);
+  }
+  std::string keepalive_param = parser->get_keepalive();
+  if (!keepalive_param.empty()) {
+    // mosquitto wants at least 5 s, MQTT at most 65535 s
+    if (!parse_int(keepalive_param, 5, 65535, value)) {
+      std::cout << "Input command arguments \"--keepalive\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+    mqtt_config.keepalive = static_cast<int>(value);
+  }
+  std::string loop_param = parser->get_mqtt_loop();
+  if (!loop_param.empty()) {
+    size_t colon = loop_param.find(':');
+    std::string loop = loop_param.substr(0, colon);
+    bool valid = loop == "start" || loop == "thread";
+    mqtt_config.loop_thread = loop == "thread";
+    if (valid && colon != std::string::npos) {
+      valid = mqtt_config.loop_thread &&
+              parse_int(loop_param.substr(colon + 1), 1, 99, value);
+      mqtt_config.loop_priority = static_cast<int>(value);
+    }
+    if (!valid) {
+      std::cout << "Input command arguments \"--mqtt-loop\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  // The main thread receives the messages and drives the display
+  bool reactor = parser->use_reactor();
+  if (reactor && !loop_param.empty()) {
+    std::cout << "Input command arguments \"--reactor\" and \"--mqtt-loop\" don't go together !"
+              << std::endl;
     parser->show_usage();
     return EXIT_FAILURE;
   }
 
-  std::string mqtt_broker_port = parser->get_broker_port();
-  if (mqtt_broker_port.empty()) {
-    std::cout << "Input command arguments \"-p\" error !" << std::endl;
+  ReplaySource::Rate replay_rate = ReplaySource::Rate::FAST;
+  double replay_fps = 0;
+  std::string rate_param = parser->get_replay_rate();
+  if (!rate_param.empty() &&
+      !ReplaySource::parse_rate(rate_param, replay_rate, replay_fps)) {
+    std::cout << "Input command arguments \"--rate\" error !" << std::endl;
     parser->show_usage();
     return EXIT_FAILURE;
   }
+  bool headless = parser->is_headless();
+
+  double display_fps = 60;
+  bool tiled = parser->use_tiled_display();
+  std::string display_fps_param = parser->get_display_fps();
+  if (!display_fps_param.empty()) {
+    try {
+      display_fps = std::stod(display_fps_param, nullptr);
+    } catch (std::exception &) {
+      display_fps = 0;
+    }
+    if (display_fps <= 0) {
+      std::cout << "Input command arguments \"--display-fps\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+  }
 
-  int32_t broker_port;
-  try {
-    broker_port = std::stoi(mqtt_broker_port, nullptr);
-  } catch (std::invalid_argument) {
-    std::cout << "Input command arguments \"-p\" error !" << std::endl;
+  int64_t stats_interval = 0;
+  std::string stats_interval_param = parser->get_stats_interval();
+  if (!stats_interval_param.empty()) {
+    try {
+      stats_interval = std::stoll(stats_interval_param, nullptr);
+    } catch (std::exception &) {
+      stats_interval = 0;
+    }
+    if (stats_interval <= 0) {
+      std::cout << "Input command arguments \"--stats-interval\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+  }
+  std::string stats_dump_path = parser->get_stats_dump_path();
+
+  MetricsConfig metrics_config;
+  metrics_config.path = parser->get_metrics_file();
+  std::string metrics_port_param = parser->get_metrics_port();
+  if (!metrics_port_param.empty()) {
+    int port = 0;
+    try {
+      port = std::stoi(metrics_port_param, nullptr);
+    } catch (std::exception &) {
+      port = 0;
+    }
+    if (port <= 0 || port > 65535) {
+      std::cout << "Input command arguments \"--metrics-port\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+    metrics_config.port = static_cast<uint16_t>(port);
+  }
+  std::string metrics_interval_param = parser->get_metrics_interval();
+  if (!metrics_interval_param.empty()) {
+    int64_t metrics_interval = 0;
+    try {
+      metrics_interval = std::stoll(metrics_interval_param, nullptr);
+    } catch (std::exception &) {
+      metrics_interval = 0;
+    }
+    if (metrics_interval <= 0) {
+      std::cout << "Input command arguments \"--metrics-interval\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+    metrics_config.interval = std::chrono::seconds(metrics_interval);
+  }
+  bool metrics = !metrics_config.path.empty() || metrics_config.port != 0;
+
+  PixelLayout pixel_layout = PixelLayout::PLANAR;
+  std::string layout_param = parser->get_pixel_layout();
+  if (!layout_param.empty() && !parse_pixel_layout(layout_param, pixel_layout)) {
+    std::cout << "Input command arguments \"--layout\" error !" << std::endl;
+    parser->show_usage();
+    return EXIT_FAILURE;
+  }
+
+  DeserializeMode deserialize_mode = DeserializeMode::FULL;
+  std::string verify_param = parser->get_deserialize_mode();
+  if (!verify_param.empty() && !parse_deserialize_mode(verify_param, deserialize_mode)) {
+    std::cout << "Input command arguments \"--verify\" error !" << std::endl;
     parser->show_usage();
     return EXIT_FAILURE;
   }
 
-  std::string topic = parser->get_topic();
-  if (topic.empty()) {
-    std::cout << "Input command arguments \"-t\" error !" << std::endl;
+  size_t workers = std::max(1u, std::thread::hardware_concurrency());
+  std::string workers_param = parser->get_workers();
+  if (!workers_param.empty()) {
+    // 0 dispatches the frames on the thread receiving them
+    int64_t value;
+    if (!parse_int(workers_param, 0, 1024, value)) {
+      std::cout << "Input command arguments \"--workers\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+    workers = static_cast<size_t>(value);
+  }
+
+  // Threads converting the frames, 0 leaves it to the workers
+  size_t decoders = std::max(1u, std::thread::hardware_concurrency());
+  std::string decoders_param = parser->get_decoders();
+  if (!decoders_param.empty()) {
+    int64_t value;
+    if (!parse_int(decoders_param, 0, 1024, value)) {
+      std::cout << "Input command arguments \"--decoders\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+    decoders = static_cast<size_t>(value);
+  }
+
+  // Cores and priorities per thread role, every thread applies its own
+  // when it starts
+  std::string sched_param = parser->get_sched();
+  if (!sched_param.empty() && !ThreadTuning::parse(sched_param)) {
+    std::cout << "Input command arguments \"--sched\" error !" << std::endl;
     parser->show_usage();
     return EXIT_FAILURE;
   }
+  bool lock_memory = parser->use_mlock();
+
+  uint64_t prefault_mb = 0;
+  uint32_t prefault_slabs = 8;
+  std::string prefault_param = parser->get_prefault();
+  if (!prefault_param.empty()) {
+    size_t colon = prefault_param.find(':');
+    bool valid = parse_int(prefault_param.substr(0, colon), 1, 4096, value);
+    prefault_mb = static_cast<uint64_t>(value);
+    if (valid && colon != std::string::npos) {
+      // The buffer pool of a stream keeps 16 at most
+      valid = parse_int(prefault_param.substr(colon + 1), 1, 16, value);
+      prefault_slabs = static_cast<uint32_t>(value);
+    }
+    if (!valid) {
+      std::cout << "Input command arguments \"--prefault\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+  }
 
   std::string output_path = parser->get_output_path();
 
+  // Without -q the queue is unbounded
+  bool bounded_queue = false;
+  OverflowPolicy queue_policy = OverflowPolicy::BLOCK;
+  size_t queue_capacity = 8;
+  std::string queue_param = parser->get_queue_policy();
+  if (!queue_param.empty()) {
+    auto pos = queue_param.find(':');
+    bool valid = parse_overflow_policy(queue_param.substr(0, pos), queue_policy);
+    if (valid && pos != std::string::npos) {
+      int64_t value = 0;
+      valid = parse_int(queue_param.substr(pos + 1), 1, 65536, value);
+      queue_capacity = static_cast<size_t>(value);
+    }
+    if (!valid) {
+      std::cout << "Input command arguments \"-q\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+    bounded_queue = true;
+  }
+
+  ImageWriterConfig writer_config;
+  writer_config.output_path = output_path;
+  // A video format writes video files instead of one image file per frame
+  VideoFileWriterConfig video_config;
+  bool video = false;
+  std::string format_param = parser->get_output_format();
+  if (!format_param.empty() &&
+      !ImageWriter::parse_format(format_param, writer_config.format,
+                                 writer_config.png_compression)) {
+    video = VideoFileWriter::parse_format(format_param, video_config.format,
+                                          video_config.jpeg_quality);
+    if (!video) {
+      std::cout << "Input command arguments \"-f\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::string writer_threads_param = parser->get_writer_threads();
+  if (!writer_threads_param.empty()) {
+    int64_t value = 0;
+    // A video file is written in order by one thread
+    if (!parse_int(writer_threads_param, 1, 256, value) || video) {
+      std::cout << "Input command arguments \"-w\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+    writer_config.threads = static_cast<size_t>(value);
+  }
+
+  std::string writer_policy_param = parser->get_writer_policy();
+  if (!writer_policy_param.empty()) {
+    auto pos = writer_policy_param.find(':');
+    std::string policy = writer_policy_param.substr(0, pos);
+    bool valid = policy == "block" || policy == "drop";
+    writer_config.drop_when_full = policy == "drop";
+    if (valid && pos != std::string::npos) {
+      int64_t value = 0;
+      valid = parse_int(writer_policy_param.substr(pos + 1), 1, 65536, value);
+      writer_config.queue_capacity = static_cast<size_t>(value);
+    }
+    if (!valid) {
+      std::cout << "Input command arguments \"-W\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  // The video options only go with a video format
+  std::string rotate_time_param = parser->get_rotate_time();
+  if (!rotate_time_param.empty()) {
+    int64_t value;
+    if (!video || !parse_int(rotate_time_param, 1, 7 * 24 * 3600, value)) {
+      std::cout << "Input command arguments \"--rotate-time\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+    video_config.rotate_duration = std::chrono::seconds(value);
+  }
+  std::string rotate_size_param = parser->get_rotate_size();
+  if (!rotate_size_param.empty()) {
+    int64_t value;
+    if (!video || !parse_int(rotate_size_param, 1, 1024 * 1024, value)) {
+      std::cout << "Input command arguments \"--rotate-size\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+    video_config.rotate_size = static_cast<uint64_t>(value) * 1024 * 1024;
+  }
+  std::string video_fps_param = parser->get_video_fps();
+  if (!video_fps_param.empty()) {
+    bool valid = video;
+    try {
+      video_config.fps = std::stod(video_fps_param, nullptr);
+    } catch (std::exception &) {
+      valid = false;
+    }
+    if (!valid || !(video_config.fps >= 1 && video_config.fps <= 1000)) {
+      std::cout << "Input command arguments \"--video-fps\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+  }
+  if (video) {
+    video_config.output_path = output_path;
+    video_config.queue_capacity = writer_config.queue_capacity;
+    video_config.drop_when_full = writer_config.drop_when_full;
+    writer_config.output_path.clear();
+  }
+
+  std::string record_path = parser->get_record_path();
+  uint64_t segment_size_mb = 1024;
+  std::string segment_size_param = parser->get_segment_size();
+  if (!segment_size_param.empty()) {
+    int64_t value;
+    if (!parse_int(segment_size_param, 1, 1024 * 1024, value)) {
+      std::cout << "Input command arguments \"-s\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+    segment_size_mb = static_cast<uint64_t>(value);
+  }
+  bool direct_io = parser->use_direct_io();
+
+  // --shm NAME[:SLOTS], shm_open() names start with a slash
+  std::string shm_name = parser->get_shm();
+  uint32_t shm_slots = 8;
+  if (!shm_name.empty()) {
+    size_t colon = shm_name.find(':');
+    bool valid = true;
+    if (colon != std::string::npos) {
+      int64_t value = 0;
+      valid = parse_int(shm_name.substr(colon + 1), 1, 1024, value);
+      shm_slots = static_cast<uint32_t>(value);
+      shm_name.resize(colon);
+    }
+    if (!shm_name.empty() && shm_name[0] != '/') {
+      shm_name.insert(0, "/");
+    }
+    // shm_open() takes NAME_MAX characters after the slash, with several
+    // streams the topic is appended to that
+    if (!valid || shm_name.size() < 2 || shm_name.size() - 1 > NAME_MAX ||
+        shm_name.find('/', 1) != std::string::npos) {
+      std::cout << "Input command arguments \"--shm\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Recordings hold whole frames, only live messages are chunked
+  bool chunked = parser->use_chunks() && !replay;
+  uint64_t chunk_timeout_ms = 1000;
+  std::string chunk_timeout_param = parser->get_chunk_timeout();
+  if (!chunk_timeout_param.empty()) {
+    int64_t value;
+    if (!parse_int(chunk_timeout_param, 1, 3600 * 1000, value)) {
+      std::cout << "Input command arguments \"--chunk-timeout\" error !" << std::endl;
+      parser->show_usage();
+      return EXIT_FAILURE;
+    }
+    chunk_timeout_ms = static_cast<uint64_t>(value);
+  }
+
   std::cout << "Input parameter:" << std::endl;
-  std::cout << "        Broker IP: " << mqtt_broker_ip << std::endl;
-  std::cout << "      Broker port: " << broker_port << std::endl;
-  std::cout << "            Topic: " << topic << std::endl;
+  if (replay) {
+    std::cout << "           Replay: " << replay_path << " ("
+              << (rate_param.empty() ? "fast" : rate_param) << ")" << std::endl;
+  } else {
+    std::cout << "        Broker IP: " << mqtt_broker_ip << std::endl;
+    std::cout << "      Broker port: " << broker_port << std::endl;
+    for (auto &topic : topics) {
+      std::cout << "            Topic: " << topic << std::endl;
+    }
+    std::cout << "             MQTT: " << MqttSubscription::describe(mqtt_config) << std::endl;
+    if (chunked) {
+      std::cout << "           Chunks: frames missing chunks after "
+                << chunk_timeout_ms << " ms are discarded" << std::endl;
+    }
+  }
+  if (headless) {
+    std::cout << "         Headless: no window" << std::endl;
+  } else {
+    std::cout << "          Display: up to " << display_fps << " fps"
+              << (tiled ? ", tiled" : "") << std::endl;
+  }
 
+  if (!output_path.empty() && video) {
+    std::cout << "     Video output: " << output_path << " ("
+              << VideoFileWriter::format_name(video_config.format);
+    if (video_config.format == VideoFormat::MJPEG) {
+      std::cout << ", quality " << video_config.jpeg_quality;
+    }
+    std::cout << ", " << video_config.fps << " fps";
+    if (video_config.rotate_duration.count() > 0) {
+      std::cout << ", new file every " << video_config.rotate_duration.count() << " s";
+    }
+    if (video_config.rotate_size > 0) {
+      std::cout << ", new file every " << video_config.rotate_size / (1024 * 1024) << " MB";
+    }
+    std::cout << ", " << (video_config.drop_when_full ? "drop" : "block")
+              << " when " << video_config.queue_capacity
+              << " frames are queued)" << std::endl;
+  } else if (!output_path.empty()) {
+    std::cout << "      File output: " << output_path << " ("
+              << ImageWriter::format_name(writer_config.format) << ", "
+              << writer_config.threads << " threads, "
+              << (writer_config.drop_when_full ? "drop" : "block")
+              << " when " << writer_config.queue_capacity
+              << " frames are queued)" << std::endl;
+  }
   if (!output_path.empty()) {
-    std::cout << "  BMP file output: " << output_path << std::endl;
 
     struct stat sb;
     if (stat(output_path.c_str(), &sb) != 0 || (sb.st_mode & S_IFDIR) ==0) {
@@ -174,51 +592,191 @@ int main(int argc, char ** argv)
     }
   }
 
-  auto msg_queue = std::make_shared<MsgQueue<std::vector<uint8_t>>>();
+  if (!record_path.empty()) {
+    std::cout << "        Recording: " << record_path << " ("
+              << segment_size_mb << " MB segments"
+              << (direct_io ? ", O_DIRECT" : "") << ")" << std::endl;
 
-  auto sub =
-      std::make_shared<MqttSubscription>(mqtt_broker_ip, broker_port, topic, msg_queue);
+    struct stat sb;
+    if (stat(record_path.c_str(), &sb) != 0 || (sb.st_mode & S_IFDIR) ==0) {
+      std::cout << "Record path \"" << record_path << "\" doesn't exist !!!" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
 
-  auto deserialized_data_thread =
-      std::make_shared<std::thread>(data_process, sub, msg_queue, output_path);
+  if (!shm_name.empty()) {
+    std::cout << "    Shared memory: " << shm_name << " (" << shm_slots
+              << " slots per stream)" << std::endl;
+  }
 
-  auto updated_window = std::make_shared<std::thread>([](){
-    int64_t save_timestamp = 0;
-    while (!g_request_exit) {
+  std::cout << "     Pixel layout: " << pixel_layout_name(pixel_layout) << std::endl;
+  std::cout << "    Deserializing: " << deserialize_mode_name(deserialize_mode) << std::endl;
+  if (workers > 0) {
+    std::cout << "          Workers: " << workers << std::endl;
+  } else {
+    std::cout << "          Workers: none, the receiving thread dispatches the frames"
+              << std::endl;
+  }
+  if (reactor) {
+    std::cout << "       Event loop: " << (replay ? "" : "MQTT, ")
+              << (headless ? "" : "display, ") << "signals on the main thread" << std::endl;
+  }
+  std::cout << "         Decoders: " << decoders << std::endl;
+  std::cout << "    Thread tuning: " << ThreadTuning::describe() << std::endl;
+  // Before the threads start, so their stacks are locked too
+  if (lock_memory && ThreadTuning::lock_memory()) {
+    std::cout << "           Memory: locked" << std::endl;
+  }
+  if (prefault_mb > 0) {
+    std::cout << " Prefault buffers: " << prefault_slabs << " of " << prefault_mb
+              << " MB per stream" << std::endl;
+  }
+  std::printf("Planar to BGR conversion uses %s\n",
+              PlanarToBgrScaler::isa_name(PlanarToBgrScaler().isa()));
 
-      auto now = std::chrono::system_clock::now();
+  if (stats_interval > 0) {
+    std::cout << "       Statistics: every " << stats_interval << " s" << std::endl;
+  }
+  if (!stats_dump_path.empty()) {
+    std::cout << "  Statistics dump: " << stats_dump_path << std::endl;
+  }
+  if (metrics) {
+    std::cout << "          Metrics: every " << metrics_config.interval.count() << " s";
+    if (!metrics_config.path.empty()) {
+      std::cout << " to " << metrics_config.path;
+    }
+    if (metrics_config.port != 0) {
+      std::cout << (metrics_config.path.empty() ? "" : " and")
+                << " on http://127.0.0.1:" << metrics_config.port << "/metrics";
+    }
+    std::cout << std::endl;
+  }
 
-      std::chrono::duration<double> diff;
-      {
-        std::lock_guard<std::mutex> lock(last_show_time_mutex);
-        diff = now - last_show_time;
-      }
+  if (bounded_queue) {
+    std::cout << "            Queue: " << overflow_policy_name(queue_policy)
+              << ", capacity " << queue_capacity << std::endl;
+  }
 
-      if (diff > std::chrono::seconds(1)) {
-        show_empty_window();
-      }
-      std::this_thread::sleep_for(std::chrono::microseconds(300));
-    }
-  });
+  ImgReceiverConfig receiver_config;
+  receiver_config.broker_addr = mqtt_broker_ip;
+  receiver_config.broker_port = broker_port;
+  receiver_config.topics = topics;
+  receiver_config.mqtt = mqtt_config;
+  receiver_config.replay_path = replay_path;
+  receiver_config.replay_rate = replay_rate;
+  receiver_config.replay_fps = replay_fps;
+  receiver_config.workers = workers;
+  receiver_config.decoders = decoders;
+
+  StreamConfig &stream_config = receiver_config.stream;
+  stream_config.bounded_queue = bounded_queue;
+  stream_config.queue_policy = queue_policy;
+  stream_config.queue_capacity = queue_capacity;
+  stream_config.layout = pixel_layout;
+  stream_config.deserialize_mode = deserialize_mode;
+  stream_config.writer = writer_config;
+  stream_config.video = video_config;
+  stream_config.record_path = record_path;
+  stream_config.segment_size = segment_size_mb * 1024 * 1024;
+  stream_config.direct_io = direct_io;
+  stream_config.shm_name = shm_name;
+  stream_config.shm_slots = shm_slots;
+  stream_config.chunked = chunked;
+  stream_config.chunk_timeout = std::chrono::milliseconds(chunk_timeout_ms);
+  stream_config.prefault_size = prefault_mb * 1024 * 1024;
+  stream_config.prefault_slabs = prefault_slabs;
+
+  // Waits for the signals, with --reactor it also receives the messages and
+  // renders the display
+  EventLoop loop;
+  if (!loop.is_valid() ||
+      !loop.add_signals({SIGINT, SIGTERM}, [&loop](int signal) {
+        std::printf("\n%s, exiting\n", strsignal(signal));
+        loop.stop();
+      })) {
+    std::cout << "Can't set up the event loop !!!" << std::endl;
+    return EXIT_FAILURE;
+  }
 
-  // main thread enter wait status
-  if (!g_request_exit) {
-    std::unique_lock<std::mutex> lock(g_main_thread_mutex);
-    g_main_thread_cond.wait(lock, []{
-      return g_request_exit == true;
-    });
+  // The receiver does everything but the window
+  std::shared_ptr<FrameDisplay> display;
+  if (!headless) {
+    display = std::make_shared<FrameDisplay>(display_fps, tiled,
+                                             ImgReceiver::is_multi_stream(topics));
+  }
+  ImgReceiver receiver(receiver_config, display);
+  if (!receiver.open()) {
+    std::cout << "No frames to replay in \"" << replay_path << "\" !!!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto router = receiver.router();
+  auto sub = receiver.subscription();
+
+  std::shared_ptr<MetricsExporter> exporter;
+  if (metrics) {
+    exporter = std::make_shared<MetricsExporter>(router, metrics_config);
+    if (sub) {
+      exporter->add_metric("img_viewer_mqtt_reconnects_total", "counter",
+                           "Connections to the broker after the first one",
+                           [sub] { return static_cast<double>(sub->reconnect_count()); });
+      exporter->add_metric("img_viewer_mqtt_connected", "gauge",
+                           "1 while connected to the broker",
+                           [sub] { return sub->is_connect_broker() ? 1.0 : 0.0; });
+    }
+    if (!exporter->start()) {
+      return EXIT_FAILURE;
+    }
   }
-  msg_queue->wakeup_for_exit();
 
-  if (deserialized_data_thread->joinable()) {
-    deserialized_data_thread->joinable();
+  if (display && reactor) {
+    if (!display->attach(loop)) {
+      std::cout << "Can't attach the display to the event loop !!!" << std::endl;
+      return EXIT_FAILURE;
+    }
+  } else if (display) {
+    display->start();
+  }
+  if (reactor) {
+    receiver.attach(loop);
+  }
+  auto start_time = std::chrono::steady_clock::now();
+  // A replay ends after the last frame, or on a signal
+  bool connected = receiver.start([&loop] { loop.stop(); });
+  if (stats_interval > 0) {
+    router->start_reporting(std::chrono::seconds(stats_interval));
+  }
+  if (connected) {
+    loop.run();
+  } else {
+    std::cout << "Can't connect to the broker !!!" << std::endl;
   }
 
-  if(updated_window->joinable()) {
-    updated_window->join();
+  // Replays decode every frame queued first
+  receiver.stop();
+  if (display) {
+    display->stop();
+    cv::destroyAllWindows();
+  }
+  // The file ends with the final counts
+  if (exporter) {
+    exporter->stop();
   }
 
-  cv::destroyAllWindows();
+  receiver.show_statistics();
+  if (display) {
+    display->show_statistics();
+  }
+  if (reactor) {
+    loop.show_statistics();
+  }
+  ThreadTuning::show_statistics();
+  show_cpu_usage(*router, start_time);
+  if (exporter) {
+    exporter->show_statistics();
+  }
+  if (!stats_dump_path.empty()) {
+    router->dump_statistics(stats_dump_path);
+  }
 
-  return 0;
+  return connected ? 0 : EXIT_FAILURE;
 }
\ No newline at end of file
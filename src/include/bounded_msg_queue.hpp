@@ -0,0 +1,324 @@
+#ifndef BOUNDED_MSG_QUEUE_HPP__
+#define BOUNDED_MSG_QUEUE_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "msg_queue.hpp"
+
+// What add_msg_to_queue() does when the queue is full
+enum class OverflowPolicy {
+  BLOCK,       // wait until the consumer takes a message
+  DROP_OLDEST, // discard the oldest queued message
+  DROP_NEWEST, // discard the message being added
+  LATEST_ONLY  // one slot mailbox, a new message replaces the queued one
+};
+
+static inline bool parse_overflow_policy(const std::string &name,
+                                         OverflowPolicy &policy)
+{
+  if (name == "block") {
+    policy = OverflowPolicy::BLOCK;
+  } else if (name == "drop-oldest") {
+    policy = OverflowPolicy::DROP_OLDEST;
+  } else if (name == "drop-newest") {
+    policy = OverflowPolicy::DROP_NEWEST;
+  } else if (name == "latest") {
+    policy = OverflowPolicy::LATEST_ONLY;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static inline const char *overflow_policy_name(OverflowPolicy policy)
+{
+  switch (policy) {
+  case OverflowPolicy::BLOCK:
+    return "block";
+  case OverflowPolicy::DROP_OLDEST:
+    return "drop-oldest";
+  case OverflowPolicy::DROP_NEWEST:
+    return "drop-newest";
+  case OverflowPolicy::LATEST_ONLY:
+    return "latest";
+  }
+  return "unknown";
+}
+
+// Bounded single producer / single consumer ring buffer.
+//
+// Every slot carries a sequence number, so pushing and popping never take a
+// lock. The producer may also pop (to drop the oldest message), so the head is
+// advanced with a CAS. The only mutex is used to park a consumer on an empty
+// queue (or a producer on a full queue with the BLOCK policy), and is only
+// touched when the other side is really waiting.
+template<class MSG_TYPE>
+class BoundedMsgQueue final : public MsgQueueBase<MSG_TYPE> {
+public:
+  BoundedMsgQueue(size_t capacity, OverflowPolicy policy)
+    : policy_(policy),
+      capacity_(policy == OverflowPolicy::LATEST_ONLY ? 1 : std::max<size_t>(capacity, 1)),
+      ring_size_(std::max<size_t>(capacity_, 2)),
+      slots_(ring_size_)
+  {
+    for (size_t i = 0; i < ring_size_; ++i) {
+      slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  BoundedMsgQueue(const BoundedMsgQueue &) = delete;
+  BoundedMsgQueue &operator=(const BoundedMsgQueue &) = delete;
+
+  void add_msg_to_queue(std::shared_ptr<MSG_TYPE> msg) override
+  {
+    pushed_count_.fetch_add(1, std::memory_order_relaxed);
+
+    while (!try_push(msg)) {
+      if (exit_) {
+        return;
+      }
+
+      switch (policy_) {
+      case OverflowPolicy::BLOCK:
+        blocked_count_.fetch_add(1, std::memory_order_relaxed);
+        wait_not_full();
+        break;
+      case OverflowPolicy::DROP_NEWEST:
+        dropped_newest_count_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      case OverflowPolicy::DROP_OLDEST:
+      case OverflowPolicy::LATEST_ONLY: {
+        std::shared_ptr<MSG_TYPE> oldest;
+        if (try_pop(oldest)) {
+          auto &counter = policy_ == OverflowPolicy::DROP_OLDEST ?
+                          dropped_oldest_count_ : replaced_count_;
+          counter.fetch_add(1, std::memory_order_relaxed);
+        } else {
+          // The consumer is just taking the slot we need
+          std::this_thread::yield();
+        }
+        break;
+      }
+      }
+    }
+
+    wakeup(consumer_waiting_, not_empty_cond_);
+  }
+
+  std::shared_ptr<MSG_TYPE> get_msg_from_queue() override
+  {
+    std::shared_ptr<MSG_TYPE> msg;
+    while (!try_pop(msg)) {
+      if (exit_) {
+        return std::shared_ptr<MSG_TYPE>();
+      }
+      wait_not_empty();
+    }
+
+    if (policy_ == OverflowPolicy::BLOCK) {
+      wakeup(producer_waiting_, not_full_cond_);
+    }
+    return msg;
+  }
+
+  std::shared_ptr<MSG_TYPE> try_get_msg_from_queue() override
+  {
+    std::shared_ptr<MSG_TYPE> msg;
+    if (try_pop(msg) && policy_ == OverflowPolicy::BLOCK) {
+      wakeup(producer_waiting_, not_full_cond_);
+    }
+    return msg;
+  }
+
+  void wakeup_for_exit() override
+  {
+    exit_ = true;
+    {
+      std::lock_guard<std::mutex> lock(wait_mutex_);
+    }
+    not_empty_cond_.notify_all();
+    not_full_cond_.notify_all();
+  }
+
+  void clean_queue() override
+  {
+    std::shared_ptr<MSG_TYPE> msg;
+    while (try_pop(msg)) {
+      msg.reset();
+    }
+    wakeup(producer_waiting_, not_full_cond_);
+  }
+
+  bool is_empty() override
+  {
+    size_t pos = head_.load(std::memory_order_acquire);
+    return slots_[pos % ring_size_].seq.load(std::memory_order_acquire) != pos + 1;
+  }
+
+  size_t capacity() const { return capacity_; }
+  OverflowPolicy policy() const { return policy_; }
+
+  uint64_t pushed_count() const { return pushed_count_; }
+  uint64_t popped_count() const { return popped_count_; }
+  uint64_t dropped_oldest_count() const { return dropped_oldest_count_; }
+  uint64_t dropped_newest_count() const { return dropped_newest_count_; }
+  uint64_t replaced_count() const { return replaced_count_; }
+  uint64_t blocked_count() const { return blocked_count_; }
+
+  uint64_t dropped_count() const override
+  {
+    return dropped_oldest_count_ + dropped_newest_count_ + replaced_count_;
+  }
+
+  // Only the producer knows the tail, so this is taken from the counters. A
+  // producer blocked on a full queue already counted its message.
+  size_t size() override
+  {
+    uint64_t pushed = pushed_count_.load(std::memory_order_relaxed);
+    uint64_t removed = popped_count_.load(std::memory_order_relaxed) +
+                       dropped_newest_count_.load(std::memory_order_relaxed);
+    return pushed > removed ? std::min<size_t>(pushed - removed, capacity_) : 0;
+  }
+
+  size_t peak_size() const override { return peak_size_.load(std::memory_order_relaxed); }
+
+  void show_statistics() override
+  {
+    std::printf("Queue (%s, capacity %lu): pushed %lu, popped %lu, "
+                "dropped oldest %lu, dropped newest %lu, replaced %lu, "
+                "producer blocked %lu, peak %lu queued\n",
+                overflow_policy_name(policy_),
+                static_cast<unsigned long>(capacity_),
+                static_cast<unsigned long>(pushed_count_),
+                static_cast<unsigned long>(popped_count_),
+                static_cast<unsigned long>(dropped_oldest_count_),
+                static_cast<unsigned long>(dropped_newest_count_),
+                static_cast<unsigned long>(replaced_count_),
+                static_cast<unsigned long>(blocked_count_),
+                static_cast<unsigned long>(peak_size_.load()));
+  }
+
+private:
+  struct Slot {
+    std::atomic<size_t> seq{0};
+    std::shared_ptr<MSG_TYPE> msg;
+  };
+
+  const OverflowPolicy policy_;
+  const size_t capacity_;
+  // The sequence numbers can't tell a full slot from a free one with a
+  // single slot, so the LATEST_ONLY mailbox uses two and caps the occupancy.
+  const size_t ring_size_;
+  std::vector<Slot> slots_;
+
+  // Producer and consumer positions live on their own cache lines
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) size_t tail_{0};
+
+  alignas(64) std::atomic_bool exit_{false};
+  std::atomic_bool consumer_waiting_{false};
+  std::atomic_bool producer_waiting_{false};
+  std::mutex wait_mutex_;
+  std::condition_variable not_empty_cond_;
+  std::condition_variable not_full_cond_;
+
+  std::atomic_uint64_t pushed_count_{0};
+  std::atomic_uint64_t popped_count_{0};
+  std::atomic_uint64_t dropped_oldest_count_{0};
+  std::atomic_uint64_t dropped_newest_count_{0};
+  std::atomic_uint64_t replaced_count_{0};
+  std::atomic_uint64_t blocked_count_{0};
+  std::atomic<size_t> peak_size_{0};
+
+  // Only called by the producer. msg is left untouched on failure.
+  bool try_push(std::shared_ptr<MSG_TYPE> &msg)
+  {
+    Slot &slot = slots_[tail_ % ring_size_];
+    if (slot.seq.load(std::memory_order_acquire) != tail_ ||
+        tail_ - head_.load(std::memory_order_acquire) >= capacity_) {
+      return false;
+    }
+
+    slot.msg = std::move(msg);
+    slot.seq.store(tail_ + 1, std::memory_order_release);
+    tail_++;
+
+    size_t size = tail_ - head_.load(std::memory_order_relaxed);
+    if (size > peak_size_.load(std::memory_order_relaxed)) {
+      peak_size_.store(size, std::memory_order_relaxed);
+    }
+    return true;
+  }
+
+  // Called by the consumer, and by the producer when dropping the oldest
+  bool try_pop(std::shared_ptr<MSG_TYPE> &msg)
+  {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+      slot = &slots_[pos % ring_size_];
+      size_t seq = slot->seq.load(std::memory_order_acquire);
+      if (seq == pos + 1) {
+        if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (seq == pos) {
+        // The slot wasn't filled yet, so the queue is empty
+        return false;
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+
+    msg = std::move(slot->msg);
+    slot->seq.store(pos + ring_size_, std::memory_order_release);
+    popped_count_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  void wait_not_empty()
+  {
+    std::unique_lock<std::mutex> lock(wait_mutex_);
+    consumer_waiting_.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    not_empty_cond_.wait(lock, [this]{
+      return (!is_empty() || exit_);
+    });
+    consumer_waiting_.store(false, std::memory_order_relaxed);
+  }
+
+  void wait_not_full()
+  {
+    std::unique_lock<std::mutex> lock(wait_mutex_);
+    producer_waiting_.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    not_full_cond_.wait(lock, [this]{
+      return (tail_ - head_.load(std::memory_order_acquire) < capacity_ || exit_);
+    });
+    producer_waiting_.store(false, std::memory_order_relaxed);
+  }
+
+  void wakeup(std::atomic_bool &waiting, std::condition_variable &cond)
+  {
+    // Pairs with the fence in wait_not_empty()/wait_not_full(). Either the
+    // waiter sees the new state, or we see that it is waiting.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting.load(std::memory_order_relaxed)) {
+      {
+        std::lock_guard<std::mutex> lock(wait_mutex_);
+      }
+      cond.notify_one();
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef BUFFER_POOL_HPP__
+#define BUFFER_POOL_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// A page aligned slab which holds one serialized message.
+// It exposes the part of the std::vector interface cista::deserialize needs,
+// so the message can be deserialized in place.
+class FrameBuffer final {
+public:
+  explicit FrameBuffer(size_t capacity);
+  ~FrameBuffer();
+
+  FrameBuffer(const FrameBuffer &) = delete;
+  FrameBuffer &operator=(const FrameBuffer &) = delete;
+
+  uint8_t *data() { return data_; }
+  const uint8_t *data() const { return data_; }
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+
+  uint8_t &operator[](size_t pos) { return data_[pos]; }
+  const uint8_t &operator[](size_t pos) const { return data_[pos]; }
+
+  // Touch every page, so the first frame copied in doesn't page fault
+  void prefault();
+
+  // Copy len bytes from src into this slab. len must not exceed capacity().
+  void assign(const void *src, size_t len);
+
+  // For a frame filled piecewise by write(). len must not exceed capacity().
+  void resize(size_t len) { size_ = len; }
+  // offset + len must not exceed size()
+  void write(size_t offset, const void *src, size_t len);
+
+  // steady_clock time at which the payload was received
+  int64_t receive_time_ns() const { return receive_time_ns_; }
+  void set_receive_time_ns(int64_t time_ns) { receive_time_ns_ = time_ns; }
+
+private:
+  uint8_t *data_{nullptr};
+  size_t capacity_{0};
+  size_t size_{0};
+  int64_t receive_time_ns_{0};
+};
+
+// Recycles fixed-size FrameBuffer slabs between the MQTT network thread and
+// the consumers.
+// The slab size is taken from the first frame and the pool is only rebuilt if
+// a bigger frame arrives. A slab goes back to the pool once every consumer
+// has dropped its reference, so the steady state doesn't allocate.
+class BufferPool final {
+public:
+  explicit BufferPool(size_t max_slabs = 16);
+
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+
+  // Get a slab and copy the payload into it.
+  std::shared_ptr<FrameBuffer> acquire(const void *payload, size_t len);
+
+  // Get a slab of len bytes to be filled with FrameBuffer::write()
+  std::shared_ptr<FrameBuffer> allocate(size_t len);
+  // Allocate count slabs of len bytes with their pages faulted in, before
+  // the first frame arrives. Frames up to len bytes then use them.
+  void prefault(size_t len, size_t count);
+
+  // Count bytes written into a slab from allocate()
+  void add_copy_bytes(size_t len) { copy_bytes_ += len; }
+
+  size_t slab_size();
+  uint64_t frame_count() const { return frame_count_; }
+  uint64_t allocation_count() const { return allocation_count_; }
+  uint64_t copy_bytes() const { return copy_bytes_; }
+
+  void show_statistics();
+
+private:
+  std::mutex mutex_;
+  size_t max_slabs_;
+  size_t slab_size_{0};
+  std::vector<std::shared_ptr<FrameBuffer>> slabs_;
+
+  std::atomic_uint64_t frame_count_{0};
+  std::atomic_uint64_t allocation_count_{0};
+  std::atomic_uint64_t copy_bytes_{0};
+
+  std::shared_ptr<FrameBuffer> get_free_slab(size_t len);
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef CHUNK_ASSEMBLER_HPP__
+#define CHUNK_ASSEMBLER_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "buffer_pool.hpp"
+#include "chunk_format.hpp"
+
+// Puts the chunks of a stream (see chunk_format.hpp) back together.
+//
+// The first chunk of a frame takes a slab of the whole frame size from the
+// buffer pool, every chunk is copied straight to its offset in it. The frame
+// is handed on once its last chunk arrived. Frames whose chunks stop
+// arriving are discarded after the timeout, or when more than max_partial
+// frames are incomplete at once. Chunks of a frame which was handed on or
+// discarded less than the timeout ago are late and ignored, so a redelivered
+// chunk doesn't start the frame over.
+class ChunkAssembler final {
+public:
+  ChunkAssembler(std::shared_ptr<BufferPool> buffer_pool,
+                 std::chrono::milliseconds timeout, size_t max_partial = 8);
+
+  ChunkAssembler(const ChunkAssembler &) = delete;
+  ChunkAssembler &operator=(const ChunkAssembler &) = delete;
+
+  // Returns the frame once chunk completes it, otherwise nullptr.
+  // assembly_ns is set to the time from its first chunk until now.
+  std::shared_ptr<FrameBuffer> add(const void *chunk, size_t len, int64_t *assembly_ns);
+
+  uint64_t chunk_count() const { return chunk_count_; }
+  uint64_t assembled_count() const { return assembled_count_; }
+  // Frames discarded with chunks missing
+  uint64_t incomplete_count() const { return incomplete_count_; }
+  uint64_t duplicate_count() const { return duplicate_count_; }
+  uint64_t late_count() const { return late_count_; }
+  uint64_t invalid_count() const { return invalid_count_; }
+
+  void show_statistics();
+
+private:
+  struct PartialFrame {
+    std::shared_ptr<FrameBuffer> buffer;
+    uint32_t count{0};
+    uint32_t received{0};
+    std::vector<bool> chunks;
+    int64_t first_chunk_ns{0};
+  };
+
+  std::shared_ptr<BufferPool> buffer_pool_;
+  int64_t timeout_ns_;
+  size_t max_partial_;
+
+  std::mutex mutex_;
+  std::map<uint32_t, PartialFrame> partial_;  // by frame_id
+  // frame_id and time of the frames finished within the timeout, oldest first
+  std::deque<std::pair<uint32_t, int64_t>> finished_;
+
+  std::atomic_uint64_t chunk_count_{0};
+  std::atomic_uint64_t assembled_count_{0};
+  std::atomic_uint64_t incomplete_count_{0};
+  std::atomic_uint64_t duplicate_count_{0};
+  std::atomic_uint64_t late_count_{0};
+  std::atomic_uint64_t invalid_count_{0};
+
+  void expire(int64_t now);
+  void finish(uint32_t frame_id, int64_t now);
+  bool is_finished(uint32_t frame_id) const;
+};
+
+#endif
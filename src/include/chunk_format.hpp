@@ -0,0 +1,37 @@
+#ifndef CHUNK_FORMAT_HPP__
+#define CHUNK_FORMAT_HPP__
+
+#include <cstdint>
+
+// A serialized img_msg can be sent as several MQTT messages (chunks), so the
+// broker never holds a multi-megabyte message and a QoS 1 retransmit only
+// repeats one chunk. Every chunk is a ChunkHeader followed by the bytes
+// [offset, offset + chunk length) of the serialized frame. The chunks of a
+// frame share its frame_id and may arrive in any order.
+//
+// A frame is split evenly: chunk index starts at index * chunk_stride() and
+// every chunk but the last holds chunk_stride() bytes. The receiver rejects
+// chunks which don't, so they can neither overlap nor leave a gap.
+
+constexpr char kChunkMagic[4] = {'I', 'M', 'C', 'K'};
+
+// The receiver rejects frames split any finer
+constexpr uint32_t kMaxChunkCount = 1 << 16;
+
+struct ChunkHeader {
+  char magic[4];
+  uint32_t frame_id;    // counts up per frame, wraps around
+  uint32_t index;       // 0 to count - 1
+  uint32_t count;       // chunks of the frame
+  uint64_t frame_size;  // of the whole serialized frame
+  uint64_t offset;      // of this chunk in the frame
+};
+
+static_assert(sizeof(ChunkHeader) == 32, "ChunkHeader is a wire format");
+
+// Bytes of every chunk but the last
+static inline uint64_t chunk_stride(uint64_t frame_size, uint32_t count) {
+  return (frame_size + count - 1) / count;
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef DECODE_POOL_HPP__
+#define DECODE_POOL_HPP__
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads that deserialize, decode and convert the frames of all streams.
+//
+// A single stream of large frames needs more than one core, so several of
+// its frames (or row stripes of one frame) are converted in parallel. The
+// jobs finish in any order, the streams put their frames back in order.
+class DecodePool final {
+public:
+  explicit DecodePool(size_t threads);
+  ~DecodePool();
+
+  DecodePool(const DecodePool &) = delete;
+  DecodePool &operator=(const DecodePool &) = delete;
+
+  // Returns false after stop(), the job is not run then
+  bool submit(std::function<void()> job);
+
+  // Wait until every submitted job has finished
+  void drain();
+
+  // Run the jobs still queued and stop the threads
+  void stop();
+
+  size_t thread_count() const { return threads_.size(); }
+  size_t peak_backlog();
+
+private:
+  std::mutex mutex_;
+  std::condition_variable job_cond_;
+  std::condition_variable idle_cond_;
+  std::deque<std::function<void()>> jobs_;
+  // Queued plus running jobs
+  size_t active_count_{0};
+  size_t peak_backlog_{0};
+  bool stop_{false};
+  std::vector<std::thread> threads_;
+
+  void worker();
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef DELTA_ENCODER_HPP__
+#define DELTA_ENCODER_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "delta_format.hpp"
+
+// Builds the img_msg::data of delta frames (see delta_format.hpp) on the
+// sender, from whole frames in the base encoding.
+class DeltaEncoder final {
+public:
+  // channels and sample_size (bytes per sample) of the base encoding
+  DeltaEncoder(uint32_t width, uint32_t height, uint32_t channels, uint32_t sample_size,
+               PixelLayout layout, uint32_t tile_size);
+
+  // The tiles of pixels which differ from previous. Without previous it is
+  // a keyframe with every tile.
+  void encode(const uint8_t *pixels, const uint8_t *previous, uint32_t sequence,
+              std::vector<uint8_t> &data) const;
+
+  // Tiles of a keyframe
+  uint32_t tile_count() const { return columns_ * rows_; }
+
+private:
+  uint32_t width_;
+  uint32_t height_;
+  uint32_t channels_;
+  uint32_t sample_size_;
+  PixelLayout layout_;
+  uint32_t tile_size_;
+  uint32_t columns_;
+  uint32_t rows_;
+
+  template <typename Copy>
+  void for_each_run(DeltaTile tile, Copy copy) const;
+};
+
+#endif
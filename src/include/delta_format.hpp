@@ -0,0 +1,90 @@
+#ifndef DELTA_FORMAT_HPP__
+#define DELTA_FORMAT_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "frame_decoder.hpp"
+
+// A camera looking at a mostly still scene can send only the tiles which
+// changed since its previous frame. Such a message has the encoding
+// "delta-<encoding>", e.g. delta-rgb8, and its img_msg::data is
+// - a DeltaHeader
+// - tile_count DeltaTile entries
+// - the pixels of every tile in the same order, each packed like a frame
+//   of the tile's size in the base encoding and the stream's layout
+// The frame is cut into tiles of tile_size pixels square from the top left,
+// the tiles at the right and bottom edges are cut off by the frame.
+//
+// A keyframe carries every tile. The receiver applies a delta only if its
+// sequence follows the previous frame's, otherwise it waits for the next
+// keyframe. So keyframes let receivers which join late, or lost a frame,
+// catch up.
+
+constexpr char kDeltaMagic[4] = {'I', 'M', 'D', 'T'};
+constexpr char kDeltaPrefix[] = "delta-";
+constexpr size_t kDeltaPrefixLength = sizeof(kDeltaPrefix) - 1;
+
+// DeltaHeader::flags
+constexpr uint32_t kDeltaKeyframe = 1;
+
+struct DeltaHeader {
+  char magic[4];
+  uint32_t sequence;    // counts up per frame, wraps around
+  uint32_t flags;
+  uint32_t tile_size;   // pixels, the same for all frames up to a keyframe
+  uint32_t tile_count;  // tiles in this frame
+};
+
+struct DeltaTile {
+  uint16_t column;  // x / tile_size
+  uint16_t row;     // y / tile_size
+};
+
+static_assert(sizeof(DeltaHeader) == 20, "DeltaHeader is a wire format");
+static_assert(sizeof(DeltaTile) == 4, "DeltaTile is a wire format");
+
+static inline bool is_delta_encoding(const char *encoding, size_t length)
+{
+  return length > kDeltaPrefixLength &&
+         std::memcmp(encoding, kDeltaPrefix, kDeltaPrefixLength) == 0;
+}
+
+// "delta-rgb8" -> "rgb8"
+static inline std::string_view delta_base_encoding(const char *encoding, size_t length)
+{
+  return std::string_view(encoding + kDeltaPrefixLength, length - kDeltaPrefixLength);
+}
+
+// Calls copy(frame_offset, tile_offset, length) for every run of bytes
+// the tile at x, y of tile_width x tile_height pixels takes up in a frame
+// of frame_width x frame_height pixels and in its packed form
+template <typename Copy>
+inline void for_each_tile_run(uint32_t frame_width, uint32_t frame_height, uint32_t x,
+                              uint32_t y, uint32_t tile_width, uint32_t tile_height,
+                              uint32_t channels, uint32_t sample_size, PixelLayout layout,
+                              Copy copy)
+{
+  if (layout == PixelLayout::PLANAR) {
+    size_t plane = static_cast<size_t>(frame_width) * frame_height;
+    size_t tile_plane = static_cast<size_t>(tile_width) * tile_height;
+    for (uint32_t c = 0; c < channels; ++c) {
+      for (uint32_t row = 0; row < tile_height; ++row) {
+        copy((c * plane + static_cast<size_t>(y + row) * frame_width + x) * sample_size,
+             (c * tile_plane + static_cast<size_t>(row) * tile_width) * sample_size,
+             static_cast<size_t>(tile_width) * sample_size);
+      }
+    }
+    return;
+  }
+
+  size_t pixel_size = static_cast<size_t>(channels) * sample_size;
+  for (uint32_t row = 0; row < tile_height; ++row) {
+    copy((static_cast<size_t>(y + row) * frame_width + x) * pixel_size,
+         static_cast<size_t>(row) * tile_width * pixel_size, tile_width * pixel_size);
+  }
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef EVENT_LOOP_HPP__
+#define EVENT_LOOP_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+// A single threaded epoll loop. Sockets, timers (timerfd), signals
+// (signalfd) and notifiers (eventfd) each get a handler, which run() calls
+// on its own thread, so the handlers need no locks among each other.
+//
+// Only stop() and notify() may be called from other threads. Everything
+// else is called before run() or from the handlers.
+class EventLoop final {
+public:
+  using Handler = std::function<void(uint32_t events)>;
+
+  EventLoop();
+  ~EventLoop();
+
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+
+  bool is_valid() const { return epoll_fd_ >= 0 && stop_fd_ >= 0; }
+
+  // Watch fd for events (EPOLLIN, EPOLLOUT). The caller keeps owning fd and
+  // must remove() it before closing it.
+  bool add(int fd, uint32_t events, Handler handler);
+  bool modify(int fd, uint32_t events);
+  // Closes the timers, signals and notifiers created by the loop
+  void remove(int fd);
+
+  // Calls handler after delay and then every interval (0 for once). A zero
+  // delay leaves the timer disarmed. Returns the timer, -1 on failure.
+  int add_timer(std::chrono::nanoseconds delay, std::chrono::nanoseconds interval,
+                std::function<void()> handler);
+  bool set_timer(int timer, std::chrono::nanoseconds delay,
+                 std::chrono::nanoseconds interval = std::chrono::nanoseconds(0));
+
+  // The signals have to be blocked in every thread first, see
+  // block_signals()
+  bool add_signals(const std::vector<int> &signals, std::function<void(int)> handler);
+
+  // notify(notifier) from any thread makes the loop call handler. Several
+  // notifications before the loop gets to it call it once.
+  int add_notifier(std::function<void()> handler);
+  static void notify(int notifier);
+
+  // Until stop()
+  void run();
+  void stop();
+
+  // epoll_wait() returns, and the handlers called
+  uint64_t wakeup_count() const { return wakeup_count_; }
+  uint64_t event_count() const { return event_count_; }
+
+  void show_statistics();
+
+  // Blocks the signals in the calling thread and in the threads it starts
+  // afterwards, so they only arrive through add_signals()
+  static bool block_signals(const std::vector<int> &signals);
+
+private:
+  struct Entry {
+    Handler handler;
+    bool owned;  // closed by remove()
+  };
+
+  int epoll_fd_{-1};
+  int stop_fd_{-1};
+  std::atomic_bool stop_{false};
+  std::map<int, std::shared_ptr<Entry>> entries_;
+
+  std::chrono::steady_clock::time_point start_time_;
+  std::atomic_uint64_t wakeup_count_{0};
+  std::atomic_uint64_t event_count_{0};
+
+  bool add_entry(int fd, uint32_t events, Handler handler, bool owned);
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef FRAME_CHANNEL_HPP__
+#define FRAME_CHANNEL_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "frame_sink.hpp"
+
+// Called on the thread emitting the frames of the stream, in their order.
+// Keeping a copy of the frame keeps its image.
+using FrameCallback = std::function<void(const ReceivedFrame &frame)>;
+
+// Hands the full size frames of all streams to an application, through a
+// callback, a queue the application pulls from, or both.
+//
+// The queue holds up to pull_capacity frames. When it is full the oldest
+// frame is dropped and counted as skipped, so a slow reader sees the latest
+// frames and never holds up decoding.
+class FrameChannel final : public FrameSink {
+public:
+  FrameChannel(FrameCallback callback, size_t pull_capacity);
+
+  FrameChannel(const FrameChannel &) = delete;
+  FrameChannel &operator=(const FrameChannel &) = delete;
+
+  bool full_size() const override { return true; }
+  // The queued frames, plus the one the application works on
+  size_t held_frames() const override { return pull_capacity_ + 1; }
+
+  uint32_t add_stream(const std::string &name, std::shared_ptr<PipelineStats> stats) override;
+  void publish(uint32_t stream, ReceivedFrame frame) override;
+
+  // Waits up to timeout for a frame. Returns false on a timeout, or once
+  // the channel is closed and empty.
+  bool pull(ReceivedFrame &frame, std::chrono::milliseconds timeout);
+  // Wakes up pull(), the frames still queued can be pulled
+  void close();
+
+  std::string stream_name(uint32_t stream);
+  // Frames pulled, or without a queue the ones passed to the callback
+  uint64_t delivered_count(uint32_t stream) override;
+  uint64_t skipped_count(uint32_t stream) override;
+
+  void show_statistics();
+
+private:
+  struct Stream {
+    std::string name;
+    std::atomic_uint64_t delivered_count{0};
+    std::atomic_uint64_t skipped_count{0};
+  };
+
+  FrameCallback callback_;
+  size_t pull_capacity_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  // Streams are never removed
+  std::vector<std::unique_ptr<Stream>> streams_;
+  std::deque<ReceivedFrame> frames_;
+  bool closed_{false};
+
+  Stream &get(uint32_t stream);
+};
+
+#endif
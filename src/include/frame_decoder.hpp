@@ -0,0 +1,105 @@
+#ifndef FRAME_DECODER_HPP__
+#define FRAME_DECODER_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "planar_convert.hpp"
+
+// How the channels of img_msg::data are arranged
+enum class PixelLayout {
+  PLANAR,      // one plane per channel, e.g. RRR...GGG...BBB...
+  INTERLEAVED  // channels next to each other, e.g. RGBRGB...
+};
+
+static inline bool parse_pixel_layout(const std::string &name, PixelLayout &layout)
+{
+  if (name == "planar") {
+    layout = PixelLayout::PLANAR;
+  } else if (name == "interleaved") {
+    layout = PixelLayout::INTERLEAVED;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static inline const char *pixel_layout_name(PixelLayout layout)
+{
+  return layout == PixelLayout::PLANAR ? "planar" : "interleaved";
+}
+
+// Encodings whose data is a compressed image file, which is decoded with
+// cv::imdecode() instead of a FrameDecoder
+static inline bool is_compressed_encoding(const char *encoding, size_t length)
+{
+  std::string_view name(encoding, length);
+  return name == "jpeg" || name == "jpg" || name == "png";
+}
+
+// Turns the pixels of an img_msg into the 8 bit BGR image used by the display
+// and the writer, scaling the width like PlanarToBgrScaler.
+//
+// Every encoding of numChannels() has a decoder compiled for its channel
+// count, bit depth and channel order, in both layouts. 16 bit samples keep
+// their high byte and alpha is dropped. The decoder is looked up when a
+// stream's encoding first appears (or changes), later frames only check
+// that it is still the same.
+class FrameDecoder final {
+public:
+  explicit FrameDecoder(PixelLayout layout = PixelLayout::PLANAR);
+  FrameDecoder(PixelLayout layout, PlanarToBgrScaler::Isa isa);
+
+  // Returns false if the encoding isn't supported. changed tells whether the
+  // encoding differs from the one of the previous call.
+  bool select(const char *encoding, size_t length, bool *changed = nullptr);
+
+  // Bytes of img_msg::data a frame of the selected encoding needs
+  size_t frame_size(uint32_t width, uint32_t height) const;
+
+  // src holds frame_size(width, height) bytes. dst holds height rows of
+  // dst_width * 3 bytes, dst_step bytes apart.
+  void decode(const uint8_t *src, uint32_t width, uint32_t height,
+              uint8_t *dst, size_t dst_step, uint32_t dst_width);
+
+  // Only rows first_row to end_row - 1, so several decoders can share a
+  // frame. src and dst still point to the whole frame.
+  void decode_rows(const uint8_t *src, uint32_t width, uint32_t height,
+                   uint32_t first_row, uint32_t end_row, uint8_t *dst,
+                   size_t dst_step, uint32_t dst_width);
+
+  const std::string &encoding() const { return encoding_; }
+  // Of the selected encoding
+  uint32_t channels() const { return entry_ ? static_cast<uint32_t>(entry_->channels) : 0; }
+  uint32_t sample_size() const { return entry_ ? static_cast<uint32_t>(entry_->depth / 8) : 0; }
+  PixelLayout layout() const { return layout_; }
+  PlanarToBgrScaler::Isa isa() const { return scaler_.isa(); }
+
+  // All supported encodings
+  static std::vector<std::string> encodings();
+
+  using DecodeFn = void (*)(const uint8_t *src, uint32_t width, uint32_t height,
+                            uint32_t first_row, uint32_t end_row, uint8_t *dst,
+                            size_t dst_step, uint32_t dst_width,
+                            PlanarToBgrScaler &scaler, uint8_t *rows);
+  struct Entry {
+    const char *encoding;
+    int channels;
+    int depth;  // bits per sample
+    DecodeFn planar;
+    DecodeFn interleaved;
+  };
+
+private:
+  PixelLayout layout_;
+  PlanarToBgrScaler scaler_;
+  std::string encoding_;
+  const Entry *entry_{nullptr};
+  DecodeFn decode_{nullptr};
+  std::vector<uint8_t> rows_;  // R, G and B rows of the line being decoded
+};
+
+#endif
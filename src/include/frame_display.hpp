@@ -0,0 +1,121 @@
+#ifndef FRAME_DISPLAY_HPP__
+#define FRAME_DISPLAY_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "event_loop.hpp"
+#include "frame_sink.hpp"
+#include "pipeline_stats.hpp"
+
+// Shows decoded frames on its own thread, so the display speed no longer
+// limits decoding.
+//
+// Every stream publishes into its own latest-frame slot. The render thread
+// shows the newest frames at no more than max_fps and skips the frames which
+// were replaced before it got to them. Each stream gets a window of its own,
+// or a tile of one composite window. Without frames for a second a stream
+// shows the "Wait for BMP file" screen. All HighGUI calls happen on this
+// thread, or on the thread of an EventLoop the display is attached to.
+class FrameDisplay final : public FrameSink {
+public:
+  // With multi_stream the window titles (or tile texts) name the streams
+  FrameDisplay(double max_fps, bool tiled, bool multi_stream);
+  ~FrameDisplay();
+
+  FrameDisplay(const FrameDisplay &) = delete;
+  FrameDisplay &operator=(const FrameDisplay &) = delete;
+
+  bool full_size() const override { return false; }
+  // The frame waiting in the slot and the one on screen
+  size_t held_frames() const override { return 2; }
+
+  // Returns the slot to publish into
+  uint32_t add_stream(const std::string &name, std::shared_ptr<PipelineStats> stats) override;
+
+  void start();
+  // Instead of start(): the loop renders on its thread. A notifier wakes it
+  // for new frames, timers for the frame rate limit, the window events and
+  // the idle screens.
+  bool attach(EventLoop &loop);
+  void stop();
+
+  // The display keeps a reference to the image until it is replaced
+  void publish(uint32_t stream, ReceivedFrame frame) override;
+
+  uint64_t published_count(uint32_t stream);
+  uint64_t rendered_count(uint32_t stream);
+  uint64_t delivered_count(uint32_t stream) override { return rendered_count(stream); }
+  uint64_t skipped_count(uint32_t stream) override;
+
+  void show_statistics();
+
+  // Window of a single stream, and of the composite
+  static const char *window_name();
+
+private:
+  struct Slot {
+    std::string title;
+    std::shared_ptr<PipelineStats> stats;
+    std::shared_ptr<const cv::Mat> latest;  // waiting to be rendered
+    int64_t publish_ns{0};
+
+    // Only used by the render thread
+    std::shared_ptr<const cv::Mat> shown;  // on its tile
+    std::chrono::steady_clock::time_point last_frame;
+    bool idle{false};
+
+    std::atomic_uint64_t published_count{0};
+    std::atomic_uint64_t rendered_count{0};
+    std::atomic_uint64_t skipped_count{0};
+  };
+
+  // A frame taken from its slot to be shown
+  struct Rendered {
+    Slot *slot;
+    std::shared_ptr<const cv::Mat> frame;
+    int64_t publish_ns;
+  };
+
+  std::chrono::nanoseconds min_interval_;
+  bool tiled_;
+  bool multi_stream_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<std::unique_ptr<Slot>> slots_;
+  size_t pending_{0};  // slots with a frame waiting
+  bool stop_{false};
+  std::thread thread_;
+
+  // Only with an EventLoop
+  EventLoop *loop_{nullptr};
+  std::atomic_int notifier_{-1};
+  int render_timer_{-1};
+  int events_timer_{-1};
+
+  // Only used by the render thread
+  std::chrono::steady_clock::time_point last_render_;
+  bool waiting_window_{true};
+  std::vector<Slot *> render_slots_;
+  std::vector<Rendered> rendered_;
+  cv::Mat composite_;
+  cv::Size tile_size_;
+
+  void render_loop();
+  std::chrono::nanoseconds render_step();
+  void on_loop_event();
+  void render_tiles(const std::vector<Slot *> &slots);
+  static void show_idle_screen(const std::string &title);
+};
+
+#endif
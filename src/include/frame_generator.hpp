@@ -0,0 +1,83 @@
+#ifndef FRAME_GENERATOR_HPP__
+#define FRAME_GENERATOR_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "frame_decoder.hpp"
+
+struct GeneratorConfig {
+  uint32_t width{640};
+  uint32_t height{480};
+  std::string encoding{"rgb8"};
+  PixelLayout layout{PixelLayout::PLANAR};
+  // Serialize with cista::mode::WITH_INTEGRITY, for img_viewer --verify integrity
+  bool integrity{false};
+  // Distinct images which are sent in turn
+  size_t variants{8};
+  // jpeg quality (0 - 100) or png compression level (0 - 9) of compressed
+  // encodings, -1 is the OpenCV default
+  int quality{-1};
+  // Send tiles of this many pixels square which changed since the previous
+  // frame (see delta_format.hpp), 0 sends whole frames. Raw encodings only.
+  uint32_t delta_tile_size{0};
+  // A delta stream sends every tile on every this many frames, 0 only on
+  // the first one
+  uint32_t keyframe_interval{30};
+  // Only a box of this many pixels square moves over a still background,
+  // like a camera watching a still scene. 0 moves the whole pattern.
+  uint32_t moving_box{0};
+};
+
+// Builds serialized img_msg payloads of a moving test pattern.
+// jpeg and png frames are encoded with cv::imencode().
+//
+// The variants are serialized once up front. A frame only patches the
+// timestamp into the next variant (and updates the checksum with
+// integrity), so generating frames costs next to nothing unless the
+// integrity checksum is needed. Delta frames are serialized up front as
+// well: every variant as a keyframe, and as the delta from the variant
+// before it.
+class FrameGenerator final {
+public:
+  explicit FrameGenerator(const GeneratorConfig &config);
+
+  FrameGenerator(const FrameGenerator &) = delete;
+  FrameGenerator &operator=(const FrameGenerator &) = delete;
+
+  // The payload stays valid until the next call
+  const std::vector<uint8_t> &next(int64_t timestamp);
+
+  // The average, compressed variants and delta frames differ
+  size_t payload_size() const { return payload_size_; }
+  // Of the largest variant or keyframe
+  size_t max_payload_size() const { return max_payload_size_; }
+  const GeneratorConfig &config() const { return config_; }
+
+  // Whether the encoding is one img_viewer decodes
+  static bool is_supported(const std::string &encoding);
+
+private:
+  GeneratorConfig config_;
+  // Whole frames, or the deltas from the variant before
+  std::vector<std::vector<uint8_t>> payloads_;
+  // Only with deltas
+  std::vector<std::vector<uint8_t>> keyframes_;
+  size_t sequence_offset_{0};
+  size_t payload_size_{0};
+  size_t max_payload_size_{0};
+  size_t next_variant_{0};
+  uint32_t frame_index_{0};
+
+  uint8_t pixel(uint32_t x, uint32_t y, size_t variant, size_t channel) const;
+  std::vector<uint8_t> raw_pixels(size_t variant) const;
+  std::vector<uint8_t> serialize(size_t variant) const;
+  std::vector<uint8_t> serialize_compressed(size_t variant) const;
+  void serialize_deltas();
+  std::vector<uint8_t> serialize_msg(const std::string &encoding, const uint8_t *data,
+                                     size_t size) const;
+};
+
+#endif
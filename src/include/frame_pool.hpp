@@ -0,0 +1,64 @@
+#ifndef FRAME_POOL_HPP__
+#define FRAME_POOL_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// Recycles the cv::Mat frames a stream converts into and hands to the
+// writer and the display, so a frame doesn't cost an allocation and the
+// page faults of touching it for the first time.
+//
+// The pool holds frames of one size and type, the ones of the last
+// acquire(). It is rebuilt when they change, which is when the resolution
+// of the stream changes. A frame goes back to the pool once every user has
+// dropped its reference and no cv::Mat copy of it is left, a copy keeps
+// the pixels through OpenCV's reference count instead of the shared_ptr.
+class FramePool final {
+public:
+  explicit FramePool(const std::string &name, size_t max_frames = 16);
+
+  FramePool(const FramePool &) = delete;
+  FramePool &operator=(const FramePool &) = delete;
+
+  // A frame of size and type, with the pixels of whichever frame it was
+  // before. Once max_frames are in use the frame is allocated outside of
+  // the pool.
+  std::shared_ptr<cv::Mat> acquire(cv::Size size, int type);
+
+  // Frames beyond max_frames in use at once are allocated outside of the pool
+  void set_max_frames(size_t max_frames);
+
+  // Frames handed out from the pool, and the ones that had to be allocated
+  uint64_t hit_count() const { return hit_count_; }
+  uint64_t miss_count() const { return miss_count_; }
+  // Pixel memory of the frames held by the pool, in use or not
+  size_t resident_bytes();
+  size_t peak_resident_bytes();
+
+  void show_statistics();
+
+private:
+  std::string name_;
+  size_t max_frames_;
+
+  std::mutex mutex_;
+  cv::Size size_;
+  int type_{-1};
+  std::vector<std::shared_ptr<cv::Mat>> frames_;
+  size_t peak_resident_bytes_{0};
+  uint64_t rebuild_count_{0};
+
+  std::atomic_uint64_t hit_count_{0};
+  std::atomic_uint64_t miss_count_{0};
+
+  size_t frame_bytes() const;
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef FRAME_RECORDER_HPP__
+#define FRAME_RECORDER_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "recording_format.hpp"
+
+// Appends serialized img_msg payloads unchanged to segment files.
+//
+// Payloads are copied into large page aligned chunks, and a background thread
+// writes full chunks with one sequential write() each. Every segment gets a
+// side index (segment_<n>.idx) of offset, size and timestamp, so a reader can
+// find any frame in O(1). A new segment is started once a segment reaches the
+// configured size.
+class FrameRecorder final {
+public:
+  // direct_io opens segments with O_DIRECT to bypass the page cache
+  FrameRecorder(const std::string &path, uint64_t segment_size, bool direct_io);
+  ~FrameRecorder();
+
+  FrameRecorder(const FrameRecorder &) = delete;
+  FrameRecorder &operator=(const FrameRecorder &) = delete;
+
+  // Copies the payload, so the caller may reuse it as soon as this returns.
+  // It only blocks if the disk is more than kMaxPendingChunks chunks behind.
+  void record(const uint8_t *payload, size_t size, int64_t timestamp);
+
+  // Write everything still buffered and close the segment
+  void stop();
+
+  uint64_t frame_count() const { return frame_count_; }
+  uint64_t written_bytes() const { return written_bytes_; }
+  uint32_t segment_count() const { return segment_index_ + 1; }
+  bool has_error() const { return error_; }
+
+  void show_statistics();
+
+private:
+  static constexpr size_t kChunkSize = 16 * 1024 * 1024;
+  static constexpr size_t kMaxPendingChunks = 4;
+
+  struct Chunk {
+    uint8_t *data{nullptr};
+    size_t used{0};
+    uint32_t segment{0};
+    bool last_in_segment{false};
+    std::vector<RecordingIndexEntry> entries;
+  };
+
+  std::string path_;
+  uint64_t segment_size_;
+  bool direct_io_;
+
+  // Only used by the recording thread
+  std::unique_ptr<Chunk> current_;
+  uint32_t segment_index_{0};
+  uint64_t segment_offset_{0};
+
+  std::mutex mutex_;
+  std::condition_variable pending_cond_;
+  std::condition_variable free_cond_;
+  std::deque<std::unique_ptr<Chunk>> pending_;
+  std::vector<std::unique_ptr<Chunk>> free_;
+  size_t allocated_chunks_{0};
+  bool stop_{false};
+  std::thread writer_;
+
+  // Only used by the writer thread
+  int data_fd_{-1};
+  int index_fd_{-1};
+  uint32_t open_segment_{0};
+  uint64_t segment_written_{0};
+
+  std::atomic_uint64_t frame_count_{0};
+  std::atomic_uint64_t written_bytes_{0};
+  std::atomic_bool error_{false};
+
+  void append(const uint8_t *data, size_t size);
+  void submit_current(bool last_in_segment);
+  std::unique_ptr<Chunk> get_free_chunk();
+
+  void writer_loop();
+  void write_chunk(Chunk &chunk);
+  bool open_segment(uint32_t segment);
+  void close_segment();
+};
+
+#endif
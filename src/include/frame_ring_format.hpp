@@ -0,0 +1,75 @@
+#ifndef FRAME_RING_FORMAT_HPP__
+#define FRAME_RING_FORMAT_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Layout of the POSIX shared memory object (shm_open()) into which
+// img_viewer --shm publishes the decoded frames of a stream:
+//   RingHeader
+//   slot_count slots of slot_size bytes, each a RingSlot followed by the
+//   pixels of a frame
+//
+// There is one writer, any number of readers map the object read only.
+// The writer fills slot write_count % slot_count and then counts up
+// write_count. Every slot is guarded by a seqlock: its generation is odd
+// while the writer changes it. A reader reads the generation, uses the slot
+// in place and reads the generation again. If it changed, the writer
+// overwrote the slot meanwhile and whatever the reader got is garbage.
+//
+// The writer replaces the object when a frame no longer fits a slot, and
+// removes it when it exits. Both set closed first, readers then open the
+// name again.
+//
+// The writer holds an exclusive flock() on the object while it uses it, so
+// another writer can tell a live ring from one left behind by a crash.
+
+constexpr char kRingMagic[8] = {'I', 'M', 'G', 'R', 'I', 'N', 'G', '1'};
+constexpr uint32_t kRingVersion = 1;
+// Slots start on page boundaries, their pixels kRingSlotDataOffset bytes in
+constexpr size_t kRingAlignment = 4096;
+
+// RingSlot::format
+enum class RingPixelFormat : uint32_t {
+  BGR8 = 0  // 8 bit BGR, what the display and the writer get
+};
+
+struct alignas(64) RingHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t slot_count;
+  uint64_t slot_size;      // bytes from one RingSlot to the next
+  uint64_t data_capacity;  // pixel bytes a slot takes
+  char stream[128];        // topic of the stream, 0 terminated
+  alignas(64) std::atomic_uint64_t write_count;  // frames written so far
+  std::atomic_uint32_t closed;
+};
+
+struct alignas(64) RingSlot {
+  std::atomic_uint64_t generation;  // odd while being written
+  uint64_t frame;                   // write_count when it was written
+  int64_t timestamp;                // img_msg::timestamp, ns
+  int64_t receive_time_ns;          // steady clock (CLOCK_MONOTONIC), same for all processes
+  uint32_t width;
+  uint32_t height;
+  uint32_t step;                    // bytes from one row to the next
+  RingPixelFormat format;
+  uint64_t size;                    // pixel bytes
+};
+
+static_assert(std::atomic_uint64_t::is_always_lock_free &&
+                  std::atomic_uint32_t::is_always_lock_free,
+              "The ring is shared between processes, its atomics can't take locks");
+
+static inline size_t ring_slot_offset(uint32_t slot, uint64_t slot_size)
+{
+  size_t header = (sizeof(RingHeader) + kRingAlignment - 1) / kRingAlignment * kRingAlignment;
+  return header + slot * slot_size;
+}
+
+// Pixels start this far into a slot
+constexpr size_t kRingSlotDataOffset = 64;
+static_assert(sizeof(RingSlot) <= kRingSlotDataOffset, "RingSlot grew");
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef FRAME_RING_READER_HPP__
+#define FRAME_RING_READER_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "frame_ring_format.hpp"
+
+// A frame in the shared memory ring, the pixels are not copied
+struct RingFrame {
+  uint64_t frame{0};  // counts up from the first frame of the ring
+  int64_t timestamp{0};
+  int64_t receive_time_ns{0};
+  uint32_t width{0};
+  uint32_t height{0};
+  uint32_t step{0};
+  RingPixelFormat format{RingPixelFormat::BGR8};
+  const uint8_t *data{nullptr};
+  size_t size{0};
+
+  // Seqlock state of the slot when the frame was taken
+  const RingSlot *slot{nullptr};
+  uint64_t generation{0};
+};
+
+// Reads the frames img_viewer --shm publishes (see frame_ring_format.hpp)
+// from another process, in place.
+//
+// The writer never waits for readers. A reader which falls more than the
+// ring size behind loses the oldest frames, and a frame it is still using
+// may be overwritten, so check valid() after using the pixels.
+//
+//   FrameRingReader reader("/img_viewer");
+//   RingFrame frame;
+//   while (running) {
+//     if (!reader.next(frame)) { sleep a little; continue; }
+//     use frame.data
+//     if (!reader.valid(frame)) { throw away what came out of it }
+//   }
+class FrameRingReader final {
+public:
+  explicit FrameRingReader(const std::string &name);
+  ~FrameRingReader();
+
+  FrameRingReader(const FrameRingReader &) = delete;
+  FrameRingReader &operator=(const FrameRingReader &) = delete;
+
+  // The oldest frame not read yet, false if there is none. Opens the ring
+  // if needed, and opens it again once the writer replaced or removed it.
+  // The first frame read is the newest one in the ring.
+  bool next(RingFrame &frame);
+
+  // Whether the writer has not touched the frame's slot since next()
+  bool valid(const RingFrame &frame) const;
+
+  bool is_open() const { return ring_ != nullptr; }
+  // Topic of the stream, empty until the ring is open
+  const std::string &stream() const { return stream_; }
+  // Frames overwritten before they were read
+  uint64_t missed_count() const { return missed_count_; }
+  // How often the ring was opened
+  uint64_t open_count() const { return open_count_; }
+
+private:
+  std::string name_;
+  std::string stream_;
+  const uint8_t *ring_{nullptr};
+  size_t ring_size_{0};
+  uint32_t slot_count_{0};
+  uint64_t slot_size_{0};
+  uint64_t data_capacity_{0};
+  uint64_t next_frame_{0};
+
+  uint64_t missed_count_{0};
+  uint64_t open_count_{0};
+
+  bool open();
+  void close();
+  const RingHeader *header() const { return reinterpret_cast<const RingHeader *>(ring_); }
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef FRAME_RING_WRITER_HPP__
+#define FRAME_RING_WRITER_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+#include "frame_ring_format.hpp"
+
+// Publishes the decoded frames of a stream into a POSIX shared memory ring
+// (see frame_ring_format.hpp), so local processes can use them without
+// their own subscription.
+//
+// The ring is created with the first frame, with slots for frames of its
+// size. A larger frame replaces the ring. A ring of the same name another
+// running viewer writes to is never taken over, one left behind by a
+// crashed viewer is. Only one thread at a time may call write().
+class FrameRingWriter final {
+public:
+  // name is a shm_open() name like /img_viewer
+  FrameRingWriter(const std::string &name, const std::string &stream, uint32_t slot_count);
+  ~FrameRingWriter();
+
+  FrameRingWriter(const FrameRingWriter &) = delete;
+  FrameRingWriter &operator=(const FrameRingWriter &) = delete;
+
+  // Copy a BGR8 image into the next slot
+  bool write(const cv::Mat &image, int64_t timestamp, int64_t receive_time_ns);
+
+  const std::string &name() const { return name_; }
+  uint64_t frame_count() const { return frame_count_; }
+  uint64_t error_count() const { return error_count_; }
+
+  void show_statistics();
+
+private:
+  std::string name_;
+  std::string stream_;
+  uint32_t slot_count_;
+
+  int fd_{-1};  // of the object, holds the lock on it
+  uint8_t *ring_{nullptr};
+  size_t ring_size_{0};
+  uint64_t slot_size_{0};
+  uint64_t data_capacity_{0};
+
+  std::atomic_uint64_t frame_count_{0};
+  std::atomic_uint64_t error_count_{0};
+  uint32_t create_count_{0};
+  // The shared memory couldn't be created, no point in trying every frame
+  bool failed_{false};
+
+  bool create(size_t frame_size);
+  int open_object();
+  void close();
+  RingHeader *header() { return reinterpret_cast<RingHeader *>(ring_); }
+};
+
+#endif
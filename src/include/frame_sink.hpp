@@ -0,0 +1,56 @@
+#ifndef FRAME_SINK_HPP__
+#define FRAME_SINK_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+#include "pipeline_stats.hpp"
+
+// A converted frame of a stream. The image is 8 bit BGR and shared, not
+// copied: it is a buffer of the frame pool of the stream, which takes it back
+// once the last reference is dropped. Its pixels must not be modified, and
+// frames held on to for long make the stream allocate new ones.
+//
+// Keep the frame (or the shared_ptr) to hold on to the pixels. A plain
+// `cv::Mat m = *frame.image;` shares them too, the pool doesn't reuse the
+// buffer while such a copy exists, but it isn't counted as a held frame.
+// clone() to keep an image of one's own.
+struct ReceivedFrame {
+  uint32_t stream{0};          // what FrameSink::add_stream() returned
+  uint64_t seq{0};             // gaps are frames which weren't decoded
+  int64_t timestamp{0};        // img_msg::timestamp
+  int64_t receive_time_ns{0};  // steady clock, when the message arrived
+  std::shared_ptr<const cv::Mat> image;
+};
+
+// Where the streams hand their converted frames, e.g. a window or an
+// application linking the receiver.
+//
+// publish() is called in frame order by the thread emitting the frames of a
+// stream (a decode or a dispatch thread), so it must not block for long.
+class FrameSink {
+public:
+  virtual ~FrameSink() = default;
+
+  // Full size frames, or the ones scaled for the display (50 columns wider)
+  virtual bool full_size() const = 0;
+  // Frames of a stream the sink holds at most, the frame pools keep that
+  // many more
+  virtual size_t held_frames() const = 0;
+
+  // Called when a stream shows up, name is its topic or the replayed path.
+  // Returns the stream number its frames are published under.
+  virtual uint32_t add_stream(const std::string &name,
+                              std::shared_ptr<PipelineStats> stats) = 0;
+  virtual void publish(uint32_t stream, ReceivedFrame frame) = 0;
+
+  // Frames shown or handed on, and the ones replaced by newer frames first
+  virtual uint64_t delivered_count(uint32_t stream) = 0;
+  virtual uint64_t skipped_count(uint32_t stream) = 0;
+};
+
+#endif
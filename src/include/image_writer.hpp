@@ -0,0 +1,93 @@
+#ifndef IMAGE_WRITER_HPP__
+#define IMAGE_WRITER_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+enum class ImageFormat {
+  BMP,
+  PNG,
+  RAW  // interleaved BGR pixels without any header
+};
+
+struct ImageWriterConfig {
+  std::string output_path;
+  ImageFormat format{ImageFormat::BMP};
+  int png_compression{1};  // 0 - 9
+  size_t threads{1};
+  size_t queue_capacity{16};
+  bool drop_when_full{false};  // otherwise submit() blocks
+};
+
+// Writes images to output_path/frame_<index>.<ext> on its own worker threads,
+// so a slow disk doesn't stall the receive loop.
+// The file name comes from the index given to submit(), so the numbering
+// doesn't depend on which worker writes the file.
+class ImageWriter final {
+public:
+  explicit ImageWriter(const ImageWriterConfig &config);
+  ~ImageWriter();
+
+  ImageWriter(const ImageWriter &) = delete;
+  ImageWriter &operator=(const ImageWriter &) = delete;
+
+  // The writer keeps a reference to image, so the caller must not modify its
+  // pixels afterwards. Returns false if the frame was dropped.
+  bool submit(uint32_t index, std::shared_ptr<cv::Mat> image);
+
+  // Write everything still queued and stop the workers
+  void stop();
+
+  uint64_t written_count() const { return written_count_; }
+  uint64_t dropped_count() const { return dropped_count_; }
+  uint64_t failed_count() const { return failed_count_; }
+  uint64_t written_bytes() const { return written_bytes_; }
+  size_t backlog();
+  size_t peak_backlog();
+
+  void show_statistics();
+
+  // FORMAT is bmp, png[:Level] or raw
+  static bool parse_format(const std::string &param, ImageFormat &format,
+                           int &png_compression);
+  static const char *format_name(ImageFormat format);
+
+private:
+  struct Job {
+    uint32_t index;
+    std::shared_ptr<cv::Mat> image;
+  };
+
+  ImageWriterConfig config_;
+  std::vector<int> imwrite_params_;
+  std::string extension_;
+
+  std::mutex mutex_;
+  std::condition_variable not_empty_cond_;
+  std::condition_variable not_full_cond_;
+  std::deque<Job> jobs_;
+  size_t peak_backlog_{0};
+  bool stop_{false};
+  std::vector<std::thread> workers_;
+
+  std::chrono::steady_clock::time_point start_time_;
+  std::atomic_uint64_t written_count_{0};
+  std::atomic_uint64_t dropped_count_{0};
+  std::atomic_uint64_t failed_count_{0};
+  std::atomic_uint64_t written_bytes_{0};
+
+  void worker();
+  bool write(const Job &job);
+};
+
+#endif
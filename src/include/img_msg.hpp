@@ -18,7 +18,7 @@ namespace imx500_img_transport {
   static inline int numChannels(const std::string & encoding)
   {
     if (encoding == "rgb8" ||
-      encoding == "rgb8"   ||
+      encoding == "bgr8"   ||
       encoding == "bgr16"  ||
       encoding == "rgb16")
     {
@@ -0,0 +1,108 @@
+#ifndef IMG_RECEIVER_HPP__
+#define IMG_RECEIVER_HPP__
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "event_loop.hpp"
+#include "frame_channel.hpp"
+#include "frame_sink.hpp"
+#include "mqtt_subscription.hpp"
+#include "replay_source.hpp"
+#include "stream_pipeline.hpp"
+#include "stream_router.hpp"
+
+// What the receiver subscribes to or replays, and how the streams are set up
+struct ImgReceiverConfig {
+  // Either a broker and its topics (wildcards allowed), or a recording made
+  // with -r, or a directory of serialized img_msg files, to replay
+  std::string broker_addr;
+  int32_t broker_port{1883};
+  std::vector<std::string> topics;
+  MqttSubscriptionConfig mqtt;
+
+  std::string replay_path;
+  ReplaySource::Rate replay_rate{ReplaySource::Rate::FAST};
+  double replay_fps{0};
+
+  StreamConfig stream;
+  // Dispatch threads (0: the receiving thread) and decode threads (0: the
+  // dispatch threads), see StreamRouter
+  size_t workers{1};
+  size_t decoders{1};
+
+  // Without a sink of their own the frames go to the callback and to a
+  // queue of pull_capacity frames (0: no pull())
+  FrameCallback on_frame;
+  size_t pull_capacity{0};
+};
+
+// The receive side of img_viewer as a library: subscribes to the topics (or
+// replays a recording), queues, deserializes and converts the frames, and
+// hands them to a frame sink. The frames are shared with the pipeline, not
+// copied (see ReceivedFrame).
+//
+//   ImgReceiverConfig config;
+//   config.broker_addr = "127.0.0.1";
+//   config.topics = {"camera/#"};
+//   config.pull_capacity = 4;
+//   ImgReceiver receiver(config);
+//   receiver.start();
+//   ReceivedFrame frame;
+//   while (receiver.pull(frame, std::chrono::milliseconds(100))) { ... }
+//   receiver.stop();
+//
+// Nothing here uses the OpenCV GUI, img_viewer brings its own FrameDisplay
+// as the sink.
+class ImgReceiver final {
+public:
+  // sink takes the frames instead of on_frame and pull()
+  explicit ImgReceiver(const ImgReceiverConfig &config,
+                       std::shared_ptr<FrameSink> sink = nullptr);
+  ~ImgReceiver();
+
+  ImgReceiver(const ImgReceiver &) = delete;
+  ImgReceiver &operator=(const ImgReceiver &) = delete;
+
+  // Checks that there are frames to replay, always true for a broker
+  bool open();
+  // Call before start() to let loop receive the messages instead of a
+  // network thread, see MqttSubscription::attach()
+  void attach(EventLoop &loop);
+  // Starts the streams and connects to the broker, or starts the replay
+  // (on_done is called after its last frame). Returns false if the broker
+  // can't be reached, stop() still has to be called.
+  bool start(std::function<void()> on_done = nullptr);
+  // Replays: every frame queued is decoded first. No frames come in
+  // afterwards, pull() returns the ones still queued.
+  void stop();
+
+  // Only without a sink of its own
+  bool pull(ReceivedFrame &frame, std::chrono::milliseconds timeout);
+  std::string stream_name(uint32_t stream);
+
+  bool is_replay() const { return !config_.replay_path.empty(); }
+  std::shared_ptr<StreamRouter> router() { return router_; }
+  // nullptr for replays
+  std::shared_ptr<MqttSubscription> subscription() { return sub_; }
+
+  void show_statistics();
+
+  // Several topics or a wildcard give several streams
+  static bool is_multi_stream(const std::vector<std::string> &topics);
+
+private:
+  ImgReceiverConfig config_;
+  std::shared_ptr<FrameChannel> channel_;
+  std::shared_ptr<StreamRouter> router_;
+  std::shared_ptr<ReplaySource> replay_source_;
+  std::shared_ptr<MqttSubscription> sub_;
+  bool started_{false};
+  bool stopped_{false};
+};
+
+#endif
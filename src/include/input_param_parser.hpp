@@ -55,13 +55,314 @@ public:
     return std::string();
   }
 
+  const std::string get_queue_policy() {
+    if (cmdOptExists("-q") && !getOneOption("-q").empty()) {
+      return getOneOption("-q");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_output_format() {
+    if (cmdOptExists("-f") && !getOneOption("-f").empty()) {
+      return getOneOption("-f");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_writer_threads() {
+    if (cmdOptExists("-w") && !getOneOption("-w").empty()) {
+      return getOneOption("-w");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_writer_policy() {
+    if (cmdOptExists("-W") && !getOneOption("-W").empty()) {
+      return getOneOption("-W");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_rotate_time() {
+    if (cmdOptExists("--rotate-time") && !getOneOption("--rotate-time").empty()) {
+      return getOneOption("--rotate-time");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_rotate_size() {
+    if (cmdOptExists("--rotate-size") && !getOneOption("--rotate-size").empty()) {
+      return getOneOption("--rotate-size");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_video_fps() {
+    if (cmdOptExists("--video-fps") && !getOneOption("--video-fps").empty()) {
+      return getOneOption("--video-fps");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_record_path() {
+    if (cmdOptExists("-r") && !getOneOption("-r").empty()) {
+      return getOneOption("-r");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_segment_size() {
+    if (cmdOptExists("-s") && !getOneOption("-s").empty()) {
+      return getOneOption("-s");
+    }
+
+    return std::string();
+  }
+
+  bool use_direct_io() {
+    return cmdOptExists("--direct-io");
+  }
+
+  const std::string get_replay_path() {
+    if (cmdOptExists("-i") && !getOneOption("-i").empty()) {
+      return getOneOption("-i");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_replay_rate() {
+    if (cmdOptExists("--rate") && !getOneOption("--rate").empty()) {
+      return getOneOption("--rate");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_qos() {
+    if (cmdOptExists("--qos") && !getOneOption("--qos").empty()) {
+      return getOneOption("--qos");
+    }
+
+    return std::string();
+  }
+
+  bool use_mqtt5() {
+    return cmdOptExists("--mqtt5");
+  }
+
+  const std::string get_receive_maximum() {
+    if (cmdOptExists("--receive-max") && !getOneOption("--receive-max").empty()) {
+      return getOneOption("--receive-max");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_max_packet_size() {
+    if (cmdOptExists("--max-packet") && !getOneOption("--max-packet").empty()) {
+      return getOneOption("--max-packet");
+    }
+
+    return std::string();
+  }
+
+  bool use_tcp_nodelay() {
+    return cmdOptExists("--tcp-nodelay");
+  }
+
+  const std::string get_receive_buffer() {
+    if (cmdOptExists("--rcvbuf") && !getOneOption("--rcvbuf").empty()) {
+      return getOneOption("--rcvbuf");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_keepalive() {
+    if (cmdOptExists("--keepalive") && !getOneOption("--keepalive").empty()) {
+      return getOneOption("--keepalive");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_mqtt_loop() {
+    if (cmdOptExists("--mqtt-loop") && !getOneOption("--mqtt-loop").empty()) {
+      return getOneOption("--mqtt-loop");
+    }
+
+    return std::string();
+  }
+
+  bool use_reactor() {
+    return cmdOptExists("--reactor");
+  }
+
+  bool use_chunks() {
+    return cmdOptExists("--chunked");
+  }
+
+  const std::string get_shm() {
+    if (cmdOptExists("--shm") && !getOneOption("--shm").empty()) {
+      return getOneOption("--shm");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_chunk_timeout() {
+    if (cmdOptExists("--chunk-timeout") && !getOneOption("--chunk-timeout").empty()) {
+      return getOneOption("--chunk-timeout");
+    }
+
+    return std::string();
+  }
+
+  bool is_headless() {
+    return cmdOptExists("--headless");
+  }
+
+  const std::string get_display_fps() {
+    if (cmdOptExists("--display-fps") && !getOneOption("--display-fps").empty()) {
+      return getOneOption("--display-fps");
+    }
+
+    return std::string();
+  }
+
+  bool use_tiled_display() {
+    return cmdOptExists("--tile");
+  }
+
+  const std::string get_pixel_layout() {
+    if (cmdOptExists("--layout") && !getOneOption("--layout").empty()) {
+      return getOneOption("--layout");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_deserialize_mode() {
+    if (cmdOptExists("--verify") && !getOneOption("--verify").empty()) {
+      return getOneOption("--verify");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_workers() {
+    if (cmdOptExists("--workers") && !getOneOption("--workers").empty()) {
+      return getOneOption("--workers");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_decoders() {
+    if (cmdOptExists("--decoders") && !getOneOption("--decoders").empty()) {
+      return getOneOption("--decoders");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_sched() {
+    if (cmdOptExists("--sched") && !getOneOption("--sched").empty()) {
+      return getOneOption("--sched");
+    }
+
+    return std::string();
+  }
+
+  bool use_mlock() {
+    return cmdOptExists("--mlock");
+  }
+
+  const std::string get_prefault() {
+    if (cmdOptExists("--prefault") && !getOneOption("--prefault").empty()) {
+      return getOneOption("--prefault");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_stats_interval() {
+    if (cmdOptExists("--stats-interval") && !getOneOption("--stats-interval").empty()) {
+      return getOneOption("--stats-interval");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_stats_dump_path() {
+    if (cmdOptExists("--stats-dump") && !getOneOption("--stats-dump").empty()) {
+      return getOneOption("--stats-dump");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_metrics_file() {
+    if (cmdOptExists("--metrics-file") && !getOneOption("--metrics-file").empty()) {
+      return getOneOption("--metrics-file");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_metrics_port() {
+    if (cmdOptExists("--metrics-port") && !getOneOption("--metrics-port").empty()) {
+      return getOneOption("--metrics-port");
+    }
+
+    return std::string();
+  }
+
+  const std::string get_metrics_interval() {
+    if (cmdOptExists("--metrics-interval") && !getOneOption("--metrics-interval").empty()) {
+      return getOneOption("--metrics-interval");
+    }
+
+    return std::string();
+  }
+
   void show_usage() {
     std::cout << "Usage: "
       << program_name_
       << " -a MQTT_Broker_IP_Addr"
       << " -p Server_TCP_Port"
-      << " -t Topic"
-      << " [-o Output_BMP_FILE_PATH]"
+      << " -t Topic[,Topic...]"
+      << " [--chunked [--chunk-timeout MS]]"
+      << " [--qos 0|1|2] [--mqtt5 [--receive-max N] [--max-packet KB]]"
+      << " [--tcp-nodelay] [--rcvbuf KB] [--keepalive Seconds]"
+      << " [--mqtt-loop start|thread[:Priority] | --reactor]"
+      << " [-o Output_FILE_PATH]"
+      << " [-f bmp|png[:Level]|raw|mjpeg[:Quality]|y4m|bgr]"
+      << " [--rotate-time Seconds] [--rotate-size MB] [--video-fps FPS]"
+      << " [-w Writer_Threads]"
+      << " [-W block|drop[:Queue_Len]]"
+      << " [-r Record_PATH [-s Segment_MB] [--direct-io]] [--shm Name[:Slots]]"
+      << " [-q block|drop-oldest|drop-newest|latest[:Capacity]]"
+      << " [--headless | --display-fps FPS [--tile]]"
+      << " [--workers N] [--decoders N] [--layout planar|interleaved]"
+      << " [--verify full|integrity|unchecked]"
+      << " [--sched Role=Spec[,Role=Spec...]] [--mlock] [--prefault MB[:Slabs]]"
+      << " [--stats-interval Seconds] [--stats-dump CSV_FILE]"
+      << " [--metrics-file PROM_FILE] [--metrics-port Port] [--metrics-interval Seconds]"
+      << std::endl;
+    std::cout << "       "
+      << program_name_
+      << " -i Replay_PATH [--rate fast|recorded|FPS]"
+      << " [Same options as above except -a, -p, -t, --chunked and the MQTT settings]"
       << std::endl;
   }
 
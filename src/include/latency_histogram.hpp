@@ -0,0 +1,114 @@
+#ifndef LATENCY_HISTOGRAM_HPP__
+#define LATENCY_HISTOGRAM_HPP__
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+// Lock free histogram of nanosecond values with log-linear buckets, in the
+// style of HdrHistogram. Every power of two is split into 32 linear buckets,
+// so values are kept with about 3 % precision. record() may be called from
+// any number of threads.
+class LatencyHistogram final {
+public:
+  LatencyHistogram() {
+    for (auto &bucket : buckets_) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void record(int64_t value) {
+    uint64_t v = value < 0 ? 0 : static_cast<uint64_t>(value);
+    buckets_[bucket_index(v)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(v, std::memory_order_relaxed);
+
+    uint64_t current = max_.load(std::memory_order_relaxed);
+    while (v > current &&
+           !max_.compare_exchange_weak(current, v, std::memory_order_relaxed)) {
+    }
+    current = min_.load(std::memory_order_relaxed);
+    while (v < current &&
+           !min_.compare_exchange_weak(current, v, std::memory_order_relaxed)) {
+    }
+  }
+
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+  uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+  uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+
+  uint64_t min() const {
+    return count() == 0 ? 0 : min_.load(std::memory_order_relaxed);
+  }
+
+  double mean() const {
+    uint64_t n = count();
+    return n == 0 ? 0 : static_cast<double>(sum_.load(std::memory_order_relaxed)) / n;
+  }
+
+  // Upper bound of the bucket holding the given percentile (0 - 100)
+  uint64_t percentile(double percentile) const {
+    uint64_t n = count();
+    if (n == 0) {
+      return 0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * n + 0.5);
+    if (rank == 0) {
+      rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBucketCount; ++i) {
+      seen += buckets_[i].load(std::memory_order_relaxed);
+      if (seen >= rank) {
+        uint64_t upper = bucket_upper_bound(i);
+        return upper < max() ? upper : max();
+      }
+    }
+    return max();
+  }
+
+  void reset() {
+    for (auto &bucket : buckets_) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+    min_.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr int kSubBucketBits = 5;
+  static constexpr uint64_t kSubBuckets = 1 << kSubBucketBits;
+  static constexpr size_t kBucketCount = (65 - kSubBucketBits) * kSubBuckets;
+
+  std::array<std::atomic_uint64_t, kBucketCount> buckets_;
+  std::atomic_uint64_t count_{0};
+  std::atomic_uint64_t sum_{0};
+  std::atomic_uint64_t max_{0};
+  std::atomic_uint64_t min_{std::numeric_limits<uint64_t>::max()};
+
+  static size_t bucket_index(uint64_t v) {
+    if (v < kSubBuckets * 2) {
+      return static_cast<size_t>(v);
+    }
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - kSubBucketBits;
+    return (shift + 1) * kSubBuckets + ((v >> shift) - kSubBuckets);
+  }
+
+  static uint64_t bucket_upper_bound(size_t index) {
+    if (index < kSubBuckets * 2) {
+      return index;
+    }
+    int shift = static_cast<int>(index / kSubBuckets) - 1;
+    uint64_t sub = index % kSubBuckets + kSubBuckets;
+    return ((sub + 1) << shift) - 1;
+  }
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef METRICS_EXPORTER_HPP__
+#define METRICS_EXPORTER_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "stream_router.hpp"
+#include "warning_limiter.hpp"
+
+struct MetricsConfig {
+  // Prometheus text file, replaced every interval. Empty for none.
+  std::string path;
+  // Port on 127.0.0.1 serving GET /metrics, 0 for none
+  uint16_t port{0};
+  std::chrono::seconds interval{5};
+};
+
+// Exports the counters of every stream in the Prometheus text format: frames
+// received, decoded, displayed and written, dropped frames by reason, queue
+// depths, ingest rates, stage latencies and buffer allocations.
+//
+// The counters are atomics the pipelines keep anyway. Every interval one
+// thread of its own takes a snapshot, works out the rates since the last
+// one and writes the file (through a temporary file and rename(), so a
+// scraper never sees half of it). The HTTP endpoint serves the latest
+// snapshot on the same thread, so scraping never touches the pipelines.
+class MetricsExporter final {
+public:
+  MetricsExporter(std::shared_ptr<StreamRouter> router, const MetricsConfig &config);
+  ~MetricsExporter();
+
+  MetricsExporter(const MetricsExporter &) = delete;
+  MetricsExporter &operator=(const MetricsExporter &) = delete;
+
+  // A value of the process outside the streams, like the MQTT reconnects.
+  // type is counter or gauge. Call before start().
+  void add_metric(const std::string &name, const std::string &type,
+                  const std::string &help, std::function<double()> value);
+
+  // Returns false if the port can't be bound
+  bool start();
+
+  // Updates the file once more, so it ends with the final counts
+  void stop();
+
+  uint64_t update_count() const { return update_count_; }
+  uint64_t request_count() const { return request_count_; }
+
+  void show_statistics();
+
+private:
+  struct Metric {
+    std::string name;
+    std::string type;
+    std::string help;
+    std::function<double()> value;
+  };
+
+  // A stream at the previous update, for the rates
+  struct Rate {
+    int64_t time_ns{0};
+    uint64_t decoded{0};
+    uint64_t received_bytes{0};
+    double fps{0};
+    double bytes_per_second{0};
+  };
+
+  std::shared_ptr<StreamRouter> router_;
+  MetricsConfig config_;
+  std::vector<Metric> metrics_;
+
+  // Only used by the exporter thread
+  std::map<std::string, Rate> rates_;
+  std::string text_;
+
+  int listen_fd_{-1};
+  // Wakes the thread up to stop
+  int wake_fds_[2]{-1, -1};
+  std::atomic_bool stop_{false};
+  std::thread thread_;
+
+  std::atomic_uint64_t update_count_{0};
+  std::atomic_uint64_t request_count_{0};
+  WarningLimiter write_warning_;
+
+  void run();
+  void update();
+  std::string render();
+  bool write_file(const std::string &text);
+  void serve(int fd);
+  bool listen_on(uint16_t port);
+  void close_fds();
+};
+
+#endif
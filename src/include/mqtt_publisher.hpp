@@ -0,0 +1,76 @@
+#ifndef MQTT_PUBLISHER_HPP__
+#define MQTT_PUBLISHER_HPP__
+
+#include <mosquitto.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+// Publishes payloads to a broker from the caller's thread, while libmosquitto
+// sends them from its network thread.
+//
+// libmosquitto queues every published message in memory, so publish() waits
+// while max_pending messages aren't written to the socket (QoS 0) or
+// acknowledged (QoS 1 and 2) yet. The publish rate then can't outrun the
+// broker. While the broker is away QoS 1 and 2 messages never complete, so
+// the wait also ends when the abort check set with set_abort() says so.
+class MqttPublisher final {
+public:
+  MqttPublisher(std::string broker_ip, int32_t broker_port, int qos,
+                size_t max_pending = 64);
+  ~MqttPublisher();
+
+  MqttPublisher(const MqttPublisher &) = delete;
+  MqttPublisher &operator=(const MqttPublisher &) = delete;
+
+  // Connects and starts the network thread
+  bool init();
+  // Waits for the CONNACK
+  bool wait_connected(std::chrono::milliseconds timeout);
+
+  // Checked while publish() waits, e.g. for a signal to exit. Call before
+  // publishing.
+  void set_abort(std::function<bool()> abort) { abort_ = std::move(abort); }
+
+  // Copies the payload. Returns false if it couldn't be queued, or the wait
+  // for the broker was aborted.
+  bool publish(const std::string &topic, const void *payload, size_t len);
+
+  // Wakes a blocked publish() and disconnects
+  void stop();
+
+  bool is_connect_broker() const { return is_connected_; }
+  uint64_t published_count() const { return published_count_; }
+  uint64_t failed_count() const { return failed_count_; }
+  size_t pending_count();
+
+private:
+  std::string broker_ip_;
+  int32_t broker_port_;
+  int qos_;
+  size_t max_pending_;
+  std::function<bool()> abort_;
+
+  struct mosquitto *mosq_{nullptr};
+
+  std::atomic_bool is_connected_{false};
+  std::atomic_bool connack_{false};
+  std::atomic_bool stop_{false};
+  std::atomic_uint64_t published_count_{0};
+  std::atomic_uint64_t failed_count_{0};
+
+  std::mutex pending_mutex_;
+  std::condition_variable pending_cond_;
+  size_t pending_{0};
+
+  static void on_connect(struct mosquitto *mosq, void *obj, int reason_code);
+  static void on_disconnect(struct mosquitto *mosq, void *obj, int reason_code);
+  static void on_publish(struct mosquitto *mosq, void *obj, int mid);
+};
+
+#endif
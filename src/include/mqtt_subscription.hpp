@@ -6,42 +6,126 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <cstdint>
+#include <functional>
 #include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
-#include "msg_queue.hpp"
+#include "event_loop.hpp"
+#include "stream_router.hpp"
+#include "warning_limiter.hpp"
 
+// How the subscription talks to the broker. The defaults are what the
+// viewer always did: MQTT 3.1.1, QoS 1, a 60 s keepalive and the network
+// loop of mosquitto_loop_start().
+struct MqttSubscriptionConfig {
+  int qos{1};
+  // MQTT v5 lets the client limit the QoS 1 and 2 messages the broker sends
+  // before they are acknowledged, and the size of a packet. 0 keeps the
+  // defaults (20 messages, no size limit).
+  bool mqtt5{false};
+  uint16_t receive_maximum{0};
+  uint32_t max_packet_size{0};
+  bool tcp_nodelay{false};
+  // SO_RCVBUF of the socket in bytes, 0 keeps the kernel default
+  int receive_buffer{0};
+  int keepalive{60};
+  // Run the network loop on a thread of our own, at SCHED_FIFO priority
+  // loop_priority if that is above 0
+  bool loop_thread{false};
+  int loop_priority{0};
+};
+
+// Subscribes to one or more topics (wildcards allowed) and hands every
+// message to the StreamRouter, which queues it on the stream of its topic.
+// With chunked streams the stream reassembles the frame first.
 class MqttSubscription final{
 public:
+  // Called on the network thread, the payload is only valid during the call
+  using MessageHandler = std::function<void(const char *topic, const void *payload, size_t len)>;
+
+  MqttSubscription(std::string broker_ip, int32_t broker_port,
+                   std::vector<std::string> topics,
+                   std::shared_ptr<StreamRouter> &router,
+                   const MqttSubscriptionConfig &config = MqttSubscriptionConfig())
+      : MqttSubscription(broker_ip, broker_port, topics,
+                         [router](const char *topic, const void *payload, size_t len) {
+                           router->route(topic, payload, len);
+                         },
+                         config) {}
+  // Messages go to handler instead of a router
   MqttSubscription(std::string broker_ip, int32_t broker_port,
-                   std::string topic,
-                   std::shared_ptr<MsgQueue<std::vector<uint8_t>>> &queue);
+                   std::vector<std::string> topics, MessageHandler handler,
+                   const MqttSubscriptionConfig &config = MqttSubscriptionConfig());
   ~MqttSubscription();
 
-  void init();
+  // Call before init() to let loop drive the connection instead of a
+  // network thread. init(), stop() and the message handler then run on the
+  // thread of the loop, and the loop reconnects.
+  void attach(EventLoop &loop);
 
-  std::string get_topic();
+  // Connects and starts the network loop
+  bool init();
+  // Disconnects and stops the network loop, no messages come in afterwards
+  void stop();
+
+  const std::vector<std::string> &get_topics();
 
   bool is_connect_broker();
   void update_connect_status(bool is_connected);
+  // The broker granted at least one of the topics
+  bool is_subscribed() const { return is_subscribed_; }
+
+  // Connections made after the first one, mosquitto reconnects by itself
+  uint64_t reconnect_count() const { return reconnect_count_; }
+  uint64_t disconnect_count() const { return disconnect_count_; }
 
-  std::shared_ptr<MsgQueue<std::vector<uint8_t>>> get_msg_queue();
+  const MqttSubscriptionConfig &config() const { return config_; }
+  // Like "QoS 1, MQTT 5 (receive maximum 100), TCP_NODELAY"
+  static std::string describe(const MqttSubscriptionConfig &config);
 
 private:
   std::string broker_ip_;
   int32_t broker_port_;
-  std::string topic_;
+  std::vector<std::string> topics_;
+  MessageHandler handler_;
+  MqttSubscriptionConfig config_;
 
   std::atomic_bool is_connected_{false};
+  std::atomic_bool is_subscribed_{false};
+  std::atomic_uint64_t connect_count_{0};
+  std::atomic_uint64_t reconnect_count_{0};
+  std::atomic_uint64_t disconnect_count_{0};
+  std::atomic_bool stop_{false};
+  bool loop_started_{false};
+  std::thread loop_thread_;
+  // Set on purpose disconnects, which aren't reconnected
+  std::atomic_bool given_up_{false};
 
-  std::shared_ptr<MsgQueue<std::vector<uint8_t>>> queue_;
+  // Only with an EventLoop
+  EventLoop *loop_{nullptr};
+  int socket_fd_{-1};
+  uint32_t socket_events_{0};
+  int misc_timer_{-1};
+  WarningLimiter reconnect_warning_;
 
   struct mosquitto * mosq_{nullptr};
 
+  void run_loop();
+  void tune_socket();
+  void give_up();
+
+  void watch_socket();
+  void on_socket(uint32_t events);
+  void on_misc();
+
   static void on_connect(struct mosquitto *mosq, void *obj, int reason_code);
+  static void on_disconnect(struct mosquitto *mosq, void *obj, int reason_code);
   static void on_subscribe(struct mosquitto *mosq, void *obj, int mid,
                            int qos_count, const int *granted_qos);
   static void on_message(struct mosquitto *mosq, void *obj, const struct mosquitto_message *msg);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,81 @@
+#ifndef MSG_DESERIALIZER_HPP__
+#define MSG_DESERIALIZER_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "img_msg.hpp"
+
+// How much cista verifies of a received payload
+enum class DeserializeMode {
+  FULL,       // bounds check every pointer and element (cista's default)
+  INTEGRITY,  // the payload starts with a checksum, which is verified
+  UNCHECKED   // trust the payload, only fix up the pointers
+};
+
+static inline bool parse_deserialize_mode(const std::string &name, DeserializeMode &mode)
+{
+  if (name == "full") {
+    mode = DeserializeMode::FULL;
+  } else if (name == "integrity") {
+    mode = DeserializeMode::INTEGRITY;
+  } else if (name == "unchecked") {
+    mode = DeserializeMode::UNCHECKED;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static inline const char *deserialize_mode_name(DeserializeMode mode)
+{
+  switch (mode) {
+  case DeserializeMode::INTEGRITY:
+    return "integrity";
+  case DeserializeMode::UNCHECKED:
+    return "unchecked";
+  default:
+    return "full";
+  }
+}
+
+// Deserializes img_msg payloads in place.
+//
+// In every mode check_header() runs first. It only reads the fixed size part
+// of the message, so it takes the same time for any frame size, and makes
+// sure the dimensions are sane and the encoding and the pixel data lie inside
+// the payload. That is all the receiver reads, so unchecked payloads can't
+// make it read out of bounds either.
+//
+// The sender has to serialize with cista::mode::WITH_INTEGRITY for the
+// integrity mode, which puts an 8 byte checksum in front of the message.
+class MsgDeserializer final {
+public:
+  explicit MsgDeserializer(DeserializeMode mode = DeserializeMode::FULL);
+
+  // Returns nullptr if the payload is rejected, error() tells why
+  const imx500_img_transport::img_msg *deserialize(uint8_t *payload, size_t size);
+
+  DeserializeMode mode() const { return mode_; }
+  const std::string &error() const { return error_; }
+
+  // Returns nullptr if the header is fine, else the reason
+  static const char *check_header(const uint8_t *payload, size_t size,
+                                  DeserializeMode mode);
+
+  // The message in a payload which isn't deserialized yet. Only the plain
+  // fields (timestamp, height, width) can be read. nullptr if too short.
+  static const imx500_img_transport::img_msg *header(const uint8_t *payload,
+                                                     size_t size,
+                                                     DeserializeMode mode);
+
+  // Bytes in front of the message
+  static size_t header_offset(DeserializeMode mode);
+
+private:
+  DeserializeMode mode_;
+  std::string error_;
+};
+
+#endif
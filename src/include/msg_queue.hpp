@@ -3,28 +3,64 @@
 
 #include <atomic>
 #include <condition_variable>
-#include <iostream>
+#include <cstdint>
+#include <cstdio>
 #include <memory>
 #include <mutex>
 #include <queue>
 
+#include "warning_limiter.hpp"
+
+// Interface shared by the unbounded MsgQueue and the BoundedMsgQueue, so the
+// subscriber and the stream pipelines don't depend on the queue implementation.
 template<class MSG_TYPE>
-class MsgQueue {
+class MsgQueueBase {
 public:
-  void add_msg_to_queue(std::shared_ptr<MSG_TYPE> msg)
+  virtual ~MsgQueueBase() = default;
+
+  virtual void add_msg_to_queue(std::shared_ptr<MSG_TYPE> msg) = 0;
+  virtual std::shared_ptr<MSG_TYPE> get_msg_from_queue() = 0;
+  // Returns nullptr instead of waiting if the queue is empty
+  virtual std::shared_ptr<MSG_TYPE> try_get_msg_from_queue() = 0;
+  virtual void wakeup_for_exit() = 0;
+  virtual void clean_queue() = 0;
+  virtual bool is_empty() = 0;
+  // Messages discarded by the overflow policy
+  virtual uint64_t dropped_count() const { return 0; }
+  // Messages queued now, and the most there ever were
+  virtual size_t size() = 0;
+  virtual size_t peak_size() const = 0;
+  virtual void show_statistics() {}
+};
+
+template<class MSG_TYPE>
+class MsgQueue : public MsgQueueBase<MSG_TYPE> {
+public:
+  void add_msg_to_queue(std::shared_ptr<MSG_TYPE> msg) override
   {
+    size_t size;
     {
       std::lock_guard<std::mutex> lock(queue_mutex_);
       queue_.push(msg);
-      if (queue_.size() > 1000) {
-        std::cout << "Warning: The size of queue > 1000 and sender isn't ready !!!" << std::endl;
+      size = queue_.size();
+      if (size > peak_size_) {
+        peak_size_ = size;
       }
     }
 
     cond_.notify_one();
+
+    // The producer is the network thread, printing on every message would
+    // only fall further behind
+    uint64_t suppressed;
+    if (size > kWarningSize && overflow_warning_.allow(&suppressed)) {
+      std::printf("Warning: %lu messages queued, the consumer isn't keeping up "
+                  "(%lu more warnings)\n",
+                  static_cast<unsigned long>(size), static_cast<unsigned long>(suppressed));
+    }
   }
 
-  std::shared_ptr<MSG_TYPE> get_msg_from_queue()
+  std::shared_ptr<MSG_TYPE> get_msg_from_queue() override
   {
     if (!is_empty()) {
       return get_msg();
@@ -39,27 +75,56 @@ public:
     }
   }
 
-  void wakeup_for_exit()
+  std::shared_ptr<MSG_TYPE> try_get_msg_from_queue() override
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (queue_.empty()) {
+      return std::shared_ptr<MSG_TYPE>();
+    }
+    std::shared_ptr<MSG_TYPE> msg = queue_.front();
+    queue_.pop();
+    return msg;
+  }
+
+  void wakeup_for_exit() override
   {
     exit_ = true;
     cond_.notify_one();
   }
 
-  void clean_queue()
+  void clean_queue() override
   {
     std::lock_guard<std::mutex> lock(queue_mutex_);
     queue_ = std::queue<std::shared_ptr<MSG_TYPE>>();
   }
 
-  bool is_empty()
+  bool is_empty() override
   {
     std::lock_guard<std::mutex> lock(queue_mutex_);
     return queue_.empty();
   }
 
+  size_t size() override
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    return queue_.size();
+  }
+
+  size_t peak_size() const override { return peak_size_; }
+
+  void show_statistics() override
+  {
+    std::printf("Queue (unbounded): peak %lu queued\n",
+                static_cast<unsigned long>(peak_size_.load()));
+  }
+
 private:
+  static constexpr size_t kWarningSize = 1000;
+
   std::mutex queue_mutex_;
   std::queue<std::shared_ptr<MSG_TYPE>> queue_;
+  std::atomic<size_t> peak_size_{0};
+  WarningLimiter overflow_warning_;
   std::mutex cond_mutex_;
   std::condition_variable cond_;
   std::atomic_bool exit_{false};
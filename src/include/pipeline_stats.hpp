@@ -0,0 +1,144 @@
+#ifndef PIPELINE_STATS_HPP__
+#define PIPELINE_STATS_HPP__
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "latency_histogram.hpp"
+
+static inline int64_t steady_clock_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Same clock as img_msg::timestamp on the sender
+static inline int64_t realtime_clock_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Throughput of the receive pipeline and latency of each of its stages
+class PipelineStats final {
+public:
+  enum Stage {
+    NETWORK,      // from img_msg::timestamp until on_message, needs synced clocks
+    REASSEMBLE,   // from the first until the last chunk of a chunked frame
+    QUEUE,        // from on_message (or replay) until a worker takes it
+    DESERIALIZE,
+    DECODE,       // cv::imdecode() of a compressed frame
+    CONVERT,
+    REORDER,      // a decoded frame waiting for the frames received before it
+    WRITE,        // handing the frame to the writer and the recorder
+    DISPLAY,      // from handing the frame to the display until it is shown
+    TOTAL,        // from on_message until the frame is done
+    STAGE_COUNT
+  };
+
+  // The name tells the streams apart in the reports
+  explicit PipelineStats(const std::string &name = std::string()) : name_(name) {}
+
+  PipelineStats(const PipelineStats &) = delete;
+  PipelineStats &operator=(const PipelineStats &) = delete;
+
+  void record(Stage stage, int64_t duration_ns) {
+    histograms_[stage].record(duration_ns);
+    interval_histograms_[stage].record(duration_ns);
+  }
+
+  // Time a thread spent working on a stage. Several threads may work on a
+  // stage at once, so the busy time can exceed the wall time.
+  void add_busy(Stage stage, int64_t duration_ns) {
+    busy_ns_[stage] += duration_ns;
+    interval_busy_ns_[stage] += duration_ns;
+  }
+
+  // A stage which keeps its thread busy all along
+  void record_work(Stage stage, int64_t duration_ns) {
+    record(stage, duration_ns);
+    add_busy(stage, duration_ns);
+  }
+
+  // Called once a frame went through the whole pipeline
+  void add_frame(uint64_t payload_size);
+
+  // A compressed frame of payload_size bytes decoded to image_size bytes
+  void add_compressed(uint64_t payload_size, uint64_t image_size) {
+    compressed_count_++;
+    compressed_bytes_ += payload_size;
+    decompressed_bytes_ += image_size;
+  }
+
+  // Checks img_msg::timestamp against the previous frame of the stream.
+  // Only called from one thread at a time.
+  void add_timestamp(int64_t timestamp);
+
+  uint64_t frame_count() const { return frame_count_; }
+  uint64_t byte_count() const { return byte_count_; }
+  // From the first to the last frame
+  double active_seconds() const { return (last_frame_ns_ - first_frame_ns_) / 1e9; }
+  uint64_t duplicate_count() const { return duplicate_count_; }
+  uint64_t reordered_count() const { return reordered_count_; }
+  uint64_t gap_count() const { return gap_count_; }
+  // Decoded image size over compressed size, 0 without compressed frames
+  double compression_ratio() const {
+    return compressed_bytes_ > 0 ? static_cast<double>(decompressed_bytes_) / compressed_bytes_
+                                 : 0;
+  }
+  uint64_t missing_count() const { return missing_count_; }
+  const LatencyHistogram &histogram(Stage stage) const { return histograms_[stage]; }
+  // Busy time of a stage over the active time, 1 is one core all along
+  double utilization(Stage stage) const {
+    double seconds = active_seconds();
+    return seconds > 0 ? busy_ns_[stage] / 1e9 / seconds : 0;
+  }
+
+  // Frames/s, MB/s and latency percentiles of every stage
+  void show_summary();
+
+  // What happened since the last call, which was seconds ago
+  void show_interval(double seconds);
+
+  // Write the percentile distribution of every stage as CSV rows
+  // (stream,stage,percentile,value_ns,count)
+  void dump(FILE *file);
+  static void dump_header(FILE *file);
+
+  static const char *stage_name(Stage stage);
+
+private:
+  std::string name_;
+  std::array<LatencyHistogram, STAGE_COUNT> histograms_;
+  std::array<LatencyHistogram, STAGE_COUNT> interval_histograms_;
+  std::array<std::atomic_int64_t, STAGE_COUNT> busy_ns_{};
+  std::array<std::atomic_int64_t, STAGE_COUNT> interval_busy_ns_{};
+  std::atomic_uint64_t frame_count_{0};
+  std::atomic_uint64_t byte_count_{0};
+  std::atomic_uint64_t interval_frame_count_{0};
+  std::atomic_int64_t first_frame_ns_{0};
+  std::atomic_int64_t last_frame_ns_{0};
+
+  // Timestamp checks
+  int64_t last_timestamp_{0};
+  int64_t frame_interval_ns_{0};  // running average of the normal deltas
+  std::atomic_uint64_t duplicate_count_{0};
+  std::atomic_uint64_t reordered_count_{0};
+  std::atomic_uint64_t gap_count_{0};
+  std::atomic_uint64_t missing_count_{0};
+
+  std::atomic_uint64_t compressed_count_{0};
+  std::atomic_uint64_t compressed_bytes_{0};
+  std::atomic_uint64_t decompressed_bytes_{0};
+
+  // busy_ns over seconds gives the busy column
+  static void show_histograms(const std::array<LatencyHistogram, STAGE_COUNT> &histograms,
+                              const std::array<std::atomic_int64_t, STAGE_COUNT> &busy_ns,
+                              double seconds);
+};
+
+#endif
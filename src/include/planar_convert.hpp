@@ -0,0 +1,65 @@
+#ifndef PLANAR_CONVERT_HPP__
+#define PLANAR_CONVERT_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Converts a planar rgb8 image (R plane, G plane, B plane) to interleaved BGR
+// and scales its width in the same pass.
+//
+// The result is bit exact with cv::merge() followed by cv::resize() with
+// INTER_LINEAR, as long as the height isn't changed. The coefficients follow
+// OpenCV's 11 bit fixed point linear resize. If the width isn't changed it is
+// a plain interleave.
+class PlanarToBgrScaler final {
+public:
+  enum class Isa { SCALAR, SSE2, AVX2 };
+
+  // Use the best instruction set supported by this CPU
+  PlanarToBgrScaler();
+  explicit PlanarToBgrScaler(Isa isa);
+
+  // Only the width can be scaled
+  static bool supports(uint32_t src_width, uint32_t src_height,
+                       uint32_t dst_width, uint32_t dst_height) {
+    return src_width > 0 && src_height > 0 && dst_width > 0 &&
+           src_height == dst_height;
+  }
+
+  // planar holds 3 * width * height bytes. dst holds height rows of
+  // dst_width * 3 bytes, dst_step bytes apart.
+  void convert(const uint8_t *planar, uint32_t width, uint32_t height,
+               uint8_t *dst, size_t dst_step, uint32_t dst_width);
+
+  // One row given as separate R, G and B rows of width bytes each. dst
+  // holds dst_width * 3 bytes.
+  void convert_row(const uint8_t *r, const uint8_t *g, const uint8_t *b,
+                   uint32_t width, uint8_t *dst, uint32_t dst_width);
+
+  Isa isa() const { return isa_; }
+
+  static Isa detect_isa();
+  static bool isa_supported(Isa isa);
+  static const char *isa_name(Isa isa);
+
+private:
+  Isa isa_;
+
+  // Horizontal coefficients, rebuilt only when the geometry changes
+  uint32_t width_{0};
+  uint32_t dst_width_{0};
+  std::vector<int32_t> xofs_;   // left source pixel of each output pixel
+  std::vector<int32_t> xofs1_;  // right source pixel, clamped to the row
+  std::vector<int16_t> alpha_;  // (left, right) weight pairs
+  uint32_t simd_end_{0};        // first output pixel the SIMD loop can't do
+
+  void prepare(uint32_t width, uint32_t dst_width);
+
+  void interleave_row(const uint8_t *r, const uint8_t *g, const uint8_t *b,
+                      uint8_t *dst, uint32_t width);
+  void scale_row(const uint8_t *r, const uint8_t *g, const uint8_t *b,
+                 uint8_t *dst);
+};
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef PUBLISHER_PARAM_PARSER_HPP__
+#define PUBLISHER_PARAM_PARSER_HPP__
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// This class is used for parsing the command arguments of img_publisher
+class PublisherParamParser final {
+public:
+  PublisherParamParser(int argc, char **argv) {
+    program_name_ = std::string(argv[0]);
+    for (int i = 1; i < argc; ++i) {
+      this->param_tokens_.push_back(std::string(argv[i]));
+    }
+  }
+
+  PublisherParamParser(const PublisherParamParser &) = delete;
+  PublisherParamParser(PublisherParamParser &&) = delete;
+  PublisherParamParser &
+  operator=(const PublisherParamParser &) = delete;
+  PublisherParamParser &&
+  operator=(PublisherParamParser &&) = delete;
+
+  const std::string get_broker_addr() {
+    return getNonEmptyOption("-a");
+  }
+
+  const std::string get_broker_port() {
+    return getNonEmptyOption("-p");
+  }
+
+  const std::string get_topic() {
+    return getNonEmptyOption("-t");
+  }
+
+  const std::string get_qos() {
+    return getNonEmptyOption("--qos");
+  }
+
+  const std::string get_frame_size() {
+    return getNonEmptyOption("--size");
+  }
+
+  const std::string get_encoding() {
+    return getNonEmptyOption("-e");
+  }
+
+  const std::string get_pixel_layout() {
+    return getNonEmptyOption("--layout");
+  }
+
+  const std::string get_quality() {
+    return getNonEmptyOption("--quality");
+  }
+
+  const std::string get_chunk_size() {
+    return getNonEmptyOption("--chunk-size");
+  }
+
+  const std::string get_fps() {
+    return getNonEmptyOption("--fps");
+  }
+
+  const std::string get_burst() {
+    return getNonEmptyOption("--burst");
+  }
+
+  const std::string get_frame_count() {
+    return getNonEmptyOption("-n");
+  }
+
+  const std::string get_timestamp_mode() {
+    return getNonEmptyOption("--timestamp");
+  }
+
+  const std::string get_clock_offset() {
+    return getNonEmptyOption("--clock-offset");
+  }
+
+  const std::string get_skip_every() {
+    return getNonEmptyOption("--skip-every");
+  }
+
+  const std::string get_delta_tile_size() {
+    return getNonEmptyOption("--delta");
+  }
+
+  const std::string get_keyframe_interval() {
+    return getNonEmptyOption("--keyframe-interval");
+  }
+
+  const std::string get_moving_box() {
+    return getNonEmptyOption("--moving-box");
+  }
+
+  bool use_integrity() {
+    return cmdOptExists("--integrity");
+  }
+
+  const std::string get_output_path() {
+    return getNonEmptyOption("-o");
+  }
+
+  const std::string get_record_path() {
+    return getNonEmptyOption("-r");
+  }
+
+  void show_usage() {
+    std::cout << "Usage: "
+      << program_name_
+      << " [-a MQTT_Broker_IP_Addr -p Server_TCP_Port -t Topic[,Topic...] [--qos 0|1|2] [--chunk-size KB]]"
+      << " [-o Output_FILE_PATH] [-r Record_PATH]"
+      << std::endl;
+    std::cout << "       "
+      << " [--size WIDTHxHEIGHT] [-e Encoding] [--layout planar|interleaved] [--quality Q] [--integrity]"
+      << " [--delta Tile_Size [--keyframe-interval Frames]] [--moving-box Pixels]"
+      << " [--fps FPS] [--burst Frames] [-n Frames]"
+      << " [--timestamp now|synthetic] [--clock-offset MS] [--skip-every N]"
+      << std::endl;
+  }
+
+private:
+  std::string program_name_;
+  std::vector<std::string> param_tokens_;
+
+  const std::string getNonEmptyOption(const std::string &opt) const {
+    if (cmdOptExists(opt) && !getOneOption(opt).empty()) {
+      return getOneOption(opt);
+    }
+
+    return std::string();
+  }
+
+  const std::string getOneOption(const std::string &opt) const {
+    std::vector<std::string>::const_iterator iter;
+
+    iter = std::find(this->param_tokens_.begin(), this->param_tokens_.end(), opt);
+    if (iter != this->param_tokens_.end() && ++iter != this->param_tokens_.end()) {
+      return *iter;
+    }
+
+    return std::string();
+  }
+
+  bool cmdOptExists(const std::string &opt) const {
+    return std::find(this->param_tokens_.begin(), this->param_tokens_.end(),
+                     opt) != this->param_tokens_.end();
+  }
+};
+
+#endif
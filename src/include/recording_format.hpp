@@ -0,0 +1,38 @@
+#ifndef RECORDING_FORMAT_HPP__
+#define RECORDING_FORMAT_HPP__
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// On disk layout of a recording directory:
+//   segment_<n>.dat  serialized img_msg payloads, each starting at a multiple
+//                    of kRecordAlignment so it can be deserialized in place
+//   segment_<n>.idx  RecordingIndexHeader followed by one entry per payload
+
+constexpr char kRecordingIndexMagic[8] = {'I', 'M', 'G', 'R', 'E', 'C', 'I', 'X'};
+constexpr uint32_t kRecordingVersion = 1;
+constexpr uint64_t kRecordAlignment = 64;
+
+struct RecordingIndexHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t entry_size;
+};
+
+struct RecordingIndexEntry {
+  uint64_t offset;    // in segment_<n>.dat
+  uint64_t size;      // of the serialized payload
+  int64_t timestamp;  // img_msg::timestamp, ns
+};
+
+static inline std::string recording_segment_name(const std::string &path,
+                                                 uint32_t segment,
+                                                 const char *extension)
+{
+  char name[32];
+  std::snprintf(name, sizeof(name), "/segment_%05u%s", segment, extension);
+  return path + name;
+}
+
+#endif
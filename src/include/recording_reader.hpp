@@ -0,0 +1,74 @@
+#ifndef RECORDING_READER_HPP__
+#define RECORDING_READER_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "img_msg.hpp"
+#include "msg_deserializer.hpp"
+#include "recording_format.hpp"
+
+// Maps a recording written by FrameRecorder and gives access to any frame in
+// O(1) without copying it.
+//
+// Segments are mapped privately and writable, so cista can deserialize a
+// frame in place. Only the pages touched by the pointer fix up are copied,
+// the pixel data stays shared with the page cache.
+class RecordingReader final {
+public:
+  RecordingReader() = default;
+  ~RecordingReader();
+
+  RecordingReader(const RecordingReader &) = delete;
+  RecordingReader &operator=(const RecordingReader &) = delete;
+
+  // mode is the one the frames were received with
+  bool open(const std::string &path, DeserializeMode mode = DeserializeMode::FULL);
+  void close();
+
+  size_t frame_count() const { return frames_.size(); }
+
+  // Serialized payload of a frame, as it was received
+  const uint8_t *frame_data(size_t index) const;
+  size_t frame_size(size_t index) const { return entry(index).size; }
+  int64_t frame_timestamp(size_t index) const { return entry(index).timestamp; }
+
+  // Deserializes the frame in place the first time it is requested.
+  // Returns nullptr if the payload is corrupt.
+  const imx500_img_transport::img_msg *frame(size_t index);
+
+private:
+  struct Mapping {
+    uint8_t *data{nullptr};
+    size_t size{0};
+  };
+
+  struct Segment {
+    Mapping data;
+    Mapping index;
+    const RecordingIndexEntry *entries{nullptr};
+    size_t entry_count{0};
+  };
+
+  struct FrameLocation {
+    uint32_t segment;
+    uint32_t entry;
+  };
+
+  std::vector<Segment> segments_;
+  std::vector<FrameLocation> frames_;
+  std::vector<bool> deserialized_;
+  DeserializeMode mode_{DeserializeMode::FULL};
+
+  const RecordingIndexEntry &entry(size_t index) const {
+    const auto &location = frames_[index];
+    return segments_[location.segment].entries[location.entry];
+  }
+
+  static bool map_file(const std::string &file, bool writable, Mapping &mapping);
+  static void unmap(Mapping &mapping);
+};
+
+#endif
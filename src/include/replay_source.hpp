@@ -0,0 +1,78 @@
+#ifndef REPLAY_SOURCE_HPP__
+#define REPLAY_SOURCE_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "recording_reader.hpp"
+#include "stream_router.hpp"
+
+// Feeds recorded payloads into a stream instead of MqttSubscription, so the
+// receive pipeline can run without a broker.
+//
+// The path is either a recording made with -r, or a directory of files which
+// each hold one serialized img_msg (replayed in file name order). Payloads go
+// through the BufferPool of the stream just like the ones received from MQTT.
+// wait() returns once all frames are queued, on_done is called then.
+class ReplaySource final {
+public:
+  enum class Rate {
+    FAST,      // as fast as the queue accepts them
+    RECORDED,  // keep the gaps between the recorded timestamps
+    FIXED      // at a given frame rate
+  };
+
+  ReplaySource(const std::string &path, std::shared_ptr<StreamRouter> &router,
+               Rate rate, double fps = 0);
+  ~ReplaySource();
+
+  ReplaySource(const ReplaySource &) = delete;
+  ReplaySource &operator=(const ReplaySource &) = delete;
+
+  // Returns false if the path holds no frames
+  bool open();
+
+  // on_done is called on the replay thread
+  void start(std::function<void()> on_done = nullptr);
+  void wait();
+  void stop();
+
+  size_t frame_count() const;
+
+  // RATE is fast, recorded or a frame rate
+  static bool parse_rate(const std::string &param, Rate &rate, double &fps);
+
+private:
+  std::string path_;
+  std::shared_ptr<StreamRouter> router_;
+  std::shared_ptr<StreamPipeline> stream_;
+  Rate rate_;
+  double fps_;
+
+  RecordingReader reader_;
+  bool use_reader_{false};
+  std::vector<std::string> files_;
+  std::vector<uint8_t> file_buffer_;
+
+  // stop() wakes up the replay waiting for the time of the next frame
+  std::mutex stop_mutex_;
+  std::condition_variable stop_cond_;
+  std::atomic_bool stop_{false};
+  std::thread thread_;
+  std::function<void()> on_done_;
+
+  void run();
+  // Returns false if stopped before time
+  bool sleep_until(std::chrono::steady_clock::time_point time);
+  bool load(size_t index, const uint8_t *&data, size_t &size, int64_t &timestamp);
+};
+
+#endif
@@ -0,0 +1,299 @@
+#ifndef STREAM_PIPELINE_HPP__
+#define STREAM_PIPELINE_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "bounded_msg_queue.hpp"
+#include "buffer_pool.hpp"
+#include "chunk_assembler.hpp"
+#include "decode_pool.hpp"
+#include "frame_decoder.hpp"
+#include "frame_pool.hpp"
+#include "frame_recorder.hpp"
+#include "frame_ring_writer.hpp"
+#include "frame_sink.hpp"
+#include "image_writer.hpp"
+#include "msg_deserializer.hpp"
+#include "msg_queue.hpp"
+#include "pipeline_stats.hpp"
+#include "tile_compositor.hpp"
+#include "video_file_writer.hpp"
+#include "warning_limiter.hpp"
+
+// How every stream is set up
+struct StreamConfig {
+  // Without a bounded queue the queue is unbounded
+  bool bounded_queue{false};
+  OverflowPolicy queue_policy{OverflowPolicy::BLOCK};
+  size_t queue_capacity{8};
+
+  // Every message is a chunk of a frame (see chunk_format.hpp). Frames
+  // missing chunks after chunk_timeout are discarded.
+  bool chunked{false};
+  std::chrono::milliseconds chunk_timeout{1000};
+
+  // prefault_slabs buffers for frames up to prefault_size bytes are
+  // allocated and faulted in up front, 0 allocates them as frames arrive
+  uint64_t prefault_size{0};
+  uint32_t prefault_slabs{8};
+
+  // Layout of img_msg::data, the encoding comes with every message
+  PixelLayout layout{PixelLayout::PLANAR};
+  DeserializeMode deserialize_mode{DeserializeMode::FULL};
+
+  // An empty path disables writing or recording. Frames go either to image
+  // files or to video files.
+  ImageWriterConfig writer;
+  VideoFileWriterConfig video;
+  std::string record_path;
+  uint64_t segment_size{1024ull * 1024 * 1024};
+  bool direct_io{false};
+  // A shm_open() name to publish the decoded frames under, empty for none
+  std::string shm_name;
+  uint32_t shm_slots{8};
+
+  // img_msg::timestamp is compared with the receive time. Replayed
+  // timestamps are old, they only tell about gaps.
+  bool sender_latency{true};
+};
+
+// What a stream did so far, for the metrics. Every frame received ends up
+// decoded or dropped for one of the reasons below, apart from the ones still
+// on their way.
+struct StreamMetrics {
+  uint64_t received{0};
+  uint64_t received_bytes{0};
+  uint64_t decoded{0};
+  uint64_t displayed{0};  // or taken by the application
+  uint64_t written{0};   // image files
+  uint64_t video_written{0};
+  uint64_t recorded{0};
+  uint64_t shm_written{0};
+
+  // Dropped frames by reason
+  uint64_t queue_dropped{0};     // by the overflow policy of the stream queue
+  uint64_t rejected{0};          // malformed payloads
+  uint64_t decode_errors{0};
+  uint64_t unsupported{0};
+  uint64_t discarded{0};         // too little pixel data, or a delta without its base
+  uint64_t incomplete_chunks{0}; // frames missing chunks
+  // Decoded, but left out by the writer or the display
+  uint64_t writer_dropped{0};
+  uint64_t write_errors{0};
+  uint64_t display_skipped{0};
+
+  size_t queue_size{0};
+  size_t queue_peak{0};
+  size_t reorder_peak{0};
+  uint64_t allocations{0};  // buffer pool slabs
+  // Converted frames taken from the frame pools or allocated, and the
+  // memory the pools hold
+  uint64_t frame_pool_hits{0};
+  uint64_t frame_pool_misses{0};
+  size_t frame_pool_bytes{0};
+};
+
+// The receive pipeline of one camera: its queue, buffer pool and decoders,
+// plus its writers, recorder and the stream of the frame sink.
+//
+// push() is called by the producer (the MQTT network thread or the replay).
+// process() may be called from any worker thread, but only by one at a time,
+// which the StreamRouter takes care of.
+//
+// A frame goes through these stages:
+// - dispatch (the worker): records the payload and gives the frame a
+//   sequence number
+// - deserialize and convert (the decode pool): raw frames are converted,
+//   large ones in row stripes on several threads, compressed frames (jpeg,
+//   png) are decoded with cv::imdecode()
+// - emit (whichever thread finishes the next frame in sequence): applies the
+//   tiles of delta frames, which depend on the frame before, and hands the
+//   frame and the ones buffered behind it to the writer and the sink
+// - write on its own threads, the shared memory ring is written and the sink
+//   gets the frames by emit (the display renders them on its own thread)
+// Several frames of the stream are converted at once, but they come out in
+// the order they were received, which is the order of their timestamps.
+// The stream queue, the frames in flight, the writer queue and the frames
+// held by the sink are all bounded. Without a decode pool the worker does everything
+// up to emitting.
+class StreamPipeline final {
+public:
+  // sink and decode_pool may be nullptr
+  StreamPipeline(uint32_t id, const std::string &name, const StreamConfig &config,
+                 std::shared_ptr<FrameSink> sink, std::shared_ptr<DecodePool> decode_pool);
+  ~StreamPipeline();
+
+  StreamPipeline(const StreamPipeline &) = delete;
+  StreamPipeline &operator=(const StreamPipeline &) = delete;
+
+  uint32_t id() const { return id_; }
+  const std::string &name() const { return name_; }
+
+  // Copy the payload into a pooled buffer and queue it. A chunk is copied
+  // into its frame, which is queued with the last chunk. Returns whether a
+  // frame was queued.
+  bool push(const void *payload, size_t len);
+
+  // Dispatch up to max_frames queued frames, returns how many were taken
+  size_t process(size_t max_frames);
+
+  bool has_pending() { return !queue_->is_empty(); }
+
+  // Release the producer and flush the writer and the recorder
+  void stop();
+
+  uint64_t received_count() const { return received_count_; }
+  uint64_t received_bytes() const { return received_bytes_; }
+  uint64_t dropped_count() const { return queue_->dropped_count(); }
+  // Malformed payloads
+  uint64_t rejected_count() const { return rejected_count_; }
+  // Compressed frames cv::imdecode() failed on
+  uint64_t decode_error_count() const { return decode_error_count_; }
+  std::shared_ptr<PipelineStats> get_stats() { return stats_; }
+  std::shared_ptr<BufferPool> get_buffer_pool() { return buffer_pool_; }
+
+  // May be called from any thread while the stream runs
+  StreamMetrics metrics();
+
+  void show_statistics();
+
+private:
+  friend class StreamRouter;
+
+  // A frame on its way through the stages
+  struct DecodedFrame {
+    enum Status {
+      SKIPPED,      // never deserialized
+      REJECTED,     // malformed payload, error tells why
+      UNSUPPORTED,  // unknown encoding
+      DROPPED,      // too little pixel data or not decodable
+      DELTA,        // tiles to be applied in order by emit()
+      DECODED
+    };
+
+    uint64_t seq{0};
+    Status status{SKIPPED};
+    std::string error;
+    bool compressed{false};
+    int64_t timestamp{0};
+    uint32_t width{0};
+    uint32_t height{0};
+    std::string encoding;
+    uint64_t payload_size{0};
+    int64_t receive_time_ns{0};
+    int64_t decoded_ns{0};
+    int64_t write_time{0};
+    // Full size image for the writer, the ring and a full size sink, nullptr
+    // without them
+    std::shared_ptr<cv::Mat> image;
+    // Scaled for the display, nullptr with a full size sink
+    std::shared_ptr<cv::Mat> display_frame;
+    // A delta frame keeps its payload until its tiles are applied
+    std::shared_ptr<FrameBuffer> serialized_msg;
+    const uint8_t *data{nullptr};
+    size_t data_size{0};
+  };
+
+  // A raw frame converted in row stripes by several threads. The last
+  // stripe to finish completes the frame.
+  struct StripedFrame {
+    std::shared_ptr<FrameBuffer> serialized_msg;
+    const uint8_t *pixels{nullptr};
+    DecodedFrame frame;
+    uint32_t stripes{1};
+    std::atomic_uint32_t remaining{0};
+    int64_t start_ns{0};
+  };
+
+  uint32_t id_;
+  std::string name_;
+  StreamConfig config_;
+
+  std::shared_ptr<BufferPool> buffer_pool_;
+  // Only with chunked messages
+  std::unique_ptr<ChunkAssembler> assembler_;
+  std::shared_ptr<MsgQueueBase<FrameBuffer>> queue_;
+  std::shared_ptr<PipelineStats> stats_;
+  std::shared_ptr<ImageWriter> writer_;
+  std::shared_ptr<VideoFileWriter> video_writer_;
+  std::shared_ptr<FrameRecorder> recorder_;
+  std::unique_ptr<FrameRingWriter> ring_;
+  // The writers, the ring and a full size sink take the frame at full size
+  bool full_image_{false};
+  // Headless runs still convert to the display size, so the benchmarks
+  // cover the whole decode path
+  bool display_image_{true};
+  std::shared_ptr<FrameSink> sink_;
+  uint32_t sink_stream_{0};
+
+  std::atomic_uint64_t received_count_{0};
+  std::atomic_uint64_t received_bytes_{0};
+  std::atomic_uint64_t rejected_count_{0};
+  std::atomic_uint64_t decode_error_count_{0};
+  std::atomic_uint64_t unsupported_count_{0};
+  std::atomic_uint64_t discarded_count_{0};
+  WarningLimiter short_frame_warning_;
+
+  // Set while the stream waits for or runs on a worker
+  std::atomic_bool scheduled_{false};
+
+  std::shared_ptr<DecodePool> decode_pool_;
+  // Frames finished out of order wait here for the ones before them
+  std::mutex reorder_mutex_;
+  std::condition_variable reorder_cond_;
+  std::map<uint64_t, DecodedFrame> reorder_buffer_;
+  uint64_t next_seq_{0};
+  uint64_t emit_seq_{0};
+  bool emitting_{false};
+  size_t in_flight_{0};
+  size_t max_in_flight_{1};
+  size_t peak_reorder_{0};
+
+  // A FrameDecoder keeps scratch rows and scaling coefficients, so every
+  // thread converting a frame takes one of its own
+  std::mutex decoders_mutex_;
+  std::vector<std::unique_ptr<FrameDecoder>> decoders_;
+
+  // The converted frames, reused until the resolution changes. The sink
+  // holds on to a few frames (the display to the one on screen and the one
+  // in its slot), the writer to its queue and every frame in flight to one
+  // each.
+  FramePool display_pool_;
+  FramePool image_pool_;
+
+  // Only used by the thread emitting frames, which takes turns
+  std::unique_ptr<TileCompositor> compositor_;
+  std::string last_error_;
+  std::string last_encoding_;
+  uint32_t height_{0};
+  uint32_t width_{0};
+  uint32_t frame_index_{0};
+
+  void process_frame(std::shared_ptr<FrameBuffer> serialized_msg);
+  void decode_frame(std::shared_ptr<FrameBuffer> serialized_msg, DecodedFrame frame);
+  void decode_compressed(std::shared_ptr<FrameBuffer> serialized_msg,
+                         const uint8_t *data, size_t size, DecodedFrame frame);
+  void convert_raw(std::shared_ptr<FrameBuffer> serialized_msg, const uint8_t *pixels,
+                   size_t size, DecodedFrame frame);
+  void convert_stripe(const std::shared_ptr<StripedFrame> &striped, uint32_t stripe);
+  uint32_t stripe_count(uint32_t width, uint32_t height) const;
+  // Wait until fewer than max_in_flight_ frames are on their way
+  uint64_t begin_frame();
+  void complete(DecodedFrame frame);
+  void emit(DecodedFrame &frame);
+  void apply_delta(DecodedFrame &frame);
+  std::unique_ptr<FrameDecoder> acquire_decoder();
+  void release_decoder(std::unique_ptr<FrameDecoder> decoder);
+};
+
+#endif
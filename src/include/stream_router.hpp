@@ -0,0 +1,111 @@
+#ifndef STREAM_ROUTER_HPP__
+#define STREAM_ROUTER_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "decode_pool.hpp"
+#include "frame_sink.hpp"
+#include "stream_pipeline.hpp"
+
+// Routes messages to one StreamPipeline per topic and decodes all streams on
+// a shared pool of worker threads.
+//
+// A stream is created when the first message of its topic arrives, so
+// wildcard subscriptions work. A stream with queued frames is scheduled on
+// the pool once. A worker decodes a few of its frames and then moves it to
+// the back of the ready list, so a busy camera can't starve the others and
+// a stream is never decoded by two workers at the same time.
+//
+// The workers only dispatch the frames of a stream in order. Deserializing
+// and converting them happens on a decode pool shared by all streams.
+class StreamRouter final {
+public:
+  // With multi_stream every stream writes and records into a sub-directory
+  // named after its topic. The converted frames go to sink, which may be
+  // nullptr. With no decoders the workers convert the frames themselves, with
+  // no workers the producer dispatches them (there must be only one producer
+  // then).
+  StreamRouter(const StreamConfig &config, size_t workers, size_t decoders,
+               bool multi_stream, std::shared_ptr<FrameSink> sink);
+  ~StreamRouter();
+
+  StreamRouter(const StreamRouter &) = delete;
+  StreamRouter &operator=(const StreamRouter &) = delete;
+
+  void start();
+
+  // Print the statistics of every stream periodically
+  void start_reporting(std::chrono::seconds interval);
+
+  // Returns nullptr once there are too many streams
+  std::shared_ptr<StreamPipeline> get_stream(const std::string &topic);
+
+  // Called by the producer of the stream
+  void push(StreamPipeline &stream, const void *payload, size_t len);
+  void route(const char *topic, const void *payload, size_t len);
+
+  // Wait until every queued frame is decoded
+  void drain();
+
+  // Stop the workers, the decoders, the reports and the writers of all
+  // streams
+  void stop();
+
+  size_t worker_count() const { return worker_count_; }
+  size_t decoder_count() const { return decode_pool_ ? decode_pool_->thread_count() : 0; }
+  const StreamConfig &config() const { return config_; }
+  std::vector<std::shared_ptr<StreamPipeline>> streams();
+  // Messages of topics beyond the stream limit
+  uint64_t ignored_count() const { return ignored_count_; }
+  std::shared_ptr<DecodePool> get_decode_pool() { return decode_pool_; }
+
+  // Per stream details and a table comparing the streams
+  void show_statistics();
+
+  // Write the latency percentiles of all streams as CSV
+  bool dump_statistics(const std::string &path);
+
+private:
+  StreamConfig config_;
+  size_t worker_count_;
+  bool multi_stream_;
+  std::shared_ptr<FrameSink> sink_;
+  std::shared_ptr<DecodePool> decode_pool_;
+
+  std::mutex streams_mutex_;
+  std::map<std::string, std::shared_ptr<StreamPipeline>> topics_;
+  std::vector<std::shared_ptr<StreamPipeline>> streams_;
+  std::atomic_uint64_t ignored_count_{0};
+
+  // Streams waiting for a worker
+  std::mutex ready_mutex_;
+  std::condition_variable ready_cond_;
+  std::condition_variable idle_cond_;
+  std::deque<StreamPipeline *> ready_;
+  size_t scheduled_count_{0};
+  bool stop_{false};
+  std::vector<std::thread> workers_;
+
+  std::mutex report_mutex_;
+  std::condition_variable report_cond_;
+  bool stop_reporting_{false};
+  std::thread report_thread_;
+
+  void schedule(StreamPipeline &stream);
+  void worker_loop();
+  void report_loop(std::chrono::seconds interval);
+  std::string stream_path(const std::string &path, const std::string &topic);
+  static std::string topic_file_name(const std::string &topic);
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef THREAD_TUNING_HPP__
+#define THREAD_TUNING_HPP__
+
+#include <string>
+#include <vector>
+
+// What a thread of the pipeline does
+enum class ThreadRole {
+  MQTT,      // the MQTT network loop (the event loop with --reactor), or the replay
+  DISPATCH,  // the StreamRouter workers
+  DECODE,    // the DecodePool threads
+  WRITER,    // image and video writers and the recorder
+  DISPLAY    // the render thread
+};
+
+// Scheduling of the threads of one role
+struct ThreadSettings {
+  std::vector<int> cpus;  // empty: wherever the scheduler puts them
+  int fifo_priority{0};   // 1 - 99 runs them SCHED_FIFO, 0 keeps SCHED_OTHER
+  int nice{0};            // SCHED_OTHER only, -20 - 19
+
+  bool empty() const { return cpus.empty() && fifo_priority == 0 && nice == 0; }
+};
+
+// Pins threads to cores and sets their scheduling policy per role. The
+// settings are configured once before any thread starts, and every thread
+// applies the ones of its role when it starts. Failures (missing
+// CAP_SYS_NICE, an offline core) are reported once per role and the thread
+// keeps running with what it had.
+class ThreadTuning final {
+public:
+  ThreadTuning() = delete;
+
+  // PARAM is ROLE=SPEC[,ROLE=SPEC...], SPEC is any of cpus:LIST, fifo:P
+  // and nice:N joined by '/', LIST is cores and ranges joined by '+'.
+  // E.g. "mqtt=cpus:2/fifo:50,decode=cpus:4-7/nice:-5"
+  static bool parse(const std::string &param);
+  static void configure(ThreadRole role, const ThreadSettings &settings);
+  static bool is_configured();
+
+  // Applies the settings of role to the calling thread
+  static void apply(ThreadRole role);
+
+  // Locks the current and future pages of the process in memory, so frames
+  // aren't paged out and touching them doesn't fault to disk
+  static bool lock_memory();
+  static bool memory_locked();
+
+  // Like "mqtt: CPU 2, SCHED_FIFO 50; decode: CPUs 4-7, nice -5"
+  static std::string describe();
+  // How many threads of each role got their settings
+  static void show_statistics();
+
+  static const char *role_name(ThreadRole role);
+};
+
+#endif
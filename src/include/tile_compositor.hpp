@@ -0,0 +1,90 @@
+#ifndef TILE_COMPOSITOR_HPP__
+#define TILE_COMPOSITOR_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "delta_format.hpp"
+#include "frame_decoder.hpp"
+
+// Keeps the frame of a stream which sends delta frames (see
+// delta_format.hpp) and applies the tiles of every frame to it.
+//
+// The frame is kept in the base encoding, and converted to the display and
+// writer images which are kept as well. Only the rows of tiles which
+// changed since the last render() are converted again, the scaler works on
+// whole rows. Frames have to be applied in order, from one thread at a time.
+class TileCompositor final {
+public:
+  enum Result {
+    APPLIED,
+    SKIPPED,      // waiting for a keyframe, or a duplicate
+    UNSUPPORTED,  // unknown base encoding
+    INVALID       // malformed tiles, error() tells why
+  };
+
+  // display_image keeps an image scaled for the display, full_image one of
+  // the frame size for the writer and a full size sink
+  TileCompositor(PixelLayout layout, bool display_image, bool full_image);
+
+  TileCompositor(const TileCompositor &) = delete;
+  TileCompositor &operator=(const TileCompositor &) = delete;
+
+  // encoding is the delta encoding of the message, data its img_msg::data
+  Result apply(const std::string &encoding, uint32_t width, uint32_t height,
+               const uint8_t *data, size_t size);
+
+  // Bring the display image of display_width and the full image up to date
+  // and copy them to display and image (if not nullptr)
+  void render(uint32_t display_width, cv::Mat *display, cv::Mat *image);
+
+  const std::string &error() const { return error_; }
+
+  uint64_t frame_count() const { return frame_count_; }
+  uint64_t keyframe_count() const { return keyframe_count_; }
+  // Deltas which didn't follow the frame before
+  uint64_t resync_count() const { return resync_count_; }
+  // Deltas dropped while waiting for a keyframe
+  uint64_t skipped_count() const { return skipped_count_; }
+
+  void show_statistics();
+
+private:
+  FrameDecoder decoder_;
+  bool display_image_;
+  bool full_image_;
+
+  // The frame in the base encoding
+  std::vector<uint8_t> pixels_;
+  std::string base_encoding_;
+  uint32_t width_{0};
+  uint32_t height_{0};
+  uint32_t tile_size_{0};
+  uint32_t columns_{0};
+  uint32_t rows_{0};
+  bool synced_{false};
+  uint32_t sequence_{0};
+  std::string error_;
+
+  // Tile rows changed since the last render()
+  std::vector<uint8_t> dirty_rows_;
+  cv::Mat display_;
+  cv::Mat image_;
+
+  std::atomic_uint64_t frame_count_{0};
+  std::atomic_uint64_t keyframe_count_{0};
+  std::atomic_uint64_t resync_count_{0};
+  std::atomic_uint64_t skipped_count_{0};
+  std::atomic_uint64_t duplicate_count_{0};
+  // Of the delta frames (not keyframes), for the share of changed tiles
+  std::atomic_uint64_t delta_tiles_{0};
+  std::atomic_uint64_t delta_frame_tiles_{0};
+
+  Result invalid(const char *error);
+};
+
+#endif
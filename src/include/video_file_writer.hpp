@@ -0,0 +1,127 @@
+#ifndef VIDEO_FILE_WRITER_HPP__
+#define VIDEO_FILE_WRITER_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "warning_limiter.hpp"
+
+enum class VideoFormat {
+  MJPEG,  // Motion JPEG in an AVI, through cv::VideoWriter
+  Y4M,    // YUV4MPEG2 with 4:2:0 chroma, readable by ffmpeg and most encoders
+  BGR     // interleaved BGR pixels without any header, lossless
+};
+
+struct VideoFileWriterConfig {
+  std::string output_path;
+  VideoFormat format{VideoFormat::MJPEG};
+  int jpeg_quality{90};  // 1 - 100
+  // Frame rate in the AVI and Y4M headers. Players go by it, the real
+  // timing is in the timestamp file.
+  double fps{30};
+  // A new file is started before a file covers rotate_duration of frame
+  // timestamps or grows beyond rotate_size bytes, 0 for no limit
+  std::chrono::seconds rotate_duration{0};
+  uint64_t rotate_size{0};
+  size_t queue_capacity{16};
+  bool drop_when_full{false};  // otherwise submit() blocks
+};
+
+// Writes the frames of a stream into video files output_path/video_<n>.<ext>
+// on a thread of its own, instead of one image file per frame.
+//
+// Every frame is appended to the open file with one write (MJPEG leaves it
+// to cv::VideoWriter), so a long run costs a few files instead of a file
+// creation per frame. Next to every video video_<n>.ts lists the
+// timestamp of each frame in the mkvmerge "timestamp format v2", in ms
+// since the first frame of the file. The header comment gives the
+// absolute timestamp of the first frame and the resolution, which a .bgr
+// file needs to be read. A change of resolution starts a new file too.
+class VideoFileWriter final {
+public:
+  explicit VideoFileWriter(const VideoFileWriterConfig &config);
+  ~VideoFileWriter();
+
+  VideoFileWriter(const VideoFileWriter &) = delete;
+  VideoFileWriter &operator=(const VideoFileWriter &) = delete;
+
+  // image is a CV_8UC3 BGR frame, timestamp its img_msg timestamp in ns.
+  // The writer keeps a reference to image, so the caller must not modify
+  // its pixels afterwards. Returns false if the frame was dropped.
+  bool submit(int64_t timestamp, std::shared_ptr<cv::Mat> image);
+
+  // Write everything still queued and close the file
+  void stop();
+
+  uint64_t written_count() const { return written_count_; }
+  uint64_t dropped_count() const { return dropped_count_; }
+  uint64_t failed_count() const { return failed_count_; }
+  uint64_t written_bytes() const { return written_bytes_; }
+  uint32_t file_count() const { return file_count_; }
+  size_t backlog();
+  size_t peak_backlog();
+
+  void show_statistics();
+
+  // FORMAT is mjpeg[:Quality], y4m or bgr
+  static bool parse_format(const std::string &param, VideoFormat &format,
+                           int &jpeg_quality);
+  static const char *format_name(VideoFormat format);
+
+private:
+  struct Job {
+    int64_t timestamp;
+    std::shared_ptr<cv::Mat> image;
+  };
+
+  VideoFileWriterConfig config_;
+  std::string extension_;
+
+  std::mutex mutex_;
+  std::condition_variable not_empty_cond_;
+  std::condition_variable not_full_cond_;
+  std::deque<Job> jobs_;
+  size_t peak_backlog_{0};
+  bool stop_{false};
+  std::thread worker_;
+
+  // Only used by the worker
+  cv::VideoWriter video_;
+  int fd_{-1};
+  std::FILE *timestamps_{nullptr};
+  bool file_open_{false};
+  std::string file_path_;
+  cv::Size file_size_;
+  int64_t first_timestamp_{0};
+  uint64_t file_bytes_{0};
+  uint64_t frame_bytes_{0};  // the last frame written
+  cv::Mat yuv_;
+  std::string frame_header_;
+  WarningLimiter open_warning_;
+
+  std::chrono::steady_clock::time_point start_time_;
+  std::atomic_uint64_t written_count_{0};
+  std::atomic_uint64_t dropped_count_{0};
+  std::atomic_uint64_t failed_count_{0};
+  std::atomic_uint64_t written_bytes_{0};
+  std::atomic_uint32_t file_count_{0};
+
+  void worker();
+  bool write(const Job &job);
+  bool needs_new_file(const Job &job) const;
+  bool open_file(const Job &job);
+  void close_file();
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef WARNING_LIMITER_HPP__
+#define WARNING_LIMITER_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Lets a warning through at most once per interval and counts the ones held
+// back meanwhile. A warning which hits every frame then costs an atomic add
+// instead of a write to the terminal. allow() may be called from any number
+// of threads.
+//
+//   uint64_t suppressed;
+//   if (limiter.allow(&suppressed)) { print, mention suppressed }
+class WarningLimiter final {
+public:
+  explicit WarningLimiter(std::chrono::milliseconds interval = std::chrono::seconds(5))
+      : interval_ns_(std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count()) {}
+
+  WarningLimiter(const WarningLimiter &) = delete;
+  WarningLimiter &operator=(const WarningLimiter &) = delete;
+
+  // Whether to print the warning now. suppressed gets the number of
+  // warnings held back since the last one printed.
+  bool allow(uint64_t *suppressed = nullptr) {
+    count_.fetch_add(1, std::memory_order_relaxed);
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t next = next_ns_.load(std::memory_order_relaxed);
+    if (now < next ||
+        !next_ns_.compare_exchange_strong(next, now + interval_ns_,
+                                          std::memory_order_relaxed)) {
+      suppressed_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    uint64_t held_back = suppressed_.exchange(0, std::memory_order_relaxed);
+    if (suppressed != nullptr) {
+      *suppressed = held_back;
+    }
+    return true;
+  }
+
+  // Every call of allow(), printed or not
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+private:
+  int64_t interval_ns_;
+  std::atomic_int64_t next_ns_{0};
+  std::atomic_uint64_t count_{0};
+  std::atomic_uint64_t suppressed_{0};
+};
+
+#endif
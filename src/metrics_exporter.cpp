@@ -0,0 +1,427 @@
+#include "include/metrics_exporter.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+namespace {
+const double kQuantiles[] = {0.5, 0.9, 0.99};
+
+// A scraper taking longer than this to send its request is dropped
+constexpr int kRequestTimeoutMs = 1000;
+
+void append(std::string &out, const char *format, ...) {
+  char line[1024];
+  va_list args;
+  va_start(args, format);
+  int len = std::vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (len > 0) {
+    out.append(line, std::min<size_t>(len, sizeof(line) - 1));
+  }
+}
+
+void family(std::string &out, const char *name, const char *type, const char *help) {
+  append(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// Topics may hold anything, label values escape \, " and newlines
+std::string label_value(const std::string &value) {
+  std::string escaped;
+  for (char c : value) {
+    if (c == '\\' || c == '"') {
+      escaped += '\\';
+      escaped += c;
+    } else if (c == '\n') {
+      escaped += "\\n";
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+struct StreamSnapshot {
+  std::string label;
+  StreamMetrics metrics;
+  std::shared_ptr<PipelineStats> stats;
+  double fps{0};
+  double bytes_per_second{0};
+};
+} // namespace
+
+MetricsExporter::MetricsExporter(std::shared_ptr<StreamRouter> router,
+                                 const MetricsConfig &config)
+    : router_(router), config_(config) {
+  if (config_.interval.count() <= 0) {
+    config_.interval = std::chrono::seconds(1);
+  }
+}
+
+MetricsExporter::~MetricsExporter() {
+  stop();
+}
+
+void MetricsExporter::add_metric(const std::string &name, const std::string &type,
+                                 const std::string &help, std::function<double()> value) {
+  metrics_.push_back(Metric{name, type, help, std::move(value)});
+}
+
+bool MetricsExporter::start() {
+  if (pipe2(wake_fds_, O_CLOEXEC | O_NONBLOCK) != 0) {
+    std::printf("Failed to create the metrics pipe: %s\n", std::strerror(errno));
+    return false;
+  }
+  if (config_.port != 0 && !listen_on(config_.port)) {
+    close_fds();
+    return false;
+  }
+  thread_ = std::thread(&MetricsExporter::run, this);
+  return true;
+}
+
+void MetricsExporter::stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+  stop_ = true;
+  char wake = 1;
+  if (write(wake_fds_[1], &wake, 1) < 0) {
+    // The pipe is full, so the thread is being woken anyway
+  }
+  thread_.join();
+  close_fds();
+
+  if (!config_.path.empty()) {
+    update();
+  }
+}
+
+void MetricsExporter::show_statistics() {
+  std::printf("Metrics: %lu updates", static_cast<unsigned long>(update_count_));
+  if (config_.port != 0) {
+    std::printf(", %lu requests served", static_cast<unsigned long>(request_count_));
+  }
+  std::printf("\n");
+}
+
+bool MetricsExporter::listen_on(uint16_t port) {
+  listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (listen_fd_ < 0) {
+    std::printf("Failed to create the metrics socket: %s\n", std::strerror(errno));
+    return false;
+  }
+  int reuse = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  // The metrics tell about the topics, so they stay on this host
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(listen_fd_, 8) != 0) {
+    std::printf("Failed to listen on 127.0.0.1:%u for metrics: %s\n", port,
+                std::strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+void MetricsExporter::close_fds() {
+  for (int *fd : {&listen_fd_, &wake_fds_[0], &wake_fds_[1]}) {
+    if (*fd >= 0) {
+      close(*fd);
+      *fd = -1;
+    }
+  }
+}
+
+void MetricsExporter::run() {
+  auto interval = std::chrono::duration_cast<std::chrono::milliseconds>(config_.interval);
+  auto next_update = std::chrono::steady_clock::now();
+  while (!stop_) {
+    auto now = std::chrono::steady_clock::now();
+    if (now >= next_update) {
+      update();
+      next_update = now + interval;
+    }
+
+    pollfd fds[2] = {{wake_fds_[0], POLLIN, 0}, {listen_fd_, POLLIN, 0}};
+    auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       next_update - std::chrono::steady_clock::now()).count() + 1;
+    int ready = poll(fds, listen_fd_ >= 0 ? 2 : 1,
+                     static_cast<int>(std::max<int64_t>(timeout, 0)));
+    if (ready <= 0 || (fds[0].revents & POLLIN) != 0) {
+      continue;
+    }
+
+    int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd >= 0) {
+      serve(fd);
+      close(fd);
+    }
+  }
+}
+
+// Answers one request with the latest snapshot. A scraper sends one request
+// per connection and scrapes every few seconds, so one at a time is enough.
+void MetricsExporter::serve(int fd) {
+  timeval timeout{kRequestTimeoutMs / 1000, (kRequestTimeoutMs % 1000) * 1000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  char request[2048];
+  size_t len = 0;
+  while (len < sizeof(request) - 1) {
+    ssize_t n = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+    if (n <= 0) {
+      return;
+    }
+    len += n;
+    request[len] = 0;
+    if (std::strstr(request, "\r\n\r\n") != nullptr ||
+        std::strstr(request, "\n\n") != nullptr) {
+      break;
+    }
+  }
+  request[len] = 0;
+
+  std::string response;
+  if (std::strncmp(request, "GET /metrics ", 13) == 0 ||
+      std::strncmp(request, "GET / ", 6) == 0) {
+    append(response,
+           "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+           "Content-Length: %lu\r\nConnection: close\r\n\r\n",
+           static_cast<unsigned long>(text_.size()));
+    response += text_;
+    request_count_++;
+  } else {
+    response = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+  }
+
+  size_t sent = 0;
+  while (sent < response.size()) {
+    ssize_t n = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return;
+    }
+    sent += n;
+  }
+}
+
+void MetricsExporter::update() {
+  text_ = render();
+  if (!config_.path.empty()) {
+    write_file(text_);
+  }
+  update_count_++;
+}
+
+bool MetricsExporter::write_file(const std::string &text) {
+  std::string temp_path = config_.path + ".tmp";
+  FILE *file = std::fopen(temp_path.c_str(), "w");
+  bool written = file != nullptr &&
+                 std::fwrite(text.data(), 1, text.size(), file) == text.size();
+  if (file != nullptr && std::fclose(file) != 0) {
+    written = false;
+  }
+  if (written && std::rename(temp_path.c_str(), config_.path.c_str()) == 0) {
+    return true;
+  }
+
+  int error = errno;
+  uint64_t suppressed;
+  if (write_warning_.allow(&suppressed)) {
+    std::printf("Failed to write the metrics to %s: %s (%lu more failures)\n",
+                config_.path.c_str(), std::strerror(error),
+                static_cast<unsigned long>(suppressed));
+  }
+  return false;
+}
+
+std::string MetricsExporter::render() {
+  int64_t now = steady_clock_ns();
+  int64_t min_rate_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(config_.interval).count() / 2;
+  std::vector<StreamSnapshot> streams;
+  for (auto &stream : router_->streams()) {
+    streams.push_back(StreamSnapshot{label_value(stream->name()), stream->metrics(),
+                                     stream->get_stats(), 0, 0});
+
+    // A stream's first update only starts its rates. The last update comes
+    // right after another one, a few ms of frames would give noise, so it
+    // keeps the rates of the interval before.
+    auto &snapshot = streams.back();
+    auto &rate = rates_[stream->name()];
+    if (rate.time_ns == 0 || now - rate.time_ns >= min_rate_ns) {
+      if (rate.time_ns != 0) {
+        double seconds = (now - rate.time_ns) / 1e9;
+        rate.fps = (snapshot.metrics.decoded - rate.decoded) / seconds;
+        rate.bytes_per_second =
+            (snapshot.metrics.received_bytes - rate.received_bytes) / seconds;
+      }
+      rate.time_ns = now;
+      rate.decoded = snapshot.metrics.decoded;
+      rate.received_bytes = snapshot.metrics.received_bytes;
+    }
+    snapshot.fps = rate.fps;
+    snapshot.bytes_per_second = rate.bytes_per_second;
+  }
+
+  const auto &config = router_->config();
+  std::string out;
+  auto counter = [&](const char *name, const char *help,
+                     uint64_t StreamMetrics::*value) {
+    family(out, name, "counter", help);
+    for (auto &stream : streams) {
+      append(out, "%s{stream=\"%s\"} %lu\n", name, stream.label.c_str(),
+             static_cast<unsigned long>(stream.metrics.*value));
+    }
+  };
+  auto gauge = [&](const char *name, const char *help, size_t StreamMetrics::*value) {
+    family(out, name, "gauge", help);
+    for (auto &stream : streams) {
+      append(out, "%s{stream=\"%s\"} %lu\n", name, stream.label.c_str(),
+             static_cast<unsigned long>(stream.metrics.*value));
+    }
+  };
+
+  counter("img_viewer_frames_received_total", "Frames received, after reassembly",
+          &StreamMetrics::received);
+  counter("img_viewer_received_bytes_total", "Payload bytes received",
+          &StreamMetrics::received_bytes);
+  counter("img_viewer_frames_decoded_total", "Frames through the whole pipeline",
+          &StreamMetrics::decoded);
+  counter("img_viewer_frames_displayed_total", "Frames shown by the display, or taken by the application",
+          &StreamMetrics::displayed);
+
+  bool outputs = !config.writer.output_path.empty() || !config.video.output_path.empty() ||
+                 !config.record_path.empty() || !config.shm_name.empty();
+  if (outputs) {
+    family(out, "img_viewer_frames_written_total", "counter",
+           "Frames handed on, by output");
+  }
+  for (auto &stream : streams) {
+    if (!config.writer.output_path.empty()) {
+      append(out, "img_viewer_frames_written_total{stream=\"%s\",output=\"files\"} %lu\n",
+             stream.label.c_str(), static_cast<unsigned long>(stream.metrics.written));
+    }
+    if (!config.video.output_path.empty()) {
+      append(out, "img_viewer_frames_written_total{stream=\"%s\",output=\"video\"} %lu\n",
+             stream.label.c_str(), static_cast<unsigned long>(stream.metrics.video_written));
+    }
+    if (!config.record_path.empty()) {
+      append(out, "img_viewer_frames_written_total{stream=\"%s\",output=\"recording\"} %lu\n",
+             stream.label.c_str(), static_cast<unsigned long>(stream.metrics.recorded));
+    }
+    if (!config.shm_name.empty()) {
+      append(out, "img_viewer_frames_written_total{stream=\"%s\",output=\"shm\"} %lu\n",
+             stream.label.c_str(), static_cast<unsigned long>(stream.metrics.shm_written));
+    }
+  }
+
+  const std::pair<const char *, uint64_t StreamMetrics::*> reasons[] = {
+      {"queue_full", &StreamMetrics::queue_dropped},
+      {"malformed", &StreamMetrics::rejected},
+      {"decode_error", &StreamMetrics::decode_errors},
+      {"unsupported", &StreamMetrics::unsupported},
+      {"discarded", &StreamMetrics::discarded},
+      {"incomplete_chunks", &StreamMetrics::incomplete_chunks},
+      {"writer_full", &StreamMetrics::writer_dropped},
+      {"write_error", &StreamMetrics::write_errors},
+      {"display_skipped", &StreamMetrics::display_skipped}};
+  family(out, "img_viewer_frames_dropped_total", "counter", "Frames dropped, by reason");
+  for (auto &stream : streams) {
+    for (auto &reason : reasons) {
+      append(out, "img_viewer_frames_dropped_total{stream=\"%s\",reason=\"%s\"} %lu\n",
+             stream.label.c_str(), reason.first,
+             static_cast<unsigned long>(stream.metrics.*reason.second));
+    }
+  }
+
+  family(out, "img_viewer_decoded_fps", "gauge",
+         "Frames decoded per second since the last update");
+  for (auto &stream : streams) {
+    append(out, "img_viewer_decoded_fps{stream=\"%s\"} %.2f\n", stream.label.c_str(),
+           stream.fps);
+  }
+  family(out, "img_viewer_ingest_bytes_per_second", "gauge",
+         "Payload bytes received per second since the last update");
+  for (auto &stream : streams) {
+    append(out, "img_viewer_ingest_bytes_per_second{stream=\"%s\"} %.0f\n",
+           stream.label.c_str(), stream.bytes_per_second);
+  }
+
+  gauge("img_viewer_queue_depth", "Frames waiting in the stream queue",
+        &StreamMetrics::queue_size);
+  gauge("img_viewer_queue_depth_peak", "Most frames ever waiting in the stream queue",
+        &StreamMetrics::queue_peak);
+  if (router_->decoder_count() > 0) {
+    gauge("img_viewer_reorder_buffer_peak",
+          "Most decoded frames ever waiting for the frames before them",
+          &StreamMetrics::reorder_peak);
+  }
+  counter("img_viewer_buffer_allocations_total", "Payload slabs allocated by the buffer pool",
+          &StreamMetrics::allocations);
+  counter("img_viewer_frame_pool_hits_total", "Converted frames reused from the frame pools",
+          &StreamMetrics::frame_pool_hits);
+  counter("img_viewer_frame_pool_misses_total", "Converted frames allocated",
+          &StreamMetrics::frame_pool_misses);
+  gauge("img_viewer_frame_pool_bytes", "Pixel memory held by the frame pools",
+        &StreamMetrics::frame_pool_bytes);
+
+  family(out, "img_viewer_stage_latency_seconds", "summary",
+         "Latency of the pipeline stages since the start");
+  for (auto &stream : streams) {
+    for (int i = 0; i < PipelineStats::STAGE_COUNT; ++i) {
+      auto stage = static_cast<PipelineStats::Stage>(i);
+      const auto &histogram = stream.stats->histogram(stage);
+      uint64_t count = histogram.count();
+      if (count == 0) {
+        continue;
+      }
+      const char *stage_name = PipelineStats::stage_name(stage);
+      for (double quantile : kQuantiles) {
+        append(out,
+               "img_viewer_stage_latency_seconds{stream=\"%s\",stage=\"%s\",quantile=\"%g\"} "
+               "%.9f\n",
+               stream.label.c_str(), stage_name, quantile,
+               histogram.percentile(quantile * 100) / 1e9);
+      }
+      append(out, "img_viewer_stage_latency_seconds_sum{stream=\"%s\",stage=\"%s\"} %.9f\n",
+             stream.label.c_str(), stage_name, histogram.sum() / 1e9);
+      append(out, "img_viewer_stage_latency_seconds_count{stream=\"%s\",stage=\"%s\"} %lu\n",
+             stream.label.c_str(), stage_name, static_cast<unsigned long>(count));
+    }
+  }
+
+  family(out, "img_viewer_ignored_messages_total", "counter",
+         "Messages of topics beyond the stream limit");
+  append(out, "img_viewer_ignored_messages_total %lu\n",
+         static_cast<unsigned long>(router_->ignored_count()));
+  auto decode_pool = router_->get_decode_pool();
+  if (decode_pool) {
+    family(out, "img_viewer_decode_backlog_peak", "gauge",
+           "Most jobs ever waiting for the decode pool");
+    append(out, "img_viewer_decode_backlog_peak %lu\n",
+           static_cast<unsigned long>(decode_pool->peak_backlog()));
+  }
+
+  for (auto &metric : metrics_) {
+    family(out, metric.name.c_str(), metric.type.c_str(), metric.help.c_str());
+    append(out, "%s %.17g\n", metric.name.c_str(), metric.value());
+  }
+  return out;
+}
@@ -0,0 +1,149 @@
+#include "include/mqtt_publisher.hpp"
+
+#include <cstdio>
+
+namespace {
+// How often a publish() waiting for the broker checks the abort check
+constexpr std::chrono::milliseconds kAbortCheckInterval(100);
+} // namespace
+
+MqttPublisher::MqttPublisher(std::string broker_ip, int32_t broker_port, int qos,
+                             size_t max_pending)
+    : broker_ip_(broker_ip), broker_port_(broker_port), qos_(qos),
+      max_pending_(max_pending > 0 ? max_pending : 1) {}
+
+MqttPublisher::~MqttPublisher() {
+  stop();
+  mosquitto_destroy(mosq_);
+  mosquitto_lib_cleanup();
+}
+
+bool MqttPublisher::init() {
+  mosquitto_lib_init();
+
+  mosq_ = mosquitto_new(NULL, true, static_cast<void *>(this));
+  if (mosq_ == NULL) {
+    std::printf("Error: Out of memory.\n");
+    return false;
+  }
+
+  mosquitto_connect_callback_set(mosq_, on_connect);
+  mosquitto_disconnect_callback_set(mosq_, on_disconnect);
+  mosquitto_publish_callback_set(mosq_, on_publish);
+
+  int rc = mosquitto_connect(mosq_, broker_ip_.c_str(), broker_port_, 60);
+  if (rc != MOSQ_ERR_SUCCESS) {
+    std::printf("Error: %s\n", mosquitto_strerror(rc));
+    return false;
+  }
+
+  rc = mosquitto_loop_start(mosq_);
+  if (rc != MOSQ_ERR_SUCCESS) {
+    std::printf("Error: %s\n", mosquitto_strerror(rc));
+    return false;
+  }
+  return true;
+}
+
+bool MqttPublisher::wait_connected(std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(pending_mutex_);
+  pending_cond_.wait_for(lock, timeout, [this] { return connack_ || stop_; });
+  return is_connected_;
+}
+
+bool MqttPublisher::publish(const std::string &topic, const void *payload, size_t len) {
+  {
+    std::unique_lock<std::mutex> lock(pending_mutex_);
+    // Nothing wakes the wait for an abort, so check it every now and then
+    while (!pending_cond_.wait_for(lock, kAbortCheckInterval,
+                                   [this] { return pending_ < max_pending_ || stop_; })) {
+      if (abort_ && abort_()) {
+        return false;
+      }
+    }
+    if (stop_) {
+      return false;
+    }
+    // on_publish() may run before mosquitto_publish() returns
+    pending_++;
+  }
+
+  int rc = mosquitto_publish(mosq_, NULL, topic.c_str(), static_cast<int>(len),
+                             payload, qos_, false);
+  if (rc != MOSQ_ERR_SUCCESS) {
+    {
+      std::lock_guard<std::mutex> lock(pending_mutex_);
+      pending_--;
+    }
+    if (failed_count_++ == 0) {
+      std::printf("Publish failed: %s\n", mosquitto_strerror(rc));
+    }
+    return false;
+  }
+  return true;
+}
+
+void MqttPublisher::stop() {
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    if (stop_) {
+      return;
+    }
+    stop_ = true;
+  }
+  pending_cond_.notify_all();
+
+  if (mosq_ != NULL) {
+    mosquitto_disconnect(mosq_);
+    mosquitto_loop_stop(mosq_, false);
+  }
+}
+
+size_t MqttPublisher::pending_count() {
+  std::lock_guard<std::mutex> lock(pending_mutex_);
+  return pending_;
+}
+
+void MqttPublisher::on_connect(struct mosquitto *mosq, void *obj, int reason_code) {
+  auto instance = static_cast<MqttPublisher *>(obj);
+  std::printf("on_connect: %s\n", mosquitto_connack_string(reason_code));
+  instance->is_connected_ = reason_code == 0;
+  if (reason_code != 0) {
+    mosquitto_disconnect(mosq);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(instance->pending_mutex_);
+    instance->connack_ = true;
+  }
+  instance->pending_cond_.notify_all();
+}
+
+void MqttPublisher::on_disconnect(struct mosquitto *mosq, void *obj, int reason_code) {
+  auto instance = static_cast<MqttPublisher *>(obj);
+  instance->is_connected_ = false;
+  if (reason_code != 0 && !instance->stop_) {
+    std::printf("Disconnected from the broker, reconnecting\n");
+  }
+
+  // Messages lost with the connection never get an on_publish()
+  {
+    std::lock_guard<std::mutex> lock(instance->pending_mutex_);
+    instance->pending_ = 0;
+  }
+  instance->pending_cond_.notify_all();
+}
+
+/* Called when a QoS 0 message is written to the socket, or a QoS 1 or 2
+ * message is acknowledged by the broker. */
+void MqttPublisher::on_publish(struct mosquitto *mosq, void *obj, int mid) {
+  auto instance = static_cast<MqttPublisher *>(obj);
+  {
+    std::lock_guard<std::mutex> lock(instance->pending_mutex_);
+    if (instance->pending_ > 0) {
+      instance->pending_--;
+    }
+  }
+  instance->published_count_++;
+  instance->pending_cond_.notify_one();
+}
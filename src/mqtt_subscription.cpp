@@ -1,17 +1,40 @@
 #include "include/mqtt_subscription.hpp"
 
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "include/thread_tuning.hpp"
+
+namespace {
+// Keepalive pings and reconnects of a client driven by an EventLoop
+constexpr std::chrono::seconds kMiscInterval(1);
+} // namespace
+
 MqttSubscription::MqttSubscription(
-    std::string broker_ip, int32_t broker_port, std::string topic,
-    std::shared_ptr<MsgQueue<std::vector<uint8_t>>> &queue)
-    : broker_ip_(broker_ip), broker_port_(broker_port), topic_(topic),
-      queue_(queue) {}
+    std::string broker_ip, int32_t broker_port, std::vector<std::string> topics,
+    MessageHandler handler, const MqttSubscriptionConfig &config)
+    : broker_ip_(broker_ip), broker_port_(broker_port), topics_(topics),
+      handler_(std::move(handler)), config_(config) {}
 
 MqttSubscription::~MqttSubscription() {
-  mosquitto_lib_cleanup();
+  stop();
   mosquitto_destroy(mosq_);
+  mosquitto_lib_cleanup();
+}
+
+void MqttSubscription::attach(EventLoop &loop) {
+  loop_ = &loop;
 }
 
-void MqttSubscription::init() {
+bool MqttSubscription::init() {
 
 	int rc;
 
@@ -21,37 +44,244 @@ void MqttSubscription::init() {
 	/* Create a new client instance.
 	 * id = NULL -> ask the broker to generate a client id for us
 	 * clean session = true -> the broker should remove old sessions when we connect
-	 * obj = NULL -> we aren't passing any of our private data for callbacks
+	 * obj = this -> the callbacks get this instance
 	 */
 	mosq_ = mosquitto_new(NULL, true, static_cast<void *>(this));
 	if(mosq_ == NULL){
 		fprintf(stderr, "Error: Out of memory.\n");
-		return;
+		return false;
 	}
 
 	/* Configure callbacks. This should be done before connecting ideally. */
 	mosquitto_connect_callback_set(mosq_, on_connect);
+	mosquitto_disconnect_callback_set(mosq_, on_disconnect);
 	mosquitto_subscribe_callback_set(mosq_, on_subscribe);
 	mosquitto_message_callback_set(mosq_, on_message);
 
-	/* Connect to test.mosquitto.org on port 1883, with a keepalive of 60 seconds.
+  /* The options apply to every connection, also the reconnects */
+  mosquitto_property *properties = NULL;
+  if (config_.mqtt5) {
+    mosquitto_int_option(mosq_, MOSQ_OPT_PROTOCOL_VERSION, MQTT_PROTOCOL_V5);
+    /* The broker holds back QoS 1 and 2 messages beyond this many
+     * unacknowledged ones, so a slow consumer slows the broker down instead
+     * of piling up acknowledgements */
+    if (config_.receive_maximum > 0) {
+      mosquitto_int_option(mosq_, MOSQ_OPT_RECEIVE_MAXIMUM, config_.receive_maximum);
+    }
+    /* The broker drops messages larger than this instead of sending them */
+    if (config_.max_packet_size > 0) {
+      mosquitto_property_add_int32(&properties, MQTT_PROP_MAXIMUM_PACKET_SIZE,
+                                   config_.max_packet_size);
+    }
+  }
+  if (config_.tcp_nodelay) {
+    mosquitto_int_option(mosq_, MOSQ_OPT_TCP_NODELAY, 1);
+  }
+  if (config_.loop_thread && loop_ == nullptr) {
+    mosquitto_threaded_set(mosq_, true);
+  }
+
+	/* Connect with the configured keepalive.
 	 * This call makes the socket connection only, it does not complete the MQTT
 	 * CONNECT/CONNACK flow, you should use mosquitto_loop_start() or
 	 * mosquitto_loop_forever() for processing net traffic. */
-	rc = mosquitto_connect(mosq_, broker_ip_.c_str(), broker_port_, 60);
+  if (config_.mqtt5) {
+    rc = mosquitto_connect_bind_v5(mosq_, broker_ip_.c_str(), broker_port_,
+                                   config_.keepalive, NULL, properties);
+    mosquitto_property_free_all(&properties);
+  } else {
+    rc = mosquitto_connect(mosq_, broker_ip_.c_str(), broker_port_, config_.keepalive);
+  }
 	if(rc != MOSQ_ERR_SUCCESS){
-		mosquitto_destroy(mosq_);
 		fprintf(stderr, "Error: %s\n", mosquitto_strerror(rc));
-		return;
+		return false;
 	}
 
+  if (loop_ != nullptr) {
+    /* Without a network thread the packets are written right away where
+     * the socket takes them, the loop writes the rest */
+    misc_timer_ = loop_->add_timer(kMiscInterval, kMiscInterval, [this] { on_misc(); });
+    watch_socket();
+    return misc_timer_ >= 0 && socket_fd_ >= 0;
+  }
+  if (config_.loop_thread) {
+    loop_thread_ = std::thread(&MqttSubscription::run_loop, this);
+    return true;
+  }
+
   /* Run the network loop in a background thread, this call returns quickly. */
   rc = mosquitto_loop_start(mosq_);
   if(rc != MOSQ_ERR_SUCCESS){
-    mosquitto_destroy(mosq_);
     std::printf("Error: %s\n", mosquitto_strerror(rc));
+    return false;
+  }
+  loop_started_ = true;
+  return true;
+}
+
+void MqttSubscription::stop() {
+  if (stop_.exchange(true) || mosq_ == NULL) {
     return;
   }
+  /* Both loops return once the client disconnected on purpose */
+  mosquitto_disconnect(mosq_);
+  if (loop_ != nullptr) {
+    if (misc_timer_ >= 0) {
+      loop_->remove(misc_timer_);
+      misc_timer_ = -1;
+    }
+    if (socket_fd_ >= 0) {
+      loop_->remove(socket_fd_);
+      socket_fd_ = -1;
+    }
+  }
+  if (loop_thread_.joinable()) {
+    loop_thread_.join();
+  }
+  if (loop_started_) {
+    mosquitto_loop_stop(mosq_, false);
+  }
+}
+
+/* The network loop on a thread of our own. Receiving a frame means copying
+ * megabytes off the socket, a real time priority keeps other threads from
+ * delaying that while the kernel buffer fills up. */
+void MqttSubscription::run_loop() {
+  if (config_.loop_priority > 0) {
+    sched_param param{};
+    param.sched_priority = config_.loop_priority;
+    int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (rc != 0) {
+      std::printf("Failed to set SCHED_FIFO priority %d on the MQTT loop: %s, "
+                  "it runs at normal priority\n",
+                  config_.loop_priority, std::strerror(rc));
+    }
+  }
+  /* Reconnects by itself until mosquitto_disconnect() */
+  int rc = mosquitto_loop_forever(mosq_, -1, 1);
+  if (rc != MOSQ_ERR_SUCCESS && !stop_) {
+    std::printf("MQTT loop stopped: %s\n", mosquitto_strerror(rc));
+  }
+}
+
+/* Registers the socket with the loop whenever libmosquitto replaced it, and
+ * waits for EPOLLOUT only while packets are waiting to be written */
+void MqttSubscription::watch_socket() {
+  int fd = mosquitto_socket(mosq_);
+  uint32_t events = EPOLLIN;
+  if (mosquitto_want_write(mosq_)) {
+    events |= EPOLLOUT;
+  }
+  if (fd != socket_fd_) {
+    if (socket_fd_ >= 0) {
+      loop_->remove(socket_fd_);
+    }
+    socket_fd_ = -1;
+    if (fd >= 0 && loop_->add(fd, events, [this](uint32_t ready) { on_socket(ready); })) {
+      socket_fd_ = fd;
+    }
+  } else if (fd >= 0 && events != socket_events_) {
+    loop_->modify(fd, events);
+  }
+  socket_events_ = events;
+}
+
+/* A frame is read in as many calls as the socket needs to deliver it. On
+ * errors libmosquitto closes the socket and calls on_disconnect(). */
+void MqttSubscription::on_socket(uint32_t events) {
+  if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+    mosquitto_loop_read(mosq_, 1);
+  }
+  if ((events & EPOLLOUT) && mosquitto_socket(mosq_) >= 0) {
+    mosquitto_loop_write(mosq_, 1);
+  }
+  watch_socket();
+}
+
+void MqttSubscription::on_misc() {
+  if (mosquitto_socket(mosq_) >= 0) {
+    /* Sends the keepalive pings, and drops a connection the broker stopped
+     * answering on */
+    mosquitto_loop_misc(mosq_);
+  } else if (!given_up_ && !stop_) {
+    /* Doesn't wait for the TCP connection, the CONNECT goes out once the
+     * socket is writable */
+    int rc = mosquitto_reconnect_async(mosq_);
+    uint64_t suppressed;
+    if (rc != MOSQ_ERR_SUCCESS && reconnect_warning_.allow(&suppressed)) {
+      std::printf("Reconnect failed: %s (%lu more failures since the last warning)\n",
+                  mosquitto_strerror(rc), static_cast<unsigned long>(suppressed));
+    }
+  }
+  watch_socket();
+}
+
+/* A frame of several MB arrives faster than one scheduling slice of the
+ * network thread can take it off the socket, a larger receive buffer lets
+ * the window stay open meanwhile. The window scale was agreed on at
+ * connect time from the system maximum, so setting it now still works up
+ * to net.core.rmem_max, or beyond with CAP_NET_ADMIN. */
+void MqttSubscription::tune_socket() {
+  if (config_.receive_buffer <= 0) {
+    return;
+  }
+  int fd = mosquitto_socket(mosq_);
+  if (fd < 0) {
+    return;
+  }
+  int size = config_.receive_buffer;
+  if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) != 0) {
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  }
+  /* The kernel reports twice the size, half of it is bookkeeping */
+  int actual = 0;
+  socklen_t len = sizeof(actual);
+  if (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &actual, &len) == 0 && actual / 2 < size &&
+      connect_count_ == 1) {
+    std::printf("Receive buffer is %d KB instead of %d KB, raise net.core.rmem_max\n",
+                actual / 2 / 1024, size / 1024);
+  }
+}
+
+std::string MqttSubscription::describe(const MqttSubscriptionConfig &config) {
+  std::string text = "QoS " + std::to_string(config.qos);
+  if (config.mqtt5) {
+    text += ", MQTT 5";
+    if (config.receive_maximum > 0 || config.max_packet_size > 0) {
+      text += " (";
+      if (config.receive_maximum > 0) {
+        text += "receive maximum " + std::to_string(config.receive_maximum);
+      }
+      if (config.max_packet_size > 0) {
+        text += config.receive_maximum > 0 ? ", " : "";
+        text += "max packet " + std::to_string(config.max_packet_size) + " bytes";
+      }
+      text += ")";
+    }
+  } else {
+    text += ", MQTT 3.1.1";
+  }
+  if (config.tcp_nodelay) {
+    text += ", TCP_NODELAY";
+  }
+  if (config.receive_buffer > 0) {
+    text += ", SO_RCVBUF " + std::to_string(config.receive_buffer / 1024) + " KB";
+  }
+  text += ", keepalive " + std::to_string(config.keepalive) + " s";
+  if (config.loop_thread) {
+    text += ", own loop thread";
+    if (config.loop_priority > 0) {
+      text += " (SCHED_FIFO " + std::to_string(config.loop_priority) + ")";
+    }
+  }
+  return text;
+}
+
+/* Disconnects for good, the network loops stop reconnecting */
+void MqttSubscription::give_up() {
+  given_up_ = true;
+  mosquitto_disconnect(mosq_);
+  update_connect_status(false);
 }
 
 bool MqttSubscription::is_connect_broker() {
@@ -62,12 +292,8 @@ void MqttSubscription::update_connect_status(bool is_connected) {
   is_connected_ = is_connected;
 }
 
-std::string MqttSubscription::get_topic() {
-  return topic_;
-}
-
-std::shared_ptr<MsgQueue<std::vector<uint8_t>>> MqttSubscription::get_msg_queue() {
-	return queue_;
+const std::vector<std::string> &MqttSubscription::get_topics() {
+  return topics_;
 }
 
 /* Callback called when the client receives a CONNACK message from the broker. */
@@ -84,26 +310,56 @@ void MqttSubscription::on_connect(struct mosquitto *mosq, void *obj, int reason_
 		 * retrying in this example, so disconnect. Without this, the client
 		 * will attempt to reconnect. */
     std::printf("Connection failed !\n");
-		mosquitto_disconnect(mosq);
-    instance->update_connect_status(false);
+    instance->give_up();
     return;
 	}
 
   instance->update_connect_status(true);
+  if (instance->connect_count_++ > 0) {
+    instance->reconnect_count_++;
+  } else {
+    /* The first callback on the thread running the network loop, whichever
+     * of the loops it is */
+    ThreadTuning::apply(ThreadRole::MQTT);
+  }
+  instance->tune_socket();
 
 	/* Making subscriptions in the on_connect() callback means that if the
 	 * connection drops and is automatically resumed by the client, then the
 	 * subscriptions will be recreated when the client reconnects. */
-	rc = mosquitto_subscribe(mosq, NULL, instance->get_topic().c_str(), 1);
+	/* All topics go into one SUBSCRIBE, so on_subscribe() sees them together. */
+	std::vector<char *> topics;
+	for (auto &topic : instance->get_topics()) {
+		topics.push_back(const_cast<char *>(topic.c_str()));
+	}
+	rc = mosquitto_subscribe_multiple(mosq, NULL, static_cast<int>(topics.size()),
+	                                  topics.data(), instance->config_.qos, 0, NULL);
 	if(rc != MOSQ_ERR_SUCCESS){
 		fprintf(stderr, "Error subscribing: %s\n", mosquitto_strerror(rc));
 		/* We might as well disconnect if we were unable to subscribe */
     std::printf("Subscribe failed !\n");
-		mosquitto_disconnect(mosq);
-    instance->update_connect_status(false);
+    instance->give_up();
 	}
 }
 
+/* Callback called when the connection is lost or closed. A reason_code other
+ * than 0 means it was lost, and mosquitto_loop_start() keeps reconnecting. */
+void MqttSubscription::on_disconnect(struct mosquitto *mosq, void *obj, int reason_code) {
+  auto instance = static_cast<MqttSubscription *>(obj);
+  instance->update_connect_status(false);
+  instance->is_subscribed_ = false;
+  instance->disconnect_count_++;
+  /* libmosquitto closed the socket already, forget it before a reconnect
+   * gets the same fd number */
+  if (instance->loop_ != nullptr && instance->socket_fd_ >= 0) {
+    instance->loop_->remove(instance->socket_fd_);
+    instance->socket_fd_ = -1;
+  }
+  if (reason_code != 0 && !instance->stop_) {
+    std::printf("on_disconnect: %s, reconnecting\n", mosquitto_strerror(reason_code));
+  }
+}
+
 /* Callback called when the broker sends a SUBACK in response to a SUBSCRIBE. */
 void MqttSubscription::on_subscribe(struct mosquitto *mosq, void *obj, int mid,
                                     int qos_count, const int *granted_qos)
@@ -111,21 +367,19 @@ void MqttSubscription::on_subscribe(struct mosquitto *mosq, void *obj, int mid,
   bool have_subscription = false;
   auto instance = static_cast<MqttSubscription *>(obj);
 
-	/* In this example we only subscribe to a single topic at once, but a
-	 * SUBSCRIBE can contain many topics at once, so this is one way to check
-	 * them all. */
+	/* A SUBSCRIBE can contain many topics at once, so check them all. */
 	for(int i=0; i<qos_count; i++){
 		std::printf("on_subscribe: %d:granted qos = %d\n", i, granted_qos[i]);
 		if(granted_qos[i] <= 2){
 			have_subscription = true;
 		}
 	}
+	instance->is_subscribed_ = have_subscription;
 	if(have_subscription == false){
 		/* The broker rejected all of our subscriptions, we know we only sent
 		 * the one SUBSCRIBE, so there is no point remaining connected. */
 		std::printf("Error: All subscriptions rejected.\n");
-		mosquitto_disconnect(mosq);
-    instance->update_connect_status(false);
+    instance->give_up();
 	}
 }
 
@@ -138,9 +392,8 @@ void MqttSubscription::on_message(struct mosquitto *mosq, void *obj,
 
   auto instance = static_cast<MqttSubscription *>(obj);
 
-  auto serialized_data = std::make_shared<std::vector<uint8_t>>(
-      static_cast<uint8_t *>(msg->payload),
-      static_cast<uint8_t *>(msg->payload) + msg->payloadlen);
-
-  instance->get_msg_queue()->add_msg_to_queue(serialized_data);
+  /* mosquitto frees the payload after this callback returns, so the stream
+   * copies it once into a recycled slab. The slab is deserialized in place
+   * later. */
+  instance->handler_(msg->topic, msg->payload, msg->payloadlen);
 }
@@ -0,0 +1,141 @@
+#include "include/msg_deserializer.hpp"
+
+#include <cstring>
+#include <exception>
+
+#include "include/delta_format.hpp"
+#include "include/frame_decoder.hpp"
+
+namespace {
+
+using imx500_img_transport::img_msg;
+
+// Bigger than any sensor, keeps width * height * channels far from overflow
+constexpr int64_t kMaxDimension = 1 << 16;
+
+// Encodings are short names like rgba16
+constexpr uint32_t kMaxEncodingLength = 64;
+
+inline uint8_t raw_byte(const bool &value) {
+  uint8_t byte;
+  std::memcpy(&byte, &value, sizeof(byte));
+  return byte;
+}
+
+// Whether the length bytes a pointer field points to lie inside the
+// payload. Before deserialization the field holds the offset of its target
+// from the field itself.
+bool target_in_payload(const void *field, const uint8_t *payload, size_t size,
+                       size_t length) {
+  cista::offset_t offset;
+  std::memcpy(&offset, field, sizeof(offset));
+  if (offset == cista::NULLPTR_OFFSET) {
+    return length == 0;
+  }
+
+  // The field is inside the payload, so none of this overflows
+  auto position = static_cast<cista::offset_t>(
+      reinterpret_cast<const uint8_t *>(field) - payload);
+  if (offset < -position || offset > static_cast<cista::offset_t>(size) - position) {
+    return false;
+  }
+  size_t start = static_cast<size_t>(position + offset);
+  return length <= size - start;
+}
+
+} // namespace
+
+MsgDeserializer::MsgDeserializer(DeserializeMode mode) : mode_(mode) {}
+
+const img_msg *MsgDeserializer::deserialize(uint8_t *payload, size_t size) {
+  const char *reason = check_header(payload, size, mode_);
+  if (reason != nullptr) {
+    error_ = reason;
+    return nullptr;
+  }
+
+  try {
+    switch (mode_) {
+    case DeserializeMode::INTEGRITY:
+      // A matching checksum means the payload is the one the sender
+      // serialized, so the per element checks are skipped
+      return cista::deserialize<img_msg, cista::mode::WITH_INTEGRITY |
+                                             cista::mode::UNCHECKED>(payload,
+                                                                     payload + size);
+    case DeserializeMode::UNCHECKED:
+      return cista::deserialize<img_msg, cista::mode::UNCHECKED>(payload,
+                                                                 payload + size);
+    default:
+      return cista::deserialize<img_msg>(payload, payload + size);
+    }
+  } catch (std::exception &e) {
+    error_ = e.what();
+    return nullptr;
+  }
+}
+
+const char *MsgDeserializer::check_header(const uint8_t *payload, size_t size,
+                                          DeserializeMode mode) {
+  const img_msg *msg = header(payload, size, mode);
+  if (msg == nullptr) {
+    return "payload too short";
+  }
+
+  if (msg->height <= 0 || msg->height > kMaxDimension || msg->width == 0 ||
+      msg->width > kMaxDimension) {
+    return "invalid dimensions";
+  }
+
+  const auto &encoding = msg->encoding;
+  uint8_t is_short = raw_byte(encoding.s_.is_short_);
+  if (is_short > 1) {
+    return "invalid encoding";
+  }
+  const char *name = encoding.s_.s_;
+  size_t name_length = strnlen(name, sizeof(encoding.s_.s_));
+  if (is_short == 0) {
+    if (encoding.h_.size_ > kMaxEncodingLength ||
+        !target_in_payload(&encoding.h_.ptr_, payload, size, encoding.h_.size_)) {
+      return "encoding outside of the payload";
+    }
+    name_length = encoding.h_.size_;
+    if (name_length > 0) {
+      cista::offset_t offset;
+      std::memcpy(&offset, &encoding.h_.ptr_, sizeof(offset));
+      name = reinterpret_cast<const char *>(&encoding.h_.ptr_) + offset;
+    }
+  }
+
+  const auto &data = msg->data;
+  if (data.used_size_ != data.allocated_size_ || raw_byte(data.self_allocated_) != 0) {
+    return "invalid pixel data";
+  }
+  // 3 bytes per pixel is the least any raw encoding needs, a compressed
+  // image just mustn't be empty and a delta frame may have no tiles
+  uint64_t min_size = is_compressed_encoding(name, name_length) ? 1
+                      : is_delta_encoding(name, name_length)
+                          ? sizeof(DeltaHeader)
+                          : static_cast<uint64_t>(msg->width) * msg->height * 3;
+  if (data.used_size_ < min_size) {
+    return "too little pixel data";
+  }
+  if (!target_in_payload(&data.el_, payload, size, data.used_size_)) {
+    return "pixel data outside of the payload";
+  }
+  return nullptr;
+}
+
+const img_msg *MsgDeserializer::header(const uint8_t *payload, size_t size,
+                                       DeserializeMode mode) {
+  size_t offset = header_offset(mode);
+  if (size < offset + sizeof(img_msg)) {
+    return nullptr;
+  }
+  return reinterpret_cast<const img_msg *>(payload + offset);
+}
+
+size_t MsgDeserializer::header_offset(DeserializeMode mode) {
+  return mode == DeserializeMode::INTEGRITY
+             ? cista::data_start(cista::mode::WITH_INTEGRITY)
+             : 0;
+}
@@ -0,0 +1,190 @@
+#include "include/pipeline_stats.hpp"
+
+#include <cstdio>
+
+namespace {
+// A delta this much longer than the frame interval means frames are missing
+constexpr double kGapFactor = 1.5;
+// Going back further than this many frames isn't a late frame
+constexpr int64_t kRestartFrames = 100;
+
+const double kDumpPercentiles[] = {0,  10, 20,   30,    40,     50, 75,
+                                   90, 95, 99, 99.9, 99.99, 99.999, 100};
+} // namespace
+
+void PipelineStats::add_frame(uint64_t payload_size) {
+  int64_t now = steady_clock_ns();
+  int64_t expected = 0;
+  first_frame_ns_.compare_exchange_strong(expected, now);
+  last_frame_ns_ = now;
+
+  frame_count_++;
+  interval_frame_count_++;
+  byte_count_ += payload_size;
+}
+
+void PipelineStats::add_timestamp(int64_t timestamp) {
+  int64_t last = last_timestamp_;
+  if (last == 0) {
+    last_timestamp_ = timestamp;
+    return;
+  }
+
+  int64_t delta = timestamp - last;
+  if (delta == 0) {
+    duplicate_count_++;
+    return;
+  }
+  if (delta < 0) {
+    if (frame_interval_ns_ == 0 || -delta > frame_interval_ns_ * kRestartFrames) {
+      // The sender was restarted, start over
+      last_timestamp_ = timestamp;
+      return;
+    }
+    // Keep the newest timestamp, so one late frame isn't also counted as a gap
+    reordered_count_++;
+    return;
+  }
+  last_timestamp_ = timestamp;
+
+  if (frame_interval_ns_ == 0) {
+    frame_interval_ns_ = delta;
+    return;
+  }
+  if (delta > frame_interval_ns_ * kGapFactor) {
+    // Gaps don't go into the average, it only follows the frame rate
+    gap_count_++;
+    int64_t missing = (delta + frame_interval_ns_ / 2) / frame_interval_ns_ - 1;
+    missing_count_ += missing > 0 ? missing : 1;
+    return;
+  }
+  frame_interval_ns_ += (delta - frame_interval_ns_) / 8;
+}
+
+void PipelineStats::show_summary() {
+  uint64_t frames = frame_count_;
+  double seconds = active_seconds();
+
+  std::printf("Pipeline%s%s: %lu frames, %.1f MB", name_.empty() ? "" : " ",
+              name_.c_str(), static_cast<unsigned long>(frames),
+              byte_count_ / (1024.0 * 1024.0));
+  if (frames > 1 && seconds > 0) {
+    // The first frame only marks the start
+    std::printf(", %.1f frames/s, %.1f MB/s", (frames - 1) / seconds,
+                byte_count_ * (frames - 1) / frames / seconds / (1024 * 1024));
+  }
+  std::printf("\n");
+  std::printf("Timestamps: %lu gaps (about %lu frames missing), %lu duplicates, "
+              "%lu out of order\n",
+              static_cast<unsigned long>(gap_count_),
+              static_cast<unsigned long>(missing_count_),
+              static_cast<unsigned long>(duplicate_count_),
+              static_cast<unsigned long>(reordered_count_));
+  if (compressed_count_ > 0) {
+    std::printf("Compressed: %lu frames of %.1f KB on average, %.1f:1\n",
+                static_cast<unsigned long>(compressed_count_),
+                compressed_bytes_ / 1024.0 / compressed_count_, compression_ratio());
+  }
+
+  show_histograms(histograms_, busy_ns_, seconds);
+}
+
+void PipelineStats::show_interval(double seconds) {
+  // Values recorded while the histograms are reset are lost, that is good
+  // enough for a periodic report
+  uint64_t frames = interval_frame_count_.exchange(0);
+  std::printf("%s%sLast %.0f s: %lu frames, %.1f frames/s, %lu gaps, %lu duplicates\n",
+              name_.c_str(), name_.empty() ? "" : ": ", seconds,
+              static_cast<unsigned long>(frames), frames / seconds,
+              static_cast<unsigned long>(gap_count_),
+              static_cast<unsigned long>(duplicate_count_));
+  show_histograms(interval_histograms_, interval_busy_ns_, seconds);
+  for (auto &histogram : interval_histograms_) {
+    histogram.reset();
+  }
+  for (auto &busy : interval_busy_ns_) {
+    busy = 0;
+  }
+}
+
+// busy is the share of one core the stage kept busy, so the stage with the
+// highest value compared to the threads it can use is the bottleneck. Stages
+// which only wait have none.
+void PipelineStats::show_histograms(
+    const std::array<LatencyHistogram, STAGE_COUNT> &histograms,
+    const std::array<std::atomic_int64_t, STAGE_COUNT> &busy_ns, double seconds) {
+  std::printf("  %-12s %10s %10s %10s %10s %10s %10s %8s (us, busy: share of a core)\n",
+              "stage", "count",
+              "mean", "p50", "p99", "p99.9", "max", "busy");
+  for (int i = 0; i < STAGE_COUNT; ++i) {
+    const auto &histogram = histograms[i];
+    if (histogram.count() == 0) {
+      continue;
+    }
+    std::printf("  %-12s %10lu %10.1f %10.1f %10.1f %10.1f %10.1f",
+                stage_name(static_cast<Stage>(i)),
+                static_cast<unsigned long>(histogram.count()),
+                histogram.mean() / 1e3, histogram.percentile(50) / 1e3,
+                histogram.percentile(99) / 1e3, histogram.percentile(99.9) / 1e3,
+                histogram.max() / 1e3);
+    if (busy_ns[i] > 0 && seconds > 0) {
+      std::printf(" %7.0f%%\n", busy_ns[i] / 1e9 / seconds * 100);
+    } else {
+      std::printf(" %8s\n", "-");
+    }
+  }
+}
+
+void PipelineStats::dump_header(FILE *file) {
+  std::fprintf(file, "stream,stage,percentile,value_ns,count\n");
+}
+
+void PipelineStats::dump(FILE *file) {
+  for (int i = 0; i < STAGE_COUNT; ++i) {
+    const auto &histogram = histograms_[i];
+    if (histogram.count() == 0) {
+      continue;
+    }
+    for (double percentile : kDumpPercentiles) {
+      std::fprintf(file, "%s,%s,%g,%lu,%lu\n", name_.c_str(),
+                   stage_name(static_cast<Stage>(i)), percentile,
+                   static_cast<unsigned long>(percentile == 0 ? histogram.min()
+                                                              : histogram.percentile(percentile)),
+                   static_cast<unsigned long>(histogram.count()));
+    }
+  }
+
+  std::fprintf(file, "# %s frames %lu, gaps %lu, missing %lu, duplicates %lu, out of order %lu\n",
+               name_.c_str(), static_cast<unsigned long>(frame_count_),
+               static_cast<unsigned long>(gap_count_),
+               static_cast<unsigned long>(missing_count_),
+               static_cast<unsigned long>(duplicate_count_),
+               static_cast<unsigned long>(reordered_count_));
+}
+
+const char *PipelineStats::stage_name(Stage stage) {
+  switch (stage) {
+  case NETWORK:
+    return "network";
+  case REASSEMBLE:
+    return "reassemble";
+  case QUEUE:
+    return "queue";
+  case DESERIALIZE:
+    return "deserialize";
+  case DECODE:
+    return "decode";
+  case CONVERT:
+    return "convert";
+  case REORDER:
+    return "reorder";
+  case WRITE:
+    return "write";
+  case DISPLAY:
+    return "display";
+  case TOTAL:
+    return "total";
+  default:
+    return "unknown";
+  }
+}
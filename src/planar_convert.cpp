@@ -0,0 +1,315 @@
+#include "include/planar_convert.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PLANAR_CONVERT_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+// Same as INTER_RESIZE_COEF_BITS in OpenCV
+constexpr int kCoefBits = 11;
+constexpr int kCoefScale = 1 << kCoefBits;
+constexpr int kRound = 1 << (kCoefBits - 1);
+
+inline uint8_t blend(const uint8_t *row, int32_t x0, int32_t x1,
+                     int16_t a0, int16_t a1) {
+  return static_cast<uint8_t>((row[x0] * a0 + row[x1] * a1 + kRound) >> kCoefBits);
+}
+
+#ifdef PLANAR_CONVERT_X86
+// Four BGR0 pixels in -> 12 BGR bytes out, in each 128 bit lane
+#define PACK_BGR_MASK_128 \
+  0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1
+
+// Build four BGR0 dwords per vector from 16 bytes of each plane
+__attribute__((target("sse2")))
+inline void merge_bgr0_sse2(__m128i b, __m128i g, __m128i r, __m128i px[4]) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i bg_lo = _mm_unpacklo_epi8(b, g);
+  __m128i bg_hi = _mm_unpackhi_epi8(b, g);
+  __m128i r0_lo = _mm_unpacklo_epi8(r, zero);
+  __m128i r0_hi = _mm_unpackhi_epi8(r, zero);
+  px[0] = _mm_unpacklo_epi16(bg_lo, r0_lo);
+  px[1] = _mm_unpackhi_epi16(bg_lo, r0_lo);
+  px[2] = _mm_unpacklo_epi16(bg_hi, r0_hi);
+  px[3] = _mm_unpackhi_epi16(bg_hi, r0_hi);
+}
+
+// Writes count BGR0 dwords as BGR. Each store writes one byte too much,
+// the caller keeps a margin at the end of the row.
+inline void store_bgr0(const uint32_t *px, int count, uint8_t *dst) {
+  for (int i = 0; i < count; ++i) {
+    std::memcpy(dst + i * 3, &px[i], sizeof(uint32_t));
+  }
+}
+
+__attribute__((target("sse2")))
+uint32_t interleave_row_sse2(const uint8_t *r, const uint8_t *g,
+                             const uint8_t *b, uint8_t *dst, uint32_t width) {
+  uint32_t x = 0;
+  alignas(16) uint32_t tmp[16];
+  for (; x + 16 + 2 <= width; x += 16) {
+    __m128i px[4];
+    merge_bgr0_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + x)),
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(g + x)),
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(r + x)),
+                    px);
+    for (int i = 0; i < 4; ++i) {
+      _mm_store_si128(reinterpret_cast<__m128i *>(tmp + i * 4), px[i]);
+    }
+    store_bgr0(tmp, 16, dst + x * 3);
+  }
+  return x;
+}
+
+__attribute__((target("avx2")))
+uint32_t interleave_row_avx2(const uint8_t *r, const uint8_t *g,
+                             const uint8_t *b, uint8_t *dst, uint32_t width) {
+  const __m128i pack = _mm_setr_epi8(PACK_BGR_MASK_128);
+  uint32_t x = 0;
+  for (; x + 16 + 2 <= width; x += 16) {
+    __m128i px[4];
+    merge_bgr0_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + x)),
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(g + x)),
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(r + x)),
+                    px);
+    uint8_t *d = dst + x * 3;
+    for (int i = 0; i < 4; ++i) {
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(d + i * 12),
+                       _mm_shuffle_epi8(px[i], pack));
+    }
+  }
+  return x;
+}
+
+__attribute__((target("sse2")))
+inline __m128i blend8_sse2(const uint8_t *row, const int32_t *xofs,
+                           const int32_t *xofs1, const int16_t *alpha) {
+  alignas(16) int16_t pairs[16];
+  for (int i = 0; i < 8; ++i) {
+    pairs[i * 2] = row[xofs[i]];
+    pairs[i * 2 + 1] = row[xofs1[i]];
+  }
+  const __m128i round = _mm_set1_epi32(kRound);
+  __m128i lo = _mm_madd_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(pairs)),
+                              _mm_loadu_si128(reinterpret_cast<const __m128i *>(alpha)));
+  __m128i hi = _mm_madd_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(pairs + 8)),
+                              _mm_loadu_si128(reinterpret_cast<const __m128i *>(alpha + 8)));
+  lo = _mm_srai_epi32(_mm_add_epi32(lo, round), kCoefBits);
+  hi = _mm_srai_epi32(_mm_add_epi32(hi, round), kCoefBits);
+  __m128i v = _mm_packs_epi32(lo, hi);
+  return _mm_packus_epi16(v, v);
+}
+
+__attribute__((target("sse2")))
+uint32_t scale_row_sse2(const uint8_t *r, const uint8_t *g, const uint8_t *b,
+                        uint8_t *dst, const int32_t *xofs, const int32_t *xofs1,
+                        const int16_t *alpha, uint32_t end) {
+  uint32_t dx = 0;
+  alignas(16) uint32_t tmp[16];
+  for (; dx + 8 <= end; dx += 8) {
+    __m128i px[4];
+    merge_bgr0_sse2(blend8_sse2(b, xofs + dx, xofs1 + dx, alpha + dx * 2),
+                    blend8_sse2(g, xofs + dx, xofs1 + dx, alpha + dx * 2),
+                    blend8_sse2(r, xofs + dx, xofs1 + dx, alpha + dx * 2),
+                    px);
+    _mm_store_si128(reinterpret_cast<__m128i *>(tmp), px[0]);
+    _mm_store_si128(reinterpret_cast<__m128i *>(tmp + 4), px[1]);
+    store_bgr0(tmp, 8, dst + dx * 3);
+  }
+  return dx;
+}
+
+__attribute__((target("avx2")))
+inline __m256i blend8_avx2(const uint8_t *row, __m256i idx, __m256i alpha) {
+  // Keep the left pixel in the low and the right pixel in the high 16 bits
+  const __m256i pair = _mm256_setr_epi8(
+      0, -1, 1, -1, 4, -1, 5, -1, 8, -1, 9, -1, 12, -1, 13, -1,
+      0, -1, 1, -1, 4, -1, 5, -1, 8, -1, 9, -1, 12, -1, 13, -1);
+  __m256i v = _mm256_i32gather_epi32(reinterpret_cast<const int *>(row), idx, 1);
+  v = _mm256_madd_epi16(_mm256_shuffle_epi8(v, pair), alpha);
+  return _mm256_srli_epi32(_mm256_add_epi32(v, _mm256_set1_epi32(kRound)), kCoefBits);
+}
+
+__attribute__((target("avx2")))
+uint32_t scale_row_avx2(const uint8_t *r, const uint8_t *g, const uint8_t *b,
+                        uint8_t *dst, const int32_t *xofs,
+                        const int16_t *alpha, uint32_t end) {
+  const __m256i pack = _mm256_setr_epi8(PACK_BGR_MASK_128, PACK_BGR_MASK_128);
+  uint32_t dx = 0;
+  for (; dx + 8 <= end; dx += 8) {
+    __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(xofs + dx));
+    __m256i al = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(alpha + dx * 2));
+    __m256i px = _mm256_or_si256(
+        blend8_avx2(b, idx, al),
+        _mm256_or_si256(_mm256_slli_epi32(blend8_avx2(g, idx, al), 8),
+                        _mm256_slli_epi32(blend8_avx2(r, idx, al), 16)));
+    px = _mm256_shuffle_epi8(px, pack);
+    uint8_t *d = dst + dx * 3;
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(d), _mm256_castsi256_si128(px));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(d + 12), _mm256_extracti128_si256(px, 1));
+  }
+  return dx;
+}
+#endif
+} // namespace
+
+PlanarToBgrScaler::PlanarToBgrScaler() : isa_(detect_isa()) {}
+
+PlanarToBgrScaler::PlanarToBgrScaler(Isa isa)
+    : isa_(isa_supported(isa) ? isa : detect_isa()) {}
+
+PlanarToBgrScaler::Isa PlanarToBgrScaler::detect_isa() {
+  if (isa_supported(Isa::AVX2)) {
+    return Isa::AVX2;
+  }
+  if (isa_supported(Isa::SSE2)) {
+    return Isa::SSE2;
+  }
+  return Isa::SCALAR;
+}
+
+bool PlanarToBgrScaler::isa_supported(Isa isa) {
+  switch (isa) {
+  case Isa::SCALAR:
+    return true;
+#ifdef PLANAR_CONVERT_X86
+  case Isa::SSE2:
+    return __builtin_cpu_supports("sse2");
+  case Isa::AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+const char *PlanarToBgrScaler::isa_name(Isa isa) {
+  switch (isa) {
+  case Isa::SCALAR:
+    return "scalar";
+  case Isa::SSE2:
+    return "sse2";
+  case Isa::AVX2:
+    return "avx2";
+  }
+  return "unknown";
+}
+
+void PlanarToBgrScaler::prepare(uint32_t width, uint32_t dst_width) {
+  if (width == width_ && dst_width == dst_width_) {
+    return;
+  }
+  width_ = width;
+  dst_width_ = dst_width;
+
+  xofs_.resize(dst_width);
+  xofs1_.resize(dst_width);
+  alpha_.resize(dst_width * 2);
+
+  // Mirrors the coefficient setup of cv::resize() for INTER_LINEAR
+  double scale_x = 1. / (static_cast<double>(dst_width) / width);
+  simd_end_ = dst_width >= 2 ? dst_width - 2 : 0;
+  for (uint32_t dx = 0; dx < dst_width; ++dx) {
+    float fx = static_cast<float>((dx + 0.5) * scale_x - 0.5);
+    int32_t sx = static_cast<int32_t>(std::floor(fx));
+    fx -= sx;
+    if (sx < 0) {
+      fx = 0;
+      sx = 0;
+    }
+    if (sx >= static_cast<int32_t>(width) - 1) {
+      fx = 0;
+      sx = width - 1;
+    }
+
+    xofs_[dx] = sx;
+    xofs1_[dx] = std::min<int32_t>(sx + 1, width - 1);
+    alpha_[dx * 2] = static_cast<int16_t>(std::lrint((1.f - fx) * kCoefScale));
+    alpha_[dx * 2 + 1] = static_cast<int16_t>(std::lrint(fx * kCoefScale));
+
+    // The AVX2 loop reads 4 bytes from each source position
+    if (sx + 3 >= static_cast<int32_t>(width)) {
+      simd_end_ = std::min(simd_end_, dx);
+    }
+  }
+}
+
+void PlanarToBgrScaler::convert(const uint8_t *planar, uint32_t width,
+                                uint32_t height, uint8_t *dst, size_t dst_step,
+                                uint32_t dst_width) {
+  size_t plane_size = static_cast<size_t>(width) * height;
+  const uint8_t *r = planar;
+  const uint8_t *g = planar + plane_size;
+  const uint8_t *b = planar + plane_size * 2;
+
+  bool same_width = width == dst_width;
+  if (!same_width) {
+    prepare(width, dst_width);
+  }
+
+  for (uint32_t y = 0; y < height; ++y) {
+    size_t offset = static_cast<size_t>(y) * width;
+    uint8_t *row = dst + y * dst_step;
+    if (same_width) {
+      interleave_row(r + offset, g + offset, b + offset, row, width);
+    } else {
+      scale_row(r + offset, g + offset, b + offset, row);
+    }
+  }
+}
+
+void PlanarToBgrScaler::convert_row(const uint8_t *r, const uint8_t *g,
+                                    const uint8_t *b, uint32_t width,
+                                    uint8_t *dst, uint32_t dst_width) {
+  if (width == dst_width) {
+    interleave_row(r, g, b, dst, width);
+  } else {
+    prepare(width, dst_width);
+    scale_row(r, g, b, dst);
+  }
+}
+
+void PlanarToBgrScaler::interleave_row(const uint8_t *r, const uint8_t *g,
+                                       const uint8_t *b, uint8_t *dst,
+                                       uint32_t width) {
+  uint32_t x = 0;
+#ifdef PLANAR_CONVERT_X86
+  if (isa_ == Isa::AVX2) {
+    x = interleave_row_avx2(r, g, b, dst, width);
+  } else if (isa_ == Isa::SSE2) {
+    x = interleave_row_sse2(r, g, b, dst, width);
+  }
+#endif
+  for (; x < width; ++x) {
+    dst[x * 3] = b[x];
+    dst[x * 3 + 1] = g[x];
+    dst[x * 3 + 2] = r[x];
+  }
+}
+
+void PlanarToBgrScaler::scale_row(const uint8_t *r, const uint8_t *g,
+                                  const uint8_t *b, uint8_t *dst) {
+  uint32_t dx = 0;
+#ifdef PLANAR_CONVERT_X86
+  if (isa_ == Isa::AVX2) {
+    dx = scale_row_avx2(r, g, b, dst, xofs_.data(), alpha_.data(), simd_end_);
+  } else if (isa_ == Isa::SSE2) {
+    dx = scale_row_sse2(r, g, b, dst, xofs_.data(), xofs1_.data(),
+                        alpha_.data(), simd_end_);
+  }
+#endif
+  for (; dx < dst_width_; ++dx) {
+    int32_t x0 = xofs_[dx];
+    int32_t x1 = xofs1_[dx];
+    int16_t a0 = alpha_[dx * 2];
+    int16_t a1 = alpha_[dx * 2 + 1];
+    dst[dx * 3] = blend(b, x0, x1, a0, a1);
+    dst[dx * 3 + 1] = blend(g, x0, x1, a0, a1);
+    dst[dx * 3 + 2] = blend(r, x0, x1, a0, a1);
+  }
+}
@@ -0,0 +1,127 @@
+#include "include/recording_reader.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+RecordingReader::~RecordingReader() {
+  close();
+}
+
+bool RecordingReader::open(const std::string &path, DeserializeMode mode) {
+  close();
+  mode_ = mode;
+
+  for (uint32_t segment = 0;; ++segment) {
+    Segment current;
+    if (!map_file(recording_segment_name(path, segment, ".idx"), false, current.index)) {
+      break;
+    }
+
+    auto header = reinterpret_cast<const RecordingIndexHeader *>(current.index.data);
+    if (current.index.size < sizeof(RecordingIndexHeader) ||
+        std::memcmp(header->magic, kRecordingIndexMagic, sizeof(header->magic)) != 0 ||
+        header->version != kRecordingVersion ||
+        header->entry_size != sizeof(RecordingIndexEntry)) {
+      std::printf("Invalid recording index of segment %u\n", segment);
+      unmap(current.index);
+      break;
+    }
+
+    // An empty segment can't be mapped, but it has no frames either
+    map_file(recording_segment_name(path, segment, ".dat"), true, current.data);
+
+    current.entries = reinterpret_cast<const RecordingIndexEntry *>(
+        current.index.data + sizeof(RecordingIndexHeader));
+    current.entry_count = (current.index.size - sizeof(RecordingIndexHeader)) /
+                          sizeof(RecordingIndexEntry);
+
+    // A capture which was cut off may index data which never got written
+    while (current.entry_count > 0) {
+      const auto &last = current.entries[current.entry_count - 1];
+      if (last.offset + last.size <= current.data.size) {
+        break;
+      }
+      current.entry_count--;
+    }
+
+    for (size_t i = 0; i < current.entry_count; ++i) {
+      frames_.push_back(FrameLocation{segment, static_cast<uint32_t>(i)});
+    }
+    segments_.push_back(current);
+  }
+
+  deserialized_.assign(frames_.size(), false);
+  return !segments_.empty();
+}
+
+void RecordingReader::close() {
+  for (auto &segment : segments_) {
+    unmap(segment.data);
+    unmap(segment.index);
+  }
+  segments_.clear();
+  frames_.clear();
+  deserialized_.clear();
+}
+
+const uint8_t *RecordingReader::frame_data(size_t index) const {
+  const auto &location = frames_[index];
+  return segments_[location.segment].data.data + entry(index).offset;
+}
+
+const imx500_img_transport::img_msg *RecordingReader::frame(size_t index) {
+  const auto &location = frames_[index];
+  uint8_t *data = segments_[location.segment].data.data + entry(index).offset;
+
+  // cista turns the offsets into pointers in place, that must happen once
+  if (deserialized_[index]) {
+    return MsgDeserializer::header(data, entry(index).size, mode_);
+  }
+
+  MsgDeserializer deserializer(mode_);
+  auto msg = deserializer.deserialize(data, entry(index).size);
+  if (msg == nullptr) {
+    std::printf("Frame %lu of the recording is corrupt: %s\n",
+                static_cast<unsigned long>(index), deserializer.error().c_str());
+    return nullptr;
+  }
+  deserialized_[index] = true;
+  return msg;
+}
+
+bool RecordingReader::map_file(const std::string &file, bool writable,
+                               Mapping &mapping) {
+  int fd = ::open(file.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat sb;
+  if (fstat(fd, &sb) != 0 || sb.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+
+  int prot = PROT_READ | (writable ? PROT_WRITE : 0);
+  void *data = mmap(nullptr, sb.st_size, prot, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  mapping.data = static_cast<uint8_t *>(data);
+  mapping.size = sb.st_size;
+  return true;
+}
+
+void RecordingReader::unmap(Mapping &mapping) {
+  if (mapping.data != nullptr) {
+    munmap(mapping.data, mapping.size);
+    mapping.data = nullptr;
+    mapping.size = 0;
+  }
+}
@@ -0,0 +1,164 @@
+#include "include/replay_source.hpp"
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+#include "include/msg_deserializer.hpp"
+#include "include/thread_tuning.hpp"
+
+ReplaySource::ReplaySource(const std::string &path,
+                           std::shared_ptr<StreamRouter> &router, Rate rate,
+                           double fps)
+    : path_(path), router_(router), rate_(rate), fps_(fps) {}
+
+ReplaySource::~ReplaySource() {
+  stop();
+}
+
+bool ReplaySource::open() {
+  if (reader_.open(path_, router_->config().deserialize_mode)) {
+    use_reader_ = true;
+    return reader_.frame_count() > 0;
+  }
+
+  DIR *dir = opendir(path_.c_str());
+  if (dir == nullptr) {
+    return false;
+  }
+  while (struct dirent *entry = readdir(dir)) {
+    std::string file = path_ + "/" + entry->d_name;
+    struct stat sb;
+    if (stat(file.c_str(), &sb) == 0 && S_ISREG(sb.st_mode)) {
+      files_.push_back(file);
+    }
+  }
+  closedir(dir);
+
+  std::sort(files_.begin(), files_.end());
+  return !files_.empty();
+}
+
+size_t ReplaySource::frame_count() const {
+  return use_reader_ ? reader_.frame_count() : files_.size();
+}
+
+void ReplaySource::start(std::function<void()> on_done) {
+  on_done_ = std::move(on_done);
+  stream_ = router_->get_stream(path_);
+  thread_ = std::thread(&ReplaySource::run, this);
+}
+
+void ReplaySource::wait() {
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void ReplaySource::stop() {
+  {
+    std::lock_guard<std::mutex> lock(stop_mutex_);
+    stop_ = true;
+  }
+  stop_cond_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void ReplaySource::run() {
+  ThreadTuning::apply(ThreadRole::MQTT);
+  std::printf("Replay %lu frames from %s\n",
+              static_cast<unsigned long>(frame_count()), path_.c_str());
+
+  auto start_time = std::chrono::steady_clock::now();
+  // Of the first frame which loads, files which aren't messages are skipped
+  int64_t first_timestamp = 0;
+  bool have_first = false;
+
+  for (size_t i = 0; i < frame_count() && !stop_; ++i) {
+    const uint8_t *data;
+    size_t size;
+    int64_t timestamp;
+    if (!load(i, data, size, timestamp)) {
+      continue;
+    }
+
+    if (!have_first) {
+      first_timestamp = timestamp;
+      have_first = true;
+    }
+    if (rate_ == Rate::RECORDED &&
+        !sleep_until(start_time + std::chrono::nanoseconds(timestamp - first_timestamp))) {
+      break;
+    } else if (rate_ == Rate::FIXED &&
+               !sleep_until(start_time + std::chrono::nanoseconds(
+                                             static_cast<int64_t>(i * 1e9 / fps_)))) {
+      break;
+    }
+
+    router_->push(*stream_, data, size);
+  }
+  if (on_done_) {
+    on_done_();
+  }
+}
+
+bool ReplaySource::sleep_until(std::chrono::steady_clock::time_point time) {
+  std::unique_lock<std::mutex> lock(stop_mutex_);
+  return !stop_cond_.wait_until(lock, time, [this] { return stop_.load(); });
+}
+
+bool ReplaySource::load(size_t index, const uint8_t *&data, size_t &size,
+                        int64_t &timestamp) {
+  if (use_reader_) {
+    data = reader_.frame_data(index);
+    size = reader_.frame_size(index);
+    timestamp = reader_.frame_timestamp(index);
+    return true;
+  }
+
+  std::ifstream file(files_[index], std::ios::binary | std::ios::ate);
+  if (!file) {
+    std::printf("Failed to read %s\n", files_[index].c_str());
+    return false;
+  }
+  file_buffer_.resize(file.tellg());
+  file.seekg(0);
+  file.read(reinterpret_cast<char *>(file_buffer_.data()), file_buffer_.size());
+
+  auto header = MsgDeserializer::header(file_buffer_.data(), file_buffer_.size(),
+                                        router_->config().deserialize_mode);
+  if (!file || header == nullptr) {
+    std::printf("%s isn't a serialized img_msg\n", files_[index].c_str());
+    return false;
+  }
+
+  data = file_buffer_.data();
+  size = file_buffer_.size();
+  timestamp = header->timestamp;
+  return true;
+}
+
+bool ReplaySource::parse_rate(const std::string &param, Rate &rate, double &fps) {
+  if (param == "fast") {
+    rate = Rate::FAST;
+    return true;
+  }
+  if (param == "recorded") {
+    rate = Rate::RECORDED;
+    return true;
+  }
+
+  try {
+    fps = std::stod(param, nullptr);
+  } catch (std::exception &) {
+    return false;
+  }
+  rate = Rate::FIXED;
+  return fps > 0;
+}
@@ -0,0 +1,660 @@
+#include "include/stream_pipeline.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "include/img_msg.hpp"
+
+namespace {
+// A stripe converts at least this many pixels, smaller frames are converted
+// in one piece (about 0.1 ms of work)
+constexpr size_t kMinStripePixels = 256 * 1024;
+} // namespace
+
+StreamPipeline::StreamPipeline(uint32_t id, const std::string &name,
+                               const StreamConfig &config,
+                               std::shared_ptr<FrameSink> sink,
+                               std::shared_ptr<DecodePool> decode_pool)
+    : id_(id), name_(name), config_(config),
+      buffer_pool_(std::make_shared<BufferPool>()),
+      stats_(std::make_shared<PipelineStats>(name)), sink_(sink),
+      decode_pool_(decode_pool), display_pool_("display"), image_pool_("image") {
+  // Enough frames in flight to keep every thread of the pool busy while
+  // the oldest one is still converting
+  if (decode_pool_) {
+    max_in_flight_ = std::max<size_t>(2, decode_pool_->thread_count() * 2);
+  }
+
+  if (config_.prefault_size > 0) {
+    buffer_pool_->prefault(config_.prefault_size, config_.prefault_slabs);
+  }
+  if (config_.chunked) {
+    assembler_ = std::make_unique<ChunkAssembler>(buffer_pool_, config_.chunk_timeout);
+  }
+
+  if (config_.bounded_queue) {
+    queue_ = std::make_shared<BoundedMsgQueue<FrameBuffer>>(config_.queue_capacity,
+                                                            config_.queue_policy);
+  } else {
+    queue_ = std::make_shared<MsgQueue<FrameBuffer>>();
+  }
+
+  if (!config_.writer.output_path.empty()) {
+    writer_ = std::make_shared<ImageWriter>(config_.writer);
+  } else if (!config_.video.output_path.empty()) {
+    video_writer_ = std::make_shared<VideoFileWriter>(config_.video);
+  }
+  if (!config_.record_path.empty()) {
+    recorder_ = std::make_shared<FrameRecorder>(config_.record_path,
+                                                config_.segment_size, config_.direct_io);
+  }
+  if (!config_.shm_name.empty()) {
+    ring_ = std::make_unique<FrameRingWriter>(config_.shm_name, name_, config_.shm_slots);
+  }
+  bool full_size_sink = sink_ && sink_->full_size();
+  full_image_ = writer_ || video_writer_ || ring_ || full_size_sink;
+  display_image_ = !full_size_sink;
+
+  size_t held = sink_ ? sink_->held_frames() : 0;
+  display_pool_.set_max_frames(max_in_flight_ + (full_size_sink ? 0 : held));
+  image_pool_.set_max_frames(max_in_flight_ + (full_size_sink ? held : 0) +
+                             std::max(config_.writer.queue_capacity,
+                                      config_.video.queue_capacity));
+  if (sink_) {
+    sink_stream_ = sink_->add_stream(name_, stats_);
+  }
+}
+
+StreamPipeline::~StreamPipeline() {
+  stop();
+}
+
+bool StreamPipeline::push(const void *payload, size_t len) {
+  received_bytes_ += len;
+  if (!assembler_) {
+    received_count_++;
+    queue_->add_msg_to_queue(buffer_pool_->acquire(payload, len));
+    return true;
+  }
+
+  int64_t assembly_ns;
+  auto frame = assembler_->add(payload, len, &assembly_ns);
+  if (!frame) {
+    return false;
+  }
+  stats_->record(PipelineStats::REASSEMBLE, assembly_ns);
+  received_count_++;
+  queue_->add_msg_to_queue(std::move(frame));
+  return true;
+}
+
+size_t StreamPipeline::process(size_t max_frames) {
+  size_t processed = 0;
+  while (processed < max_frames) {
+    auto serialized_msg = queue_->try_get_msg_from_queue();
+    if (serialized_msg.get() == nullptr) {
+      break;
+    }
+    process_frame(std::move(serialized_msg));
+    processed++;
+  }
+  return processed;
+}
+
+void StreamPipeline::process_frame(std::shared_ptr<FrameBuffer> serialized_msg) {
+  int64_t stage_start = steady_clock_ns();
+  stats_->record(PipelineStats::QUEUE, stage_start - serialized_msg->receive_time_ns());
+
+  // Deserialization changes the buffer in place, so record it before
+  int64_t write_time = 0;
+  // Plain fields can be read before deserialization
+  auto header = MsgDeserializer::header(serialized_msg->data(), serialized_msg->size(),
+                                        config_.deserialize_mode);
+  if (recorder_ && header != nullptr) {
+    recorder_->record(serialized_msg->data(), serialized_msg->size(),
+                      header->timestamp);
+    write_time = steady_clock_ns() - stage_start;
+  }
+
+  DecodedFrame frame;
+  frame.seq = begin_frame();
+  frame.payload_size = serialized_msg->size();
+  frame.receive_time_ns = serialized_msg->receive_time_ns();
+  frame.write_time = write_time;
+
+  if (!decode_pool_) {
+    decode_frame(std::move(serialized_msg), std::move(frame));
+  } else if (!decode_pool_->submit([this, serialized_msg, frame]() {
+               decode_frame(serialized_msg, frame);
+             })) {
+    complete(std::move(frame));
+  }
+}
+
+void StreamPipeline::decode_frame(std::shared_ptr<FrameBuffer> serialized_msg,
+                                  DecodedFrame frame) {
+  int64_t stage_start = steady_clock_ns();
+  MsgDeserializer deserializer(config_.deserialize_mode);
+  auto deserialized_msg =
+      deserializer.deserialize(serialized_msg->data(), serialized_msg->size());
+  if (deserialized_msg == nullptr) {
+    frame.status = DecodedFrame::REJECTED;
+    frame.error = deserializer.error();
+    complete(std::move(frame));
+    return;
+  }
+
+  int64_t now = steady_clock_ns();
+  stats_->record_work(PipelineStats::DESERIALIZE, now - stage_start);
+
+  if (config_.sender_latency) {
+    int64_t receive_wall_ns =
+        realtime_clock_ns() - (now - serialized_msg->receive_time_ns());
+    stats_->record(PipelineStats::NETWORK, receive_wall_ns - deserialized_msg->timestamp);
+  }
+
+  const auto &encoding = deserialized_msg->encoding;
+  frame.timestamp = deserialized_msg->timestamp;
+  frame.height = static_cast<uint32_t>(deserialized_msg->height);
+  frame.width = deserialized_msg->width;
+  frame.encoding.assign(encoding.data(), encoding.size());
+  frame.compressed = is_compressed_encoding(encoding.data(), encoding.size());
+
+  // The pixels stay valid as long as the payload buffer
+  const uint8_t *data = deserialized_msg->data.data();
+  size_t size = deserialized_msg->data.size();
+  if (is_delta_encoding(encoding.data(), encoding.size())) {
+    frame.serialized_msg = std::move(serialized_msg);
+    frame.data = data;
+    frame.data_size = size;
+    frame.decoded_ns = now;
+    frame.status = DecodedFrame::DELTA;
+    complete(std::move(frame));
+  } else if (frame.compressed) {
+    decode_compressed(std::move(serialized_msg), data, size, std::move(frame));
+  } else {
+    convert_raw(std::move(serialized_msg), data, size, std::move(frame));
+  }
+}
+
+void StreamPipeline::decode_compressed(std::shared_ptr<FrameBuffer> serialized_msg,
+                                       const uint8_t *data, size_t size,
+                                       DecodedFrame frame) {
+  int64_t stage_start = steady_clock_ns();
+  // cv::imdecode() reuses the frame if the message tells the right size.
+  // IMREAD_COLOR gives the BGR the raw decoders produce.
+  auto image = image_pool_.acquire(cv::Size(frame.width, frame.height), CV_8UC3);
+  cv::imdecode(cv::Mat(1, static_cast<int>(size), CV_8UC1, const_cast<uint8_t *>(data)),
+               cv::IMREAD_COLOR, image.get());
+  int64_t now = steady_clock_ns();
+  stats_->record_work(PipelineStats::DECODE, now - stage_start);
+  stage_start = now;
+  // Back to the pool before the frame waits for the ones before it
+  serialized_msg.reset();
+
+  if (image->empty()) {
+    if (decode_error_count_++ == 0) {
+      std::printf("%s: Failed to decode a %lu byte %s frame\n", name_.c_str(),
+                  static_cast<unsigned long>(size), frame.encoding.c_str());
+    }
+    frame.status = DecodedFrame::DROPPED;
+    complete(std::move(frame));
+    return;
+  }
+  stats_->add_compressed(size, image->total() * image->elemSize());
+
+  if (display_image_) {
+    cv::Size display_size(image->cols + 50, image->rows);
+    frame.display_frame = display_pool_.acquire(display_size, CV_8UC3);
+    cv::resize(*image, *frame.display_frame, display_size);
+  }
+  now = steady_clock_ns();
+  stats_->record_work(PipelineStats::CONVERT, now - stage_start);
+
+  if (full_image_) {
+    frame.image = std::move(image);
+  }
+  frame.decoded_ns = now;
+  frame.status = DecodedFrame::DECODED;
+  complete(std::move(frame));
+}
+
+void StreamPipeline::convert_raw(std::shared_ptr<FrameBuffer> serialized_msg,
+                                 const uint8_t *pixels, size_t size, DecodedFrame frame) {
+  int64_t stage_start = steady_clock_ns();
+  // The decoder is only looked up when the encoding changes
+  auto decoder = acquire_decoder();
+  if (!decoder->select(frame.encoding.data(), frame.encoding.size())) {
+    release_decoder(std::move(decoder));
+    frame.status = DecodedFrame::UNSUPPORTED;
+    complete(std::move(frame));
+    return;
+  }
+
+  uint32_t height = frame.height;
+  uint32_t width = frame.width;
+  if (size < decoder->frame_size(width, height) || width == 0 || height == 0) {
+    discarded_count_++;
+    uint64_t suppressed;
+    if (short_frame_warning_.allow(&suppressed)) {
+      std::printf("%s: %ux%u %s frame with %lu bytes of data, dropped "
+                  "(%lu more since the last warning)\n",
+                  name_.c_str(), width, height, frame.encoding.c_str(),
+                  static_cast<unsigned long>(size), static_cast<unsigned long>(suppressed));
+    }
+    release_decoder(std::move(decoder));
+    frame.status = DecodedFrame::DROPPED;
+    complete(std::move(frame));
+    return;
+  }
+
+  // The writer owns its image until it is written to disk
+  if (full_image_) {
+    frame.image = image_pool_.acquire(cv::Size(width, height), CV_8UC3);
+  }
+  // Convert and scale to the display size in one pass
+  if (display_image_) {
+    frame.display_frame = display_pool_.acquire(cv::Size(width + 50, height), CV_8UC3);
+  }
+
+  uint32_t stripes = stripe_count(width, height);
+  if (stripes <= 1) {
+    if (full_image_) {
+      decoder->decode(pixels, width, height, frame.image->data, frame.image->step, width);
+    }
+    if (display_image_) {
+      decoder->decode(pixels, width, height, frame.display_frame->data,
+                      frame.display_frame->step, width + 50);
+    }
+    release_decoder(std::move(decoder));
+
+    int64_t now = steady_clock_ns();
+    stats_->record_work(PipelineStats::CONVERT, now - stage_start);
+    serialized_msg.reset();
+    frame.decoded_ns = now;
+    frame.status = DecodedFrame::DECODED;
+    complete(std::move(frame));
+    return;
+  }
+  release_decoder(std::move(decoder));
+
+  auto striped = std::make_shared<StripedFrame>();
+  striped->serialized_msg = std::move(serialized_msg);
+  striped->pixels = pixels;
+  striped->frame = std::move(frame);
+  striped->stripes = stripes;
+  striped->remaining = stripes;
+  striped->start_ns = stage_start;
+  // This thread takes the first stripe, a stopped pool leaves the others to
+  // it as well
+  for (uint32_t i = 1; i < stripes; ++i) {
+    if (!decode_pool_->submit([this, striped, i]() { convert_stripe(striped, i); })) {
+      convert_stripe(striped, i);
+    }
+  }
+  convert_stripe(striped, 0);
+}
+
+void StreamPipeline::convert_stripe(const std::shared_ptr<StripedFrame> &striped,
+                                    uint32_t stripe) {
+  int64_t stage_start = steady_clock_ns();
+  auto &frame = striped->frame;
+  uint32_t height = frame.height;
+  uint32_t width = frame.width;
+  uint32_t first_row = static_cast<uint32_t>(static_cast<uint64_t>(height) * stripe /
+                                             striped->stripes);
+  uint32_t end_row = static_cast<uint32_t>(static_cast<uint64_t>(height) * (stripe + 1) /
+                                           striped->stripes);
+
+  auto decoder = acquire_decoder();
+  decoder->select(frame.encoding.data(), frame.encoding.size());
+  if (full_image_) {
+    decoder->decode_rows(striped->pixels, width, height, first_row, end_row,
+                         frame.image->data, frame.image->step, width);
+  }
+  if (display_image_) {
+    decoder->decode_rows(striped->pixels, width, height, first_row, end_row,
+                         frame.display_frame->data, frame.display_frame->step, width + 50);
+  }
+  release_decoder(std::move(decoder));
+
+  int64_t now = steady_clock_ns();
+  stats_->add_busy(PipelineStats::CONVERT, now - stage_start);
+  // The other stripes are done once the count drops to zero
+  if (striped->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+  stats_->record(PipelineStats::CONVERT, now - striped->start_ns);
+  striped->serialized_msg.reset();
+  frame.decoded_ns = now;
+  frame.status = DecodedFrame::DECODED;
+  complete(std::move(frame));
+}
+
+// One stripe per thread of the pool, as long as a stripe is worth handing
+// over
+uint32_t StreamPipeline::stripe_count(uint32_t width, uint32_t height) const {
+  if (!decode_pool_) {
+    return 1;
+  }
+  size_t stripes = static_cast<size_t>(width) * height / kMinStripePixels;
+  stripes = std::min({stripes, decode_pool_->thread_count(), static_cast<size_t>(height)});
+  return static_cast<uint32_t>(std::max<size_t>(stripes, 1));
+}
+
+uint64_t StreamPipeline::begin_frame() {
+  std::unique_lock<std::mutex> lock(reorder_mutex_);
+  reorder_cond_.wait(lock, [this] { return in_flight_ < max_in_flight_; });
+  in_flight_++;
+  return next_seq_++;
+}
+
+void StreamPipeline::complete(DecodedFrame frame) {
+  std::unique_lock<std::mutex> lock(reorder_mutex_);
+  if (emitting_ || frame.seq != emit_seq_) {
+    // The thread emitting the frames before it takes it along
+    uint64_t seq = frame.seq;
+    reorder_buffer_.emplace(seq, std::move(frame));
+    peak_reorder_ = std::max(peak_reorder_, reorder_buffer_.size());
+    return;
+  }
+
+  // Emitting outside of the lock lets the other threads go on
+  emitting_ = true;
+  while (true) {
+    lock.unlock();
+    emit(frame);
+    lock.lock();
+
+    emit_seq_++;
+    in_flight_--;
+    reorder_cond_.notify_one();
+
+    auto next = reorder_buffer_.find(emit_seq_);
+    if (next == reorder_buffer_.end()) {
+      break;
+    }
+    frame = std::move(next->second);
+    reorder_buffer_.erase(next);
+  }
+  emitting_ = false;
+}
+
+// Runs in frame order, so everything comparing a frame with the one before
+// happens here
+void StreamPipeline::emit(DecodedFrame &frame) {
+  if (frame.status == DecodedFrame::DELTA) {
+    apply_delta(frame);
+  }
+
+  switch (frame.status) {
+  case DecodedFrame::SKIPPED:
+    return;
+  case DecodedFrame::REJECTED:
+    // Only the first of a run of equally broken frames is reported
+    rejected_count_++;
+    if (frame.error != last_error_) {
+      std::printf("%s: Rejected frame of %lu bytes: %s\n", name_.c_str(),
+                  static_cast<unsigned long>(frame.payload_size), frame.error.c_str());
+      last_error_ = frame.error;
+    }
+    return;
+  default:
+    break;
+  }
+
+  stats_->add_timestamp(frame.timestamp);
+  bool changed = frame.encoding != last_encoding_;
+  last_encoding_ = frame.encoding;
+  if (frame.status == DecodedFrame::UNSUPPORTED) {
+    unsupported_count_++;
+    if (changed) {
+      std::cout << name_ << ": Unsupported encoding " << frame.encoding << " !!!"
+                << std::endl;
+    }
+    return;
+  }
+  if (frame.status != DecodedFrame::DECODED) {
+    return;
+  }
+
+  if (changed || frame.height != height_ || frame.width != width_) {
+    if (frame.compressed) {
+      std::printf("%s: %ux%u %s frames\n", name_.c_str(), frame.width, frame.height,
+                  frame.encoding.c_str());
+    } else {
+      std::printf("%s: %ux%u %s frames (%s)\n", name_.c_str(), frame.width,
+                  frame.height, frame.encoding.c_str(), pixel_layout_name(config_.layout));
+    }
+    height_ = frame.height;
+    width_ = frame.width;
+  }
+
+  int64_t now = steady_clock_ns();
+  if (decode_pool_) {
+    stats_->record(PipelineStats::REORDER, now - frame.decoded_ns);
+  }
+
+  int64_t write_time = frame.write_time;
+  if (ring_) {
+    // Local readers get the frame before it is moved to the writer
+    ring_->write(*frame.image, frame.timestamp, frame.receive_time_ns);
+  }
+  // A full size sink shares the image with the writers, which only read it
+  ReceivedFrame received;
+  if (sink_) {
+    received.stream = sink_stream_;
+    received.seq = frame.seq;
+    received.timestamp = frame.timestamp;
+    received.receive_time_ns = frame.receive_time_ns;
+    if (display_image_) {
+      received.image = std::move(frame.display_frame);
+    } else {
+      received.image = frame.image;
+    }
+  }
+  if (writer_) {
+    // A dropped frame still uses up its index, so the gap shows in the file
+    // names
+    writer_->submit(frame_index_++, std::move(frame.image));
+  } else if (video_writer_) {
+    video_writer_->submit(frame.timestamp, std::move(frame.image));
+  }
+  if (full_image_) {
+    int64_t submitted = steady_clock_ns();
+    write_time += submitted - now;
+    now = submitted;
+  }
+  if (full_image_ || recorder_) {
+    stats_->record_work(PipelineStats::WRITE, write_time);
+  }
+
+  // The display thread only shows the latest frame and an application pulls
+  // from a bounded queue, decoding never waits for them
+  if (sink_) {
+    sink_->publish(sink_stream_, std::move(received));
+  }
+
+  stats_->record(PipelineStats::TOTAL, now - frame.receive_time_ns);
+  stats_->add_frame(frame.payload_size);
+}
+
+// Only the rows of the tiles which changed are converted
+void StreamPipeline::apply_delta(DecodedFrame &frame) {
+  int64_t stage_start = steady_clock_ns();
+  if (!compositor_) {
+    compositor_ =
+        std::make_unique<TileCompositor>(config_.layout, display_image_, full_image_);
+  }
+  auto result = compositor_->apply(frame.encoding, frame.width, frame.height, frame.data,
+                                   frame.data_size);
+  frame.serialized_msg.reset();
+  frame.data = nullptr;
+
+  switch (result) {
+  case TileCompositor::UNSUPPORTED:
+    frame.status = DecodedFrame::UNSUPPORTED;
+    return;
+  case TileCompositor::INVALID:
+    frame.status = DecodedFrame::REJECTED;
+    frame.error = compositor_->error();
+    return;
+  case TileCompositor::SKIPPED:
+    discarded_count_++;
+    frame.status = DecodedFrame::DROPPED;
+    return;
+  default:
+    break;
+  }
+
+  if (display_image_) {
+    frame.display_frame =
+        display_pool_.acquire(cv::Size(frame.width + 50, frame.height), CV_8UC3);
+  }
+  if (full_image_) {
+    frame.image = image_pool_.acquire(cv::Size(frame.width, frame.height), CV_8UC3);
+  }
+  compositor_->render(frame.width + 50, frame.display_frame.get(), frame.image.get());
+  int64_t now = steady_clock_ns();
+  stats_->record_work(PipelineStats::CONVERT, now - stage_start);
+  // The reorder stage only covers the wait before the tiles were applied
+  frame.decoded_ns += now - stage_start;
+  frame.status = DecodedFrame::DECODED;
+}
+
+std::unique_ptr<FrameDecoder> StreamPipeline::acquire_decoder() {
+  {
+    std::lock_guard<std::mutex> lock(decoders_mutex_);
+    if (!decoders_.empty()) {
+      auto decoder = std::move(decoders_.back());
+      decoders_.pop_back();
+      return decoder;
+    }
+  }
+  return std::make_unique<FrameDecoder>(config_.layout);
+}
+
+void StreamPipeline::release_decoder(std::unique_ptr<FrameDecoder> decoder) {
+  std::lock_guard<std::mutex> lock(decoders_mutex_);
+  decoders_.push_back(std::move(decoder));
+}
+
+void StreamPipeline::stop() {
+  // A producer blocked on a full queue gives up
+  queue_->wakeup_for_exit();
+  if (writer_) {
+    writer_->stop();
+  }
+  if (video_writer_) {
+    video_writer_->stop();
+  }
+  if (recorder_) {
+    recorder_->stop();
+  }
+}
+
+StreamMetrics StreamPipeline::metrics() {
+  StreamMetrics metrics;
+  metrics.received = received_count_;
+  metrics.received_bytes = received_bytes_;
+  metrics.decoded = stats_->frame_count();
+  if (sink_) {
+    metrics.displayed = sink_->delivered_count(sink_stream_);
+    metrics.display_skipped = sink_->skipped_count(sink_stream_);
+  }
+  if (writer_) {
+    metrics.written = writer_->written_count();
+    metrics.writer_dropped = writer_->dropped_count();
+    metrics.write_errors = writer_->failed_count();
+  }
+  if (video_writer_) {
+    metrics.video_written = video_writer_->written_count();
+    metrics.writer_dropped = video_writer_->dropped_count();
+    metrics.write_errors = video_writer_->failed_count();
+  }
+  if (recorder_) {
+    metrics.recorded = recorder_->frame_count();
+  }
+  if (ring_) {
+    metrics.shm_written = ring_->frame_count();
+  }
+
+  metrics.queue_dropped = queue_->dropped_count();
+  metrics.rejected = rejected_count_;
+  metrics.decode_errors = decode_error_count_;
+  metrics.unsupported = unsupported_count_;
+  metrics.discarded = discarded_count_;
+  if (assembler_) {
+    metrics.incomplete_chunks = assembler_->incomplete_count();
+  }
+
+  metrics.queue_size = queue_->size();
+  metrics.queue_peak = queue_->peak_size();
+  {
+    std::lock_guard<std::mutex> lock(reorder_mutex_);
+    metrics.reorder_peak = peak_reorder_;
+  }
+  metrics.allocations = buffer_pool_->allocation_count();
+  metrics.frame_pool_hits = display_pool_.hit_count() + image_pool_.hit_count();
+  metrics.frame_pool_misses = display_pool_.miss_count() + image_pool_.miss_count();
+  metrics.frame_pool_bytes = display_pool_.resident_bytes() + image_pool_.resident_bytes();
+  return metrics;
+}
+
+void StreamPipeline::show_statistics() {
+  std::printf("=== Stream %s ===\n", name_.c_str());
+  if (writer_) {
+    writer_->show_statistics();
+  }
+  if (video_writer_) {
+    video_writer_->show_statistics();
+  }
+  if (recorder_) {
+    recorder_->show_statistics();
+  }
+  if (ring_) {
+    ring_->show_statistics();
+  }
+  if (assembler_) {
+    assembler_->show_statistics();
+  }
+  if (compositor_) {
+    compositor_->show_statistics();
+  }
+  buffer_pool_->show_statistics();
+  if (display_image_) {
+    display_pool_.show_statistics();
+  }
+  if (full_image_) {
+    image_pool_.show_statistics();
+  }
+  queue_->show_statistics();
+  if (rejected_count_ > 0) {
+    std::printf("Rejected %lu malformed frames (%s deserialization)\n",
+                static_cast<unsigned long>(rejected_count_.load()),
+                deserialize_mode_name(config_.deserialize_mode));
+  }
+  if (decode_error_count_ > 0) {
+    std::printf("Failed to decode %lu compressed frames\n",
+                static_cast<unsigned long>(decode_error_count_.load()));
+  }
+  if (unsupported_count_ > 0) {
+    std::printf("Ignored %lu frames of unsupported encodings\n",
+                static_cast<unsigned long>(unsupported_count_.load()));
+  }
+  if (discarded_count_ > 0) {
+    std::printf("Discarded %lu frames short of pixels or of the frame they update\n",
+                static_cast<unsigned long>(discarded_count_.load()));
+  }
+  if (decode_pool_) {
+    std::lock_guard<std::mutex> lock(reorder_mutex_);
+    std::printf("Reorder buffer: peak %lu frames, at most %lu in flight\n",
+                static_cast<unsigned long>(peak_reorder_),
+                static_cast<unsigned long>(max_in_flight_));
+  }
+  stats_->show_summary();
+}
@@ -0,0 +1,288 @@
+#include "include/stream_router.hpp"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+
+#include "include/thread_tuning.hpp"
+
+namespace {
+// Frames a worker decodes before it lets another stream run
+constexpr size_t kMaxBatch = 4;
+
+// A wildcard subscription could match any number of topics
+constexpr size_t kMaxStreams = 64;
+} // namespace
+
+StreamRouter::StreamRouter(const StreamConfig &config, size_t workers, size_t decoders,
+                           bool multi_stream, std::shared_ptr<FrameSink> sink)
+    : config_(config), worker_count_(workers),
+      multi_stream_(multi_stream), sink_(sink) {
+  if (decoders > 0) {
+    decode_pool_ = std::make_shared<DecodePool>(decoders);
+  }
+}
+
+StreamRouter::~StreamRouter() {
+  stop();
+}
+
+void StreamRouter::start() {
+  for (size_t i = 0; i < worker_count_; ++i) {
+    workers_.emplace_back(&StreamRouter::worker_loop, this);
+  }
+}
+
+void StreamRouter::start_reporting(std::chrono::seconds interval) {
+  report_thread_ = std::thread(&StreamRouter::report_loop, this, interval);
+}
+
+std::shared_ptr<StreamPipeline> StreamRouter::get_stream(const std::string &topic) {
+  std::lock_guard<std::mutex> lock(streams_mutex_);
+  auto iter = topics_.find(topic);
+  if (iter != topics_.end()) {
+    return iter->second;
+  }
+
+  if (streams_.size() >= kMaxStreams) {
+    return nullptr;
+  }
+
+  StreamConfig config = config_;
+  if (multi_stream_) {
+    if (!config.writer.output_path.empty()) {
+      config.writer.output_path = stream_path(config.writer.output_path, topic);
+    }
+    if (!config.video.output_path.empty()) {
+      config.video.output_path = stream_path(config.video.output_path, topic);
+    }
+    if (!config.record_path.empty()) {
+      config.record_path = stream_path(config.record_path, topic);
+    }
+    if (!config.shm_name.empty()) {
+      config.shm_name += "_" + topic_file_name(topic);
+    }
+  }
+
+  auto stream = std::make_shared<StreamPipeline>(
+      static_cast<uint32_t>(streams_.size()), topic, config, sink_, decode_pool_);
+  topics_[topic] = stream;
+  streams_.push_back(stream);
+  std::printf("New stream %u: %s\n", stream->id(), topic.c_str());
+  return stream;
+}
+
+// A topic like cam/1/img becomes cam_1_img. Every other character but
+// letters, digits and '-' is escaped as %XX (cam_1 becomes cam%5F1), so two
+// topics never share a name and no name is "." or "..".
+std::string StreamRouter::topic_file_name(const std::string &topic) {
+  static const char kHex[] = "0123456789ABCDEF";
+  std::string name;
+  for (char c : topic) {
+    unsigned char byte = static_cast<unsigned char>(c);
+    if (isalnum(byte) || c == '-') {
+      name += c;
+    } else if (c == '/') {
+      name += '_';
+    } else {
+      name += '%';
+      name += kHex[byte >> 4];
+      name += kHex[byte & 0xf];
+    }
+  }
+  return name;
+}
+
+void StreamRouter::push(StreamPipeline &stream, const void *payload, size_t len) {
+  // Most chunks only complete part of a frame
+  if (!stream.push(payload, len)) {
+    return;
+  }
+  if (worker_count_ == 0) {
+    // Only converts the frame here without a decode pool, otherwise it
+    // waits while too many frames of the stream are being converted
+    while (stream.process(kMaxBatch) > 0) {
+    }
+    return;
+  }
+  schedule(stream);
+}
+
+void StreamRouter::route(const char *topic, const void *payload, size_t len) {
+  auto stream = get_stream(topic);
+  if (!stream) {
+    ignored_count_++;
+    return;
+  }
+  push(*stream, payload, len);
+}
+
+void StreamRouter::schedule(StreamPipeline &stream) {
+  // Pairs with the fence in worker_loop(). Either the worker sees the frame
+  // just queued, or we see that the stream isn't scheduled any more.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (stream.scheduled_.exchange(true)) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(ready_mutex_);
+    ready_.push_back(&stream);
+    scheduled_count_++;
+  }
+  ready_cond_.notify_one();
+}
+
+void StreamRouter::worker_loop() {
+  ThreadTuning::apply(ThreadRole::DISPATCH);
+  while (true) {
+    StreamPipeline *stream;
+    {
+      std::unique_lock<std::mutex> lock(ready_mutex_);
+      ready_cond_.wait(lock, [this] { return stop_ || !ready_.empty(); });
+      if (stop_) {
+        return;
+      }
+      stream = ready_.front();
+      ready_.pop_front();
+    }
+
+    stream->process(kMaxBatch);
+
+    if (!stream->has_pending()) {
+      stream->scheduled_.store(false);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      // A frame queued just before the flag was cleared didn't schedule
+      // the stream, so take it back unless the producer already did
+      if (!stream->has_pending() || stream->scheduled_.exchange(true)) {
+        std::lock_guard<std::mutex> lock(ready_mutex_);
+        if (--scheduled_count_ == 0) {
+          idle_cond_.notify_all();
+        }
+        continue;
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(ready_mutex_);
+      ready_.push_back(stream);
+    }
+    ready_cond_.notify_one();
+  }
+}
+
+void StreamRouter::drain() {
+  {
+    std::unique_lock<std::mutex> lock(ready_mutex_);
+    idle_cond_.wait(lock, [this] { return scheduled_count_ == 0 || stop_; });
+  }
+  // The workers are done, so no more frames go to the decoders
+  if (decode_pool_) {
+    decode_pool_->drain();
+  }
+}
+
+void StreamRouter::stop() {
+  {
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    stop_reporting_ = true;
+  }
+  report_cond_.notify_one();
+  if (report_thread_.joinable()) {
+    report_thread_.join();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(ready_mutex_);
+    stop_ = true;
+  }
+  ready_cond_.notify_all();
+  idle_cond_.notify_all();
+  for (auto &worker : workers_) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+  workers_.clear();
+
+  // Frames still being decoded go to the writers before they stop
+  if (decode_pool_) {
+    decode_pool_->stop();
+  }
+
+  for (auto &stream : streams()) {
+    stream->stop();
+  }
+}
+
+std::vector<std::shared_ptr<StreamPipeline>> StreamRouter::streams() {
+  std::lock_guard<std::mutex> lock(streams_mutex_);
+  return streams_;
+}
+
+void StreamRouter::report_loop(std::chrono::seconds interval) {
+  std::unique_lock<std::mutex> lock(report_mutex_);
+  while (!report_cond_.wait_for(lock, interval, [this] { return stop_reporting_; })) {
+    for (auto &stream : streams()) {
+      stream->get_stats()->show_interval(static_cast<double>(interval.count()));
+    }
+  }
+}
+
+void StreamRouter::show_statistics() {
+  auto all_streams = streams();
+  for (auto &stream : all_streams) {
+    stream->show_statistics();
+  }
+
+  std::printf("%-32s %10s %10s %10s %10s %10s %10s\n", "stream", "received",
+              "decoded", "fps", "dropped", "rejected", "gaps");
+  for (auto &stream : all_streams) {
+    auto stats = stream->get_stats();
+    uint64_t frames = stats->frame_count();
+    double seconds = stats->active_seconds();
+    // The first frame only marks the start
+    double fps = frames > 1 && seconds > 0 ? (frames - 1) / seconds : 0;
+    std::printf("%-32s %10lu %10lu %10.1f %10lu %10lu %10lu\n", stream->name().c_str(),
+                static_cast<unsigned long>(stream->received_count()),
+                static_cast<unsigned long>(stats->frame_count()), fps,
+                static_cast<unsigned long>(stream->dropped_count()),
+                static_cast<unsigned long>(stream->rejected_count()),
+                static_cast<unsigned long>(stats->gap_count()));
+  }
+  if (decode_pool_) {
+    std::printf("Decode pool: %lu threads, peak backlog %lu frames\n",
+                static_cast<unsigned long>(decode_pool_->thread_count()),
+                static_cast<unsigned long>(decode_pool_->peak_backlog()));
+  }
+  if (ignored_count_ > 0) {
+    std::printf("Ignored %lu messages, more than %lu streams\n",
+                static_cast<unsigned long>(ignored_count_),
+                static_cast<unsigned long>(kMaxStreams));
+  }
+}
+
+bool StreamRouter::dump_statistics(const std::string &path) {
+  FILE *file = std::fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    std::printf("Failed to open %s\n", path.c_str());
+    return false;
+  }
+
+  PipelineStats::dump_header(file);
+  for (auto &stream : streams()) {
+    stream->get_stats()->dump(file);
+  }
+  return std::fclose(file) == 0;
+}
+
+std::string StreamRouter::stream_path(const std::string &path, const std::string &topic) {
+  std::string stream_dir = path + "/" + topic_file_name(topic);
+  if (mkdir(stream_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    std::printf("Failed to create %s\n", stream_dir.c_str());
+  }
+  return stream_dir;
+}
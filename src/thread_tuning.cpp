@@ -0,0 +1,305 @@
+#include "include/thread_tuning.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+constexpr ThreadRole kRoles[] = {ThreadRole::MQTT, ThreadRole::DISPATCH, ThreadRole::DECODE,
+                                 ThreadRole::WRITER, ThreadRole::DISPLAY};
+constexpr size_t kRoleCount = sizeof(kRoles) / sizeof(kRoles[0]);
+
+// Written before the threads start, only read afterwards
+ThreadSettings g_settings[kRoleCount];
+bool g_memory_locked = false;
+
+std::atomic_uint64_t g_applied[kRoleCount];
+std::atomic_uint64_t g_failed[kRoleCount];
+std::atomic_bool g_warned[kRoleCount];
+
+size_t role_index(ThreadRole role) {
+  return static_cast<size_t>(role);
+}
+
+bool parse_number(const std::string &text, int min, int max, int &value) {
+  try {
+    size_t pos;
+    value = std::stoi(text, &pos);
+    return pos == text.size() && value >= min && value <= max;
+  } catch (std::exception &) {
+    return false;
+  }
+}
+
+// Like "2", "4-7" or "1+3-5"
+bool parse_cpus(const std::string &text, std::vector<int> &cpus) {
+  long online = ::sysconf(_SC_NPROCESSORS_CONF);
+  int max = static_cast<int>(std::min<long>(online > 0 ? online : 1, CPU_SETSIZE)) - 1;
+
+  size_t start = 0;
+  while (start <= text.size()) {
+    size_t end = text.find('+', start);
+    std::string range = text.substr(start, end == std::string::npos ? end : end - start);
+    size_t dash = range.find('-');
+    int first, last;
+    if (dash == std::string::npos) {
+      if (!parse_number(range, 0, max, first)) {
+        return false;
+      }
+      last = first;
+    } else if (!parse_number(range.substr(0, dash), 0, max, first) ||
+               !parse_number(range.substr(dash + 1), first, max, last)) {
+      return false;
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+    if (end == std::string::npos) {
+      break;
+    }
+    start = end + 1;
+  }
+  return !cpus.empty();
+}
+
+// "2", "4-7" or "1,3-5"
+std::string format_cpus(const std::vector<int> &cpus) {
+  std::string text;
+  for (size_t i = 0; i < cpus.size();) {
+    size_t j = i;
+    while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+      j++;
+    }
+    if (!text.empty()) {
+      text += ",";
+    }
+    text += std::to_string(cpus[i]);
+    if (j > i) {
+      text += "-" + std::to_string(cpus[j]);
+    }
+    i = j + 1;
+  }
+  return text;
+}
+
+void warn_once(ThreadRole role, const char *what, int error, const char *hint) {
+  if (!g_warned[role_index(role)].exchange(true)) {
+    std::printf("Failed to set %s on the %s threads: %s%s\n", what,
+                ThreadTuning::role_name(role), std::strerror(error), hint);
+  }
+}
+} // namespace
+
+bool ThreadTuning::parse(const std::string &param) {
+  size_t start = 0;
+  while (start <= param.size()) {
+    size_t end = param.find(',', start);
+    std::string entry = param.substr(start, end == std::string::npos ? end : end - start);
+    size_t equal = entry.find('=');
+    if (equal == std::string::npos) {
+      return false;
+    }
+
+    std::string name = entry.substr(0, equal);
+    const ThreadRole *role = nullptr;
+    for (auto &candidate : kRoles) {
+      if (name == role_name(candidate)) {
+        role = &candidate;
+      }
+    }
+    if (role == nullptr) {
+      return false;
+    }
+
+    ThreadSettings settings;
+    std::string spec = entry.substr(equal + 1);
+    size_t item_start = 0;
+    while (item_start <= spec.size()) {
+      size_t item_end = spec.find('/', item_start);
+      std::string item = spec.substr(
+          item_start, item_end == std::string::npos ? item_end : item_end - item_start);
+      size_t colon = item.find(':');
+      std::string key = item.substr(0, colon);
+      std::string value = colon == std::string::npos ? std::string() : item.substr(colon + 1);
+
+      if (key == "cpus") {
+        if (!settings.cpus.empty() || !parse_cpus(value, settings.cpus)) {
+          return false;
+        }
+      } else if (key == "fifo") {
+        if (!parse_number(value, 1, 99, settings.fifo_priority)) {
+          return false;
+        }
+      } else if (key == "nice") {
+        if (!parse_number(value, -20, 19, settings.nice)) {
+          return false;
+        }
+      } else {
+        return false;
+      }
+      if (item_end == std::string::npos) {
+        break;
+      }
+      item_start = item_end + 1;
+    }
+    // Nice levels only apply to SCHED_OTHER
+    if (settings.empty() || (settings.fifo_priority != 0 && settings.nice != 0)) {
+      return false;
+    }
+    configure(*role, settings);
+
+    if (end == std::string::npos) {
+      break;
+    }
+    start = end + 1;
+  }
+  return true;
+}
+
+void ThreadTuning::configure(ThreadRole role, const ThreadSettings &settings) {
+  g_settings[role_index(role)] = settings;
+}
+
+bool ThreadTuning::is_configured() {
+  for (auto &settings : g_settings) {
+    if (!settings.empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadTuning::apply(ThreadRole role) {
+  const ThreadSettings &settings = g_settings[role_index(role)];
+  if (settings.empty()) {
+    return;
+  }
+
+  bool ok = true;
+  if (!settings.cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : settings.cpus) {
+      CPU_SET(cpu, &set);
+    }
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0) {
+      warn_once(role, "the CPU affinity", rc, "");
+      ok = false;
+    }
+  }
+
+  if (settings.fifo_priority != 0) {
+    sched_param param{};
+    param.sched_priority = settings.fifo_priority;
+    int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (rc != 0) {
+      warn_once(role, "SCHED_FIFO", rc,
+                rc == EPERM ? ", needs CAP_SYS_NICE or RLIMIT_RTPRIO" : "");
+      ok = false;
+    }
+  } else if (settings.nice != 0) {
+    // On Linux the nice level is per thread
+    pid_t tid = static_cast<pid_t>(::syscall(SYS_gettid));
+    if (::setpriority(PRIO_PROCESS, static_cast<id_t>(tid), settings.nice) != 0) {
+      int error = errno;
+      warn_once(role, "the nice level", error,
+                error == EACCES ? ", lower levels need CAP_SYS_NICE or RLIMIT_NICE" : "");
+      ok = false;
+    }
+  }
+
+  if (ok) {
+    g_applied[role_index(role)]++;
+  } else {
+    g_failed[role_index(role)]++;
+  }
+}
+
+bool ThreadTuning::lock_memory() {
+  if (::mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    int error = errno;
+    struct rlimit limit {};
+    ::getrlimit(RLIMIT_MEMLOCK, &limit);
+    std::printf("Failed to lock the memory: %s (RLIMIT_MEMLOCK %lu KB), needs CAP_IPC_LOCK "
+                "or a higher ulimit -l\n",
+                std::strerror(error), static_cast<unsigned long>(limit.rlim_cur / 1024));
+    return false;
+  }
+  g_memory_locked = true;
+  return true;
+}
+
+bool ThreadTuning::memory_locked() {
+  return g_memory_locked;
+}
+
+std::string ThreadTuning::describe() {
+  std::string text;
+  for (auto role : kRoles) {
+    const ThreadSettings &settings = g_settings[role_index(role)];
+    if (settings.empty()) {
+      continue;
+    }
+    if (!text.empty()) {
+      text += "; ";
+    }
+    text += role_name(role);
+    text += ":";
+    std::string separator = " ";
+    if (!settings.cpus.empty()) {
+      text += separator + (settings.cpus.size() > 1 ? "CPUs " : "CPU ") +
+              format_cpus(settings.cpus);
+      separator = ", ";
+    }
+    if (settings.fifo_priority != 0) {
+      text += separator + "SCHED_FIFO " + std::to_string(settings.fifo_priority);
+    } else if (settings.nice != 0) {
+      text += separator + "nice " + std::to_string(settings.nice);
+    }
+  }
+  return text.empty() ? "default" : text;
+}
+
+void ThreadTuning::show_statistics() {
+  std::string text;
+  for (auto role : kRoles) {
+    if (g_settings[role_index(role)].empty()) {
+      continue;
+    }
+    if (!text.empty()) {
+      text += ", ";
+    }
+    uint64_t applied = g_applied[role_index(role)];
+    uint64_t failed = g_failed[role_index(role)];
+    text += std::string(role_name(role)) + " " + std::to_string(applied) + " of " +
+            std::to_string(applied + failed) + " threads";
+  }
+  std::printf("Thread tuning: %s%s\n", text.empty() ? "none" : text.c_str(),
+              g_memory_locked ? ", memory locked" : "");
+}
+
+const char *ThreadTuning::role_name(ThreadRole role) {
+  switch (role) {
+  case ThreadRole::MQTT:
+    return "mqtt";
+  case ThreadRole::DISPATCH:
+    return "dispatch";
+  case ThreadRole::DECODE:
+    return "decode";
+  case ThreadRole::WRITER:
+    return "writer";
+  case ThreadRole::DISPLAY:
+    return "display";
+  }
+  return "unknown";
+}
@@ -0,0 +1,184 @@
+#include "include/tile_compositor.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+TileCompositor::TileCompositor(PixelLayout layout, bool display_image, bool full_image)
+    : decoder_(layout), display_image_(display_image), full_image_(full_image) {}
+
+TileCompositor::Result TileCompositor::apply(const std::string &encoding, uint32_t width,
+                                             uint32_t height, const uint8_t *data,
+                                             size_t size) {
+  auto base = delta_base_encoding(encoding.data(), encoding.size());
+  if (!decoder_.select(base.data(), base.size())) {
+    return UNSUPPORTED;
+  }
+
+  DeltaHeader header;
+  if (size < sizeof(header)) {
+    return invalid("delta header too short");
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, kDeltaMagic, sizeof(kDeltaMagic)) != 0 ||
+      header.tile_size == 0 || header.tile_size > (1u << 16)) {
+    return invalid("invalid delta header");
+  }
+
+  // Check every tile before the frame is touched
+  const uint32_t tile_size = header.tile_size;
+  const uint32_t columns = (width + tile_size - 1) / tile_size;
+  const uint32_t rows = (height + tile_size - 1) / tile_size;
+  const size_t pixel_size = static_cast<size_t>(decoder_.channels()) * decoder_.sample_size();
+  if (header.tile_count > static_cast<uint64_t>(columns) * rows) {
+    return invalid("more tiles than the frame has");
+  }
+  const size_t tiles_end = sizeof(header) + header.tile_count * sizeof(DeltaTile);
+  if (size < tiles_end) {
+    return invalid("tiles outside of the payload");
+  }
+  std::vector<DeltaTile> tiles(header.tile_count);
+  if (!tiles.empty()) {
+    std::memcpy(tiles.data(), data + sizeof(header), tiles.size() * sizeof(DeltaTile));
+  }
+  size_t end = tiles_end;
+  for (auto &tile : tiles) {
+    if (tile.column >= columns || tile.row >= rows) {
+      return invalid("tile outside of the frame");
+    }
+    uint32_t x = tile.column * tile_size;
+    uint32_t y = tile.row * tile_size;
+    end += static_cast<size_t>(std::min(tile_size, width - x)) *
+           std::min(tile_size, height - y) * pixel_size;
+    if (end > size) {
+      return invalid("tile pixels outside of the payload");
+    }
+  }
+
+  bool same_frame = synced_ && width == width_ && height == height_ &&
+                    tile_size == tile_size_ && base == base_encoding_;
+  if (header.flags & kDeltaKeyframe) {
+    std::vector<uint8_t> covered(static_cast<size_t>(columns) * rows, 0);
+    for (auto &tile : tiles) {
+      covered[static_cast<size_t>(tile.row) * columns + tile.column] = 1;
+    }
+    if (std::find(covered.begin(), covered.end(), 0) != covered.end()) {
+      return invalid("keyframe without every tile");
+    }
+    if (!same_frame) {
+      width_ = width;
+      height_ = height;
+      tile_size_ = tile_size;
+      columns_ = columns;
+      rows_ = rows;
+      base_encoding_.assign(base.data(), base.size());
+      pixels_.resize(decoder_.frame_size(width, height));
+    }
+    dirty_rows_.assign(rows_, 1);
+    synced_ = true;
+    keyframe_count_++;
+  } else {
+    if (!same_frame) {
+      // A receiver which joined late, or a new resolution, starts with a
+      // keyframe
+      skipped_count_++;
+      return SKIPPED;
+    }
+    if (header.sequence == sequence_) {
+      // QoS 1 may deliver a frame twice
+      duplicate_count_++;
+      return SKIPPED;
+    }
+    if (header.sequence != sequence_ + 1) {
+      // A frame was lost, the tiles it changed are unknown
+      synced_ = false;
+      resync_count_++;
+      skipped_count_++;
+      return SKIPPED;
+    }
+    delta_tiles_ += tiles.size();
+    delta_frame_tiles_ += static_cast<uint64_t>(columns_) * rows_;
+  }
+  sequence_ = header.sequence;
+
+  const uint8_t *src = data + tiles_end;
+  for (auto &tile : tiles) {
+    uint32_t x = tile.column * tile_size_;
+    uint32_t y = tile.row * tile_size_;
+    uint32_t tile_width = std::min(tile_size_, width_ - x);
+    uint32_t tile_height = std::min(tile_size_, height_ - y);
+    for_each_tile_run(width_, height_, x, y, tile_width, tile_height, decoder_.channels(),
+                      decoder_.sample_size(), decoder_.layout(),
+                      [&](size_t frame_offset, size_t tile_offset, size_t length) {
+                        std::memcpy(pixels_.data() + frame_offset, src + tile_offset,
+                                    length);
+                      });
+    src += static_cast<size_t>(tile_width) * tile_height * pixel_size;
+    dirty_rows_[tile.row] = 1;
+  }
+  frame_count_++;
+  return APPLIED;
+}
+
+void TileCompositor::render(uint32_t display_width, cv::Mat *display, cv::Mat *image) {
+  const int rows = static_cast<int>(height_);
+  bool all = false;
+  if (display_image_ &&
+      (display_.rows != rows || display_.cols != static_cast<int>(display_width))) {
+    display_.create(rows, static_cast<int>(display_width), CV_8UC3);
+    all = true;
+  }
+  if (full_image_ && (image_.rows != rows || image_.cols != static_cast<int>(width_))) {
+    image_.create(rows, static_cast<int>(width_), CV_8UC3);
+    all = true;
+  }
+
+  // Convert runs of dirty tile rows in one go
+  for (uint32_t row = 0; row < rows_;) {
+    if (!all && !dirty_rows_[row]) {
+      row++;
+      continue;
+    }
+    uint32_t end = row + 1;
+    while (end < rows_ && (all || dirty_rows_[end])) {
+      end++;
+    }
+    uint32_t first_row = row * tile_size_;
+    uint32_t end_row = std::min(height_, end * tile_size_);
+    if (display_image_) {
+      decoder_.decode_rows(pixels_.data(), width_, height_, first_row, end_row,
+                           display_.data, display_.step, display_width);
+    }
+    if (full_image_) {
+      decoder_.decode_rows(pixels_.data(), width_, height_, first_row, end_row,
+                           image_.data, image_.step, width_);
+    }
+    row = end;
+  }
+  std::fill(dirty_rows_.begin(), dirty_rows_.end(), 0);
+
+  if (display != nullptr && display_image_) {
+    display_.copyTo(*display);
+  }
+  if (image != nullptr && full_image_) {
+    // The writer owns its image until it is written
+    image_.copyTo(*image);
+  }
+}
+
+TileCompositor::Result TileCompositor::invalid(const char *error) {
+  error_ = error;
+  return INVALID;
+}
+
+void TileCompositor::show_statistics() {
+  std::printf("Delta frames: %lu applied (%lu keyframes), %.1f%% of the tiles changed "
+              "per delta, %lu resyncs, %lu frames skipped until a keyframe, "
+              "%lu duplicates\n",
+              static_cast<unsigned long>(frame_count_),
+              static_cast<unsigned long>(keyframe_count_),
+              delta_frame_tiles_ > 0 ? 100.0 * delta_tiles_ / delta_frame_tiles_ : 0.0,
+              static_cast<unsigned long>(resync_count_),
+              static_cast<unsigned long>(skipped_count_),
+              static_cast<unsigned long>(duplicate_count_));
+}
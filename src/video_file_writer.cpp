@@ -0,0 +1,379 @@
+#include "include/video_file_writer.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cmath>
+
+#include <opencv2/imgproc.hpp>
+
+#include "include/thread_tuning.hpp"
+
+namespace {
+
+// Writes all of iov, continuing after short writes
+bool write_all(int fd, struct iovec *iov, int count) {
+  while (count > 0) {
+    ssize_t written = ::writev(fd, iov, count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    while (count > 0 && static_cast<size_t>(written) >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = static_cast<uint8_t *>(iov->iov_base) + written;
+      iov->iov_len -= written;
+    }
+  }
+  return true;
+}
+
+// Like "30:1" or "29970:1000"
+std::string frame_rate(double fps) {
+  if (fps == std::floor(fps)) {
+    return std::to_string(static_cast<long>(fps)) + ":1";
+  }
+  return std::to_string(std::lround(fps * 1000)) + ":1000";
+}
+
+} // namespace
+
+VideoFileWriter::VideoFileWriter(const VideoFileWriterConfig &config)
+    : config_(config), start_time_(std::chrono::steady_clock::now()) {
+  switch (config_.format) {
+  case VideoFormat::MJPEG:
+    extension_ = ".avi";
+    break;
+  case VideoFormat::Y4M:
+    extension_ = ".y4m";
+    break;
+  case VideoFormat::BGR:
+    extension_ = ".bgr";
+    break;
+  }
+
+  if (config_.fps <= 0) {
+    config_.fps = 30;
+  }
+  if (config_.queue_capacity == 0) {
+    config_.queue_capacity = 1;
+  }
+  worker_ = std::thread(&VideoFileWriter::worker, this);
+}
+
+VideoFileWriter::~VideoFileWriter() {
+  stop();
+}
+
+bool VideoFileWriter::submit(int64_t timestamp, std::shared_ptr<cv::Mat> image) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (jobs_.size() >= config_.queue_capacity) {
+      if (config_.drop_when_full) {
+        dropped_count_++;
+        return false;
+      }
+      not_full_cond_.wait(lock, [this] {
+        return jobs_.size() < config_.queue_capacity || stop_;
+      });
+    }
+    if (stop_) {
+      dropped_count_++;
+      return false;
+    }
+
+    jobs_.push_back(Job{timestamp, std::move(image)});
+    if (jobs_.size() > peak_backlog_) {
+      peak_backlog_ = jobs_.size();
+    }
+  }
+
+  not_empty_cond_.notify_one();
+  return true;
+}
+
+void VideoFileWriter::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stop_) {
+      return;
+    }
+    stop_ = true;
+  }
+  not_empty_cond_.notify_all();
+  not_full_cond_.notify_all();
+
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+}
+
+size_t VideoFileWriter::backlog() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return jobs_.size();
+}
+
+size_t VideoFileWriter::peak_backlog() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return peak_backlog_;
+}
+
+void VideoFileWriter::worker() {
+  ThreadTuning::apply(ThreadRole::WRITER);
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      not_empty_cond_.wait(lock, [this] {
+        return !jobs_.empty() || stop_;
+      });
+      // Queued jobs are still written after stop()
+      if (jobs_.empty()) {
+        break;
+      }
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+    not_full_cond_.notify_one();
+
+    if (write(job)) {
+      written_count_++;
+    } else {
+      failed_count_++;
+    }
+  }
+  close_file();
+}
+
+bool VideoFileWriter::needs_new_file(const Job &job) const {
+  if (!file_open_ || job.image->cols != file_size_.width ||
+      job.image->rows != file_size_.height) {
+    return true;
+  }
+  // The timestamp file only goes forward
+  if (job.timestamp < first_timestamp_) {
+    return true;
+  }
+  if (config_.rotate_duration.count() > 0 &&
+      job.timestamp - first_timestamp_ >=
+          std::chrono::nanoseconds(config_.rotate_duration).count()) {
+    return true;
+  }
+  // Frames of a file have the same size, MJPEG ones about the same, so the
+  // file stays below rotate_size unless a single frame is larger
+  return config_.rotate_size > 0 && file_bytes_ + frame_bytes_ > config_.rotate_size;
+}
+
+bool VideoFileWriter::open_file(const Job &job) {
+  std::string base = config_.output_path + "/video_" + std::to_string(file_count_);
+  std::string path = base + extension_;
+  cv::Size size(job.image->cols, job.image->rows);
+  file_path_ = path;
+
+  bool opened;
+  if (config_.format == VideoFormat::MJPEG) {
+    opened = video_.open(path, cv::CAP_OPENCV_MJPEG,
+                         cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), config_.fps, size);
+    if (opened) {
+      video_.set(cv::VIDEOWRITER_PROP_QUALITY, config_.jpeg_quality);
+    }
+  } else {
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    opened = fd_ >= 0;
+  }
+  if (opened) {
+    timestamps_ = std::fopen((base + ".ts").c_str(), "w");
+  }
+  if (!opened || timestamps_ == nullptr) {
+    uint64_t suppressed;
+    if (open_warning_.allow(&suppressed)) {
+      std::printf("Failed to create %s, dropping frames (%lu more failures since the "
+                  "last warning) !!!\n",
+                  path.c_str(), static_cast<unsigned long>(suppressed));
+    }
+    close_file();
+    return false;
+  }
+
+  file_open_ = true;
+  file_size_ = size;
+  first_timestamp_ = job.timestamp;
+  file_bytes_ = 0;
+  frame_bytes_ = 0;
+  file_count_++;
+
+  const char *pixels[] = {"mjpeg", "yuv420p", "bgr24"};
+  std::fprintf(timestamps_, "# timestamp format v2\n# %dx%d %s, first frame at %ld ns\n",
+               size.width, size.height, pixels[static_cast<int>(config_.format)],
+               static_cast<long>(job.timestamp));
+
+  if (config_.format == VideoFormat::Y4M) {
+    // 4:2:0 needs an even size, an odd last row or column is left out
+    std::string header = "YUV4MPEG2 W" + std::to_string(size.width & ~1) + " H" +
+                         std::to_string(size.height & ~1) + " F" + frame_rate(config_.fps) +
+                         " Ip A1:1 C420jpeg\n";
+    struct iovec iov{const_cast<char *>(header.data()), header.size()};
+    if (!write_all(fd_, &iov, 1)) {
+      std::printf("Failed to write %s !!!\n", path.c_str());
+      close_file();
+      return false;
+    }
+    file_bytes_ += header.size();
+  }
+  return true;
+}
+
+void VideoFileWriter::close_file() {
+  if (video_.isOpened()) {
+    // Writes the AVI index
+    video_.release();
+  }
+  if (fd_ >= 0 && ::close(fd_) != 0) {
+    std::printf("Failed to close %s !!!\n", file_path_.c_str());
+  }
+  fd_ = -1;
+  if (timestamps_ != nullptr) {
+    std::fclose(timestamps_);
+    timestamps_ = nullptr;
+  }
+  file_open_ = false;
+}
+
+bool VideoFileWriter::write(const Job &job) {
+  if (!job.image || job.image->empty() || job.image->type() != CV_8UC3) {
+    return false;
+  }
+  if (needs_new_file(job)) {
+    close_file();
+    if (!open_file(job)) {
+      return false;
+    }
+  }
+
+  size_t bytes = 0;
+  bool ok = true;
+  switch (config_.format) {
+  case VideoFormat::MJPEG: {
+    video_.write(*job.image);
+    // cv::VideoWriter doesn't tell how much it wrote
+    struct stat sb;
+    if (::stat(file_path_.c_str(), &sb) == 0 &&
+        static_cast<uint64_t>(sb.st_size) > file_bytes_) {
+      bytes = sb.st_size - file_bytes_;
+    }
+    break;
+  }
+  case VideoFormat::Y4M: {
+    cv::Mat image = *job.image;
+    if ((image.cols | image.rows) & 1) {
+      image = image(cv::Rect(0, 0, image.cols & ~1, image.rows & ~1));
+    }
+    cv::cvtColor(image, yuv_, cv::COLOR_BGR2YUV_I420);
+    // A timestamp in the frame header is allowed by the format and ignored
+    // by readers which don't know it
+    frame_header_ = "FRAME XTS=" + std::to_string(job.timestamp) + "\n";
+    bytes = frame_header_.size() + yuv_.total() * yuv_.elemSize();
+    struct iovec iov[2] = {{const_cast<char *>(frame_header_.data()), frame_header_.size()},
+                           {yuv_.data, yuv_.total() * yuv_.elemSize()}};
+    ok = write_all(fd_, iov, 2);
+    break;
+  }
+  case VideoFormat::BGR: {
+    size_t row_size = job.image->cols * job.image->elemSize();
+    if (job.image->isContinuous()) {
+      struct iovec iov{job.image->data, row_size * job.image->rows};
+      ok = write_all(fd_, &iov, 1);
+    } else {
+      for (int y = 0; y < job.image->rows && ok; ++y) {
+        struct iovec iov{const_cast<uint8_t *>(job.image->ptr(y)), row_size};
+        ok = write_all(fd_, &iov, 1);
+      }
+    }
+    bytes = row_size * job.image->rows;
+    break;
+  }
+  }
+
+  if (!ok) {
+    std::printf("Failed to write %s, starting a new file !!!\n", file_path_.c_str());
+    close_file();
+    return false;
+  }
+  std::fprintf(timestamps_, "%.3f\n", (job.timestamp - first_timestamp_) / 1e6);
+  file_bytes_ += bytes;
+  frame_bytes_ = bytes;
+  written_bytes_ += bytes;
+  return true;
+}
+
+void VideoFileWriter::show_statistics() {
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start_time_;
+  double seconds = elapsed.count() > 0 ? elapsed.count() : 1;
+
+  std::printf("Video writer (%s, %u files): written %lu frames "
+              "(%.1f frames/s, %.1f MB/s), dropped %lu, failed %lu, "
+              "backlog %lu, peak backlog %lu\n",
+              format_name(config_.format), static_cast<unsigned>(file_count_),
+              static_cast<unsigned long>(written_count_),
+              written_count_ / seconds,
+              written_bytes_ / seconds / (1024 * 1024),
+              static_cast<unsigned long>(dropped_count_),
+              static_cast<unsigned long>(failed_count_),
+              static_cast<unsigned long>(backlog()),
+              static_cast<unsigned long>(peak_backlog()));
+}
+
+bool VideoFileWriter::parse_format(const std::string &param, VideoFormat &format,
+                                   int &jpeg_quality) {
+  auto pos = param.find(':');
+  std::string name = param.substr(0, pos);
+
+  if (name == "mjpeg") {
+    format = VideoFormat::MJPEG;
+    if (pos != std::string::npos) {
+      try {
+        jpeg_quality = std::stoi(param.substr(pos + 1), nullptr);
+      } catch (std::exception &) {
+        return false;
+      }
+      if (jpeg_quality < 1 || jpeg_quality > 100) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  if (pos != std::string::npos) {
+    return false;
+  }
+  if (name == "y4m") {
+    format = VideoFormat::Y4M;
+  } else if (name == "bgr") {
+    format = VideoFormat::BGR;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char *VideoFileWriter::format_name(VideoFormat format) {
+  switch (format) {
+  case VideoFormat::MJPEG:
+    return "mjpeg";
+  case VideoFormat::Y4M:
+    return "y4m";
+  case VideoFormat::BGR:
+    return "bgr";
+  }
+  return "unknown";
+}
@@ -0,0 +1,175 @@
+// Feeds ChunkAssembler chunks in order, out of order, twice and overlapping,
+// and checks which frames it assembles and what it counts.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "buffer_pool.hpp"
+#include "chunk_assembler.hpp"
+#include "chunk_format.hpp"
+
+namespace {
+
+int g_failures = 0;
+
+void check(bool ok, const std::string &what) {
+  if (!ok) {
+    std::printf("FAILED: %s\n", what.c_str());
+    g_failures++;
+  }
+}
+
+// A serialized frame of size bytes, different for every frame_id
+std::vector<uint8_t> make_frame(uint32_t frame_id, size_t size) {
+  std::vector<uint8_t> frame(size);
+  for (size_t i = 0; i < size; ++i) {
+    frame[i] = static_cast<uint8_t>(i * 7 + frame_id);
+  }
+  return frame;
+}
+
+// Chunk index of count with the given offset and length of frame
+std::vector<uint8_t> make_chunk(uint32_t frame_id, uint32_t index, uint32_t count,
+                                const std::vector<uint8_t> &frame, uint64_t offset,
+                                size_t len) {
+  ChunkHeader header;
+  std::memcpy(header.magic, kChunkMagic, sizeof(header.magic));
+  header.frame_id = frame_id;
+  header.index = index;
+  header.count = count;
+  header.frame_size = frame.size();
+  header.offset = offset;
+
+  std::vector<uint8_t> chunk(sizeof(header) + len);
+  std::memcpy(chunk.data(), &header, sizeof(header));
+  std::memcpy(chunk.data() + sizeof(header), frame.data() + offset, len);
+  return chunk;
+}
+
+// Chunk index of frame split evenly into count chunks, like img_publisher does
+std::vector<uint8_t> even_chunk(uint32_t frame_id, uint32_t index, uint32_t count,
+                                const std::vector<uint8_t> &frame) {
+  uint64_t stride = chunk_stride(frame.size(), count);
+  uint64_t offset = index * stride;
+  return make_chunk(frame_id, index, count, frame, offset,
+                    std::min<uint64_t>(stride, frame.size() - offset));
+}
+
+std::shared_ptr<FrameBuffer> add(ChunkAssembler &assembler,
+                                 const std::vector<uint8_t> &chunk) {
+  int64_t assembly_ns = 0;
+  return assembler.add(chunk.data(), chunk.size(), &assembly_ns);
+}
+
+bool same(const std::shared_ptr<FrameBuffer> &buffer, const std::vector<uint8_t> &frame) {
+  return buffer && buffer->size() == frame.size() &&
+         std::memcmp(buffer->data(), frame.data(), frame.size()) == 0;
+}
+
+void test_in_order() {
+  ChunkAssembler assembler(std::make_shared<BufferPool>(), std::chrono::milliseconds(1000));
+  // 103 bytes in 4 chunks: 26, 26, 26 and 25 bytes
+  auto frame = make_frame(1, 103);
+  for (uint32_t index = 0; index < 3; ++index) {
+    check(!add(assembler, even_chunk(1, index, 4, frame)), "in order: early frame");
+  }
+  check(same(add(assembler, even_chunk(1, 3, 4, frame)), frame), "in order: pixels");
+  check(assembler.assembled_count() == 1, "in order: assembled");
+  check(assembler.invalid_count() == 0, "in order: invalid");
+}
+
+void test_out_of_order() {
+  ChunkAssembler assembler(std::make_shared<BufferPool>(), std::chrono::milliseconds(1000));
+  auto frame = make_frame(2, 100);
+  const uint32_t order[] = {3, 0, 2};
+  for (uint32_t index : order) {
+    check(!add(assembler, even_chunk(2, index, 4, frame)), "out of order: early frame");
+  }
+  check(same(add(assembler, even_chunk(2, 1, 4, frame)), frame), "out of order: pixels");
+  check(assembler.assembled_count() == 1, "out of order: assembled");
+}
+
+// QoS 1 redeliveries, before and after the frame is complete
+void test_duplicates() {
+  ChunkAssembler assembler(std::make_shared<BufferPool>(), std::chrono::milliseconds(1000));
+  auto frame = make_frame(3, 100);
+  check(!add(assembler, even_chunk(3, 0, 2, frame)), "duplicate: early frame");
+  check(!add(assembler, even_chunk(3, 0, 2, frame)), "duplicate: frame from a duplicate");
+  check(assembler.duplicate_count() == 1, "duplicate: counted");
+  check(same(add(assembler, even_chunk(3, 1, 2, frame)), frame), "duplicate: pixels");
+  check(!add(assembler, even_chunk(3, 1, 2, frame)), "duplicate: frame again");
+  check(assembler.late_count() == 1, "duplicate: late");
+  check(assembler.assembled_count() == 1, "duplicate: assembled");
+}
+
+// Two chunks of 50 bytes at offset 0 must not make a 100 byte frame, whose
+// second half would be left from an earlier frame in the slab
+void test_overlapping() {
+  auto pool = std::make_shared<BufferPool>(1);
+  ChunkAssembler assembler(pool, std::chrono::milliseconds(1000));
+
+  auto earlier = make_frame(4, 100);
+  add(assembler, even_chunk(4, 0, 2, earlier));
+  auto buffer = add(assembler, even_chunk(4, 1, 2, earlier));
+  check(same(buffer, earlier), "overlapping: earlier frame");
+  buffer.reset();
+
+  auto frame = make_frame(5, 100);
+  check(!add(assembler, make_chunk(5, 0, 2, frame, 0, 50)), "overlapping: first chunk");
+  check(!add(assembler, make_chunk(5, 1, 2, frame, 0, 50)), "overlapping: frame assembled");
+  check(assembler.invalid_count() == 1, "overlapping: invalid");
+
+  // Overlapping by a byte, and a range bigger than the index stands for
+  auto other = make_frame(6, 100);
+  check(!add(assembler, make_chunk(6, 1, 2, other, 49, 51)), "overlapping: early offset");
+  check(!add(assembler, make_chunk(6, 0, 2, other, 0, 51)), "overlapping: long chunk");
+  check(!add(assembler, make_chunk(6, 1, 2, other, 50, 49)), "overlapping: short chunk");
+  check(assembler.invalid_count() == 4, "overlapping: all invalid");
+
+  // The frame still completes from the right chunks
+  check(!add(assembler, make_chunk(6, 0, 2, other, 0, 50)), "overlapping: early frame");
+  check(same(add(assembler, make_chunk(6, 1, 2, other, 50, 50)), other),
+        "overlapping: pixels");
+  check(assembler.assembled_count() == 2, "overlapping: assembled");
+}
+
+// Headers a sender can't produce
+void test_invalid_headers() {
+  ChunkAssembler assembler(std::make_shared<BufferPool>(), std::chrono::milliseconds(1000));
+  auto frame = make_frame(7, 10);
+
+  auto chunk = even_chunk(7, 0, 2, frame);
+  chunk[0] = 'X';
+  check(!add(assembler, chunk), "bad magic");
+  check(!add(assembler, make_chunk(7, 2, 2, frame, 0, 5)), "index out of range");
+  // 10 bytes in 4 chunks of 3 leave the last one with 1 byte at offset 9,
+  // in 6 chunks of 2 the last one would start past the end
+  check(!add(assembler, make_chunk(7, 3, 4, frame, 8, 2)), "last chunk offset");
+  check(!add(assembler, make_chunk(7, 5, 6, frame, 10, 0)), "empty last chunk");
+  check(!add(assembler, std::vector<uint8_t>(sizeof(ChunkHeader) - 1)), "short header");
+  check(assembler.invalid_count() == 5, "invalid headers counted");
+  check(assembler.assembled_count() == 0, "invalid headers: assembled");
+}
+
+} // namespace
+
+int main() {
+  test_in_order();
+  test_out_of_order();
+  test_duplicates();
+  test_overlapping();
+  test_invalid_headers();
+
+  if (g_failures > 0) {
+    std::printf("%d checks failed\n", g_failures);
+    return EXIT_FAILURE;
+  }
+  std::printf("All checks passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,248 @@
+// Checks the pixels FrameDecoder gives for every encoding and layout against
+// hand computed BGR values, and the frame sizes short frames are rejected by.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "frame_decoder.hpp"
+
+namespace {
+
+int g_failures = 0;
+
+void check(bool ok, const std::string &what) {
+  if (!ok) {
+    std::printf("FAILED: %s\n", what.c_str());
+    g_failures++;
+  }
+}
+
+constexpr uint32_t kWidth = 3;
+constexpr uint32_t kHeight = 2;
+constexpr size_t kPixels = kWidth * kHeight;
+
+// R, G, B of the test image, row by row
+constexpr uint8_t kRgb[kPixels][3] = {
+    {10, 20, 30},    {40, 50, 60},    {70, 80, 90},
+    {100, 110, 120}, {130, 140, 150}, {255, 0, 128},
+};
+
+// What every encoding of kRgb decodes to
+constexpr uint8_t kBgr[kPixels * 3] = {
+    30,  20,  10,  60,  50,  40,  90,  80,  70,
+    120, 110, 100, 150, 140, 130, 128, 0,   255,
+};
+
+// Low byte of the 16 bit samples, a decoder which rounded would get the
+// next value
+constexpr uint8_t kLowByte = 0xff;
+constexpr uint8_t kAlpha = 0x5a;
+
+struct Expectation {
+  const char *encoding;
+  bool bgr;
+  int channels;
+  int bytes;
+  size_t frame_size;  // of kWidth x kHeight
+};
+
+constexpr Expectation kExpectations[] = {
+    {"rgb8", false, 3, 1, 18},   {"bgr8", true, 3, 1, 18},
+    {"rgb16", false, 3, 2, 36},  {"bgr16", true, 3, 2, 36},
+    {"rgba8", false, 4, 1, 24},  {"bgra8", true, 4, 1, 24},
+    {"rgba16", false, 4, 2, 48}, {"bgra16", true, 4, 2, 48},
+};
+
+// kRgb as the data of an img_msg of the given encoding
+std::vector<uint8_t> encode(const Expectation &expectation, PixelLayout layout) {
+  const int channels = expectation.channels;
+  const int bytes = expectation.bytes;
+  std::vector<uint8_t> data(kPixels * channels * bytes);
+  for (size_t i = 0; i < kPixels; ++i) {
+    for (int c = 0; c < channels; ++c) {
+      uint8_t value = c == 3 ? kAlpha : kRgb[i][expectation.bgr ? 2 - c : c];
+      size_t index = layout == PixelLayout::PLANAR ? c * kPixels + i : i * channels + c;
+      if (bytes == 1) {
+        data[index] = value;
+      } else {
+        uint16_t sample = static_cast<uint16_t>(value << 8 | kLowByte);
+        std::memcpy(&data[index * 2], &sample, sizeof(sample));
+      }
+    }
+  }
+  return data;
+}
+
+// Decodes data at its own width into rows with padding, which must be left
+// alone
+std::vector<uint8_t> decode(FrameDecoder &decoder, const std::vector<uint8_t> &data,
+                            uint32_t width, uint32_t height) {
+  constexpr size_t kPadding = 5;
+  constexpr uint8_t kUnused = 0xee;
+  const size_t row = static_cast<size_t>(width) * 3;
+  std::vector<uint8_t> padded((row + kPadding) * height, kUnused);
+  decoder.decode(data.data(), width, height, padded.data(), row + kPadding, width);
+
+  std::vector<uint8_t> image;
+  for (uint32_t y = 0; y < height; ++y) {
+    const uint8_t *line = padded.data() + y * (row + kPadding);
+    image.insert(image.end(), line, line + row);
+    for (size_t x = row; x < row + kPadding; ++x) {
+      check(line[x] == kUnused, decoder.encoding() + ": wrote past the row");
+    }
+  }
+  return image;
+}
+
+void test_every_encoding() {
+  const PixelLayout layouts[] = {PixelLayout::PLANAR, PixelLayout::INTERLEAVED};
+  const PlanarToBgrScaler::Isa isas[] = {PlanarToBgrScaler::Isa::SCALAR,
+                                         PlanarToBgrScaler::Isa::SSE2,
+                                         PlanarToBgrScaler::Isa::AVX2};
+
+  for (const auto &encoding : FrameDecoder::encodings()) {
+    const Expectation *expectation = nullptr;
+    for (const auto &candidate : kExpectations) {
+      if (encoding == candidate.encoding) {
+        expectation = &candidate;
+      }
+    }
+    check(expectation != nullptr, encoding + ": no expected pixels");
+    if (expectation == nullptr) {
+      continue;
+    }
+
+    for (auto layout : layouts) {
+      for (auto isa : isas) {
+        if (!PlanarToBgrScaler::isa_supported(isa)) {
+          continue;
+        }
+        std::string what = encoding + " " + pixel_layout_name(layout) + " " +
+                           PlanarToBgrScaler::isa_name(isa);
+
+        FrameDecoder decoder(layout, isa);
+        check(decoder.select(encoding.data(), encoding.size()), what + ": not selected");
+        check(decoder.channels() == static_cast<uint32_t>(expectation->channels),
+              what + ": channels");
+        check(decoder.sample_size() == static_cast<uint32_t>(expectation->bytes),
+              what + ": sample size");
+        check(decoder.frame_size(kWidth, kHeight) == expectation->frame_size,
+              what + ": frame size");
+
+        std::vector<uint8_t> image = decode(decoder, encode(*expectation, layout),
+                                            kWidth, kHeight);
+        check(std::memcmp(image.data(), kBgr, sizeof(kBgr)) == 0, what + ": pixels");
+      }
+    }
+  }
+}
+
+// Byte for byte, without encode()
+void test_channel_order() {
+  const std::vector<uint8_t> pixel = {1, 2, 3};
+
+  FrameDecoder rgb(PixelLayout::INTERLEAVED);
+  rgb.select("rgb8", 4);
+  check(decode(rgb, pixel, 1, 1) == std::vector<uint8_t>({3, 2, 1}), "rgb8 order");
+
+  FrameDecoder bgr(PixelLayout::INTERLEAVED);
+  bgr.select("bgr8", 4);
+  check(decode(bgr, pixel, 1, 1) == std::vector<uint8_t>({1, 2, 3}), "bgr8 order");
+
+  // RR GG BB of two pixels
+  const std::vector<uint8_t> planes = {1, 4, 2, 5, 3, 6};
+  FrameDecoder planar(PixelLayout::PLANAR);
+  planar.select("rgb8", 4);
+  check(decode(planar, planes, 2, 1) == std::vector<uint8_t>({3, 2, 1, 6, 5, 4}),
+        "rgb8 planar order");
+  planar.select("bgr8", 4);
+  check(decode(planar, planes, 2, 1) == std::vector<uint8_t>({1, 2, 3, 4, 5, 6}),
+        "bgr8 planar order");
+}
+
+// Host byte order, the high byte is kept and the low byte dropped
+void test_16_bit_truncation() {
+  const uint16_t samples[] = {0x12ff, 0x3480, 0x5601, 0xffff};
+  std::vector<uint8_t> data(sizeof(samples));
+  std::memcpy(data.data(), samples, sizeof(samples));
+
+  FrameDecoder rgba(PixelLayout::INTERLEAVED);
+  rgba.select("rgba16", 6);
+  check(decode(rgba, data, 1, 1) == std::vector<uint8_t>({0x56, 0x34, 0x12}),
+        "rgba16 high bytes");
+
+  FrameDecoder bgr(PixelLayout::INTERLEAVED);
+  bgr.select("bgr16", 5);
+  data.resize(6);
+  check(decode(bgr, data, 1, 1) == std::vector<uint8_t>({0x12, 0x34, 0x56}),
+        "bgr16 high bytes");
+}
+
+// Alpha never shows up, whatever its value
+void test_alpha_dropped() {
+  FrameDecoder decoder(PixelLayout::INTERLEAVED);
+  decoder.select("bgra8", 5);
+  for (int alpha : {0, 128, 255}) {
+    const std::vector<uint8_t> pixel = {7, 8, 9, static_cast<uint8_t>(alpha)};
+    check(decode(decoder, pixel, 1, 1) == std::vector<uint8_t>({7, 8, 9}),
+          "bgra8 alpha " + std::to_string(alpha));
+  }
+
+  // The alpha plane comes last
+  const std::vector<uint8_t> planes = {7, 8, 9, 255};
+  FrameDecoder planar(PixelLayout::PLANAR);
+  planar.select("rgba8", 5);
+  check(decode(planar, planes, 1, 1) == std::vector<uint8_t>({9, 8, 7}),
+        "rgba8 planar alpha");
+}
+
+// StreamPipeline drops frames with less data than frame_size(), and frames
+// of an encoding select() refuses
+void test_short_data() {
+  FrameDecoder decoder;
+  for (const auto &expectation : kExpectations) {
+    std::string encoding = expectation.encoding;
+    check(decoder.select(encoding.data(), encoding.size()), encoding + ": not selected");
+    size_t size = decoder.frame_size(640, 480);
+    check(size == 640u * 480 * expectation.channels * expectation.bytes,
+          encoding + ": 640x480 frame size");
+    check(encode(expectation, PixelLayout::PLANAR).size() ==
+              decoder.frame_size(kWidth, kHeight),
+          encoding + ": frame size of the test image");
+  }
+
+  for (const char *encoding : {"mono8", "rgb", "rgb88", "jpeg", ""}) {
+    bool changed = false;
+    check(!decoder.select(encoding, std::strlen(encoding), &changed),
+          std::string(encoding) + ": selected");
+    check(changed, std::string(encoding) + ": not changed");
+    check(decoder.frame_size(kWidth, kHeight) == 0, std::string(encoding) + ": frame size");
+    check(decoder.channels() == 0, std::string(encoding) + ": channels");
+  }
+
+  // Only length bytes of the encoding count
+  bool changed = false;
+  check(decoder.select("rgb8 and more", 4, &changed), "rgb8 prefix not selected");
+  check(changed, "rgb8 after an unsupported encoding not changed");
+  check(decoder.select("rgb8", 4, &changed) && !changed, "rgb8 again changed");
+}
+
+} // namespace
+
+int main() {
+  test_every_encoding();
+  test_channel_order();
+  test_16_bit_truncation();
+  test_alpha_dropped();
+  test_short_data();
+
+  if (g_failures > 0) {
+    std::printf("%d checks failed\n", g_failures);
+    return EXIT_FAILURE;
+  }
+  std::printf("All checks passed\n");
+  return EXIT_SUCCESS;
+}
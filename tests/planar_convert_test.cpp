@@ -0,0 +1,104 @@
+// Checks that PlanarToBgrScaler gives the same pixels as the cv::merge() +
+// cv::resize() sequence it replaces in data_process, with every supported
+// instruction set.
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "planar_convert.hpp"
+
+namespace {
+
+struct FrameSize {
+  uint32_t width;
+  uint32_t height;
+};
+
+// The display adds 50 columns to the received width
+constexpr uint32_t kExtraWidth = 50;
+
+void reference(std::vector<uint8_t> &planar, uint32_t width, uint32_t height,
+               cv::Mat &merged, cv::Mat &scaled) {
+  size_t plane_size = static_cast<size_t>(width) * height;
+  cv::Mat colors[3];
+  colors[2] = cv::Mat(height, width, CV_8UC1, planar.data());
+  colors[1] = cv::Mat(height, width, CV_8UC1, planar.data() + plane_size);
+  colors[0] = cv::Mat(height, width, CV_8UC1, planar.data() + plane_size * 2);
+  cv::merge(colors, 3, merged);
+  cv::resize(merged, scaled, cv::Size(width + kExtraWidth, height));
+}
+
+size_t count_mismatches(const cv::Mat &a, const cv::Mat &b) {
+  size_t mismatches = 0;
+  for (int y = 0; y < a.rows; ++y) {
+    const uint8_t *row_a = a.ptr<uint8_t>(y);
+    const uint8_t *row_b = b.ptr<uint8_t>(y);
+    for (size_t x = 0; x < static_cast<size_t>(a.cols) * 3; ++x) {
+      mismatches += row_a[x] != row_b[x];
+    }
+  }
+  return mismatches;
+}
+
+} // namespace
+
+int main() {
+  // The odd widths end in the scalar tail of the SIMD loops
+  const FrameSize sizes[] = {{17, 3},    {33, 5},     {100, 7},    {257, 4},
+                             {640, 480}, {1920, 1080}, {3840, 2160}};
+  const PlanarToBgrScaler::Isa isas[] = {PlanarToBgrScaler::Isa::SCALAR,
+                                         PlanarToBgrScaler::Isa::SSE2,
+                                         PlanarToBgrScaler::Isa::AVX2};
+
+  std::mt19937 rng(42);
+  int failures = 0;
+
+  for (const auto &size : sizes) {
+    std::vector<uint8_t> planar(static_cast<size_t>(size.width) * size.height * 3);
+    for (auto &value : planar) {
+      value = static_cast<uint8_t>(rng());
+    }
+
+    cv::Mat merged;
+    cv::Mat expected;
+    reference(planar, size.width, size.height, merged, expected);
+
+    for (auto isa : isas) {
+      if (!PlanarToBgrScaler::isa_supported(isa)) {
+        continue;
+      }
+
+      PlanarToBgrScaler scaler(isa);
+      uint32_t dst_width = size.width + kExtraWidth;
+      cv::Mat scaled(size.height, dst_width, CV_8UC3);
+      cv::Mat interleaved(size.height, size.width, CV_8UC3);
+      scaler.convert(planar.data(), size.width, size.height, scaled.data,
+                     scaled.step, dst_width);
+      scaler.convert(planar.data(), size.width, size.height, interleaved.data,
+                     interleaved.step, size.width);
+
+      size_t scaled_mismatches = count_mismatches(expected, scaled);
+      size_t interleaved_mismatches = count_mismatches(merged, interleaved);
+      if (scaled_mismatches > 0 || interleaved_mismatches > 0) {
+        std::printf("FAILED: %ux%u %s: %lu bytes differ from cv::resize(), %lu from "
+                    "cv::merge()\n",
+                    size.width, size.height, PlanarToBgrScaler::isa_name(isa),
+                    static_cast<unsigned long>(scaled_mismatches),
+                    static_cast<unsigned long>(interleaved_mismatches));
+        failures++;
+      }
+    }
+  }
+
+  if (failures > 0) {
+    std::printf("%d conversions failed\n", failures);
+    return EXIT_FAILURE;
+  }
+  std::printf("All conversions bit exact\n");
+  return EXIT_SUCCESS;
+}